@@ -0,0 +1,57 @@
+// use named PMU regions instead of hand-picking two events:
+// each region rotates through all the event pairs, so after 
+// enough runs the summary shows why each loop is slow.
+#include "rpi.h"
+#include "pmu-region.h"
+
+enum { N = 16*1024 };
+static uint32_t a[N];
+
+// touches every word: mostly dcache hits.
+__attribute__((noinline)) uint32_t sum_seq(void) {
+    uint32_t sum = 0;
+    for(unsigned i = 0; i < N; i++)
+        sum += a[i];
+    return sum;
+}
+
+// one word per 32-byte line: a miss on every load once the 
+// array is bigger than the 16k dcache.
+__attribute__((noinline)) uint32_t sum_stride(void) {
+    uint32_t sum = 0;
+    for(unsigned j = 0; j < 8; j++)
+        for(unsigned i = j; i < N; i += 8)
+            sum += a[i];
+    return sum;
+}
+
+// data-dependent branch: mispredicts about half the time.
+__attribute__((noinline)) uint32_t branchy(void) {
+    uint32_t n = 0;
+    for(unsigned i = 0; i < N; i++)
+        if(a[i] & 1)
+            n++;
+    return n;
+}
+
+void notmain(void) {
+    caches_enable();
+    for(unsigned i = 0; i < N; i++)
+        a[i] = rpi_rand32();
+
+    // 4 runs per event pair.
+    for(int i = 0; i < 4*PMU_NPAIRS; i++) {
+        PMU_REGION_BEGIN("sequential sum");
+            sum_seq();
+        PMU_REGION_END("sequential sum");
+
+        PMU_REGION_BEGIN("strided sum");
+            sum_stride();
+        PMU_REGION_END("strided sum");
+
+        PMU_REGION_BEGIN("branchy");
+            branchy();
+        PMU_REGION_END("branchy");
+    }
+    pmu_region_summary();
+}
@@ -15,9 +15,11 @@
 #include "purify.h"
 #include "sbrk-trap.h"
 #include "memmap-default.h"
+#include "shadow-mem.h"
 #include "rpi.h"
 
 static int purify_quiet_p = 0;
+static purify_mode_t purify_mode;
 void purify_yap_off(void) {
     purify_quiet_p = 1;
     memtrace_yap_off();
@@ -61,19 +63,37 @@ static int purify_handler(void *data, fault_ctx_t *ctx) {
         trace(": %s to address %x\n", 
                 ctx->load_p ? "load" : "store", ctx->addr);
 
-    // Check if the address is in an allocated block
-    hdr_t *h = ck_ptr_is_alloced((void *)ctx->addr);
-    if (h) {
-        // Address is in an allocated block, access is legal
-        return MEMTRACE_OK;
+    uint32_t last = ctx->addr + ctx->nbytes - 1;
+    if (purify_mode == PURIFY_SHADOW) {
+        if (shadow_is_legal(ctx->addr, ctx->nbytes))
+            return MEMTRACE_OK;
+        // report the end if the start is fine.
+        if (shadow_is_legal(ctx->addr, 1))
+            ctx->addr = last;
+    } else {
+        // both the first and last byte have to be in the same 
+        // allocated block.
+        hdr_t *h = ck_ptr_is_alloced((void *)ctx->addr);
+        if (h) {
+            if (ck_ptr_is_alloced((void *)last) == h)
+                return MEMTRACE_OK;
+            ctx->addr = last;
+        }
     }
 
     purify_error(ctx);
     clean_reboot();
 }
 
-void purify_init(void) {
-    memtrace_init(0, purify_handler, 0, dom_trap);
+void purify_init_mode(purify_mode_t mode) {
+    assert(mode == PURIFY_LIST || mode == PURIFY_SHADOW);
+    purify_mode = mode;
+
+    memtrace_setup();
+    memtrace_checker_add("purify", 0, purify_handler, 0, dom_trap);
+    // needs the heap + non-trapping memory <memtrace_init> sets up.
+    if (mode == PURIFY_SHADOW)
+        shadow_init();
     memtrace_trap_enable();
     memtrace_yap_off();
 }
@@ -81,13 +101,21 @@ void purify_init(void) {
 void *purify_alloc_raw(unsigned n, src_loc_t loc) {
     memtrace_trap_disable();
     unsigned *p =  (ckalloc)(n, loc);
+    if (purify_mode == PURIFY_SHADOW)
+        shadow_mark_alloced(p, n);
     memtrace_trap_enable();
     return p;
 }
 
 void purify_free_raw(void *p, src_loc_t loc) {
     memtrace_trap_disable();
+    // grab the size before <ckfree> recycles the header.  ckfree
+    // does all the error checking, so only trust <h> after.
+    hdr_t *h = ck_ptr_is_alloced(p);
+    unsigned n = h ? ck_nbytes(h) : 0;
     (ckfree)(p, loc);
+    if (purify_mode == PURIFY_SHADOW)
+        shadow_mark_freed(p, n);
     memtrace_trap_enable();
 }
 
@@ -0,0 +1,22 @@
+#ifndef __CHECKER_TRACE_H__
+#define __CHECKER_TRACE_H__
+// watch-range tracer: a memtrace checker that counts (and if
+// yapping, prints) every load/store that overlaps [lo,hi) in
+// trap domain <dom>.  can stack with purify: both share the
+// same fault.
+#include "memtrace.h"
+
+void trace_init(uint32_t lo, uint32_t hi, unsigned dom);
+
+// turn just the tracer off/on: other checkers keep running.
+void trace_on(void);
+void trace_off(void);
+
+// number of traced accesses so far.
+unsigned trace_nloads(void);
+unsigned trace_nstores(void);
+
+void trace_yap_off(void);
+void trace_yap_on(void);
+
+#endif
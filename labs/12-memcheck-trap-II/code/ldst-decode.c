@@ -0,0 +1,143 @@
+// armv6 load/store decoder: see <ldst-decode.h>.  encodings
+// from the armv6 arm (A3-A5, C4): bit ranges below are
+// <bits(inst, hi, lo)>.
+#include "ldst-decode.h"
+
+static inline uint32_t bits(uint32_t x, unsigned hi, unsigned lo) {
+    return (x >> lo) & ((1u << (hi - lo + 1)) - 1);
+}
+static inline uint32_t bit(uint32_t x, unsigned n) {
+    return (x >> n) & 1;
+}
+
+static unsigned popcount16(uint32_t x) {
+    unsigned n = 0;
+    for(x &= 0xffff; x; x &= x - 1)
+        n++;
+    return n;
+}
+
+// lowest address of a block transfer of <nbytes> from base <rn>,
+// given the P (before) and U (up) bits.
+static void multi_range(ldst_t *l, uint32_t inst, unsigned nbytes) {
+    int p = bit(inst, 24), u = bit(inst, 23);
+    l->multi_p = 1;
+    l->rn = bits(inst, 19, 16);
+    if(u)
+        l->off = p ? 4 : 0;                 // ib, ia
+    else
+        l->off = -(int32_t)nbytes + (p ? 0 : 4);    // db, da
+}
+
+// coprocessor load/store: vfp if coproc is 10 (single) or 11 
+// (double).  we only know the size of vfp transfers.  the vfp
+// does not claim the unconditional ldc2/stc2 space.
+static unsigned ldc_stc(uint32_t inst, ldst_t *l, int vfp_p) {
+    unsigned cp = bits(inst, 11, 8);
+    unsigned imm8 = bits(inst, 7, 0);
+    int p = bit(inst, 24), w = bit(inst, 21);
+
+    if(!vfp_p || (cp != 10 && cp != 11))
+        return 4;
+    // vldr/vstr: P=1, W=0.
+    if(p && !w)
+        return cp == 10 ? 4 : 8;
+    // vldm/vstm/vpush/vpop are increment-after or decrement-before
+    // with writeback: anything else is undefined.
+    if(p == bit(inst, 23))
+        return 4;
+    // <imm8> words (fldmx has an odd count: one extra word).
+    unsigned n = imm8 * 4;
+    l->multi_p = 1;
+    l->rn = bits(inst, 19, 16);
+    l->off = bit(inst, 23) ? 0 : -(int32_t)n;
+    return n;
+}
+
+static unsigned decode(uint32_t inst, ldst_t *l) {
+    unsigned cond = bits(inst, 31, 28);
+    unsigned op = bits(inst, 27, 25);
+    l->load_p = bit(inst, 20);
+
+    if(cond == 0xf) {
+        // srs: 1111 100P U1W0 1101 ...   (stores lr, spsr)
+        // rfe: 1111 100P U0W1 ....       (loads pc, cpsr)
+        if(op == 0b100) {
+            // srs uses the banked sp of another mode: we can't 
+            // compute its base, so rely on the fault address.
+            if(bit(inst, 22) && !bit(inst, 20) && bits(inst, 19, 16) == 0b1101)
+                return 8;
+            if(!bit(inst, 22) && bit(inst, 20)) {
+                multi_range(l, inst, 8);
+                return 8;
+            }
+            return 0;
+        }
+        // ldc2/stc2
+        if(op == 0b110 && (bit(inst, 24) || bit(inst, 23) || bit(inst, 21)))
+            return ldc_stc(inst, l, 0);
+        // pld and everything else.
+        return 0;
+    }
+
+    switch(op) {
+    case 0b000: {
+        if(!bit(inst, 7) || !bit(inst, 4))
+            return 0;
+        unsigned sh = bits(inst, 6, 5);
+        if(sh) {
+            // extra load/store: ldrh/strh, ldrsb/ldrd, ldrsh/strd
+            if(sh == 0b01)
+                return 2;
+            // ldrd/strd have L=0: bit 5 says which.
+            if(!l->load_p) {
+                l->load_p = (sh == 0b10);
+                return 8;
+            }
+            return sh == 0b10 ? 1 : 2;
+        }
+        // sh=0: multiplies, unless bit 24 is set.
+        if(!bit(inst, 24) || bits(inst, 7, 4) != 0b1001)
+            return 0;
+        // swp/swpb: 0001 0B00
+        if(bits(inst, 23, 20) == 0b0000 || bits(inst, 23, 20) == 0b0100) {
+            l->load_p = 1;
+            return bit(inst, 22) ? 1 : 4;
+        }
+        // ldrex/strex{d,b,h}: 0001 1ooL
+        if(bit(inst, 23)) {
+            static const uint8_t sz[4] = { 4, 8, 1, 2 };
+            return sz[bits(inst, 22, 21)];
+        }
+        return 0;
+    }
+    case 0b010:
+        return bit(inst, 22) ? 1 : 4;
+    case 0b011:
+        // bit 4 set = media instructions.
+        if(bit(inst, 4))
+            return 0;
+        return bit(inst, 22) ? 1 : 4;
+    case 0b100: {
+        unsigned n = 4 * popcount16(inst);
+        multi_range(l, inst, n);
+        return n;
+    }
+    case 0b110:
+        // P=U=W=0 is mcrr/mrrc, not a transfer.
+        if(!bit(inst, 24) && !bit(inst, 23) && !bit(inst, 21))
+            return 0;
+        return ldc_stc(inst, l, 1);
+    default:
+        return 0;
+    }
+}
+
+unsigned ldst_decode(uint32_t inst, ldst_t *l) {
+    *l = (ldst_t){ 0 };
+    unsigned n = decode(inst, l);
+    if(!n)
+        *l = (ldst_t){ 0 };
+    l->nbytes = n;
+    return n;
+}
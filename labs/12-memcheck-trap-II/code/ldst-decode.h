@@ -0,0 +1,50 @@
+#ifndef __LDST_DECODE_H__
+#define __LDST_DECODE_H__
+// decode an armv6 (arm, not thumb) instruction into the memory
+// access it does: how many bytes, load or store, and for the 
+// multi-register transfers where the range starts.
+//
+// handles:
+//   - ldr/str{b,t,bt}, ldrh/strh, ldrsb/ldrsh, ldrd/strd
+//   - ldrex/strex{b,h,d}, swp/swpb
+//   - ldm/stm (incl push/pop), srs/rfe
+//   - vldr/vstr, vldm/vstm (incl vpush/vpop); other ldc/stc
+//     count as one word.
+//   - everything else (including pld) is not an access: 
+//     <nbytes> = 0.
+//
+// no pi dependencies so we can check it on unix against a 
+// disassembler (see tests-ldst/).
+#include <stdint.h>
+
+typedef struct {
+    unsigned nbytes;        // total bytes accessed, 0 = not a load/store.
+    unsigned load_p:1;      // 1 = load, 0 = store (swp counts as a load).
+
+    // 1 = multi-register transfer with the range computed from a 
+    // base register: the lowest address is <regs[rn] + off>.
+    // otherwise the lowest address is the faulting address.
+    unsigned multi_p:1;
+    uint8_t rn;
+    int32_t off;
+} ldst_t;
+
+// decode <inst>: returns <l->nbytes>.
+unsigned ldst_decode(uint32_t inst, ldst_t *l);
+
+// just the number of bytes: 0 if not a load/store.
+static inline unsigned ldst_nbytes(uint32_t inst) {
+    ldst_t l;
+    return ldst_decode(inst, &l);
+}
+
+// lowest address accessed by the instruction decoded into <l>, 
+// given the registers before it ran and the fault address.
+static inline uint32_t 
+ldst_addr(const ldst_t *l, const uint32_t *regs, uint32_t fault_addr) {
+    if(!l->multi_p)
+        return fault_addr;
+    return regs[l->rn] + l->off;
+}
+
+#endif
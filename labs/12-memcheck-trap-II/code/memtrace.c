@@ -1,6 +1,7 @@
 #include "rpi.h"
 #include "memtrace.h"
 #include "sbrk-trap.h"
+#include "ldst-decode.h"
 #include <stdint.h>
 
 #include "watchpoint.h"
@@ -14,49 +15,72 @@
 // (caller,callee and cpsr).
 #include "switchto.h"
 
-// Global state for the memory tracing system
-static struct {
-    void *data;              
-    memtrace_fn_t pre;      
-    memtrace_fn_t post;      
-    unsigned trap_dom;      
-} memtrace_state;
-
-// 1 = we expect a domain fault.
-// 0 = we expect a or a watchpoint fault.
-// used to catch some mistakes.
-static int expect_domain_fault_p = 1;
-
-// right now we only allow a single checker.  wrap this
-// up for multiple checkers.
-static memtrace_fn_t pre;
-static memtrace_fn_t post;
-static void *data;
+// 140e helpers for co-processor access.
+#include "asm-helpers.h"
+#include "cycle-count.h"
+
+// b4-43: the fault status register: bits [7:4] are the domain.
+cp_asm_get(dfsr, p15, 0, c5, c0, 0)
+
+// registered checkers.
+static memtrace_checker_t checkers[MEMTRACE_MAX_CHECKERS];
+static unsigned nchecker;
+
+// checkers we called in <pre> for the current fault: <post> 
+// calls the same ones even if a handler changed something.
+static uint32_t fault_checkers;
+
+// cost shared by all checkers.
+static unsigned nfaults;
+static uint32_t fault_cycles;
 
 static int quiet_p = 1;
 void memtrace_yap_off(void) { quiet_p = 1; }
 void memtrace_yap_on(void)  { quiet_p = 0; }
 
-// pre-computed domain register values.
+// pre-computed domain register values: recomputed whenever 
+// a checker is added, enabled or disabled.
 static uint32_t trap_access;
 static uint32_t no_trap_access;
+// can't compare against <trap_access>: if every checker is
+// disabled it's the same as <no_trap_access>.
+static int trap_on_p;
 
 static int trap_is_on_p(void) {
-    return domain_access_ctrl_get() == trap_access;
+    return trap_on_p;
 }
 
 static void trap_on(void) {
+    trap_on_p = 1;
     domain_access_ctrl_set(trap_access);
 }
 
 static void trap_off(void) {
+    trap_on_p = 0;
     domain_access_ctrl_set(no_trap_access);
 }
 
+// trap the domains with at least one enabled checker.
+static void trap_access_update(void) {
+    uint32_t all = 0, trapped = 0;
+    for(unsigned i = 0; i < nchecker; i++) {
+        memtrace_checker_t *c = &checkers[i];
+        uint32_t bits = 1 << (c->trap_dom*2);
+        all |= bits;
+        if(c->enabled_p)
+            trapped |= bits;
+    }
+    no_trap_access = 4 | all;
+    trap_access = no_trap_access & ~trapped;
+
+    if(trap_is_on_p())
+        trap_on();
+}
+
 // turn memtracing on: wrapper with extra error checking.
 void memtrace_trap_enable(void) {
-    // need at least one handler!
-    assert(pre || post);
+    // need at least one checker!
+    assert(nchecker);
     // if not true, didn't init
     assert(trap_access && no_trap_access);
     assert(!trap_is_on_p());
@@ -71,13 +95,57 @@ void memtrace_trap_disable(void) {
     trap_off();
 }
 
-// XXX: a good extension: change this so you look at the
-// actual instruction and get the actual bytes.
-static inline unsigned inst_nbytes(uint32_t inst) {
-    return 4;
+// the access the faulting instruction does: decoded in <pre>
+// (before writeback changes the base register) and reused in 
+// <post>.
+static uint32_t fault_addr;
+static unsigned fault_nbytes;
+static int fault_load_p;
+
+// decode the instruction at <r->regs[15]>: sets the lowest address 
+// it touches, the total number of bytes and if it's a load.
+static void fault_decode(regs_t *r, uint32_t addr) {
+    uint32_t inst = *(uint32_t *)r->regs[15];
+    ldst_t l;
+    if(!ldst_decode(inst, &l))
+        panic("pc=%x: faulting inst=%x is not a load/store?\n", 
+            r->regs[15], inst);
+    fault_addr = ldst_addr(&l, r->regs, addr);
+    fault_nbytes = l.nbytes;
+    fault_load_p = l.load_p;
+}
+
+// does [addr, addr+nbytes) overlap <c>'s range?
+static int checker_wants_p(memtrace_checker_t *c, unsigned dom, 
+        uint32_t addr, unsigned nbytes) {
+    if(!c->enabled_p || c->trap_dom != dom)
+        return 0;
+    return addr < c->hi && addr + nbytes > c->lo;
+}
+
+// call <pre> or <post> for every checker in <fault_checkers>.
+static void checkers_run(fault_ctx_t *ctx, int pre_p) {
+    for(unsigned i = 0; i < nchecker; i++) {
+        if(!(fault_checkers & (1 << i)))
+            continue;
+        memtrace_checker_t *c = &checkers[i];
+        memtrace_fn_t fn = pre_p ? c->pre : c->post;
+        if(!fn)
+            continue;
+
+        if (!quiet_p)
+            output("memtrace: %s: %s-handler: pc=%x, addr=%x\n", 
+                c->name, pre_p ? "pre" : "post", ctx->pc, ctx->addr);
+
+        uint32_t s = cycle_cnt_read();
+        fn(c->data, ctx);
+        c->ncycles += cycle_cnt_read() - s;
+    }
 }
 
 static void data_fault(regs_t *r) {
+    uint32_t s = cycle_cnt_read();
+
     // sanity check that we still at SUPER
     //   - should make it so we can run at user level.
     if(mode_get(r->regs[16]) != SUPER_MODE)
@@ -85,31 +153,29 @@ static void data_fault(regs_t *r) {
 
     if (trap_is_on_p()) {
         uint32_t addr = data_abort_addr();
+        unsigned dom = (dfsr_get() >> 4) & 0xf;
         memtrace_trap_disable();
-        uint32_t pc = r->regs[15];
+        nfaults++;
 
         watchpt_on_ptr((uint32_t *)addr);
 
-        fault_ctx_t ctx = fault_ctx_mk(r, addr, inst_nbytes(0), 0);
+        fault_decode(r, addr);
+        fault_ctx_t ctx = fault_ctx_mk(r, fault_addr, fault_nbytes, fault_load_p);
 
-        if (pre) {
-            if (!quiet_p)
-                output("memtrace: pre-handler: pc=%x, addr=%x\n", pc, addr);
-            pre(data, &ctx);
+        fault_checkers = 0;
+        for(unsigned i = 0; i < nchecker; i++) {
+            memtrace_checker_t *c = &checkers[i];
+            if(checker_wants_p(c, dom, fault_addr, fault_nbytes)) {
+                fault_checkers |= 1 << i;
+                c->ncalls++;
+            }
         }
+        checkers_run(&ctx, 1);
     } else {
         uint32_t addr = watchpt_fault_addr();
         watchpt_off_ptr((uint32_t *)addr);
-        int load_p = watchpt_load_fault_p();
-        uint32_t pc = r->regs[15];
-        fault_ctx_t ctx = fault_ctx_mk(r, addr, inst_nbytes(0), load_p);
-
-        if (post) {
-            if (!quiet_p)
-                output("memtrace: post-handler: pc=%x, addr=%x\n", pc, addr);
-            post(data, &ctx);
-        }
-
+        fault_ctx_t ctx = fault_ctx_mk(r, fault_addr, fault_nbytes, fault_load_p);
+        checkers_run(&ctx, 0);
         memtrace_trap_enable();
     }
 
@@ -117,15 +183,16 @@ static void data_fault(regs_t *r) {
     while(!uart_can_put8())
         ;
 
+    fault_cycles += cycle_cnt_read() - s;
     switchto(r);
 }
 
-// initialize memtrace system.
-void memtrace_init(
-    void *data_h,
-    memtrace_fn_t pre_h,
-    memtrace_fn_t post_h,
-    unsigned trap_dom) {
+// setup vm and the fault handler once.
+void memtrace_setup(void) {
+    static int init_p;
+    if(init_p)
+        return;
+    init_p = 1;
 
     // setting up VM does not belong here, but we do it to keep things
     // simple for today's lab.
@@ -133,17 +200,74 @@ void memtrace_init(
     sbrk_init();
     assert(mmu_is_enabled());
 
-    pre = pre_h;
-    post = post_h;
+    // XXX: what's the right way to handle SS exceptions at the same time?
+    full_except_install(0);
+    full_except_set_data_abort(data_fault);
+}
+
+memtrace_checker_t *memtrace_checker_add(
+    const char *name,
+    void *data,
+    memtrace_fn_t pre,
+    memtrace_fn_t post,
+    unsigned trap_dom) {
+
     if(!pre && !post)
         panic("must supply one handler: pre=%x, post=%x\n", pre,post);
-    data = data_h;
     assert(trap_dom < 16);
+    if(nchecker == MEMTRACE_MAX_CHECKERS)
+        panic("too many checkers: max=%d\n", MEMTRACE_MAX_CHECKERS);
 
-    trap_access = 4;
-    no_trap_access = 4 | (1 << (trap_dom*2));
+    memtrace_checker_t *c = &checkers[nchecker++];
+    *c = (memtrace_checker_t) {
+        .name = name,
+        .data = data,
+        .pre = pre,
+        .post = post,
+        .trap_dom = trap_dom,
+        .lo = 0,
+        .hi = ~0,
+        .enabled_p = 1,
+    };
+    trap_access_update();
+    return c;
+}
 
-    // XXX: what's the right way to handle SS exceptions at the same time?
-    full_except_install(0);
-    full_except_set_data_abort(data_fault);
+void memtrace_checker_range(memtrace_checker_t *c, uint32_t lo, uint32_t hi) {
+    assert(lo < hi);
+    c->lo = lo;
+    c->hi = hi;
+}
+
+void memtrace_checker_enable(memtrace_checker_t *c) {
+    c->enabled_p = 1;
+    trap_access_update();
+}
+
+void memtrace_checker_disable(memtrace_checker_t *c) {
+    c->enabled_p = 0;
+    trap_access_update();
+}
+
+unsigned memtrace_nfaults(void) {
+    return nfaults;
+}
+
+void memtrace_stats(void) {
+    output("memtrace: %d faults, %d cycles total\n", nfaults, fault_cycles);
+    for(unsigned i = 0; i < nchecker; i++) {
+        memtrace_checker_t *c = &checkers[i];
+        output("\tchecker=<%s>: dom=%d, enabled=%d, calls=%d, cycles=%d\n",
+            c->name, c->trap_dom, c->enabled_p, c->ncalls, c->ncycles);
+    }
+}
+
+// initialize memtrace system with a single checker.
+void memtrace_init(
+    void *data_h,
+    memtrace_fn_t pre_h,
+    memtrace_fn_t post_h,
+    unsigned trap_dom) {
+    memtrace_setup();
+    memtrace_checker_add("memtrace", data_h, pre_h, post_h, trap_dom);
 }
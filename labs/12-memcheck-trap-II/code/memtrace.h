@@ -19,9 +19,11 @@ typedef struct fault_ctx {
                             // be the same for <post>
 
     // the following are the same for pre/post.
-    uint32_t addr;          // memory address of fault.
-    unsigned nbytes;        // number of bytes of access [note: you'll need
-                            // to implement this calculation]
+    uint32_t addr;          // lowest address accessed: for ldm/stm
+                            // etc the start of the whole range, 
+                            // not the faulting word.
+    unsigned nbytes;        // number of bytes of access (decoded from
+                            // the instruction: see <ldst-decode.h>)
     unsigned load_p:1;      // access = load (=1), or store (=0).
 } fault_ctx_t;
 
@@ -46,17 +48,19 @@ typedef int (*memtrace_fn_t)(void *handle, fault_ctx_t *c);
 
 // step 1: initialize the system.  
 //  must specify:
-//    1. the trapping domain (not hard to change to multiple)
+//    1. the trapping domain.
 //    2. at least one <pre> or <post> handler to call before / after 
 //       any trapping memory instruction.
+//  this is just <memtrace_setup> + <memtrace_checker_add>: can call 
+//  more than once (or mix with <memtrace_checker_add>) to stack 
+//  checkers.
 //  note: 
 //    - virtual memory must already be setup.
 //    - we don't correctly handle executing code in trapping memory
 //      would require some finicky changes.
 //    - in a adult version you'd be able to: 
 //         1. override different pieces.
-//         2. have multiple checkers.
-//         3. delete checkers.
+//         2. delete checkers.
 //      all good to build for yours!
 void memtrace_init(
     void *data,           
@@ -64,6 +68,62 @@ void memtrace_init(
     memtrace_fn_t post, 
     unsigned trap_dom);
 
+// sets up vm and the fault handler: only does it the first time 
+// it's called.
+void memtrace_setup(void);
+
+// multiple checkers.  each checker has its own handlers, trap 
+// domain, address range and on/off switch, but all the checkers
+// for an access share its single domain fault + watchpoint fault
+// round trip: running purify and a tracer costs one fault per 
+// access, not two.
+//
+// a checker gets called for an access if:
+//   1. it's enabled.
+//   2. the fault was in its domain.
+//   3. the access overlaps its address range (default: everything).
+// the range does not change what traps (only domains do), just 
+// who gets called.  if every checker for a domain is disabled, 
+// its memory stops trapping.
+enum { MEMTRACE_MAX_CHECKERS = 8 };
+
+typedef struct memtrace_checker {
+    const char *name;
+    void *data;
+    memtrace_fn_t pre, post;
+    unsigned trap_dom;
+
+    // only called for accesses overlapping [lo, hi)
+    uint32_t lo, hi;
+    unsigned enabled_p:1;
+
+    // cost: number of accesses handed to this checker and the 
+    // cycles spent in its <pre> + <post>.
+    unsigned ncalls;
+    uint32_t ncycles;
+} memtrace_checker_t;
+
+// register a checker: it starts out enabled, with no range limit.
+memtrace_checker_t *memtrace_checker_add(
+    const char *name,
+    void *data,           
+    memtrace_fn_t pre, 
+    memtrace_fn_t post, 
+    unsigned trap_dom);
+
+// only call <c> for accesses that overlap [lo, hi).
+void memtrace_checker_range(memtrace_checker_t *c, uint32_t lo, uint32_t hi);
+
+// turn a single checker on/off: can call while trapping is on.
+void memtrace_checker_enable(memtrace_checker_t *c);
+void memtrace_checker_disable(memtrace_checker_t *c);
+
+// total number of trapped accesses (domain faults) so far.
+unsigned memtrace_nfaults(void);
+
+// print each checker's cost and the total.
+void memtrace_stats(void);
+
 // step 2: turn trapping off/on.
 //   note: should probably make it so you can recursively turn 
 //   off.
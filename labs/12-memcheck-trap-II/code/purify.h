@@ -4,7 +4,25 @@
 #include "src-loc.h"
 
 
-void purify_init(void);
+// how purify decides if a trapped access is legal:
+//  - PURIFY_LIST: look the address up in ckalloc's allocated blocks.
+//  - PURIFY_SHADOW: check a bit-per-byte shadow map of the heap
+//    (shadow-mem.c).  O(1) per trap and also flags accesses that
+//    straddle the end of a block.
+// both report errors the same way.
+typedef enum { PURIFY_LIST = 1, PURIFY_SHADOW } purify_mode_t;
+
+// default mode for <purify_init>: compile with -DPURIFY_SHADOW_P=1
+// to run existing tests using shadow memory.
+#ifndef PURIFY_SHADOW_P
+#   define PURIFY_SHADOW_P 0
+#endif
+
+void purify_init_mode(purify_mode_t mode);
+static inline void purify_init(void) {
+    purify_init_mode(PURIFY_SHADOW_P ? PURIFY_SHADOW : PURIFY_LIST);
+}
+
 #define purify_alloc(_n) purify_alloc_raw(_n, SRC_LOC_MK())
 #define purify_free(_ptr) purify_free_raw(_ptr, SRC_LOC_MK())
 
@@ -0,0 +1,85 @@
+// bit-per-byte shadow memory: see shadow-mem.h
+//
+// each trap becomes a couple of shifts and a load from the bitmap
+// rather than a walk of the allocated list.
+#include "rpi.h"
+#include "sbrk-trap.h"
+#include "shadow-mem.h"
+
+static uint8_t *shadow;
+static uint32_t heap_lo, heap_hi;
+
+void shadow_init(void) {
+    assert(!shadow);
+    heap_lo = (uint32_t)kmalloc_heap_start();
+    heap_hi = (uint32_t)kmalloc_heap_end();
+    assert(heap_lo < heap_hi);
+
+    // notrap_alloc zero-fills: everything starts not-addressable.
+    unsigned nbytes = (heap_hi - heap_lo + 7) / 8;
+    shadow = notrap_alloc(nbytes);
+}
+
+int shadow_is_on(void) {
+    return shadow != 0;
+}
+
+// set bits [off, off+n) to <v>.
+static void shadow_set(uint32_t off, unsigned n, int v) {
+    // leading partial byte.
+    for(; n && off % 8; off++, n--) {
+        if(v)
+            shadow[off/8] |= 1 << (off%8);
+        else
+            shadow[off/8] &= ~(1 << (off%8));
+    }
+    // whole bytes.
+    if(n >= 8) {
+        memset(&shadow[off/8], v ? 0xff : 0, n/8);
+        off += n & ~7;
+        n &= 7;
+    }
+    // trailing partial byte.
+    for(; n; off++, n--) {
+        if(v)
+            shadow[off/8] |= 1 << (off%8);
+        else
+            shadow[off/8] &= ~(1 << (off%8));
+    }
+}
+
+static uint32_t shadow_off(const void *addr, unsigned nbytes) {
+    uint32_t a = (uint32_t)addr;
+    if(a < heap_lo || a + nbytes > heap_hi)
+        panic("block [%x,%x) is not in the heap [%x,%x)\n",
+                a, a+nbytes, heap_lo, heap_hi);
+    return a - heap_lo;
+}
+
+void shadow_mark_alloced(const void *addr, unsigned nbytes) {
+    assert(shadow);
+    shadow_set(shadow_off(addr, nbytes), nbytes, 1);
+}
+
+void shadow_mark_freed(const void *addr, unsigned nbytes) {
+    assert(shadow);
+    shadow_set(shadow_off(addr, nbytes), nbytes, 0);
+}
+
+int shadow_is_legal(uint32_t addr, unsigned nbytes) {
+    assert(shadow);
+    assert(nbytes);
+    if(addr < heap_lo || addr + nbytes > heap_hi)
+        return 0;
+
+    uint32_t off = addr - heap_lo;
+    // common case: access within a single shadow byte.
+    if(off/8 == (off + nbytes - 1)/8) {
+        uint8_t mask = ((1 << nbytes) - 1) << (off % 8);
+        return (shadow[off/8] & mask) == mask;
+    }
+    for(unsigned i = 0; i < nbytes; i++, off++)
+        if(!(shadow[off/8] & (1 << (off%8))))
+            return 0;
+    return 1;
+}
@@ -0,0 +1,28 @@
+#ifndef __SHADOW_MEM_H__
+#define __SHADOW_MEM_H__
+// simple valgrind-style shadow memory for the trapping heap.
+//
+// one bit per heap byte: 1 = addressable (inside a live allocated
+// block), 0 = not (header, redzone, freed, never allocated).  the 
+// bitmap lives in non-trapping memory (<notrap_alloc>) so updating 
+// and checking it never recursively faults.
+//
+// for our 1MB heap the shadow is 128KB.
+
+// allocate shadow for the current kmalloc heap.  must be called
+// after <sbrk_init> (i.e., after <memtrace_init>).
+void shadow_init(void);
+
+// is shadow memory active?
+int shadow_is_on(void);
+
+// mark [addr, addr+nbytes) as addressable / not addressable.
+void shadow_mark_alloced(const void *addr, unsigned nbytes);
+void shadow_mark_freed(const void *addr, unsigned nbytes);
+
+// returns 1 if every byte in [addr, addr+nbytes) is addressable,
+// 0 otherwise (including any byte outside the heap).  so an access
+// that straddles the end of a block is flagged.
+int shadow_is_legal(uint32_t addr, unsigned nbytes);
+
+#endif
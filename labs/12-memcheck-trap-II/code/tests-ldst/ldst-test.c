@@ -0,0 +1,374 @@
+// host test for the load/store decoder.
+//
+//   ./ldst-test gen <n> > x.bin    # <n> random instruction words.
+//   ./ldst-test check < x.dis      # check against disassembly.
+//
+// <check> reads objdump output (gnu: "  8:\te5910000 \tldr\tr0, [r1]",
+// llvm: "  8: 00 00 91 e5 \tldr\tr0, [r1]"), works out from the
+// mnemonic and operands how many bytes each instruction should 
+// access, whether it is a load, and for ldm/stm/vldm/vstm the base
+// register and where the range starts, and compares that against
+// <ldst_decode>.
+#include <string.h>
+#include <ctype.h>
+#include "libunix.h"
+#include "ldst-decode.h"
+
+static uint32_t rng_state = 1;
+static uint32_t rng(void) {
+    rng_state = rng_state * 1103515245 + 12345;
+    return (rng_state >> 8) ^ (rng_state << 20);
+}
+
+// random instruction word: half fully random, half built from
+// the load/store encodings so every class gets lots of coverage.
+static uint32_t gen_inst(void) {
+    uint32_t x = rng(), cond = rng() % 15;
+    switch(rng() % 10) {
+    // single ldr/str{b}
+    case 0: return (cond << 28) | (0b01 << 26) | (x & 0x3ffffff);
+    // extra load/store: bit7=bit4=1, sh != 0 (sh = 0 is multiply)
+    case 1: return (cond << 28) | (x & 0x1ffff00) | 0x90 | (1 + rng() % 3) << 5 
+                        | (x & 0xf);
+    // swp/ldrex family.
+    case 2: return (cond << 28) | 0x01000090 | (x & 0xf0ff00) | (x & 0xf);
+    // ldm/stm
+    case 3: return (cond << 28) | (0b100 << 25) | (x & 0x1ffffff);
+    // vfp loads/stores.
+    case 4: return (cond << 28) | (0b110 << 25) | (x & 0x1f0f0ff) 
+                        | (10 + rng() % 2) << 8;
+    // unconditional space: srs/rfe/pld/ldc2...
+    case 5: return 0xf0000000 | (x & 0x0fffffff);
+    default: return x;
+    }
+}
+
+static void gen(unsigned n) {
+    for(unsigned i = 0; i < n; i++) {
+        uint32_t w = gen_inst();
+        if(fwrite(&w, sizeof w, 1, stdout) != 1)
+            sys_die(fwrite, "write failed");
+    }
+}
+
+static const char *conds[] = { 
+    "eq","ne","cs","cc","hs","lo","mi","pl",
+    "vs","vc","hi","ls","ge","lt","gt","le","al", 0
+};
+
+static int is_cond(const char *s) {
+    for(int i = 0; conds[i]; i++)
+        if(strcmp(s, conds[i]) == 0)
+            return 1;
+    return 0;
+}
+
+// what the disassembly says the instruction does.
+typedef struct {
+    int mem_p;          // 0 = not a load/store.
+    unsigned nbytes;
+    int load_p;
+    int multi_p;        // check <rn>,<off> too.
+    int check_load_p;
+    int rn;
+    int off;
+} expect_t;
+
+// single transfers: base mnemonic -> bytes (vldr/vstr handled 
+// separately, they depend on the register).
+static struct { const char *mn; unsigned nbytes; } singles[] = {
+    {"ldr",4}, {"str",4}, {"ldrt",4}, {"strt",4},
+    {"ldrb",1}, {"strb",1}, {"ldrbt",1}, {"strbt",1},
+    {"ldrh",2}, {"strh",2}, {"ldrsb",1}, {"ldrsh",2},
+    {"ldrht",2}, {"strht",2}, {"ldrsbt",1}, {"ldrsht",2},
+    {"ldrd",8}, {"strd",8},
+    {"ldrex",4}, {"strex",4}, {"ldrexb",1}, {"strexb",1},
+    {"ldrexh",2}, {"strexh",2}, {"ldrexd",8}, {"strexd",8},
+    {"swp",4}, {"swpb",1},
+    {"ldc",4}, {"stc",4}, {"ldcl",4}, {"stcl",4},
+    {"ldc2",4}, {"stc2",4}, {"ldc2l",4}, {"stc2l",4},
+    {0,0}
+};
+
+// block transfers: mnemonic -> (load?, P, U).  includes the 
+// stack aliases (ldmfd = ldmia, stmfd = stmdb, ...).
+static struct { const char *mn; int load_p, p, u; } multis[] = {
+    {"ldm",1,0,1}, {"ldmia",1,0,1}, {"ldmib",1,1,1}, 
+    {"ldmda",1,0,0}, {"ldmdb",1,1,0},
+    {"ldmfd",1,0,1}, {"ldmed",1,1,1}, {"ldmfa",1,0,0}, {"ldmea",1,1,0},
+    {"stm",0,0,1}, {"stmia",0,0,1}, {"stmib",0,1,1}, 
+    {"stmda",0,0,0}, {"stmdb",0,1,0},
+    {"stmea",0,0,1}, {"stmfa",0,1,1}, {"stmed",0,0,0}, {"stmfd",0,1,0},
+    {"pop",1,0,1}, {"push",0,1,0},
+    {"vldmia",1,0,1}, {"vldmdb",1,1,0}, {"vstmia",0,0,1}, {"vstmdb",0,1,0},
+    {"vldm",1,0,1}, {"vstm",0,0,1},
+    {"vpop",1,0,1}, {"vpush",0,1,0},
+    {"rfeia",1,0,1}, {"rfeib",1,1,1}, {"rfeda",1,0,0}, {"rfedb",1,1,0},
+    {"rfe",1,0,1},
+    {0,0,0,0}
+};
+
+static int known(const char *mn) {
+    for(int i = 0; singles[i].mn; i++)
+        if(strcmp(mn, singles[i].mn) == 0)
+            return 1;
+    for(int i = 0; multis[i].mn; i++)
+        if(strcmp(mn, multis[i].mn) == 0)
+            return 1;
+    return strcmp(mn, "vldr") == 0 || strcmp(mn, "vstr") == 0
+        || strncmp(mn, "srs", 3) == 0;
+}
+
+// strip a trailing condition code ("ldrbeq" -> "ldrb") or an 
+// old-style infix one ("ldreqb" -> "ldrb").
+static void strip_cond(char *mn) {
+    if(known(mn))
+        return;
+    size_t n = strlen(mn);
+    if(n > 2 && is_cond(mn + n - 2)) {
+        char save = mn[n-2];
+        mn[n-2] = 0;
+        if(known(mn))
+            return;
+        mn[n-2] = save;
+    }
+    if(n > 5) {
+        char c[3] = { mn[3], mn[4], 0 };
+        if(is_cond(c)) {
+            char t[64];
+            snprintf(t, sizeof t, "%.3s%s", mn, mn + 5);
+            if(known(t))
+                strcpy(mn, t);
+        }
+    }
+}
+
+static int reg_num(const char *s) {
+    static const char *alias[] = { 
+        "sb","9", "sl","10", "fp","11", "ip","12", "sp","13", "lr","14", "pc","15", 0 
+    };
+    while(*s == ' ')
+        s++;
+    for(int i = 0; alias[i]; i += 2)
+        if(strncmp(s, alias[i], 2) == 0)
+            return atoi(alias[i+1]);
+    if(*s == 'r')
+        return atoi(s + 1);
+    return -1;
+}
+
+// number of registers in "{r1, r4-r6, lr}" and their size: 
+// 4, or 8 for d registers.
+static unsigned reglist_nbytes(const char *ops) {
+    const char *p = strchr(ops, '{');
+    if(!p)
+        return 0;
+    unsigned n = 0;
+    for(p++; *p && *p != '}'; ) {
+        while(*p == ' ' || *p == ',')
+            p++;
+        if(*p == '}')
+            break;
+        unsigned sz = (*p == 'd') ? 8 : 4;
+        int lo = -1, hi;
+        if(*p == 'd' || *p == 's')
+            lo = atoi(p + 1);
+        else
+            lo = reg_num(p);
+        hi = lo;
+        while(*p && *p != ',' && *p != '}' && *p != '-')
+            p++;
+        if(*p == '-') {
+            p++;
+            hi = (*p == 'd' || *p == 's') ? atoi(p + 1) : reg_num(p);
+            while(*p && *p != ',' && *p != '}')
+                p++;
+        }
+        n += (hi - lo + 1) * sz;
+    }
+    return n;
+}
+
+// returns 0 if we can't tell (unknown / undefined encodings).
+static int expect(uint32_t inst, char *mn, const char *ops, expect_t *e) {
+    memset(e, 0, sizeof *e);
+    if(strcmp(mn, "<unknown>") == 0 || strncmp(mn, "udf", 3) == 0 
+    || strncmp(mn, "undefined", 9) == 0 || mn[0] == '.')
+        return 0;
+    // fldmx/fstmx: odd word counts gnu prints specially.
+    if(mn[0] == 'f' && strstr(mn, "x"))
+        return 0;
+
+    strip_cond(mn);
+    if(!known(mn))
+        return 1;       // not a load/store.
+
+    e->mem_p = 1;
+    e->check_load_p = 1;
+    e->load_p = (mn[0] == 'l' || strncmp(mn, "pop", 3) == 0 
+            || strncmp(mn, "vld", 3) == 0 || strncmp(mn, "vpop", 4) == 0
+            || strncmp(mn, "rfe", 3) == 0);
+
+    if(strncmp(mn, "swp", 3) == 0) {
+        e->load_p = 1;
+        e->nbytes = strcmp(mn, "swpb") == 0 ? 1 : 4;
+        return 1;
+    }
+    if(strncmp(mn, "srs", 3) == 0) {
+        e->load_p = 0;
+        e->nbytes = 8;
+        return 1;
+    }
+    for(int i = 0; singles[i].mn; i++)
+        if(strcmp(mn, singles[i].mn) == 0) {
+            e->nbytes = singles[i].nbytes;
+            return 1;
+        }
+    if(strcmp(mn, "vldr") == 0 || strcmp(mn, "vstr") == 0) {
+        e->nbytes = ops[0] == 'd' ? 8 : 4;
+        return 1;
+    }
+    for(int i = 0; multis[i].mn; i++) {
+        if(strcmp(mn, multis[i].mn))
+            continue;
+        e->multi_p = 1;
+        e->load_p = multis[i].load_p;
+        if(strncmp(mn, "rfe", 3) == 0)
+            e->nbytes = 8;
+        else
+            e->nbytes = reglist_nbytes(ops);
+        if(!e->nbytes)
+            return 0;
+        // vldm/vstm with a count of 0 or past the last register
+        // are unpredictable: disassemblers clamp the list.
+        if(mn[0] == 'v') {
+            unsigned imm8 = inst & 0xff;
+            if(!imm8 || imm8 * 4 != e->nbytes) {
+                const char *end = strchr(ops, '}');
+                if(!imm8 || (end && (!strncmp(end - 3, "s31", 3) 
+                            || !strncmp(end - 3, "d15", 3) 
+                            || !strncmp(end - 3, "d31", 3))))
+                    return 0;
+            }
+        }
+        // push/pop/vpush/vpop use sp; otherwise the first operand.
+        e->rn = (mn[0] == 'p' || mn[1] == 'p') ? 13 : reg_num(ops);
+        // can't tell the base (e.g., llvm prints "rfeda #3!" for 
+        // rfe with junk in its should-be-zero bits).
+        if((int)e->rn < 0)
+            e->multi_p = 0;
+        if(multis[i].u)
+            e->off = multis[i].p ? 4 : 0;
+        else
+            e->off = -(int)e->nbytes + (multis[i].p ? 0 : 4);
+        // vldm/vstm db: the range is [rn - n, rn).
+        if(mn[0] == 'v' && !multis[i].u)
+            e->off = -(int)e->nbytes;
+        return 1;
+    }
+    panic("missing case: %s\n", mn);
+}
+
+// parse one disassembly line: returns 1 and fills in the 
+// instruction word, mnemonic and operands.
+static int parse(char *line, uint32_t *inst, char *mn, char *ops) {
+    char *colon = strchr(line, ':');
+    if(!colon || colon == line || line[0] != ' ')
+        return 0;
+    for(char *p = line; p < colon; p++)
+        if(*p != ' ' && !isxdigit(*p))
+            return 0;
+
+    // the encoding is everything up to the first tab after the 
+    // colon: either one 8-digit word (gnu) or 4 bytes (llvm).
+    char *tab = strchr(colon, '\t');
+    if(!tab)
+        return 0;
+    char *rest = tab + 1;
+    // gnu puts a tab right after the colon.
+    if(tab == colon + 1) {
+        tab = strchr(rest, '\t');
+        if(!tab)
+            return 0;
+        *tab = 0;
+        *inst = strtoul(rest, 0, 16);
+        rest = tab + 1;
+    } else {
+        *tab = 0;
+        unsigned b[4];
+        if(sscanf(colon + 1, "%x %x %x %x", &b[0], &b[1], &b[2], &b[3]) != 4)
+            return 0;
+        *inst = b[0] | b[1] << 8 | b[2] << 16 | b[3] << 24;
+    }
+
+    // mnemonic, then operands.
+    while(*rest == ' ')
+        rest++;
+    size_t n = strcspn(rest, "\t \n");
+    if(!n || n >= 64)
+        return 0;
+    memcpy(mn, rest, n);
+    mn[n] = 0;
+    rest += n;
+    while(*rest == ' ' || *rest == '\t')
+        rest++;
+    strcpy(ops, rest);
+    ops[strcspn(ops, "\n")] = 0;
+    return 1;
+}
+
+static void check(void) {
+    char line[1024], mn[64], ops[1024];
+    unsigned ninst = 0, nmem = 0, nmulti = 0, nskip = 0, nbad = 0;
+
+    while(fgets(line, sizeof line, stdin)) {
+        uint32_t inst;
+        if(!parse(line, &inst, mn, ops))
+            continue;
+        ninst++;
+
+        char orig[64];
+        strcpy(orig, mn);
+        expect_t e;
+        if(!expect(inst, mn, ops, &e)) {
+            nskip++;
+            continue;
+        }
+
+        ldst_t l;
+        unsigned n = ldst_decode(inst, &l);
+        int bad = 0;
+        if(n != (e.mem_p ? e.nbytes : 0))
+            bad = 1;
+        else if(n && e.check_load_p && l.load_p != e.load_p)
+            bad = 1;
+        else if(n && e.multi_p 
+            && (!l.multi_p || l.rn != e.rn || l.off != e.off))
+            bad = 1;
+
+        if(e.mem_p) {
+            nmem++;
+            nmulti += e.multi_p;
+        }
+        if(bad && nbad++ < 20)
+            output("MISMATCH: %08x %s %s: decoded nbytes=%u load=%d multi=%d rn=%d off=%d; "
+                    "expected nbytes=%u load=%d rn=%d off=%d\n", 
+                inst, orig, ops, n, l.load_p, l.multi_p, l.rn, l.off,
+                e.mem_p ? e.nbytes : 0, e.load_p, e.rn, e.off);
+    }
+    output("checked %u instructions: %u loads/stores (%u multi), %u skipped, %u bad\n",
+        ninst, nmem, nmulti, nskip, nbad);
+    if(!ninst || nbad)
+        exit(1);
+    output("SUCCESS\n");
+}
+
+int main(int argc, char *argv[]) {
+    if(argc == 3 && strcmp(argv[1], "gen") == 0)
+        gen(atoi(argv[2]));
+    else if(argc == 2 && strcmp(argv[1], "check") == 0)
+        check();
+    else
+        panic("usage: %s gen <n> | check\n", argv[0]);
+    return 0;
+}
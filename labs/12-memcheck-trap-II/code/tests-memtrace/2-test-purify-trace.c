@@ -0,0 +1,54 @@
+// purify and a range tracer stacked on the same domain: every
+// access costs one fault no matter how many checkers see it.
+//   1. stores to <p> (traced) and <q> (not traced).
+//   2. tracer off: same number of faults, tracer sees nothing.
+//   3. tracer back on: sees the loads.
+#include "rpi.h"
+#include "purify.h"
+#include "checker-trace.h"
+#include "memmap-default.h"
+
+enum { K = 16 };
+
+void notmain(void) {
+    purify_init();
+    purify_yap_off();
+    volatile uint32_t *p = purify_alloc(sizeof *p * K);
+    volatile uint32_t *q = purify_alloc(sizeof *q * K);
+
+    // only trace <p>
+    trace_init((uint32_t)p, (uint32_t)(p+K), dom_trap);
+
+    unsigned n = memtrace_nfaults();
+    for(int j = 0; j < K; j++) {
+        p[j] = j;
+        q[j] = j;
+    }
+    unsigned nfaults = memtrace_nfaults() - n;
+    trace("stores: faults=%d, traced stores=%d\n", nfaults, trace_nstores());
+    assert(nfaults == 2*K);
+    assert(trace_nstores() == K);
+    assert(trace_nloads() == 0);
+
+    trace_off();
+    n = memtrace_nfaults();
+    for(int j = 0; j < K; j++)
+        p[j] += 1;
+    nfaults = memtrace_nfaults() - n;
+    trace("tracer off: faults=%d, traced=%d\n", 
+        nfaults, trace_nloads() + trace_nstores());
+    assert(nfaults == 2*K);
+    assert(trace_nstores() == K);
+    assert(trace_nloads() == 0);
+
+    trace_on();
+    uint32_t sum = 0;
+    for(int j = 0; j < K; j++)
+        sum += p[j];
+    trace("tracer on: traced loads=%d\n", trace_nloads());
+    assert(trace_nloads() == K);
+    assert(sum == K*(K-1)/2 + K);
+
+    memtrace_stats();
+    trace("SUCCESS\n");
+}
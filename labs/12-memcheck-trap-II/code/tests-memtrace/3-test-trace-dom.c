@@ -0,0 +1,53 @@
+// checkers in different trap domains: the tracer watches a MB
+// in its own domain, purify watches the heap.  an access only 
+// runs its domain's checkers, and turning the tracer off stops 
+// its domain from trapping at all.
+#include "rpi.h"
+#include "purify.h"
+#include "checker-trace.h"
+#include "memmap-default.h"
+
+enum { dom_trace = 4, K = 16 };
+
+void notmain(void) {
+    purify_init();
+    purify_yap_off();
+    volatile uint32_t *h = purify_alloc(sizeof *h * K);
+
+    // map a MB in <dom_trace>: not heap, so purify would complain 
+    // if it ever saw these accesses.
+    volatile uint32_t *w = (void *)mb_map(0, dom_trace, no_user);
+    trace_init((uint32_t)w, (uint32_t)w + MB(1), dom_trace);
+
+    unsigned n = memtrace_nfaults();
+    for(int j = 0; j < K; j++) {
+        w[j] = j;
+        h[j] = j;
+    }
+    unsigned nfaults = memtrace_nfaults() - n;
+    trace("both domains: faults=%d, traced stores=%d\n", 
+        nfaults, trace_nstores());
+    assert(nfaults == 2*K);
+    assert(trace_nstores() == K);
+
+    trace_off();
+    n = memtrace_nfaults();
+    for(int j = 0; j < K; j++)
+        w[j] += 1;
+    nfaults = memtrace_nfaults() - n;
+    trace("tracer off: faults=%d\n", nfaults);
+    assert(nfaults == 0);
+
+    // the heap still traps.
+    n = memtrace_nfaults();
+    for(int j = 0; j < K; j++)
+        h[j] += 1;
+    nfaults = memtrace_nfaults() - n;
+    trace("heap: faults=%d\n", nfaults);
+    assert(nfaults == 2*K);
+    assert(trace_nstores() == K);
+    assert(trace_nloads() == 0);
+
+    memtrace_stats();
+    trace("SUCCESS\n");
+}
@@ -0,0 +1,16 @@
+// same as 1-purify-bug.c but using shadow memory: should give
+// the same error.
+#include "rpi.h"
+#include "purify.h"
+
+void notmain(void) {
+    trace("should detect memory overflow at 1 byte past block end\n");
+
+    purify_init_mode(PURIFY_SHADOW);
+    char *p = purify_alloc(4);
+    trace("allocated [addr=%x]: about to store\n", p);
+    memset(p, 0, 4);
+    p[4] = 1;   // one past end of block
+
+    trace("should have caught the corruption before now!\n");
+}
@@ -0,0 +1,20 @@
+// a word load that starts inside a block and runs 2 bytes off the 
+// end.  the first byte is legal, so a checker that only looks at 
+// the faulting address misses it: shadow mode checks every byte
+// (and list mode now checks the last one, see ldst-decode.c).
+#include "rpi.h"
+#include "purify.h"
+
+void notmain(void) {
+    trace("should detect a load straddling the block end by 2 bytes\n");
+
+    purify_init();
+    char *p = purify_alloc(6);
+    trace("allocated [addr=%x]: about to load\n", p);
+    memset(p, 0, 6);
+    // bytes [4,8) of a 6-byte block: word-aligned, so no alignment fault.
+    volatile uint32_t *w = (void *)(p + 4);
+    uint32_t x = *w;
+
+    trace("should have caught the corruption before now! [x=%x]\n", x);
+}
@@ -309,6 +309,111 @@ pi_file_t *fat32_read(fat32_fs_t *fs, pi_dirent_t *directory, char *filename) {
   return file;
 }
 
+/******************************************************************************
+ * Streaming file handles: see fat32.h.
+ ******************************************************************************/
+
+static uint32_t cluster_nbytes(fat32_fs_t *fs) {
+  return fs->sectors_per_cluster * SECTOR_SIZE;
+}
+
+int fat32_open(fat32_fs_t *fs, pi_dirent_t *directory, char *filename, fat32_file_t *f) {
+  pi_dirent_t *d = fat32_stat(fs, directory, filename);
+  if (!d)
+    return 0;
+  if (d->is_dir_p)
+    panic("<%s> is a directory\n", filename);
+
+  memset(f, 0, sizeof *f);
+  f->fs = fs;
+  f->first_cluster = d->nbytes ? d->cluster_id : 0;
+  f->nbytes = d->nbytes;
+  return 1;
+}
+
+// Return the cluster holding the cursor, walking forward from the last one
+// we touched when possible.
+static uint32_t file_cluster(fat32_file_t *f) {
+  fat32_fs_t *fs = f->fs;
+  uint32_t idx = f->pos / cluster_nbytes(fs);
+
+  if (!f->cluster || f->cluster_idx > idx) {
+    f->cluster = f->first_cluster;
+    f->cluster_idx = 0;
+  }
+  while (f->cluster_idx < idx) {
+    uint32_t next = fs->fat[f->cluster];
+    if (fat32_fat_entry_type(next) == LAST_CLUSTER)
+      panic("cluster chain shorter than the file size\n");
+    f->cluster = next;
+    f->cluster_idx++;
+  }
+  return f->cluster;
+}
+
+// How many sectors starting at the cursor can be read in one go: the rest of
+// the current cluster plus any clusters that follow it on disk, up to <nsec>.
+static uint32_t contiguous_nsec(fat32_file_t *f, uint32_t cluster, uint32_t nsec) {
+  fat32_fs_t *fs = f->fs;
+  uint32_t off = f->pos % cluster_nbytes(fs) / SECTOR_SIZE;
+  uint32_t n = fs->sectors_per_cluster - off;
+
+  while (n < nsec && fs->fat[cluster] == cluster + 1) {
+    cluster++;
+    n += fs->sectors_per_cluster;
+  }
+  return n < nsec ? n : nsec;
+}
+
+unsigned fat32_fread(fat32_file_t *f, void *buf, unsigned nbytes) {
+  fat32_fs_t *fs = f->fs;
+  uint8_t *p = buf;
+
+  if (f->pos >= f->nbytes)
+    return 0;
+  if (nbytes > f->nbytes - f->pos)
+    nbytes = f->nbytes - f->pos;
+
+  unsigned left = nbytes;
+  while (left > 0) {
+    uint32_t cluster = file_cluster(f);
+    uint32_t off = f->pos % cluster_nbytes(fs);
+    uint32_t lba = fs->cluster_begin_lba + (cluster - 2) * fs->sectors_per_cluster
+                 + off / SECTOR_SIZE;
+    uint32_t n;
+
+    if (off % SECTOR_SIZE == 0 && left >= SECTOR_SIZE) {
+      // Whole sectors: straight into the caller's buffer.
+      uint32_t nsec = contiguous_nsec(f, cluster, left / SECTOR_SIZE);
+      assert(pi_sd_read(p, lba, nsec));
+      n = nsec * SECTOR_SIZE;
+    } else {
+      uint32_t sec_off = off % SECTOR_SIZE;
+      n = SECTOR_SIZE - sec_off;
+      if (n > left)
+        n = left;
+      assert(pi_sd_read(f->sec, lba, 1));
+      memcpy(p, f->sec + sec_off, n);
+    }
+    p += n;
+    left -= n;
+    // The cluster cursor catches up lazily in `file_cluster`.
+    f->pos += n;
+  }
+  return nbytes;
+}
+
+int fat32_seek(fat32_file_t *f, unsigned off) {
+  if (off > f->nbytes)
+    return 0;
+  f->pos = off;
+  return 1;
+}
+
+int fat32_close(fat32_file_t *f) {
+  return 1;
+}
+
 /******************************************************************************
  * Everything below here is for writing to the SD card (Part 7/Extension).  If
  * you're working on read-only code, you don't need any of this.
@@ -45,6 +45,37 @@ pi_dirent_t *fat32_stat(fat32_fs_t *fs, pi_dirent_t *directory, char *filename);
 // Read a file into memory and return it.
 pi_file_t *fat32_read(fat32_fs_t *fs, pi_dirent_t *directory, char *filename);
 
+/*
+ * Streaming (read-only) access to one file: reads go from the disk
+ * straight into the caller's buffer through a cursor into the file's
+ * cluster chain, so the file is never buffered whole.  Runs of contiguous
+ * clusters are a single pi_sd_read.
+ *
+ * The handle is caller storage (kmalloc can't free).
+ */
+typedef struct {
+  fat32_fs_t *fs;
+  uint32_t first_cluster,       // 0 for an empty file.
+           nbytes,              // file size.
+           pos;                 // cursor: byte offset into the file.
+  uint32_t cluster,             // cluster of the chain we last touched,
+           cluster_idx;         //   and its index in the chain.
+  uint8_t sec[512];             // bounce buffer for partial sectors.
+} fat32_file_t;
+
+// Open <filename> in <directory> with the cursor at 0.  Returns 0 if there is
+// no such file.
+int fat32_open(fat32_fs_t *fs, pi_dirent_t *directory, char *filename, fat32_file_t *f);
+
+// Read up to <nbytes> at the cursor into <buf> and advance it.  Returns the
+// number of bytes read (0 at end of file).
+unsigned fat32_fread(fat32_file_t *f, void *buf, unsigned nbytes);
+
+// Move the cursor to byte <off>.  Returns 0 if <off> is past the end.
+int fat32_seek(fat32_file_t *f, unsigned off);
+
+int fat32_close(fat32_file_t *f);
+
 // Rename a file's directory entry (on disk).  Pass in the dirent of the parent
 // directory, *not* of the file itself.
 int fat32_rename(fat32_fs_t *fs, pi_dirent_t *directory, char *oldname, char *newname);
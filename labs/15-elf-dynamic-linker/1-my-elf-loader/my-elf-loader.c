@@ -3,13 +3,85 @@
 #include "my-fat32-driver.h"
 #include "my-elf-loader.h"
 
+enum { MAX_PHNUM = 16 };
+
+// Read `nbytes` at file offset `off` into `dst`.
+static void read_at(fat32_file_t *f, uint32_t off, void *dst, uint32_t nbytes) {
+    if (!nbytes)
+        return;
+    if (!fat32_seek(f, off) || fat32_fread(f, dst, nbytes) != nbytes)
+        panic("[MY-ELF] ELF file truncated: can't read %d bytes at offset %x\n", nbytes, off);
+}
+
+// Does [lo, hi) (addresses relative to base) overlap any PT_LOAD segment?
+static int overlaps_segment(elf32_pheader *ph, int phnum, uint32_t lo, uint32_t hi) {
+    for (int i = 0; i < phnum; i++)
+        if (ph[i].p_type == PT_LOAD && lo < ph[i].p_vaddr + ph[i].p_memsz && ph[i].p_vaddr < hi)
+            return 1;
+    return 0;
+}
+
+// Put `nbytes` of headers from file offset `off` at `base` + `off`, unless a
+// segment already put the same bytes there (offset == address, the usual
+// layout with our memmaps).
+static void place_headers(fat32_file_t *f, char *base, elf32_pheader *ph, int phnum,
+                          uint32_t off, uint32_t nbytes) {
+    for (int i = 0; i < phnum; i++)
+        if (ph[i].p_type == PT_LOAD && ph[i].p_offset == ph[i].p_vaddr
+            && off >= ph[i].p_offset && off + nbytes <= ph[i].p_offset + ph[i].p_filesz)
+            return;
+    if (overlaps_segment(ph, phnum, off, off + nbytes))
+        panic("[MY-ELF] Headers at offset %x would overwrite a segment\n", off);
+    read_at(f, off, base + off, nbytes);
+}
+
 // Load the ELF file from the SD card to memory, starting at address `base`
+// Refer to 2-2 and 2-7 of ELF.pdf for program headers and segments
 void load_elf(char *filename, char *base) {
-    int size = my_fat32_read(filename, base);
-    if (size < 0)
+    fat32_file_t f;
+    if (!my_fat32_open(filename, &f))
         panic("[MY-ELF] Couldn't read ELF file from the FAT32 filesystem\n");
-    else
-        printk("[MY-ELF] ELF file loaded into memory (%x - %x)\n", base, base + size);
+
+    elf32_header e_header;
+    read_at(&f, 0, &e_header, sizeof e_header);
+    if (e_header.e_phentsize != sizeof(elf32_pheader) || e_header.e_phnum > MAX_PHNUM)
+        panic("[MY-ELF] Bad program header table (%d entries of %d bytes)\n",
+            e_header.e_phnum, e_header.e_phentsize);
+    elf32_pheader ph[MAX_PHNUM];
+    int phnum = e_header.e_phnum;
+    read_at(&f, e_header.e_phoff, ph, phnum * sizeof *ph);
+
+    // Segments must not overlap in memory
+    for (int i = 0; i < phnum; i++) {
+        if (ph[i].p_type != PT_LOAD)
+            continue;
+        if (ph[i].p_filesz > ph[i].p_memsz)
+            panic("[MY-ELF] Segment %d: file size %x > memory size %x\n", i, ph[i].p_filesz, ph[i].p_memsz);
+        if (overlaps_segment(ph + i + 1, phnum - i - 1, ph[i].p_vaddr, ph[i].p_vaddr + ph[i].p_memsz))
+            panic("[MY-ELF] Segment %d (%x - %x) overlaps another segment\n",
+                i, ph[i].p_vaddr, ph[i].p_vaddr + ph[i].p_memsz);
+    }
+
+    // Copy p_filesz bytes of each segment to its address, and zero the rest (.bss)
+    uint32_t nread = 0;
+    for (int i = 0; i < phnum; i++) {
+        if (ph[i].p_type != PT_LOAD)
+            continue;
+        char *dst = base + ph[i].p_vaddr;
+        read_at(&f, ph[i].p_offset, dst, ph[i].p_filesz);
+        memset(dst + ph[i].p_filesz, 0, ph[i].p_memsz - ph[i].p_filesz);
+        nread += ph[i].p_filesz;
+        printk("[MY-ELF] Segment %d loaded (%x - %x), %d bytes zeroed\n",
+            i, dst, dst + ph[i].p_memsz, ph[i].p_memsz - ph[i].p_filesz);
+    }
+
+    // The headers, for everything that finds sections through them
+    place_headers(&f, base, ph, phnum, 0, sizeof e_header);
+    place_headers(&f, base, ph, phnum, e_header.e_phoff, phnum * sizeof *ph);
+    place_headers(&f, base, ph, phnum, e_header.e_shoff, e_header.e_shnum * e_header.e_shentsize);
+
+    printk("[MY-ELF] ELF file loaded: %d of %d bytes read\n", nread, f.nbytes);
+    fat32_close(&f);
 }
 
 // Verify the ELF header. We'll do only a few checks as an exercise.
@@ -22,6 +22,7 @@
 */
 
 #define E_NIDENT 16
+#define PT_LOAD 1
 #define SHT_DYNAMIC 6
 #define SHT_REL 9
 #define SHT_NOBITS 8
@@ -29,11 +30,18 @@
 
 #define DT_NULL 0
 #define DT_NEEDED 1
+#define DT_PLTRELSZ 2 // size of .rel.plt
 #define DT_PLTGOT 3
 #define DT_HASH 4
 #define DT_STRTAB 5  // .dynstr
 #define DT_SYMTAB 6  // .dynsym
 #define DT_JMPREL 23 // .rel.dyn
+#define DT_BIND_NOW 24 // ld -z now: bind the PLT at load time
+#define DT_FLAGS 30
+#define DT_FLAGS_1 0x6ffffffb
+#define DF_BIND_NOW 0x8 // in DT_FLAGS
+#define DF_1_NOW 0x1    // in DT_FLAGS_1
+#define DT_GNU_HASH 0x6ffffef5 // .gnu.hash (GNU extension, ld --hash-style=gnu)
 
 // I had to reverse-engineer these values (different from the ELF docs)
 #define R_ARM_RELATIVE 23
@@ -41,6 +49,7 @@
 #define R_ARM_JUMP_SLOT 22
 #define R_ARM_ABS32 2
 #define SHN_UNDEF 0
+#define SHN_ABS 0xfff1
 
 /*
     ELF Headers
@@ -126,22 +135,32 @@ typedef struct {
     // Essential sections for dynamic linking
     elf32_dynamic *e_dynamics;
     uint32_t       n_dynamics; // number of entries in .dynamic section
-    uint32_t      *e_hash;
+    uint32_t      *e_hash;     // .hash (DT_HASH), or NULL
+    uint32_t      *e_gnu_hash; // .gnu.hash (DT_GNU_HASH), or NULL
     elf32_sym     *e_dynsym;
+    uint32_t       n_dynsym;   // number of entries in .dynsym
     char          *e_dynstr;
     uint32_t      *e_pltgot;
     elf32_rel     *e_reldyn;
+    uint32_t       n_reldyn;   // number of entries in .rel.plt (DT_PLTRELSZ)
 } my_elf32;
 
 
-// Load the ELF file from the SD card to memory, starting at address `base`
+// Load the ELF file from the SD card to memory, starting at address `base`.
+// Only the PT_LOAD segments are read: each one's p_filesz bytes go to
+// `base` + p_vaddr and the rest of its p_memsz (.bss) is zeroed.  The ELF
+// header, program headers and section header table are also put at `base` +
+// their file offset, so the code that finds things through them
+// (verify_elf, get_dynamic_sections, ...) works the same as before.
+// Panics if segments overlap, or if the headers would land on one.
 void load_elf(char *filename, char *base);
 
 // Verify the ELF header. We'll do only a few checks as an exercise.
 // Refer to 1-3 of ELF.pdf for the ELF header format
 void verify_elf(elf32_header *e_header);
 
-// Zero-initialize the .bss section
+// Zero-initialize the .bss section (load_elf already zeroes it from the
+// program headers; this is for an image put in memory some other way)
 // In order to do this, we need to:
 //   - Find out where the section header table starts from the ELF header
 //   - Iterate through the section header table entries until we find the .bss section
@@ -32,18 +32,25 @@ void my_fat32_init() {
 // This is very unique to our Pi setup. `buffer` points to a physical address.
 // Neither the caller or this function allocates anything. It just writes to
 // the physical address pointed to by `buffer`, and return the number of bytes written.
+// The file is streamed straight into `buffer`: no heap copy of the file.
 int my_fat32_read(char *name, char *buffer) {
+    fat32_file_t f;
+    if (!my_fat32_open(name, &f))
+        return -1;
+
+    unsigned n = fat32_fread(&f, buffer, f.nbytes);
+    fat32_close(&f);
+    return n;
+}
+
+int my_fat32_open(char *name, fat32_file_t *f) {
     if (!my_fat32_initialized) {
         my_fat32_init();
     }
 
-    pi_file_t *file = fat32_read(&my_fat32.fs, &my_fat32.root, name);
-
-    if (!file) {
+    if (!fat32_open(&my_fat32.fs, &my_fat32.root, name, f)) {
         printk("%s not found.\n", name);
-        return -1;
+        return 0;
     }
-
-    memcpy(buffer, file->data, file->n_data);
-    return file->n_data;
+    return 1;
 }
@@ -16,4 +16,9 @@ void my_fat32_init();
 // the physical address pointed to by `buffer`, and return the number of bytes written.
 int my_fat32_read(char *name, char *buffer);
 
+// Open `name` for streaming reads (fat32_fread, fat32_seek) so a caller can
+// read just the parts it needs, e.g. ELF segments to their load address.
+// Returns 0 if there is no such file.
+int my_fat32_open(char *name, fat32_file_t *f);
+
 #endif
@@ -0,0 +1,164 @@
+// load the static test programs with <load_elf> (../my-elf-loader.c)
+// into a buffer and check it against `objcopy -O binary` of each file:
+//   1. every byte of each segment's file part matches the .bin.
+//   2. the rest of each segment (.bss) is zeroed.
+//   3. nothing else is written except the ELF, program and section
+//      headers, at base + their file offset.
+//   4. a file with overlapping segments is rejected.
+// usage: 1-load-static [<file.elf> ...]   (each with <file.bin> next to it)
+#include <sys/wait.h>
+#include "rpi.h"
+#include "my-fat32-driver.h"
+#include "my-elf-loader.h"
+
+enum { UNTOUCHED = 0xa5 };
+
+#define SHF_ALLOC 2
+
+static unsigned max(unsigned a, unsigned b) {
+    return a > b ? a : b;
+}
+
+// <name> with its .elf suffix replaced by .bin.
+static char *bin_name(const char *name) {
+    static char buf[1024];
+    unsigned n = strlen(name);
+    if(n < 4 || strcmp(name + n - 4, ".elf") != 0 || n >= sizeof buf)
+        panic("<%s> should end in .elf\n", name);
+    strcpy(buf, name);
+    strcpy(buf + n - 4, ".bin");
+    return buf;
+}
+
+static void test_elf(const char *name) {
+    unsigned nbytes;
+    uint8_t *file = read_file(&nbytes, name);
+    elf32_header *h = (void *)file;
+    elf32_pheader *ph = (void *)(file + h->e_phoff);
+    elf32_sheader *sh = (void *)(file + h->e_shoff);
+
+    // memory the load can touch: the segments and the headers.
+    unsigned end = max(sizeof *h, h->e_phoff + h->e_phnum * sizeof *ph);
+    end = max(end, h->e_shoff + h->e_shnum * sizeof *sh);
+    for(unsigned i = 0; i < h->e_phnum; i++)
+        if(ph[i].p_type == PT_LOAD)
+            end = max(end, ph[i].p_vaddr + ph[i].p_memsz);
+
+    uint8_t *mem = malloc(end);
+    memset(mem, UNTOUCHED, end);
+    unsigned nread = fake_fat32_nread();
+    load_elf((char *)name, (char *)mem);
+    nread = fake_fat32_nread() - nread;
+
+    // what each byte should be: -1 = never written.
+    int *expect = malloc(end * sizeof *expect);
+    for(unsigned a = 0; a < end; a++)
+        expect[a] = -1;
+    unsigned nseg = 0;
+    for(unsigned i = 0; i < h->e_phnum; i++) {
+        if(ph[i].p_type != PT_LOAD)
+            continue;
+        nseg++;
+        for(unsigned off = 0; off < ph[i].p_memsz; off++)
+            expect[ph[i].p_vaddr + off] = off < ph[i].p_filesz ? file[ph[i].p_offset + off] : 0;
+    }
+    unsigned hdrs[3][2] = {
+        { 0, sizeof *h },
+        { h->e_phoff, h->e_phnum * sizeof *ph },
+        { h->e_shoff, h->e_shnum * sizeof *sh },
+    };
+    for(unsigned k = 0; k < 3; k++)
+        for(unsigned a = hdrs[k][0]; a < hdrs[k][0] + hdrs[k][1]; a++)
+            if(expect[a] < 0)
+                expect[a] = file[a];
+    for(unsigned a = 0; a < end; a++) {
+        if(expect[a] < 0 && mem[a] != UNTOUCHED)
+            panic("%s: wrote %x at %x, outside every segment\n", name, mem[a], a);
+        if(expect[a] >= 0 && mem[a] != expect[a])
+            panic("%s: byte at %x is %x, expected %x\n", name, a, mem[a], expect[a]);
+    }
+
+    // objcopy's image starts at the lowest loaded section, and zero-fills
+    // between sections.
+    unsigned bin_nbytes;
+    uint8_t *bin = read_file(&bin_nbytes, bin_name(name));
+    uint32_t bin_start = ~0;
+    for(unsigned i = 0; i < h->e_shnum; i++)
+        if((sh[i].sh_flags & SHF_ALLOC) && sh[i].sh_type != SHT_NOBITS && sh[i].sh_size)
+            bin_start = sh[i].sh_addr < bin_start ? sh[i].sh_addr : bin_start;
+    assert(bin_start != ~0);
+    for(unsigned off = 0; off < bin_nbytes; off++) {
+        unsigned a = bin_start + off;
+        uint8_t v = a < end && expect[a] >= 0 ? mem[a] : 0;
+        if(v != bin[off])
+            panic("%s: byte at %x is %x, objcopy has %x\n", name, a, v, bin[off]);
+    }
+    output("%s: %d segment(s), read %d of %d bytes, matches %d-byte .bin\n",
+        name, nseg, nread, nbytes, bin_nbytes);
+
+    free(bin);
+    free(expect);
+    free(mem);
+    free(file);
+}
+
+// make a copy of <name> whose last program header is a PT_LOAD on top
+// of the first PT_LOAD: load_elf must refuse it.
+static void test_overlap(const char *name) {
+    unsigned nbytes;
+    uint8_t *file = read_file(&nbytes, name);
+    elf32_header *h = (void *)file;
+    elf32_pheader *ph = (void *)(file + h->e_phoff);
+    unsigned i;
+    for(i = 0; i < h->e_phnum && ph[i].p_type != PT_LOAD; i++)
+        ;
+    if(h->e_phnum < 2 || i == h->e_phnum - 1)
+        panic("%s: need another program header after the first PT_LOAD\n", name);
+    elf32_pheader *last = &ph[h->e_phnum - 1];
+    *last = ph[i];
+    last->p_vaddr += ph[i].p_memsz / 2;
+    unsigned mem_nbytes = max(nbytes, last->p_vaddr + last->p_memsz);
+
+    const char *bad = "overlap.elf";
+    int fd = create_file(bad);
+    write_exact(fd, file, nbytes);
+    close(fd);
+    free(file);
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if(pid < 0)
+        sys_die(fork, "fork failed");
+    if(!pid) {
+        char *mem = calloc(1, mem_nbytes);
+        load_elf((char *)bad, mem);
+        exit(0);
+    }
+    int status;
+    if(waitpid(pid, &status, 0) < 0)
+        sys_die(waitpid, "waitpid failed");
+    unlink(bad);
+    if(WIFEXITED(status) && WEXITSTATUS(status) == 0)
+        panic("%s: loaded overlapping segments\n", name);
+    output("%s: overlapping segments rejected\n", name);
+}
+
+int main(int argc, char *argv[]) {
+    const char *defaults[] = {
+        "../../0-my-static-tests/0-static.elf",
+        "../../0-my-static-tests/1-static.elf",
+        "../../0-my-static-tests/2-static.elf",
+        "../../0-my-static-tests/3-static.elf",
+    };
+    const char **names = defaults;
+    int n = 4;
+    if(argc > 1) {
+        names = (const char **)argv + 1;
+        n = argc - 1;
+    }
+    for(int i = 0; i < n; i++)
+        test_elf(names[i]);
+    test_overlap(names[0]);
+    output("SUCCESS\n");
+    return 0;
+}
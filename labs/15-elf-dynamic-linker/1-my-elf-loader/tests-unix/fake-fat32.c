@@ -0,0 +1,51 @@
+// the streaming half of the fat32 driver (my_fat32_open, fat32_fread,
+// fat32_seek, fat32_close) over host files.
+#include <stdarg.h>
+#include <sys/stat.h>
+#include "my-fat32-driver.h"
+
+static unsigned nread;
+
+int printk(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vprintf(fmt, args);
+    va_end(args);
+    return n;
+}
+
+int my_fat32_open(char *name, fat32_file_t *f) {
+    struct stat s;
+    if(stat(name, &s) < 0)
+        return 0;
+    if(!(f->fp = fopen(name, "rb")))
+        sys_die(fopen, "can't open <%s>", name);
+    f->nbytes = s.st_size;
+    f->pos = 0;
+    return 1;
+}
+
+unsigned fat32_fread(fat32_file_t *f, void *buf, unsigned nbytes) {
+    unsigned n = fread(buf, 1, nbytes, f->fp);
+    f->pos += n;
+    nread += n;
+    return n;
+}
+
+int fat32_seek(fat32_file_t *f, unsigned off) {
+    if(off > f->nbytes)
+        return 0;
+    if(fseek(f->fp, off, SEEK_SET) < 0)
+        sys_die(fseek, "seek failed");
+    f->pos = off;
+    return 1;
+}
+
+int fat32_close(fat32_file_t *f) {
+    fclose(f->fp);
+    return 1;
+}
+
+unsigned fake_fat32_nread(void) {
+    return nread;
+}
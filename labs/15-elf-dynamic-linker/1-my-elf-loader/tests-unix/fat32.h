@@ -0,0 +1,23 @@
+#ifndef __RPI_FAT32_H__
+#define __RPI_FAT32_H__
+// host stand-in for the fat32 driver (static-deps/fat32.h): files are
+// read from the host's disk by name (see fake-fat32.c).
+#include <stdio.h>
+#include "rpi.h"
+
+typedef struct { int unused; } fat32_fs_t;
+typedef struct { int unused; } pi_dirent_t;
+
+typedef struct {
+    FILE *fp;
+    uint32_t nbytes, pos;
+} fat32_file_t;
+
+unsigned fat32_fread(fat32_file_t *f, void *buf, unsigned nbytes);
+int fat32_seek(fat32_file_t *f, unsigned off);
+int fat32_close(fat32_file_t *f);
+
+// total bytes read through fat32_fread since the start.
+unsigned fake_fat32_nread(void);
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef __RPI_H__
+#define __RPI_H__
+// host stand-in for libpi's rpi.h: just enough to run ../my-elf-loader.c
+// over ELF files on the host's disk (see fake-fat32.c).
+#include <string.h>
+#include "libunix.h"
+
+// no format checking: the loader prints pointers with %x.
+int printk(const char *fmt, ...);
+
+// the tests never jump into what they load.
+#define BRANCHTO(addr) panic("can't branch to %x on the host\n", addr)
+
+#endif
@@ -14,10 +14,20 @@ void get_dynamic_sections(my_elf32 *e) {
     elf32_sheader *e_sheaders = (elf32_sheader *)(elf32_base + e_header->e_shoff);
     e->n_dynamics = 0;
     e->e_hash = NULL;
+    e->e_gnu_hash = NULL;
     e->e_dynsym = NULL;
+    e->n_dynsym = 0;
     e->e_dynstr = NULL;
     e->e_pltgot = NULL;
     e->e_reldyn = NULL;
+    e->n_reldyn = 0;
+
+    for (int i = 0; i < e_header->e_shnum; i++) {
+        // The symbol count: neither hash table gives it directly for every
+        // linker (.gnu.hash doesn't at all), but the section size does.
+        if (e_sheaders[i].sh_type == SHT_DYNSYM)
+            e->n_dynsym = e_sheaders[i].sh_size / sizeof(elf32_sym);
+    }
 
     for (int i = 0; i < e_header->e_shnum; i++) {
         if (e_sheaders[i].sh_type == SHT_DYNAMIC) {
@@ -34,6 +44,9 @@ void get_dynamic_sections(my_elf32 *e) {
                     case DT_HASH:
                         e->e_hash = (uint32_t *)(elf32_base + dyn[j].d_un.d_ptr);
                         break;
+                    case DT_GNU_HASH:
+                        e->e_gnu_hash = (uint32_t *)(elf32_base + dyn[j].d_un.d_ptr);
+                        break;
                     case DT_SYMTAB:
                         e->e_dynsym = (elf32_sym *)(elf32_base + dyn[j].d_un.d_ptr);
                         break;
@@ -46,17 +59,21 @@ void get_dynamic_sections(my_elf32 *e) {
                     case DT_JMPREL:
                         e->e_reldyn = (elf32_rel *)(elf32_base + dyn[j].d_un.d_ptr);
                         break;
+                    case DT_PLTRELSZ:
+                        e->n_reldyn = dyn[j].d_un.d_val / sizeof(elf32_rel);
+                        break;
                 }
             }
             break;
         }
     }
 
-    if (e->e_hash == NULL || e->e_dynsym == NULL || e->e_dynstr == NULL || e->e_pltgot == NULL || e->e_reldyn == NULL)
-        panic("[MY-DL] Couldn't find .hash, .dynsym, .dynstr, .pltgot, or .rel.dyn section\n");
+    // Either hash table will do (ld --hash-style=sysv, gnu, or both).
+    if ((e->e_hash == NULL && e->e_gnu_hash == NULL) || e->e_dynsym == NULL || e->e_dynstr == NULL || e->e_pltgot == NULL || e->e_reldyn == NULL)
+        panic("[MY-DL] Couldn't find .hash/.gnu.hash, .dynsym, .dynstr, .pltgot, or .rel.dyn section\n");
     else
-        printk("[MY-DL] Found dynamic sections: .hash: %x, .dynsym: %x, .dynstr: %x, .got.plt: %x, .rel.dyn: %x\n",
-            e->e_hash, e->e_dynsym, e->e_dynstr, e->e_pltgot, e->e_reldyn);
+        printk("[MY-DL] Found dynamic sections: .hash: %x, .gnu.hash: %x, .dynsym: %x, .dynstr: %x, .got.plt: %x, .rel.dyn: %x\n",
+            e->e_hash, e->e_gnu_hash, e->e_dynsym, e->e_dynstr, e->e_pltgot, e->e_reldyn);
 }
 
 // Perform load-time relocation of all the symbols in the 
@@ -64,8 +81,9 @@ void get_dynamic_sections(my_elf32 *e) {
 // jump to the symbol table to find the symbol address, and fill in the appropriate entries)
 // This is needed because shared libraries are position-independent and thus do not know the
 // symbol addresses at runtime.
-void load_time_relocation(my_elf32 *e) {
+unsigned load_time_relocation(my_elf32 *e) {
     printk("[MY-DL] Performing load-time relocation of all the symbols in shared library\n");
+    unsigned nrel = 0;
 
     char *elf32_base = (char *)e->e_header;
     elf32_header *e_header = (elf32_header *)elf32_base;
@@ -86,6 +104,7 @@ void load_time_relocation(my_elf32 *e) {
 
                 if (rel_type == R_ARM_RELATIVE) { // we should add the base address to the entry
                     *(uint32_t *)entry_addr += (uint32_t)elf32_base;
+                    nrel++;
                 } else if (rel_type == R_ARM_GLOB_DAT || rel_type == R_ARM_JUMP_SLOT || rel_type == R_ARM_ABS32) { // we should resolve the symbol in .got section
                     elf32_sym symtab_entry = e->e_dynsym[symtab_idx];
 
@@ -94,6 +113,7 @@ void load_time_relocation(my_elf32 *e) {
                         // Originally resolved symbol (ex. NOT notmain)
                         symbol_addr += (uint32_t)elf32_base;
                     *(uint32_t *)entry_addr = symbol_addr;
+                    nrel++;
 
                     // Sanity check
                     // printk("[MY-DL] %d-%d: %s, resolved to %x\n", j, symtab_idx, e->e_dynstr + symtab_entry.st_name, symbol_addr);
@@ -103,34 +123,111 @@ void load_time_relocation(my_elf32 *e) {
             }
         }
     }
+    return nrel;
+}
+
+// The SysV ELF hash (DT_HASH), refer to 2-20.
+static uint32_t elf_hash(const char *name) {
+    uint32_t h = 0, g;
+    while (*name) {
+        h = (h << 4) + (uint8_t)*name++;
+        if ((g = h & 0xf0000000))
+            h ^= g >> 24;
+        h &= ~g;
+    }
+    return h;
+}
+
+// The GNU hash (DT_GNU_HASH): djb2.
+uint32_t gnu_hash(const char *name) {
+    uint32_t h = 5381;
+    while (*name)
+        h = h * 33 + (uint8_t)*name++;
+    return h;
+}
+
+static int sym_name_eq(my_elf32 *e, uint32_t i, const char *name) {
+    return strcmp(e->e_dynstr + e->e_dynsym[i].st_name, name) == 0;
+}
+
+// .hash: nbucket, nchain, bucket[nbucket], chain[nchain].  bucket[h % nbucket]
+// is the first symbol with that hash, chain[i] the next one after symbol i;
+// 0 (STN_UNDEF) ends the chain.
+static elf32_sym *sysv_hash_lookup(my_elf32 *e, const char *name) {
+    uint32_t nbuckets = e->e_hash[0];
+    uint32_t *buckets = &e->e_hash[2];
+    uint32_t *chains = &buckets[nbuckets];
+
+    for (uint32_t i = buckets[elf_hash(name) % nbuckets]; i; i = chains[i])
+        if (sym_name_eq(e, i, name))
+            return &e->e_dynsym[i];
+    return NULL;
+}
+
+// .gnu.hash: nbucket, symoffset, bloom_size, bloom_shift, bloom[bloom_size],
+// bucket[nbucket], chain[].  Only the symbols from <symoffset> on (the
+// defined ones) are hashed, sorted by bucket.  bucket[h % nbucket] is the
+// first symbol in the bucket and chain[i - symoffset] holds symbol i's hash
+// with the low bit set on the last one in the bucket.  The bloom filter (two
+// bits per symbol) rejects most misses before touching the buckets.
+static elf32_sym *gnu_hash_lookup(my_elf32 *e, const char *name) {
+    uint32_t nbuckets = e->e_gnu_hash[0];
+    uint32_t symoffset = e->e_gnu_hash[1];
+    uint32_t bloom_size = e->e_gnu_hash[2];
+    uint32_t bloom_shift = e->e_gnu_hash[3];
+    uint32_t *bloom = &e->e_gnu_hash[4];
+    uint32_t *buckets = &bloom[bloom_size];
+    uint32_t *chain = &buckets[nbuckets];
+
+    uint32_t h = gnu_hash(name);
+    uint32_t word = bloom[(h / 32) % bloom_size];
+    uint32_t mask = (1u << (h % 32)) | (1u << ((h >> bloom_shift) % 32));
+    if ((word & mask) != mask)
+        return NULL;
+
+    uint32_t i = buckets[h % nbuckets];
+    if (i < symoffset)
+        return NULL;
+    for (;; i++) {
+        uint32_t h2 = chain[i - symoffset];
+        if ((h | 1) == (h2 | 1) && sym_name_eq(e, i, name))
+            return &e->e_dynsym[i];
+        if (h2 & 1)
+            return NULL;
+    }
+}
+
+// Look at every symbol: only if there is no hash table.
+static elf32_sym *linear_lookup(my_elf32 *e, const char *name) {
+    for (uint32_t i = 1; i < e->n_dynsym; i++)
+        if (sym_name_eq(e, i, name))
+            return &e->e_dynsym[i];
+    return NULL;
+}
+
+elf32_sym *lookup_symbol(my_elf32 *e, const char *symbol_name) {
+    if (e->e_gnu_hash)
+        return gnu_hash_lookup(e, symbol_name);
+    if (e->e_hash)
+        return sysv_hash_lookup(e, symbol_name);
+    return linear_lookup(e, symbol_name);
 }
 
 // Given a symbol name and an elf file, find the address of the symbol in the
 // shared library loaded into memory.
-// A super fun extension: use the .hash section to find the symbol in O(1) time!
+// Uses the .gnu.hash or .hash section to find the symbol in O(1) time.
 uint32_t resolve_symbol(my_elf32 *e, char *symbol_name) {
     printk("[MY-DL] Resolving symbol <%s>...\n", symbol_name);
     char *elf32_base = (char *)e->e_header;
     uint32_t symbol_addr = 0;
-    
-    // # symbols from hash table
-    uint32_t nbuckets = e->e_hash[0];
-    uint32_t nchains = e->e_hash[1];
-    
-    // all symbols in the dynamic symbol table
-    for (int i = 0; i < nchains; i++) {
-        // symbol name
-        char *sym_name = e->e_dynstr + e->e_dynsym[i].st_name;
-        
-        // find symbol
-        if (strcmp(sym_name, symbol_name) == 0) {
-            // Found the symbol!
-            symbol_addr = e->e_dynsym[i].st_value;
-            if (e->e_dynsym[i].st_shndx != SHN_UNDEF) {
-                // add base addr
-                symbol_addr += (uint32_t)elf32_base;
-            }
-            break;
+
+    elf32_sym *sym = lookup_symbol(e, symbol_name);
+    if (sym) {
+        // Found the symbol!
+        symbol_addr = sym->st_value;
+        if (sym->st_shndx != SHN_UNDEF) {
+            // add base addr
+            symbol_addr += (uint32_t)elf32_base;
         }
     }
 
@@ -140,4 +237,4 @@ uint32_t resolve_symbol(my_elf32 *e, char *symbol_name) {
         printk("[MY-DL] Found symbol: %s at %x\n", symbol_name, symbol_addr);
 
     return symbol_addr;
-}
\ No newline at end of file
+}
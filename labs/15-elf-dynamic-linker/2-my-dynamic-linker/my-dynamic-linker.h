@@ -15,11 +15,19 @@ void get_dynamic_sections(my_elf32 *e);
 // jump to the symbol table to find the symbol address, and fill in the appropriate entries)
 // This is needed because shared libraries are position-independent and thus do not know the
 // symbol addresses at runtime.
-void load_time_relocation(my_elf32 *e);
+// Returns the number of entries relocated.
+unsigned load_time_relocation(my_elf32 *e);
+
+// Find the .dynsym entry for <symbol_name>, or NULL if there is none.
+// Uses .gnu.hash if the library has one, then .hash, and only scans every
+// symbol if it has neither.
+elf32_sym *lookup_symbol(my_elf32 *e, const char *symbol_name);
+
+// The .gnu.hash hash function (djb2): also handy for other symbol tables.
+uint32_t gnu_hash(const char *name);
 
 // Given a symbol name and an elf file, find the address of the symbol in the
-// shared library loaded into memory.
-// A super fun extension: use the .hash section to find the symbol in O(1) time!
+// shared library loaded into memory (via `lookup_symbol`).
 uint32_t resolve_symbol(my_elf32 *e, char *symbol_name);
 
 #endif
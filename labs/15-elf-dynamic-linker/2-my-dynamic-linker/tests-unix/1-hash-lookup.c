@@ -0,0 +1,159 @@
+// check <lookup_symbol> against a plain scan of .dynsym on real arm
+// shared libraries (see Makefile), through each table the library
+// has: .gnu.hash, .hash, and neither (the linear fallback).
+//   1. every defined symbol is found, and is the right entry.
+//   2. names that aren't there (near misses of real ones) are not.
+//   3. the hash tables are faster than the scan.
+#include <stdarg.h>
+#include "rpi.h"
+#include "my-dynamic-linker.h"
+
+int printk(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vprintf(fmt, args);
+    va_end(args);
+    return n;
+}
+
+enum { NREPEAT = 200 };
+
+// lay the file out the way the pi loader does: the raw file at <base>
+// with each PT_LOAD at base + p_vaddr (already true for ld with the
+// lab's memmap, but not for every linker).
+static char *load(const char *name) {
+    unsigned nbytes;
+    uint8_t *file = read_file(&nbytes, name);
+    elf32_header *h = (void *)file;
+    elf32_pheader *ph = (void *)(file + h->e_phoff);
+
+    unsigned end = nbytes;
+    for(unsigned i = 0; i < h->e_phnum; i++)
+        if(ph[i].p_type == 1 && ph[i].p_vaddr + ph[i].p_memsz > end)
+            end = ph[i].p_vaddr + ph[i].p_memsz;
+
+    char *base = calloc(1, end);
+    memcpy(base, file, nbytes);
+    for(unsigned i = 0; i < h->e_phnum; i++) {
+        if(ph[i].p_type != 1)
+            continue;
+        if(ph[i].p_vaddr + ph[i].p_memsz > h->e_shoff)
+            panic("%s: segment %d overlaps the section headers\n", name, i);
+        memcpy(base + ph[i].p_vaddr, file + ph[i].p_offset, ph[i].p_filesz);
+    }
+    free(file);
+    return base;
+}
+
+static const char *sym_name(my_elf32 *e, elf32_sym *s) {
+    return e->e_dynstr + s->st_name;
+}
+static int defined_p(my_elf32 *e, uint32_t i) {
+    return e->e_dynsym[i].st_shndx != SHN_UNDEF && e->e_dynsym[i].st_name;
+}
+
+// the answer <lookup_symbol> should give: first entry with the name.
+static elf32_sym *ref_lookup(my_elf32 *e, const char *name) {
+    for(uint32_t i = 1; i < e->n_dynsym; i++)
+        if(strcmp(sym_name(e, &e->e_dynsym[i]), name) == 0)
+            return &e->e_dynsym[i];
+    return NULL;
+}
+
+// check every lookup through the table(s) currently set in <e>;
+// returns the time for NREPEAT passes over the defined symbols.
+static unsigned check(my_elf32 *e, const char *how) {
+    unsigned ndefined = 0, nmiss = 0;
+    for(uint32_t i = 1; i < e->n_dynsym; i++) {
+        if(!defined_p(e, i))
+            continue;
+        ndefined++;
+        const char *name = sym_name(e, &e->e_dynsym[i]);
+        elf32_sym *s = lookup_symbol(e, name);
+        if(s != ref_lookup(e, name))
+            panic("%s: <%s>: found entry %d, expected %d\n", how, name,
+                s ? (int)(s - e->e_dynsym) : -1,
+                (int)(ref_lookup(e, name) - e->e_dynsym));
+
+        // near misses: a prefix, an extra char, a changed char.
+        char misses[3][256];
+        unsigned n = strlen(name);
+        assert(n + 2 < sizeof misses[0]);
+        strcpy(misses[0], name);
+        misses[0][n - 1] = 0;
+        strcpyf(misses[1], "%s_", name);
+        strcpy(misses[2], name);
+        misses[2][0] ^= 0x20;
+        for(unsigned k = 0; k < 3; k++) {
+            if(lookup_symbol(e, misses[k]) != ref_lookup(e, misses[k]))
+                panic("%s: wrong answer for <%s>\n", how, misses[k]);
+            nmiss += !ref_lookup(e, misses[k]);
+        }
+    }
+    assert(ndefined > 0);
+
+    time_usec_t start = time_get_usec();
+    unsigned nfound = 0;
+    for(unsigned r = 0; r < NREPEAT; r++)
+        for(uint32_t i = 1; i < e->n_dynsym; i++)
+            if(defined_p(e, i))
+                nfound += lookup_symbol(e, sym_name(e, &e->e_dynsym[i])) != 0;
+    unsigned usec = time_get_usec() - start;
+    assert(nfound == ndefined * NREPEAT);
+
+    output("\t%-9s: %d symbols, %d misses ok, %d usec for %d lookups\n",
+        how, ndefined, nmiss, usec, ndefined * NREPEAT);
+    return usec;
+}
+
+static void test_so(const char *file) {
+    output("%s:\n", file);
+    char *base = load(file);
+    my_elf32 e = { .e_header = (elf32_header *)base };
+    get_dynamic_sections(&e);
+
+    uint32_t *hash = e.e_hash, *gnu = e.e_gnu_hash;
+    assert(hash || gnu);
+
+    e.e_hash = e.e_gnu_hash = NULL;
+    unsigned linear = check(&e, "linear");
+    if(gnu) {
+        e.e_gnu_hash = gnu;
+        unsigned t = check(&e, ".gnu.hash");
+        if(t >= linear)
+            output("\t.gnu.hash not faster than a linear scan?\n");
+        e.e_gnu_hash = NULL;
+    }
+    if(hash) {
+        e.e_hash = hash;
+        unsigned t = check(&e, ".hash");
+        if(t >= linear)
+            output("\t.hash not faster than a linear scan?\n");
+    }
+
+    // and the address the loader would use.
+    e.e_hash = hash;
+    e.e_gnu_hash = gnu;
+    for(uint32_t i = 1; i < e.n_dynsym; i++) {
+        if(!defined_p(&e, i))
+            continue;
+        char *name = (char *)sym_name(&e, &e.e_dynsym[i]);
+        uint32_t addr = resolve_symbol(&e, name);
+        assert(addr == (uint32_t)base + e.e_dynsym[i].st_value);
+        break;
+    }
+    free(base);
+}
+
+int main(int argc, char *argv[]) {
+    if(argc > 1) {
+        for(int i = 1; i < argc; i++)
+            test_so(argv[i]);
+    } else {
+        test_so("objs/libpi-sysv.so");
+        test_so("objs/libpi-gnu.so");
+        test_so("objs/libpi-both.so");
+    }
+    output("SUCCESS\n");
+    return 0;
+}
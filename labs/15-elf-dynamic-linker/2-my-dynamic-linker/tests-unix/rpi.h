@@ -0,0 +1,12 @@
+#ifndef __RPI_H__
+#define __RPI_H__
+// host stand-in for libpi's rpi.h: just enough to run the symbol
+// lookup in ../my-dynamic-linker.c over a shared library read from a
+// file.
+#include <string.h>
+#include "libunix.h"
+
+// no format checking: the linker prints pointers with %x.
+int printk(const char *fmt, ...);
+
+#endif
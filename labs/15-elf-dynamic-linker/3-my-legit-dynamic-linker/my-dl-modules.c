@@ -0,0 +1,291 @@
+#include "rpi.h"
+#include "my-dl-modules.h"
+#include "cycle-count.h"
+
+#define DL_LIB_ALIGN 0x100000 // 1MB between libraries
+#define STB_WEAK 2
+
+static dl_module_t modules[DL_MAX_MODULES];
+static int n_modules = 0;
+
+// Global lookup cache: open addressing on the name's hash.  Power of 2 big
+// enough for every undefined symbol of every module we expect to load.
+#define DL_CACHE_SIZE 512
+typedef struct {
+    const char *name; // points into the .dynstr of the module that asked
+    uint32_t hash;
+    uint32_t addr;
+} dl_cache_ent_t;
+static dl_cache_ent_t cache[DL_CACHE_SIZE];
+static unsigned n_cached = 0;
+
+static dl_stats_t stats;
+
+static int bind_now_p = 0;
+
+// Per-PLT-entry counters of the executable.
+#define DL_MAX_PLT 256
+static dl_plt_stat_t plt_stats[DL_MAX_PLT];
+static unsigned n_plt = 0, n_plt_bound = 0;
+static uint32_t reloc_done; // cycle count when `dl_relocate` last finished
+
+int dl_nmodules(void) {
+    return n_modules;
+}
+
+dl_module_t *dl_module(int i) {
+    assert(i >= 0 && i < n_modules);
+    return &modules[i];
+}
+
+dl_stats_t dl_stats(void) {
+    return stats;
+}
+
+void dl_bind_now(int on_p) {
+    bind_now_p = on_p;
+}
+
+unsigned dl_plt_nstat(void) {
+    return n_plt;
+}
+
+dl_plt_stat_t *dl_plt_stat(uint32_t i) {
+    assert(i < n_plt);
+    return &plt_stats[i];
+}
+
+void dl_plt_bound(uint32_t i, uint32_t addr, uint32_t start, int eager_p) {
+    uint32_t now = cycle_cnt_read();
+    if (i >= n_plt)
+        panic("[MY-DL] PLT entry %d out of range (%d entries)\n", i, n_plt);
+    dl_plt_stat_t *s = &plt_stats[i];
+    s->addr = addr;
+    s->eager_p = eager_p;
+    s->first_call = eager_p ? 0 : start - reloc_done;
+    s->resolve_cycles = now - start;
+    s->nbound_before = n_plt_bound++;
+}
+
+void dl_plt_dump(void) {
+    printk("[MY-DL] PLT of <%s>: %d entries, %d bound\n", modules[0].name, n_plt, n_plt_bound);
+    for (unsigned i = 0; i < n_plt; i++) {
+        dl_plt_stat_t *s = &plt_stats[i];
+        if (!s->addr)
+            printk("[MY-DL]   %d <%s>: not called\n", i, s->name);
+        else if (s->eager_p)
+            printk("[MY-DL]   %d <%s> = %x: bound at load (#%d) in %d cycles\n",
+                i, s->name, s->addr, s->nbound_before, s->resolve_cycles);
+        else
+            printk("[MY-DL]   %d <%s> = %x: first call %d cycles after load, "
+                "%d entries bound before it, %d cycles to bind\n",
+                i, s->name, s->addr, s->first_call, s->nbound_before, s->resolve_cycles);
+    }
+}
+
+// The file a DT_NEEDED entry refers to: its last path component, upper-cased
+// ("../0-my-libpi/libpi.so" is LIBPI.SO).
+static void needed_to_filename(char *dst, const char *needed) {
+    const char *p = needed;
+    for (const char *s = needed; *s; s++)
+        if (*s == '/')
+            p = s + 1;
+    if (strlen(p) >= DL_NAME_MAX)
+        panic("[MY-DL] Library name too long: <%s>\n", needed);
+    for (; *p; p++)
+        *dst++ = (*p >= 'a' && *p <= 'z') ? *p - 'a' + 'A' : *p;
+    *dst = 0;
+}
+
+static dl_module_t *find_module(const char *name) {
+    for (int i = 0; i < n_modules; i++)
+        if (strcmp(modules[i].name, name) == 0)
+            return &modules[i];
+    return NULL;
+}
+
+// Load <name> at <base> and fill in its module.
+static dl_module_t *add_module(const char *name, char *base, dl_load_fn load) {
+    if (n_modules == DL_MAX_MODULES)
+        panic("[MY-DL] Too many modules (max %d) loading <%s>\n", DL_MAX_MODULES, name);
+    dl_module_t *m = &modules[n_modules++];
+    memset(m, 0, sizeof *m);
+    strcpy(m->name, name);
+    m->base = base;
+
+    load(m->name, base);
+    m->e.e_header = (elf32_header *)base;
+    m->e.e_sheaders = (elf32_sheader *)(base + m->e.e_header->e_shoff);
+    m->e.e_pheaders = (elf32_pheader *)(base + m->e.e_header->e_phoff);
+    get_dynamic_sections(&m->e);
+
+    // Where the next library can go: past the segments and the headers.
+    elf32_header *h = m->e.e_header;
+    uint32_t end = h->e_shoff + h->e_shnum * h->e_shentsize;
+    for (int i = 0; i < h->e_phnum; i++) {
+        elf32_pheader *ph = &m->e.e_pheaders[i];
+        if (ph->p_type == PT_LOAD && ph->p_vaddr + ph->p_memsz > end)
+            end = ph->p_vaddr + ph->p_memsz;
+    }
+    m->end = base + end;
+
+    for (int i = 0; i < m->e.n_dynamics; i++) {
+        elf32_dynamic *d = &m->e.e_dynamics[i];
+        if (d->d_tag == DT_BIND_NOW
+        || (d->d_tag == DT_FLAGS && (d->d_un.d_val & DF_BIND_NOW))
+        || (d->d_tag == DT_FLAGS_1 && (d->d_un.d_val & DF_1_NOW)))
+            m->bind_now = 1;
+    }
+
+    printk("[MY-DL] Module %d: <%s> at %x - %x\n", n_modules - 1, m->name, m->base, m->end);
+    return m;
+}
+
+int dl_load_all(char *exec_name, char *exec_base, char *lib_base, dl_load_fn load) {
+    n_modules = 0;
+    n_cached = 0;
+    memset(cache, 0, sizeof cache);
+    memset(&stats, 0, sizeof stats);
+    memset(plt_stats, 0, sizeof plt_stats);
+    n_plt_bound = 0;
+
+    if (strlen(exec_name) >= DL_NAME_MAX)
+        panic("[MY-DL] Executable name too long: <%s>\n", exec_name);
+    my_elf32 *exec = &add_module(exec_name, exec_base, load)->e;
+
+    n_plt = exec->n_reldyn;
+    if (n_plt > DL_MAX_PLT)
+        panic("[MY-DL] <%s>: %d PLT entries (max %d)\n", exec_name, n_plt, DL_MAX_PLT);
+    for (unsigned i = 0; i < n_plt; i++)
+        plt_stats[i].name = exec->e_dynstr + exec->e_dynsym[exec->e_reldyn[i].r_info >> 8].st_name;
+
+    // Breadth first: modules[] is the queue.
+    char *next_base = lib_base;
+    for (int i = 0; i < n_modules; i++) {
+        my_elf32 *e = &modules[i].e;
+        for (int j = 0; j < e->n_dynamics; j++) {
+            if (e->e_dynamics[j].d_tag != DT_NEEDED)
+                continue;
+
+            char name[DL_NAME_MAX];
+            needed_to_filename(name, e->e_dynstr + e->e_dynamics[j].d_un.d_val);
+            if (find_module(name))
+                continue;
+
+            dl_module_t *m = add_module(name, next_base, load);
+            uint32_t end = (uint32_t)m->end;
+            next_base = (char *)((end + DL_LIB_ALIGN - 1) & ~(DL_LIB_ALIGN - 1));
+        }
+    }
+    return n_modules;
+}
+
+static uint32_t sym_addr(dl_module_t *m, elf32_sym *sym) {
+    if (sym->st_shndx == SHN_ABS)
+        return sym->st_value;
+    return (uint32_t)m->base + sym->st_value;
+}
+
+uint32_t dl_lookup(const char *name) {
+    stats.nlookup++;
+    uint32_t h = gnu_hash(name);
+    unsigned i = h & (DL_CACHE_SIZE - 1);
+    for (; cache[i].name; i = (i + 1) & (DL_CACHE_SIZE - 1)) {
+        if (cache[i].hash == h && strcmp(cache[i].name, name) == 0) {
+            stats.nhit++;
+            return cache[i].addr;
+        }
+    }
+
+    // First definition in load order.
+    for (int k = 0; k < n_modules; k++) {
+        stats.nsearch++;
+        elf32_sym *sym = lookup_symbol(&modules[k].e, name);
+        if (!sym || sym->st_shndx == SHN_UNDEF)
+            continue;
+
+        uint32_t addr = sym_addr(&modules[k], sym);
+        // Keep one slot free so probing always ends.
+        if (n_cached < DL_CACHE_SIZE - 1) {
+            cache[i] = (dl_cache_ent_t){ .name = name, .hash = h, .addr = addr };
+            n_cached++;
+        }
+        return addr;
+    }
+    return 0;
+}
+
+// The value of symbol <idx> of <m>'s .dynsym for relocation.
+static uint32_t resolve(dl_module_t *m, uint32_t idx) {
+    if (idx == 0)
+        return 0;
+    elf32_sym *sym = &m->e.e_dynsym[idx];
+    char *name = m->e.e_dynstr + sym->st_name;
+    uint32_t addr = dl_lookup(name);
+    if (!addr && (sym->st_info >> 4) != STB_WEAK)
+        panic("[MY-DL] <%s>: undefined symbol <%s>\n", m->name, name);
+    return addr;
+}
+
+unsigned dl_relocate(dl_module_t *m) {
+    char *base = m->base;
+    elf32_header *e_header = m->e.e_header;
+    elf32_sheader *e_sheaders = m->e.e_sheaders;
+    int exec_p = (m == &modules[0]);
+    int lazy_p = exec_p && !m->bind_now && !bind_now_p;
+    unsigned nrel = 0;
+
+    for (int i = 0; i < e_header->e_shnum; i++) {
+        if (e_sheaders[i].sh_type != SHT_REL)
+            continue;
+        elf32_rel *rels = (elf32_rel *)(base + e_sheaders[i].sh_offset);
+        uint32_t n = e_sheaders[i].sh_size / sizeof *rels;
+
+        for (uint32_t j = 0; j < n; j++) {
+            uint32_t *where = (uint32_t *)(base + rels[j].r_offset);
+            uint32_t type = rels[j].r_info & 0xff;
+            uint32_t idx = rels[j].r_info >> 8;
+
+            switch (type) {
+                case R_ARM_RELATIVE:
+                    *where += (uint32_t)base;
+                    break;
+                case R_ARM_JUMP_SLOT:
+                    // The executable's PLT resolves these on first call.
+                    if (lazy_p)
+                        continue;
+                    if (exec_p) {
+                        uint32_t start = cycle_cnt_read();
+                        *where = resolve(m, idx);
+                        dl_plt_bound(&rels[j] - m->e.e_reldyn, *where, start, 1);
+                    } else
+                        *where = resolve(m, idx);
+                    break;
+                case R_ARM_GLOB_DAT:
+                    *where = resolve(m, idx);
+                    break;
+                case R_ARM_ABS32: // the addend is the word itself
+                    *where += resolve(m, idx);
+                    break;
+                default:
+                    printk("[MY-DL] <%s>: unknown relocation type: %d\n", m->name, type);
+                    continue;
+            }
+            nrel++;
+        }
+    }
+    m->nrel = nrel;
+    dl_relocate_done();
+    return nrel;
+}
+
+void dl_relocate_done(void) {
+    reloc_done = cycle_cnt_read();
+}
+
+unsigned dl_relocate_all(void) {
+    unsigned n = 0;
+    for (int i = 0; i < n_modules; i++)
+        n += dl_relocate(&modules[i]);
+    return n;
+}
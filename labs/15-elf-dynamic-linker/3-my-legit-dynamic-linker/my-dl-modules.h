@@ -0,0 +1,92 @@
+#ifndef __MY_DL_MODULES_H__
+#define __MY_DL_MODULES_H__
+
+#include "rpi.h"
+#include "my-dynamic-linker.h"
+
+// More than one shared library: the executable lists the libraries it needs
+// in the DT_NEEDED entries of its .dynamic section, and so does each library.
+// We load that graph breadth first (the executable, then what it needs, then
+// what those need, ...), each module once, and keep the modules in that
+// order.  A symbol resolves to its first definition in that order, so the
+// executable or an earlier library can interpose on a later library's
+// definition (the same rule as the real ld.so).
+
+enum { DL_MAX_MODULES = 16, DL_NAME_MAX = 32 };
+
+typedef struct {
+    char name[DL_NAME_MAX]; // the file it was loaded from
+    char *base;             // where it was loaded
+    char *end;              // first address past its image (segments and headers)
+    my_elf32 e;
+    unsigned nrel;          // entries relocated by `dl_relocate`
+    int bind_now;           // linked with -z now (DT_BIND_NOW or DF_BIND_NOW/DF_1_NOW)
+} dl_module_t;
+
+// Put ELF file <name> in memory at <base> (`load_elf` on the pi).
+typedef void (*dl_load_fn)(char *name, char *base);
+
+// Load <exec_name> at <exec_base>, then every library it needs directly or
+// indirectly: the first one at <lib_base>, each next one at the first 1MB
+// boundary past the one before.  A DT_NEEDED entry names the file by its
+// last path component, upper-cased (the FAT32 8.3 name: "libpi.so" is
+// LIBPI.SO).  Returns the number of modules; the executable is module 0.
+int dl_load_all(char *exec_name, char *exec_base, char *lib_base, dl_load_fn load);
+
+int dl_nmodules(void);
+dl_module_t *dl_module(int i);
+
+// Address of the first definition of <name> in load order, or 0 if no module
+// defines it.  Every module shares one cache of the names looked up so far,
+// so e.g. `printk` is found once no matter how many libraries call it.
+uint32_t dl_lookup(const char *name);
+
+// Relocate module <m> (all of its SHT_REL sections) against the modules
+// loaded.  The executable's R_ARM_JUMP_SLOT entries are left for lazy binding
+// (`dynamic_linker_entry_c`) unless it was linked with -z now or
+// `dl_bind_now` is on.  Returns the number of entries relocated.
+unsigned dl_relocate(dl_module_t *m);
+
+// Bind every PLT entry at load time (like LD_BIND_NOW=1): a slower start,
+// but no first-call stalls later on.  Call before `dl_relocate`.
+void dl_bind_now(int on_p);
+
+// `dl_relocate` every module.  Returns the total.
+unsigned dl_relocate_all(void);
+
+// Relocation is finished some other way (a prelink cache): lazy binds
+// count their first call from now, as they would after `dl_relocate`.
+void dl_relocate_done(void);
+
+typedef struct {
+    unsigned nlookup;  // calls to `dl_lookup`
+    unsigned nhit;     // answered from the cache
+    unsigned nsearch;  // modules searched on a miss
+} dl_stats_t;
+
+dl_stats_t dl_stats(void);
+
+// One per PLT entry of the executable (its .rel.plt, in order).  Cycles are
+// cycle_cnt_read() values, which wrap after a few seconds.
+typedef struct {
+    const char *name;
+    uint32_t addr;           // what it got bound to, 0 if not yet
+    int eager_p;             // bound by `dl_relocate`, not on a first call
+    uint32_t first_call;     // cycles from the end of relocation to the first call
+    uint32_t resolve_cycles; // cycles spent binding it
+    unsigned nbound_before;  // PLT entries bound before this one
+} dl_plt_stat_t;
+
+// Record that the executable's PLT entry <i> got bound to <addr>; binding
+// started at cycle <start>.  `dl_relocate` and `dynamic_linker_entry_c`
+// call this.
+void dl_plt_bound(uint32_t i, uint32_t addr, uint32_t start, int eager_p);
+
+// Number of PLT entries of the executable, and entry <i>'s counters.
+unsigned dl_plt_nstat(void);
+dl_plt_stat_t *dl_plt_stat(uint32_t i);
+
+// printk a line per PLT entry.
+void dl_plt_dump(void);
+
+#endif
@@ -1,9 +1,10 @@
 #include "rpi.h"
 #include "my-legit-dynamic-linker.h"
+#include "my-dl-modules.h"
+#include "cycle-count.h"
 
 // From notmain.c
 extern my_elf32 exec_e;
-extern my_elf32 libpi_e;
 
 // Resolve all undefined symbols in the .dynsym section of the given ELF32 file at load-time.
 // This is needed because some symbols in a dynamic library might exist in our main executable (e.g., `notmain`)
@@ -11,7 +12,7 @@ void load_time_resolve(my_elf32 *exec_e, my_elf32 *dyn_e) {
     printk("[MY-DL] Resolving undefined symbols in shared library...\n");
 
     // Best-effort attempt to resolve undefined symbols in the .dynsym section
-    uint32_t n_symbols = dyn_e->e_hash[1]; // this is equivalent to the number of symbols in .dynsym
+    uint32_t n_symbols = dyn_e->n_dynsym;
     for (int i = 0; i < n_symbols; i++) {
         if (dyn_e->e_dynsym[i].st_shndx == SHN_UNDEF && dyn_e->e_dynsym[i].st_name) { // symbol is undefined
             char *symbol_name = dyn_e->e_dynstr + dyn_e->e_dynsym[i].st_name;
@@ -28,6 +29,8 @@ void load_time_resolve(my_elf32 *exec_e, my_elf32 *dyn_e) {
 // Performs dynamic linking and resolves the symbol, saves its address in gotplt_entry
 // Returns the address of the resolved symbol
 uint32_t dynamic_linker_entry_c(uint32_t *gotplt, uint32_t *gotplt_entry) {
+    uint32_t start = cycle_cnt_read();
+
     // Calculate the index of the unresolved symbol in .got.plt
     // gotplt_entry points to GOT[i+3], and gotplt points to GOT[2]
     // So the index is (gotplt_entry - gotplt - 3)
@@ -40,12 +43,15 @@ uint32_t dynamic_linker_entry_c(uint32_t *gotplt, uint32_t *gotplt_entry) {
 
     // Get the symbol name from .dynstr section
     char *symbol_name = exec_e.e_dynstr + exec_e.e_dynsym[symtab_idx].st_name;
-    printk("[MY-DL] Dynamic linker: Unresolved symbol encountered: <%s>. Dynamic linker invoked.\n", symbol_name);
 
-    // Resolve the symbol and fill in the got table entry
-    uint32_t symbol_addr = resolve_symbol(&libpi_e, symbol_name);
+    // Resolve the symbol (first definition among the loaded modules) and fill in the got table entry
+    uint32_t symbol_addr = dl_lookup(symbol_name);
+    if (!symbol_addr)
+        panic("[MY-DL] Couldn't find symbol: %s\n", symbol_name);
     *gotplt_entry = symbol_addr;
-    printk("[MY-DL] Dynamic linker: Resolved symbol %s to %x\n", symbol_name, symbol_addr);
+
+    // No printing here: it would be most of the stall.  See `dl_plt_dump`.
+    dl_plt_bound(symbol_index, symbol_addr, start, 0);
 
     return symbol_addr; // the rest should be handled by asm
 }
@@ -1,5 +1,9 @@
 #include "rpi.h"
 #include "my-legit-dynamic-linker.h"
+#include "my-fat32-driver.h"
+#include "my-dl-modules.h"
+#include "prelink.h"
+#include "cycle-count.h"
 #include <stdint.h>
 
 // Change this to the filename of the dynamically linked ELF file you want to load
@@ -7,45 +11,83 @@ static char *exec_filename = "0-DYN.ELF";
 static char *exec_base = (char *)0x0;
 my_elf32 exec_e;
 
+// The executable's DT_NEEDED entries (and theirs) say which libraries to load:
+// libpi.so, as LIBPI.SO, goes first, at libpi_base; any others after it.
 static char *libpi_filename = "LIBPI.SO";
 static char *libpi_base = (char *)0x10000000; // 0x1000'0000 (256MB)
 my_elf32 libpi_e;
 
+// Relocation cache for the two files above at these bases, made on the host
+// by prelink/mk-prelink (see prelink.h).  If it's missing or stale we
+// relocate the slow way.
+static char *prelink_filename = "LIBPI.PRE";
+
+// 1 = bind every PLT entry of the executable before jumping to it, instead of
+// on its first call (an executable linked with -z now does this anyway).
+static int bind_now = 0;
+
+// Read the cache into the heap.  Returns NULL if there isn't one.
+static void *prelink_read(unsigned *nbytes) {
+    fat32_file_t f;
+    if (!my_fat32_open(prelink_filename, &f))
+        return NULL;
+    void *cache = kmalloc(f.nbytes);
+    *nbytes = fat32_fread(&f, cache, f.nbytes);
+    fat32_close(&f);
+    return cache;
+}
+
+// Load an ELF file and verify its header (part 1).  load_elf also zeroes the .bss.
+static void load_and_verify(char *name, char *base) {
+    load_elf(name, base);
+    verify_elf((elf32_header *)base);
+}
+
 void notmain() {
 
     // Extension: all of the below can be done on the pi-side bootloader
 
-    // Load main executable and libpi.so into memory (part 1)
-    load_elf(exec_filename, exec_base);
-    load_elf(libpi_filename, libpi_base);
-
-    // Verify the ELF headers (part 1)
-    elf32_header *exec_e_header = (elf32_header *)exec_base;
-    elf32_header *libpi_e_header = (elf32_header *)libpi_base;
-    verify_elf(exec_e_header);
-    verify_elf(libpi_e_header);
-
-    // Zero-initialize the .bss sections (part 1)
-    bss_zero_init(exec_e_header);
-    bss_zero_init(libpi_e_header);
-
-    // Locate dynamic sections (part 2)
-    exec_e.e_header = exec_e_header;
-    exec_e.e_sheaders = (elf32_sheader *)(exec_base + exec_e_header->e_shoff);
-    exec_e.e_pheaders = (elf32_pheader *)(exec_base + exec_e_header->e_phoff);
-    libpi_e.e_header = libpi_e_header;
-    libpi_e.e_sheaders = (elf32_sheader *)(libpi_base + libpi_e_header->e_shoff);
-    libpi_e.e_pheaders = (elf32_pheader *)(libpi_base + libpi_e_header->e_phoff);
-    get_dynamic_sections(&exec_e);
-    get_dynamic_sections(&libpi_e);
-
-    // (Already done for you) Resolve all undefined symbols in the .dynsym section of the 
-    // libpi.so. This is needed because some symbols in libpi.so exist in our main executable (e.g., `notmain`),
-    // so it must be resolved at load-time.
-    load_time_resolve(&exec_e, &libpi_e);
-
-    // Perform load-time relocation for position-independent code (part 2)
-    load_time_relocation(&libpi_e);
+    // Load the executable, libpi.so (its DT_NEEDED), and whatever else they need,
+    // breadth first (part 1), and locate the dynamic sections of each (part 2).
+    int n_modules = dl_load_all(exec_filename, exec_base, libpi_base, load_and_verify);
+    exec_e = dl_module(0)->e;
+
+    // Fast path: a relocation cache made for exactly these files (only for the
+    // executable + libpi.so).  Reading it off the sd card isn't counted, just
+    // like reading the ELFs.  The cache leaves the PLT lazy.
+    unsigned nbytes = 0;
+    void *cache = NULL;
+    int lazy_p = !bind_now && !dl_module(0)->bind_now;
+    if (n_modules == 2 && strcmp(dl_module(1)->name, libpi_filename) == 0 && lazy_p) {
+        libpi_e = dl_module(1)->e;
+        cache = prelink_read(&nbytes);
+    }
+
+    cycle_cnt_init();
+    dl_bind_now(bind_now);
+    uint32_t s = cycle_cnt_read();
+    int nrel = cache ? prelink_apply(cache, nbytes, &exec_e, &libpi_e) : -1;
+    uint32_t t = cycle_cnt_read() - s;
+    if (nrel >= 0) {
+        dl_relocate_done();
+        printk("[MY-DL] Prelinked: stored %d relocations in %d cycles\n", nrel, t);
+    } else {
+        // Relocate each module against all of them (part 2).  Every module pays
+        // only for its own relocation entries; symbols are looked up once.
+        nrel = 0;
+        for (int i = 0; i < n_modules; i++) {
+            dl_module_t *m = dl_module(i);
+            s = cycle_cnt_read();
+            nrel += dl_relocate(m);
+            t = cycle_cnt_read() - s;
+            printk("[MY-DL] Relocated <%s>: %d relocations in %d cycles\n", m->name, m->nrel, t);
+        }
+        dl_stats_t st = dl_stats();
+        printk("[MY-DL] %d modules, %d relocations, %d symbol lookups (%d cached)\n",
+            n_modules, nrel, st.nlookup, st.nhit);
+        // Lazy entries show up as not called yet.
+        dl_plt_dump();
+    }
 
     // The only step needed for true runtime dynamic linking: fill in .got.plt[2] with the 
     //  address of the dynamic linker entry function.
@@ -53,5 +95,5 @@ void notmain() {
     exec_e.e_pltgot[2] = (uint32_t)dynamic_linker_entry_asm;
 
     // Jump to the entry point of the ELF file. The dynamic linking will automatically happen!
-    jump_to_elf_entry(exec_e_header);
+    jump_to_elf_entry(exec_e.e_header);
 }
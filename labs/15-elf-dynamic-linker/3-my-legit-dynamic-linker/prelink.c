@@ -0,0 +1,66 @@
+// Relocation cache: see prelink.h.  Also built into the host tool
+// (prelink/mk-prelink.c) so both sides compute the same checksum.
+#include "prelink.h"
+
+// rotate-and-xor over 32-bit words: one instruction per word on the pi
+// (eor with a rotated operand).  not a strong hash, but a rebuilt file
+// changes far more than the two words it takes to fool it.
+static uint32_t sum_words(uint32_t h, const uint32_t *p, uint32_t nwords) {
+    for (uint32_t i = 0; i < nwords; i++)
+        h = ((h << 5) | (h >> 27)) ^ p[i];
+    return h;
+}
+
+uint32_t prelink_sum(elf32_header *e_header) {
+    char *elf32_base = (char *)e_header;
+    elf32_sheader *e_sheaders = (elf32_sheader *)(elf32_base + e_header->e_shoff);
+    uint32_t h = 0;
+
+    for (int i = 0; i < e_header->e_shnum; i++) {
+        elf32_sheader *s = &e_sheaders[i];
+        if (s->sh_type == SHT_DYNSYM) {
+            h = sum_words(h, (uint32_t *)(elf32_base + s->sh_offset), s->sh_size / 4);
+        } else if (s->sh_type == SHT_REL) {
+            elf32_rel *rels = (elf32_rel *)(elf32_base + s->sh_offset);
+            uint32_t n = s->sh_size / sizeof *rels;
+            h = sum_words(h, (uint32_t *)rels, n * 2);
+            for (uint32_t j = 0; j < n; j++)
+                h = sum_words(h, (uint32_t *)(elf32_base + rels[j].r_offset), 1);
+        }
+    }
+    return h;
+}
+
+int prelink_apply(const void *cache, unsigned nbytes, my_elf32 *exec_e, my_elf32 *lib_e) {
+    const prelink_hdr_t *h = cache;
+
+    if (nbytes < sizeof *h || h->magic != PRELINK_MAGIC || h->version != PRELINK_VERSION) {
+        printk("[MY-DL] Prelink: not a relocation cache\n");
+        return -1;
+    }
+    if (nbytes != sizeof *h + h->nrel * sizeof(prelink_rel_t) || h->nexec > h->nrel) {
+        printk("[MY-DL] Prelink: truncated cache (%d bytes, expected %d)\n",
+            nbytes, sizeof *h + h->nrel * sizeof(prelink_rel_t));
+        return -1;
+    }
+    if (h->exec_base != (uint32_t)exec_e->e_header || h->lib_base != (uint32_t)lib_e->e_header) {
+        printk("[MY-DL] Prelink: made for exec at %x, lib at %x; loaded at %x, %x\n",
+            h->exec_base, h->lib_base, exec_e->e_header, lib_e->e_header);
+        return -1;
+    }
+    if (h->exec_sum != prelink_sum(exec_e->e_header) || h->lib_sum != prelink_sum(lib_e->e_header)) {
+        printk("[MY-DL] Prelink: stale cache (the executable or library changed)\n");
+        return -1;
+    }
+
+    // The executable's words always get stored; the library's only if its
+    // file wasn't written already relocated.
+    char *exec_base = (char *)exec_e->e_header, *lib_base = (char *)lib_e->e_header;
+    const prelink_rel_t *rels = (const prelink_rel_t *)(h + 1);
+    uint32_t n = h->applied_p ? h->nexec : h->nrel;
+    for (uint32_t i = 0; i < n; i++) {
+        char *base = i < h->nexec ? exec_base : lib_base;
+        *(uint32_t *)(base + rels[i].offset) = rels[i].value;
+    }
+    return n;
+}
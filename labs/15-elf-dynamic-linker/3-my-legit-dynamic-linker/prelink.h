@@ -0,0 +1,51 @@
+#ifndef __PRELINK_H__
+#define __PRELINK_H__
+
+#include "rpi.h"
+#include "my-elf-loader.h"
+
+// Prelinking: `dl_relocate` redoes the same work on every boot (walk every
+// relocation, look up every undefined symbol by name) even though the
+// executable, the library, and where they get loaded almost never change.
+// The host tool (prelink/mk-prelink.c) does that work once at a fixed load
+// base and writes out a relocation cache: just the words to store into the
+// loaded executable and library.  At boot, if the cache matches what got
+// loaded, we store the words (or only the executable's, if the tool already
+// wrote the library's into the library file) instead of relocating.
+//
+// Only for an executable + one library, with the executable's PLT left lazy:
+// everything else goes through `dl_relocate`.
+//
+// The cache file is a prelink_hdr_t followed by <nrel> prelink_rel_t's: the
+// first <nexec> are for the executable, the rest for the library.
+
+#define PRELINK_MAGIC 0x4b4c5250 // "PRLK"
+#define PRELINK_VERSION 2
+
+typedef struct {
+    uint32_t magic, version;
+    uint32_t exec_base, lib_base;   // where the tool assumed they get loaded
+    uint32_t exec_sum, lib_sum;     // `prelink_sum` of each, as loaded
+    uint32_t applied_p;             // the library's values are already in its file
+    uint32_t nexec;                 // how many of the <nrel> are the executable's
+    uint32_t nrel;                  // number of prelink_rel_t's that follow
+} prelink_hdr_t;
+
+// Store <value> at <offset> into the executable or library.
+typedef struct {
+    uint32_t offset, value;
+} prelink_rel_t;
+
+// Checksum of everything relocation depends on: .dynsym (symbol values, and
+// which names they have), the relocation tables, and the words they relocate
+// (which hold the addends).
+// Only needs the section headers, so it can run before `get_dynamic_sections`.
+uint32_t prelink_sum(elf32_header *e_header);
+
+// If <cache> (<nbytes> long) was made for <exec_e> and <lib_e> at the
+// addresses they are loaded at, relocate both from it and return the
+// number of words stored.  Returns -1 (and changes nothing) if it doesn't
+// match: `dl_relocate` each module instead.
+int prelink_apply(const void *cache, unsigned nbytes, my_elf32 *exec_e, my_elf32 *lib_e);
+
+#endif
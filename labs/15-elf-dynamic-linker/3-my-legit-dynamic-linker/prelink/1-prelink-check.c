@@ -0,0 +1,149 @@
+// check the relocation cache against the slow path, on the host:
+//   1. dl_load_all + dl_relocate of every module, as ../notmain.c does
+//      without a cache (PLT left lazy).
+//   2. a fresh load + prelink_apply of the cache from prelink_mk: the
+//      executable and library images must match (1) word for word.
+//   3. the same with the library file already relocated (mk-prelink's
+//      <out.so>): prelink_apply only stores the executable's words, and
+//      the images still match.
+//   4. a cache for a changed executable, or for other bases, is refused
+//      and leaves both alone.
+// the files must be linked with file offset == address (like the lab's
+// memmaps):
+//   1-prelink-check [<exec.elf> <lib.so>]
+#include "prelink-host.h"
+#include "my-dl-modules.h"
+
+my_elf32 exec_e, libpi_e;
+
+// the pi loads the executable at 0, which we can't map: the relocation
+// only cares that both bases are fixed.
+enum { LIB_BASE = 0x10000000, EXEC_BASE = 0x20000000, NREPEAT = 20 };
+
+static const char *exec_name = "../../0-my-dynamic-tests/0-dyn.elf";
+static const char *lib_name = "../../0-my-libpi/libpi.so";
+static unsigned exec_nbytes, lib_nbytes;
+
+// the <dl_load_fn>: dl_load_all names the library after its DT_NEEDED
+// entry, so anything but the executable is <lib_name>.
+static void load_fn(char *name, char *base) {
+    my_elf32 e;
+    if(strcmp(name, "EXEC") == 0)
+        exec_nbytes = elf_load(&e, exec_name, (uint32_t)base);
+    else
+        lib_nbytes = elf_load(&e, lib_name, (uint32_t)base);
+}
+
+static void load(void) {
+    int n = dl_load_all("EXEC", (char *)EXEC_BASE, (char *)LIB_BASE, load_fn);
+    if(n != 2)
+        panic("<%s> loads %d modules: the cache is for an executable + one library\n",
+            exec_name, n);
+    exec_e = dl_module(0)->e;
+    libpi_e = dl_module(1)->e;
+}
+
+static void check_words(const uint8_t *p, const uint8_t *ref, unsigned nbytes,
+                        const char *how, const char *name) {
+    for(uint32_t off = 0; off + 4 <= nbytes; off += 4)
+        if(memcmp(p + off, ref + off, 4) != 0)
+            panic("%s: %s word at offset %x is %x, slow path stored %x\n", how, name,
+                off, *(uint32_t *)(p + off), *(uint32_t *)(ref + off));
+}
+
+static uint8_t *exec_ref, *lib_ref;
+
+static void check_image(const char *how) {
+    check_words((void *)exec_e.e_header, exec_ref, exec_nbytes, how, "executable");
+    check_words((void *)libpi_e.e_header, lib_ref, lib_nbytes, how, "library");
+}
+
+static void *copy(const void *p, unsigned nbytes) {
+    uint8_t *c = malloc(nbytes);
+    memcpy(c, p, nbytes);
+    return c;
+}
+
+int main(int argc, char *argv[]) {
+    if(argc == 3) {
+        exec_name = argv[1];
+        lib_name = argv[2];
+    } else if(argc != 1)
+        panic("usage: %s [<exec.elf> <lib.so>]\n", argv[0]);
+    printk_on(0);
+
+    // 1. the slow path.
+    unsigned slow_usec = 0, nrel = 0;
+    dl_bind_now(0);
+    for(unsigned i = 0; i < NREPEAT; i++) {
+        load();
+        time_usec_t s = time_get_usec();
+        nrel = dl_relocate_all();
+        slow_usec += time_get_usec() - s;
+    }
+    exec_ref = copy(exec_e.e_header, exec_nbytes);
+    lib_ref = copy(libpi_e.e_header, lib_nbytes);
+
+    // 2. the cache, made for the unrelocated files.
+    unsigned fast_usec = 0, nbytes = 0;
+    prelink_hdr_t *h = 0;
+    for(unsigned i = 0; i < NREPEAT; i++) {
+        load();
+        if(!h)
+            h = prelink_mk(&exec_e, EXEC_BASE, &libpi_e, LIB_BASE, &nbytes);
+        time_usec_t s = time_get_usec();
+        int n = prelink_apply(h, nbytes, &exec_e, &libpi_e);
+        fast_usec += time_get_usec() - s;
+        if(n != h->nrel)
+            panic("prelink_apply returned %d, expected %d\n", n, h->nrel);
+    }
+    check_image("cache");
+    if(h->nrel != nrel)
+        panic("cache has %d relocations, dl_relocate did %d\n", h->nrel, nrel);
+    output("%d relocations: slow path %d usec, cache %d usec (%d runs, %d-byte cache)\n",
+        nrel, slow_usec, fast_usec, NREPEAT, nbytes);
+
+    // 3. the library file relocated ahead of time.
+    load();
+    prelink_hdr_t *applied = copy(h, nbytes);
+    prelink_apply_to_file(applied, (uint8_t *)libpi_e.e_header, lib_nbytes);
+    int n = prelink_apply(applied, nbytes, &exec_e, &libpi_e);
+    if(n != h->nexec)
+        panic("applied cache: prelink_apply returned %d, expected %d\n", n, h->nexec);
+    check_image("applied cache");
+    output("relocated library file: %d words stored at load\n", n);
+
+    // 4. mismatches leave both alone.
+    load();
+    uint8_t *exec_before = copy(exec_e.e_header, exec_nbytes);
+    uint8_t *lib_before = copy(libpi_e.e_header, lib_nbytes);
+
+    prelink_hdr_t *bad = copy(h, nbytes);
+    bad->lib_base += 0x1000;
+    assert(prelink_apply(bad, nbytes, &exec_e, &libpi_e) == -1);
+    memcpy(bad, h, nbytes);
+    bad->nrel++;
+    assert(prelink_apply(bad, nbytes, &exec_e, &libpi_e) == -1);
+    memcpy(bad, h, nbytes);
+    bad->magic = 0;
+    assert(prelink_apply(bad, nbytes, &exec_e, &libpi_e) == -1);
+
+    // a rebuilt executable: its symbols moved.
+    assert(exec_e.n_dynsym > 1);
+    exec_e.e_dynsym[exec_e.n_dynsym - 1].st_value += 4;
+    assert(prelink_apply(h, nbytes, &exec_e, &libpi_e) == -1);
+    exec_e.e_dynsym[exec_e.n_dynsym - 1].st_value -= 4;
+    // and a rebuilt library.
+    libpi_e.e_dynsym[libpi_e.n_dynsym - 1].st_value += 4;
+    assert(prelink_apply(h, nbytes, &exec_e, &libpi_e) == -1);
+    libpi_e.e_dynsym[libpi_e.n_dynsym - 1].st_value -= 4;
+
+    if(memcmp(exec_before, exec_e.e_header, exec_nbytes) != 0
+    || memcmp(lib_before, libpi_e.e_header, lib_nbytes) != 0)
+        panic("a refused cache changed the executable or library\n");
+    assert(prelink_apply(h, nbytes, &exec_e, &libpi_e) == h->nrel);
+    output("stale caches refused\n");
+
+    output("SUCCESS\n");
+    return 0;
+}
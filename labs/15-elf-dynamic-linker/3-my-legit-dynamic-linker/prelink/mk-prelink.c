@@ -0,0 +1,63 @@
+// make the relocation cache the pi loader (../notmain.c) reads:
+//   mk-prelink [<exec.elf> <exec-base> <lib.so> <lib-base> <out.pre> [<out.so>]]
+// with no arguments, uses the same files and bases as ../notmain.c.
+// given <out.so>, also writes the library with every relocation already
+// stored in it, and marks the cache so the pi only stores the
+// executable's few words (copy both to the sd card, as LIBPI.SO and LIBPI.PRE).
+#include "prelink-host.h"
+
+// the linker code refers to exec_e (../my-legit-dynamic-linker.c).
+my_elf32 exec_e, libpi_e;
+
+static uint32_t parse_base(const char *s) {
+    char *end;
+    unsigned long v = strtoul(s, &end, 0);
+    if(*end || v > 0xffffffff)
+        panic("bad base address <%s>\n", s);
+    return v;
+}
+
+int main(int argc, char *argv[]) {
+    const char *exec_name = "../../0-my-dynamic-tests/0-dyn.elf";
+    const char *lib_name = "../../0-my-libpi/libpi.so";
+    const char *out_name = "LIBPI.PRE";
+    const char *out_so = 0;
+    uint32_t exec_base = 0, lib_base = 0x10000000;
+
+    if(argc != 1 && argc != 6 && argc != 7)
+        panic("usage: %s [<exec.elf> <exec-base> <lib.so> <lib-base> <out.pre> [<out.so>]]\n", argv[0]);
+    if(argc > 1) {
+        exec_name = argv[1];
+        exec_base = parse_base(argv[2]);
+        lib_name = argv[3];
+        lib_base = parse_base(argv[4]);
+        out_name = argv[5];
+        if(argc == 7)
+            out_so = argv[6];
+    }
+
+    // the bases only go into the cache: the files can sit anywhere here.
+    printk_on(0);
+    elf_load(&exec_e, exec_name, 0);
+    unsigned lib_nbytes = elf_load(&libpi_e, lib_name, 0);
+
+    unsigned nbytes;
+    prelink_hdr_t *h = prelink_mk(&exec_e, exec_base, &libpi_e, lib_base, &nbytes);
+
+    if(out_so) {
+        unsigned n;
+        uint8_t *file = read_file(&n, lib_name);
+        assert(n == lib_nbytes);
+        prelink_apply_to_file(h, file, n);
+        int fd = create_file(out_so);
+        write_exact(fd, file, n);
+        close(fd);
+        output("wrote <%s>: <%s> relocated for base %x\n", out_so, lib_name, lib_base);
+    }
+    int fd = create_file(out_name);
+    write_exact(fd, h, nbytes);
+    close(fd);
+    output("wrote <%s>: %d relocations (%d bytes) for <%s> at %x, <%s> at %x\n",
+        out_name, h->nrel, nbytes, exec_name, exec_base, lib_name, lib_base);
+    return 0;
+}
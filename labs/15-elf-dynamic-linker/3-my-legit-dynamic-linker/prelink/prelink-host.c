@@ -0,0 +1,196 @@
+// host side of prelinking: see prelink-host.h
+#include <stdarg.h>
+#include <sys/mman.h>
+#include "prelink-host.h"
+#include "cycle-count.h"
+
+static int printk_on_p = 1;
+
+void printk_on(int on_p) {
+    printk_on_p = on_p;
+}
+
+int printk(const char *fmt, ...) {
+    if(!printk_on_p)
+        return 0;
+    va_list args;
+    va_start(args, fmt);
+    int n = vprintf(fmt, args);
+    va_end(args);
+    return n;
+}
+
+// the "cycle counter" on the host: microseconds.
+void cycle_cnt_init(void) {
+}
+
+unsigned cycle_cnt_read(void) {
+    return time_get_usec();
+}
+
+unsigned elf_load(my_elf32 *e, const char *name, uint32_t base) {
+    unsigned nbytes;
+    uint8_t *file = read_file(&nbytes, name);
+
+    elf32_header *h = (void *)file;
+    if(nbytes < sizeof *h || memcmp(h->e_ident, "\x7f" "ELF", 4) != 0 || h->e_ident[4] != 1)
+        panic("%s: not a 32-bit ELF file\n", name);
+    elf32_pheader *ph = (void *)(file + h->e_phoff);
+    for(unsigned i = 0; i < h->e_phnum; i++)
+        if(ph[i].p_type == 1 && ph[i].p_offset != ph[i].p_vaddr)
+            panic("%s: segment %d is at offset %x but address %x: the pi loader "
+                "needs them equal\n", name, i, ph[i].p_offset, ph[i].p_vaddr);
+
+    // room for the .bss past the end of the file.
+    unsigned end = nbytes;
+    for(unsigned i = 0; i < h->e_phnum; i++)
+        if(ph[i].p_type == 1 && ph[i].p_vaddr + ph[i].p_memsz > end)
+            end = ph[i].p_vaddr + ph[i].p_memsz;
+
+    char *p;
+    if(!base)
+        p = calloc(1, end);
+    else {
+        p = mmap((void *)(uintptr_t)base, end, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+        if(p == MAP_FAILED)
+            sys_die(mmap, "can't map %s at %x", name, base);
+    }
+    memcpy(p, file, nbytes);
+    free(file);
+
+    memset(e, 0, sizeof *e);
+    e->e_header = (elf32_header *)p;
+    e->e_sheaders = (elf32_sheader *)(p + e->e_header->e_shoff);
+    e->e_pheaders = (elf32_pheader *)(p + e->e_header->e_phoff);
+    get_dynamic_sections(e);
+    return nbytes;
+}
+
+#define STB_WEAK 2
+
+// the two modules in load order (what `dl_load_all` gives the pi), at
+// the bases the cache is for.
+typedef struct {
+    my_elf32 *e;
+    uint32_t base;
+} module_t;
+
+// `dl_lookup`: the first definition of <name> in load order, so the
+// executable can interpose on the library.  0 if neither defines it.
+static uint32_t lookup(module_t *mods, const char *name) {
+    for(int k = 0; k < 2; k++) {
+        elf32_sym *s = lookup_symbol(mods[k].e, name);
+        if(!s || s->st_shndx == SHN_UNDEF)
+            continue;
+        if(s->st_shndx == SHN_ABS)
+            return s->st_value;
+        return mods[k].base + s->st_value;
+    }
+    return 0;
+}
+
+// `resolve`: the value of symbol <idx> of <m>'s .dynsym.
+static uint32_t resolve(module_t *mods, module_t *m, uint32_t idx) {
+    if(!idx)
+        return 0;
+    elf32_sym *sym = &m->e->e_dynsym[idx];
+    const char *name = m->e->e_dynstr + sym->st_name;
+    uint32_t v = lookup(mods, name);
+    if(!v && (sym->st_info >> 4) != STB_WEAK)
+        panic("undefined symbol <%s>\n", name);
+    return v;
+}
+
+// the words `dl_relocate` stores into <m> with a lazy PLT: appended to
+// <rels>.  returns how many.
+static unsigned relocate(module_t *mods, module_t *m, int exec_p, prelink_rel_t *rels) {
+    char *elf32_base = (char *)m->e->e_header;
+    elf32_header *e_header = m->e->e_header;
+    elf32_sheader *e_sheaders = m->e->e_sheaders;
+    unsigned n = 0;
+
+    for(int i = 0; i < e_header->e_shnum; i++) {
+        if(e_sheaders[i].sh_type != SHT_REL)
+            continue;
+        elf32_rel *e_rels = (elf32_rel *)(elf32_base + e_sheaders[i].sh_offset);
+        uint32_t nrel = e_sheaders[i].sh_size / sizeof *e_rels;
+        for(uint32_t j = 0; j < nrel; j++) {
+            elf32_rel *r = &e_rels[j];
+            uint32_t word = *(uint32_t *)(elf32_base + r->r_offset);
+            uint32_t type = r->r_info & 0xff;
+            uint32_t idx = r->r_info >> 8;
+            uint32_t v;
+
+            switch(type) {
+            case R_ARM_RELATIVE:
+                v = word + m->base;
+                break;
+            case R_ARM_JUMP_SLOT:
+                // the executable's PLT binds on first call.
+                if(exec_p)
+                    continue;
+                v = resolve(mods, m, idx);
+                break;
+            case R_ARM_GLOB_DAT:
+                v = resolve(mods, m, idx);
+                break;
+            case R_ARM_ABS32: // the addend is the word itself
+                v = word + resolve(mods, m, idx);
+                break;
+            default:
+                output("skipping unknown relocation type %d\n", type);
+                continue;
+            }
+            rels[n++] = (prelink_rel_t) { .offset = r->r_offset, .value = v };
+        }
+    }
+    return n;
+}
+
+// one word per relocation at most.
+static unsigned max_rels(my_elf32 *e) {
+    unsigned n = 0;
+    for(int i = 0; i < e->e_header->e_shnum; i++)
+        if(e->e_sheaders[i].sh_type == SHT_REL)
+            n += e->e_sheaders[i].sh_size / sizeof(elf32_rel);
+    return n;
+}
+
+prelink_hdr_t *prelink_mk(my_elf32 *exec_e, uint32_t exec_base,
+                          my_elf32 *lib_e, uint32_t lib_base, unsigned *nbytes) {
+    module_t mods[2] = {
+        { .e = exec_e, .base = exec_base },
+        { .e = lib_e, .base = lib_base },
+    };
+
+    unsigned nmax = max_rels(exec_e) + max_rels(lib_e);
+    prelink_hdr_t *h = calloc(1, sizeof(prelink_hdr_t) + nmax * sizeof(prelink_rel_t));
+    prelink_rel_t *rels = (prelink_rel_t *)(h + 1);
+    *h = (prelink_hdr_t) {
+        .magic = PRELINK_MAGIC,
+        .version = PRELINK_VERSION,
+        .exec_base = exec_base,
+        .lib_base = lib_base,
+        .exec_sum = prelink_sum(exec_e->e_header),
+        .lib_sum = prelink_sum(lib_e->e_header),
+    };
+
+    // same order as the pi: the executable, then the library.
+    h->nexec = relocate(mods, &mods[0], 1, rels);
+    h->nrel = h->nexec + relocate(mods, &mods[1], 0, rels + h->nexec);
+    *nbytes = sizeof(prelink_hdr_t) + h->nrel * sizeof(prelink_rel_t);
+    return h;
+}
+
+void prelink_apply_to_file(prelink_hdr_t *h, uint8_t *file, unsigned nbytes) {
+    prelink_rel_t *rels = (prelink_rel_t *)(h + 1);
+    for(unsigned i = h->nexec; i < h->nrel; i++) {
+        if(rels[i].offset + 4 > nbytes)
+            panic("relocation at %x is past the end of the file\n", rels[i].offset);
+        memcpy(file + rels[i].offset, &rels[i].value, 4);
+    }
+    // the relocated words are part of the checksum.
+    h->lib_sum = prelink_sum((elf32_header *)file);
+    h->applied_p = 1;
+}
@@ -0,0 +1,30 @@
+#ifndef __PRELINK_HOST_H__
+#define __PRELINK_HOST_H__
+// host side of prelinking: compute what dl_relocate would store into
+// the executable and library, and write it out as a relocation cache
+// (see ../prelink.h).
+#include "prelink.h"
+#include "my-legit-dynamic-linker.h"
+
+// silence the linker's printk's (on by default).
+void printk_on(int on_p);
+
+// read ELF file <name> into memory the way the pi loader does (the
+// raw file, so file offsets must equal addresses): at host address
+// <base> if non-zero, otherwise anywhere.  fills in <e> (headers and
+// `get_dynamic_sections`).  returns the file size.
+unsigned elf_load(my_elf32 *e, const char *name, uint32_t base);
+
+// the relocation cache for <exec_e> loaded at <exec_base> and <lib_e>
+// at <lib_base>, the executable's PLT left lazy: a prelink_hdr_t
+// followed by the words to store.
+// <exec_e> and <lib_e> must not be relocated yet.  sets <*nbytes>.
+prelink_hdr_t *prelink_mk(my_elf32 *exec_e, uint32_t exec_base,
+                          my_elf32 *lib_e, uint32_t lib_base, unsigned *nbytes);
+
+// store the cache's library words into the library file contents
+// <file> (<nbytes> long), and mark the cache as applied: the pi then
+// only stores the executable's.
+void prelink_apply_to_file(prelink_hdr_t *h, uint8_t *file, unsigned nbytes);
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef __RPI_H__
+#define __RPI_H__
+// host stand-in for libpi's rpi.h: just enough to run the linker code
+// (../*.c, ../../2-my-dynamic-linker) over ELF files read into memory.
+#include <string.h>
+#include "libunix.h"
+
+// no format checking: the linker prints pointers with %x.
+int printk(const char *fmt, ...);
+
+#endif
@@ -0,0 +1,206 @@
+// load a graph of small arm shared libraries with ../my-dl-modules.c and
+// check the linking against a brute-force scan (see Makefile):
+//     exec.elf needs liba.so, libb.so
+//     liba.so  needs libb.so
+//     libb.so  needs libz.so
+//   1. the modules are loaded once each, breadth first, at increasing
+//      1MB-aligned bases that don't overlap.
+//   2. every relocated word is what a linear scan of the modules in load
+//      order says it should be, including interposition: libb.so's
+//      <shared> is liba.so's, libz.so's <interposed> is the executable's.
+//   3. each module relocates exactly its own entries, and symbols used by
+//      more than one module come from the lookup cache.
+//   4. the executable's PLT resolves lazily through dynamic_linker_entry_c.
+// usage: 1-dl-graph [<dir with exec.elf, liba.so, ...>]
+#include <stdarg.h>
+#include <sys/mman.h>
+#include "rpi.h"
+#include "my-dl-modules.h"
+#include "my-legit-dynamic-linker.h"
+
+// dynamic_linker_entry_c reads this (../notmain.c on the pi).
+my_elf32 exec_e;
+
+// the pi loads the executable at 0, which we can't map.
+enum { LIB_BASE = 0x10000000, LIB_NBYTES = 16 * 1024 * 1024, EXEC_BASE = 0x30000000 };
+
+int printk(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vprintf(fmt, args);
+    va_end(args);
+    return n;
+}
+
+static const char *dir = "objs/arm";
+
+// the unrelocated file of each module, for the expected values.
+static struct { char name[DL_NAME_MAX]; uint8_t *file; unsigned nbytes; } files[DL_MAX_MODULES];
+static unsigned nfiles;
+
+// what load_elf does on the pi, for files laid out with offset == address
+// (the lab's memmaps): the raw file at <base>.  FAT names are upper case;
+// the files here are lower case.
+static void load(char *name, char *base) {
+    char path[1024];
+    strcpyf(path, "%s/", dir);
+    unsigned n = strlen(path);
+    for(char *p = name; *p; p++)
+        path[n++] = (*p >= 'A' && *p <= 'Z') ? *p - 'A' + 'a' : *p;
+    path[n] = 0;
+
+    unsigned nbytes;
+    uint8_t *file = read_file(&nbytes, path);
+    elf32_header *h = (void *)file;
+    elf32_pheader *ph = (void *)(file + h->e_phoff);
+    for(unsigned i = 0; i < h->e_phnum; i++)
+        if(ph[i].p_type == PT_LOAD && ph[i].p_offset != ph[i].p_vaddr)
+            panic("%s: segment %d is at offset %x but address %x\n", path, i,
+                ph[i].p_offset, ph[i].p_vaddr);
+    memcpy(base, file, nbytes);
+
+    assert(nfiles < DL_MAX_MODULES);
+    strcpy(files[nfiles].name, name);
+    files[nfiles].file = file;
+    files[nfiles++].nbytes = nbytes;
+}
+
+// the reference: first module in load order whose .dynsym defines <name>,
+// looking at every symbol.
+static uint32_t ref_lookup(const char *name) {
+    for(int k = 0; k < dl_nmodules(); k++) {
+        my_elf32 *e = &dl_module(k)->e;
+        for(uint32_t i = 1; i < e->n_dynsym; i++) {
+            elf32_sym *s = &e->e_dynsym[i];
+            if(s->st_shndx != SHN_UNDEF && strcmp(e->e_dynstr + s->st_name, name) == 0)
+                return (uint32_t)dl_module(k)->base + s->st_value;
+        }
+    }
+    panic("no module defines <%s>\n", name);
+}
+
+// address of <m>'s definition of <name>.
+static uint32_t own_def(dl_module_t *m, const char *name) {
+    elf32_sym *s = lookup_symbol(&m->e, name);
+    assert(s && s->st_shndx != SHN_UNDEF);
+    return (uint32_t)m->base + s->st_value;
+}
+
+// check every relocated word of module <k>; returns the number of entries
+// it should have relocated.
+static unsigned check_module(int k, unsigned *nlazy) {
+    dl_module_t *m = dl_module(k);
+    uint8_t *orig = files[k].file;
+    elf32_sheader *sh = m->e.e_sheaders;
+    unsigned n = 0;
+
+    for(int i = 0; i < m->e.e_header->e_shnum; i++) {
+        if(sh[i].sh_type != SHT_REL)
+            continue;
+        elf32_rel *r = (void *)(orig + sh[i].sh_offset);
+        for(unsigned j = 0; j < sh[i].sh_size / sizeof *r; j++) {
+            uint32_t type = r[j].r_info & 0xff;
+            elf32_sym *s = &m->e.e_dynsym[r[j].r_info >> 8];
+            const char *name = m->e.e_dynstr + s->st_name;
+            uint32_t was = *(uint32_t *)(orig + r[j].r_offset);
+            uint32_t is = *(uint32_t *)(m->base + r[j].r_offset);
+            uint32_t expect;
+
+            if(type == R_ARM_RELATIVE)
+                expect = was + (uint32_t)m->base;
+            else if(type == R_ARM_JUMP_SLOT && k == 0) {
+                // lazy: untouched until the first call.
+                expect = was;
+                (*nlazy)++;
+                n--;
+            } else if(type == R_ARM_JUMP_SLOT || type == R_ARM_GLOB_DAT)
+                expect = ref_lookup(name);
+            else if(type == R_ARM_ABS32)
+                expect = was + ref_lookup(name);
+            else
+                panic("%s: unexpected relocation type %d\n", m->name, type);
+            n++;
+
+            if(is != expect)
+                panic("%s: type %d <%s> at %x: got %x, expected %x\n",
+                    m->name, type, name, r[j].r_offset, is, expect);
+        }
+    }
+    return n;
+}
+
+int main(int argc, char *argv[]) {
+    if(argc == 2)
+        dir = argv[1];
+    else if(argc != 1)
+        panic("usage: %s [<dir>]\n", argv[0]);
+
+    if(mmap((void *)LIB_BASE, LIB_NBYTES, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED
+    || mmap((void *)EXEC_BASE, 1024 * 1024, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED)
+        sys_die(mmap, "can't map the load addresses");
+
+    // 1. breadth first, each once.
+    int n = dl_load_all("EXEC.ELF", (char *)EXEC_BASE, (char *)LIB_BASE, load);
+    const char *order[] = { "EXEC.ELF", "LIBA.SO", "LIBB.SO", "LIBZ.SO" };
+    if(n != 4)
+        panic("loaded %d modules, expected 4\n", n);
+    for(int k = 0; k < n; k++) {
+        dl_module_t *m = dl_module(k);
+        if(strcmp(m->name, order[k]) != 0)
+            panic("module %d is <%s>, expected <%s>\n", k, m->name, order[k]);
+        if(k == 1)
+            assert(m->base == (char *)LIB_BASE);
+        if(k > 1) {
+            assert(m->base >= dl_module(k - 1)->end);
+            assert((uint32_t)m->base % 0x100000 == 0);
+        }
+        assert(k == 0 || (m->end > m->base && m->end <= (char *)LIB_BASE + LIB_NBYTES));
+    }
+    output("loaded:");
+    for(int k = 0; k < n; k++)
+        output(" %s@%x", dl_module(k)->name, (uint32_t)dl_module(k)->base);
+    output("\n");
+
+    // 2. + 3.
+    unsigned total = dl_relocate_all(), nlazy = 0, expect_total = 0;
+    for(int k = 0; k < n; k++) {
+        unsigned expect = check_module(k, &nlazy);
+        if(dl_module(k)->nrel != expect)
+            panic("%s: relocated %d entries, expected %d\n", dl_module(k)->name,
+                dl_module(k)->nrel, expect);
+        output("\t%s: %d relocations\n", dl_module(k)->name, expect);
+        expect_total += expect;
+    }
+    assert(total == expect_total);
+    dl_stats_t st = dl_stats();
+    output("%d lookups, %d from the cache, %d modules searched on misses\n",
+        st.nlookup, st.nhit, st.nsearch);
+    // printk is needed by three libraries, but searched for once.
+    assert(st.nhit >= 2);
+
+    dl_module_t *a = dl_module(1), *b = dl_module(2), *z = dl_module(3);
+    assert(dl_lookup("shared") == own_def(a, "shared"));
+    assert(own_def(b, "shared") != own_def(a, "shared"));
+    assert(dl_lookup("interposed") == own_def(dl_module(0), "interposed"));
+    assert(dl_lookup("interposed") != own_def(z, "interposed"));
+    assert(dl_lookup("no_such_symbol") == 0);
+
+
+    // 4. the executable's PLT: .got.plt[3 + i] is for its i'th JUMP_SLOT.
+    exec_e = dl_module(0)->e;
+    for(unsigned i = 0; i < nlazy; i++) {
+        elf32_rel *r = &exec_e.e_reldyn[i];
+        const char *name = exec_e.e_dynstr + exec_e.e_dynsym[r->r_info >> 8].st_name;
+        uint32_t *slot = &exec_e.e_pltgot[3 + i];
+        assert((char *)slot == dl_module(0)->base + r->r_offset);
+        uint32_t addr = dynamic_linker_entry_c(&exec_e.e_pltgot[2], slot);
+        if(addr != ref_lookup(name) || *slot != addr)
+            panic("lazy <%s>: got %x, expected %x\n", name, addr, ref_lookup(name));
+    }
+    output("%d lazy PLT entries resolved\n", nlazy);
+
+    output("SUCCESS\n");
+    return 0;
+}
@@ -0,0 +1,135 @@
+// the two ways the executable's PLT gets bound, and the per-entry counters
+// (../my-dl-modules.h) each one leaves behind:
+//   1. lazy (the default): relocation leaves every .got.plt slot alone, and
+//      dynamic_linker_entry_c binds each on its first call, in call order.
+//   2. dl_bind_now(1): relocation binds every slot, in .rel.plt order.
+//   3. an executable linked with -z now binds at load without being asked.
+// usage: 2-bind-modes [<dir with exec.elf, execnow.elf, liba.so, ...>]
+#include <stdarg.h>
+#include <sys/mman.h>
+#include "rpi.h"
+#include "my-dl-modules.h"
+#include "my-legit-dynamic-linker.h"
+
+// dynamic_linker_entry_c reads this (../notmain.c on the pi).
+my_elf32 exec_e;
+
+// same addresses as 1-dl-graph.c.
+enum { LIB_BASE = 0x10000000, LIB_NBYTES = 16 * 1024 * 1024, EXEC_BASE = 0x30000000 };
+
+int printk(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vprintf(fmt, args);
+    va_end(args);
+    return n;
+}
+
+static const char *dir = "objs/arm";
+
+// the raw file at <base> (offset == address), lower-cased name.
+static void load(char *name, char *base) {
+    char path[1024];
+    strcpyf(path, "%s/", dir);
+    unsigned n = strlen(path);
+    for(char *p = name; *p; p++)
+        path[n++] = (*p >= 'A' && *p <= 'Z') ? *p - 'A' + 'a' : *p;
+    path[n] = 0;
+
+    unsigned nbytes;
+    uint8_t *file = read_file(&nbytes, path);
+    memcpy(base, file, nbytes);
+    free(file);
+}
+
+// load and relocate <exec>; returns the number of PLT entries.
+static unsigned setup(char *exec, int bind_now_p) {
+    dl_bind_now(bind_now_p);
+    if(dl_load_all(exec, (char *)EXEC_BASE, (char *)LIB_BASE, load) != 4)
+        panic("%s: expected 4 modules\n", exec);
+    dl_relocate_all();
+    exec_e = dl_module(0)->e;
+
+    unsigned n = dl_plt_nstat();
+    if(n != 2)
+        panic("%s: %d PLT entries, expected 2\n", exec, n);
+    return n;
+}
+
+// PLT entry <i>'s .got.plt slot.
+static uint32_t *slot(unsigned i) {
+    uint32_t *s = (uint32_t *)(dl_module(0)->base + exec_e.e_reldyn[i].r_offset);
+    assert(s == &exec_e.e_pltgot[3 + i]);
+    return s;
+}
+
+// entry <i> is bound to the right address, and its slot says so.
+static void check_bound(unsigned i, int eager_p, unsigned nbefore) {
+    dl_plt_stat_t *s = dl_plt_stat(i);
+    uint32_t addr = dl_lookup(s->name);
+    if(s->addr != addr || *slot(i) != addr)
+        panic("<%s>: bound to %x (slot %x), expected %x\n", s->name, s->addr, *slot(i), addr);
+    if(s->eager_p != eager_p)
+        panic("<%s>: eager_p = %d, expected %d\n", s->name, s->eager_p, eager_p);
+    if(s->nbound_before != nbefore)
+        panic("<%s>: %d bound before it, expected %d\n", s->name, s->nbound_before, nbefore);
+    if(eager_p)
+        assert(s->first_call == 0);
+}
+
+static void test_lazy(void) {
+    output("-- lazy\n");
+    unsigned n = setup("EXEC.ELF", 0);
+    assert(!dl_module(0)->bind_now);
+    unsigned nrel = dl_module(0)->nrel;
+
+    // both still the unrelocated word (the PLT stub) until called.
+    for(unsigned i = 0; i < n; i++)
+        assert(dl_plt_stat(i)->addr == 0);
+    assert(*slot(0) == *slot(1));
+
+    // call them in the opposite order of .rel.plt.
+    for(int i = n - 1; i >= 0; i--) {
+        uint32_t addr = dynamic_linker_entry_c(&exec_e.e_pltgot[2], slot(i));
+        assert(addr == *slot(i));
+    }
+    check_bound(1, 0, 0);
+    check_bound(0, 0, 1);
+    assert(dl_plt_stat(0)->first_call >= dl_plt_stat(1)->first_call);
+    dl_plt_dump();
+
+    // bind now: the same relocations plus the PLT.
+    output("-- dl_bind_now(1)\n");
+    setup("EXEC.ELF", 1);
+    assert(dl_module(0)->nrel == nrel + n);
+    for(unsigned i = 0; i < n; i++)
+        check_bound(i, 1, i);
+    dl_plt_dump();
+}
+
+static void test_linked_now(void) {
+    output("-- linked with -z now\n");
+    unsigned n = setup("EXECNOW.ELF", 0);
+    assert(dl_module(0)->bind_now);
+    for(unsigned i = 0; i < n; i++)
+        check_bound(i, 1, i);
+    dl_plt_dump();
+}
+
+int main(int argc, char *argv[]) {
+    if(argc == 2)
+        dir = argv[1];
+    else if(argc != 1)
+        panic("usage: %s [<dir>]\n", argv[0]);
+
+    if(mmap((void *)LIB_BASE, LIB_NBYTES, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED
+    || mmap((void *)EXEC_BASE, 1024 * 1024, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED)
+        sys_die(mmap, "can't map the load addresses");
+
+    test_lazy();
+    test_linked_now();
+    output("SUCCESS\n");
+    return 0;
+}
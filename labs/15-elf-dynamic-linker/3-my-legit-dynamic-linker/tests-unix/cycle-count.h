@@ -0,0 +1,3 @@
+// host: libpi's cycle-count.h declares cycle_cnt_init/cycle_cnt_read as
+// plain functions under RPI_UNIX; the fakes are in this directory.
+#include "../../0-my-libpi/include/cycle-count.h"
@@ -126,6 +126,7 @@ void notmain(void)
 	};
 
 	fat32_write(&fs, &root, hello_name, &hello);
+	fat32_flush(&fs);
 
 	gpu_release(gpu);
 }
@@ -0,0 +1,313 @@
+// sector buffer cache: see bcache.h
+//
+// each cached sector is a <buf_t> that is on two lists:
+//   - a hash chain so we can find a sector by lba.
+//   - a doubly-linked lru list: most recently used at the front,
+//     the next victim at the back.  unused buffers sit at the back
+//     so they get used first.
+// since kmalloc can't free, all buffers are allocated once.
+#include "rpi.h"
+#include "bcache.h"
+
+typedef struct buf {
+    uint32_t lba;
+    unsigned valid:1, dirty:1;
+    struct buf *prev, *next;        // lru list.
+    struct buf *hash_next;
+    uint8_t *data;
+} buf_t;
+
+static int init_p;
+static buf_t *bufs;
+static unsigned nbufs, nbufs_alloc;
+
+static buf_t **hash;
+static unsigned hash_mask;
+
+// sentinel: lru.next is the most recently used.
+static buf_t lru;
+
+// staging areas for multi-sector transfers.  reads and write-backs
+// need their own since a read can evict a dirty sector.
+static uint8_t *rd_stage, *wr_stage;
+
+static unsigned readahead;
+static uint32_t end_lba;
+// where the last read ended: a read starting here is sequential.
+static uint32_t next_lba = ~0;
+
+static bcache_stats_t stats;
+
+/***********************************************************************
+ * the card itself.
+ */
+static void sd_read(void *data, uint32_t lba, uint32_t nsec) {
+    stats.nread_calls++;
+    stats.nsec_read += nsec;
+    if(!pi_sd_read(data, lba, nsec))
+        panic("could not read %d sectors at lba=%d\n", nsec, lba);
+}
+static void sd_write(const void *data, uint32_t lba, uint32_t nsec) {
+    stats.nwrite_calls++;
+    stats.nsec_written += nsec;
+    if(!pi_sd_write((void*)data, lba, nsec))
+        panic("could not write %d sectors at lba=%d\n", nsec, lba);
+}
+
+/***********************************************************************
+ * hash + lru lists.
+ */
+static inline buf_t **hash_bucket(uint32_t lba) {
+    return &hash[lba & hash_mask];
+}
+static buf_t *lookup(uint32_t lba) {
+    for(buf_t *b = *hash_bucket(lba); b; b = b->hash_next)
+        if(b->lba == lba)
+            return b;
+    return 0;
+}
+static void hash_insert(buf_t *b) {
+    buf_t **h = hash_bucket(b->lba);
+    b->hash_next = *h;
+    *h = b;
+}
+static void hash_remove(buf_t *b) {
+    buf_t **pp = hash_bucket(b->lba);
+    for(; *pp; pp = &(*pp)->hash_next) {
+        if(*pp == b) {
+            *pp = b->hash_next;
+            return;
+        }
+    }
+    panic("lba=%d not in the cache\n", b->lba);
+}
+
+static inline void lru_remove(buf_t *b) {
+    b->prev->next = b->next;
+    b->next->prev = b->prev;
+}
+static inline void lru_push_front(buf_t *b) {
+    b->next = lru.next;
+    b->prev = &lru;
+    lru.next->prev = b;
+    lru.next = b;
+}
+static inline void lru_touch(buf_t *b) {
+    lru_remove(b);
+    lru_push_front(b);
+}
+
+/***********************************************************************
+ * eviction and write-back.
+ */
+
+// write <b> back along with any dirty neighbors so a run of dirty
+// sectors costs one <pi_sd_write>.
+static void writeback(buf_t *b) {
+    uint32_t lo = b->lba, hi = b->lba + 1;
+    buf_t *x;
+
+    while(hi - lo < BCACHE_BYPASS_NSEC && (x = lookup(lo - 1)) && x->dirty)
+        lo--;
+    while(hi - lo < BCACHE_BYPASS_NSEC && (x = lookup(hi)) && x->dirty)
+        hi++;
+
+    for(uint32_t lba = lo; lba < hi; lba++) {
+        x = lookup(lba);
+        memcpy(wr_stage + (lba - lo) * NBYTES_PER_SECTOR, x->data, NBYTES_PER_SECTOR);
+        x->dirty = 0;
+    }
+    sd_write(wr_stage, lo, hi - lo);
+}
+
+// recycle the least recently used buffer for <lba>.
+static buf_t *buf_alloc(uint32_t lba) {
+    buf_t *b = lru.prev;
+    if(b->valid) {
+        stats.nevict++;
+        if(b->dirty) {
+            stats.nevict_dirty++;
+            writeback(b);
+        }
+        hash_remove(b);
+    }
+    b->lba = lba;
+    b->valid = 1;
+    b->dirty = 0;
+    hash_insert(b);
+    lru_touch(b);
+    return b;
+}
+
+/***********************************************************************
+ * public interface.
+ */
+
+void bcache_init(unsigned nsec, unsigned ra, uint32_t end) {
+    if(init_p)
+        bcache_flush();
+
+    if(nsec > nbufs_alloc) {
+        bufs = kmalloc(nsec * sizeof *bufs);
+        uint8_t *data = kmalloc(nsec * NBYTES_PER_SECTOR);
+        for(unsigned i = 0; i < nsec; i++)
+            bufs[i].data = data + i * NBYTES_PER_SECTOR;
+
+        unsigned nhash = 1;
+        while(nhash < nsec)
+            nhash *= 2;
+        hash = kmalloc(nhash * sizeof *hash);
+        hash_mask = nhash - 1;
+        nbufs_alloc = nsec;
+    }
+    if(!rd_stage) {
+        rd_stage = kmalloc(BCACHE_BYPASS_NSEC * NBYTES_PER_SECTOR);
+        wr_stage = kmalloc(BCACHE_BYPASS_NSEC * NBYTES_PER_SECTOR);
+    }
+    if(hash)
+        memset(hash, 0, (hash_mask + 1) * sizeof *hash);
+
+    nbufs = nsec;
+    lru.next = lru.prev = &lru;
+    for(unsigned i = 0; i < nbufs; i++) {
+        bufs[i].valid = bufs[i].dirty = 0;
+        lru_push_front(&bufs[i]);
+    }
+
+    if(ra > BCACHE_BYPASS_NSEC - 1)
+        ra = BCACHE_BYPASS_NSEC - 1;
+    readahead = ra;
+    end_lba = end;
+    next_lba = ~0;
+    memset(&stats, 0, sizeof stats);
+    init_p = 1;
+}
+
+// how many sectors to read speculatively after <lba>: stop at the
+// first cached sector so we never clobber a dirty one.
+static unsigned readahead_nsec(uint32_t lba, unsigned n) {
+    unsigned ra = readahead;
+    if(n + ra > BCACHE_BYPASS_NSEC)
+        ra = BCACHE_BYPASS_NSEC - n;
+    if(end_lba && lba + ra > end_lba)
+        ra = lba < end_lba ? end_lba - lba : 0;
+
+    unsigned k;
+    for(k = 0; k < ra && !lookup(lba + k); k++)
+        ;
+    return k;
+}
+
+int bcache_read(void *data, uint32_t lba, uint32_t nsec) {
+    demand(init_p, "bcache not initialized!\n");
+    uint8_t *p = data;
+    int seq_p = (lba == next_lba);
+    next_lba = lba + nsec;
+
+    if(!nbufs || nsec >= BCACHE_BYPASS_NSEC) {
+        if(nbufs)
+            stats.nbypass++;
+        sd_read(p, lba, nsec);
+        // cached sectors can be newer than the card.
+        if(nbufs) {
+            for(unsigned i = 0; i < nsec; i++) {
+                buf_t *b = lookup(lba + i);
+                if(b && b->dirty)
+                    memcpy(p + i * NBYTES_PER_SECTOR, b->data, NBYTES_PER_SECTOR);
+            }
+        }
+        return 1;
+    }
+
+    for(unsigned i = 0; i < nsec; ) {
+        buf_t *b = lookup(lba + i);
+        if(b) {
+            stats.nhit++;
+            lru_touch(b);
+            memcpy(p + i * NBYTES_PER_SECTOR, b->data, NBYTES_PER_SECTOR);
+            i++;
+            continue;
+        }
+
+        // read the whole run of missing sectors in one go, plus
+        // read-ahead if this run ends a sequential read.
+        unsigned n = 1;
+        while(i + n < nsec && !lookup(lba + i + n))
+            n++;
+        unsigned ra = 0;
+        if(seq_p && i + n == nsec)
+            ra = readahead_nsec(lba + nsec, n);
+
+        sd_read(rd_stage, lba + i, n + ra);
+        for(unsigned k = 0; k < n + ra; k++)
+            memcpy(buf_alloc(lba + i + k)->data,
+                rd_stage + k * NBYTES_PER_SECTOR, NBYTES_PER_SECTOR);
+        memcpy(p + i * NBYTES_PER_SECTOR, rd_stage, n * NBYTES_PER_SECTOR);
+
+        stats.nmiss += n;
+        stats.nreadahead += ra;
+        i += n;
+    }
+    return 1;
+}
+
+void *bcache_sec_read(uint32_t lba, uint32_t nsec) {
+    uint8_t *data = kmalloc(nsec * NBYTES_PER_SECTOR);
+    bcache_read(data, lba, nsec);
+    return data;
+}
+
+int bcache_write(const void *data, uint32_t lba, uint32_t nsec) {
+    demand(init_p, "bcache not initialized!\n");
+    const uint8_t *p = data;
+
+    if(!nbufs || nsec >= BCACHE_BYPASS_NSEC) {
+        if(nbufs)
+            stats.nbypass++;
+        sd_write(p, lba, nsec);
+        // cached copies now match the card.
+        if(nbufs) {
+            for(unsigned i = 0; i < nsec; i++) {
+                buf_t *b = lookup(lba + i);
+                if(b) {
+                    memcpy(b->data, p + i * NBYTES_PER_SECTOR, NBYTES_PER_SECTOR);
+                    b->dirty = 0;
+                }
+            }
+        }
+        return 1;
+    }
+
+    // whole sectors: no need to read the old contents.
+    for(unsigned i = 0; i < nsec; i++) {
+        buf_t *b = lookup(lba + i);
+        if(b)
+            lru_touch(b);
+        else
+            b = buf_alloc(lba + i);
+        memcpy(b->data, p + i * NBYTES_PER_SECTOR, NBYTES_PER_SECTOR);
+        b->dirty = 1;
+    }
+    return 1;
+}
+
+unsigned bcache_flush(void) {
+    demand(init_p, "bcache not initialized!\n");
+    unsigned n = stats.nsec_written;
+    for(unsigned i = 0; i < nbufs; i++)
+        if(bufs[i].valid && bufs[i].dirty)
+            writeback(&bufs[i]);
+    return stats.nsec_written - n;
+}
+
+bcache_stats_t bcache_stats(void) {
+    return stats;
+}
+
+void bcache_stats_print(const char *msg) {
+    bcache_stats_t *s = &stats;
+    output("%s: %d hit, %d miss, %d read-ahead, %d evicted (%d dirty), %d bypass\n",
+        msg, s->nhit, s->nmiss, s->nreadahead, s->nevict, s->nevict_dirty, s->nbypass);
+    output("%s: sd: %d reads (%d sectors), %d writes (%d sectors)\n",
+        msg, s->nread_calls, s->nsec_read, s->nwrite_calls, s->nsec_written);
+}
@@ -0,0 +1,53 @@
+#ifndef __RPI_BCACHE_H__
+#define __RPI_BCACHE_H__
+// sector buffer cache between the fat32 driver and the sd card.
+//
+// same calling convention as pi-sd.h: the fat32 code calls
+// <bcache_read>/<bcache_write> instead of <pi_sd_read>/<pi_sd_write>
+// and the cache decides when the card actually gets touched:
+//   - reads are served from cached sectors when possible.  a miss
+//     that continues the previous read also pulls in the next
+//     <readahead> sectors in the same <pi_sd_read>.
+//   - writes just dirty the cached sector.  dirty sectors go to the
+//     card when they are evicted (least recently used first) or on
+//     <bcache_flush>, coalesced into runs of adjacent sectors.
+//   - transfers of at least <BCACHE_BYPASS_NSEC> sectors (the whole
+//     FAT, big files) go straight to the card so they don't wipe
+//     out the cache; cached copies are kept coherent.
+//
+// nothing is on the card until <bcache_flush> (<fat32_flush>).
+#include "pi-sd.h"
+
+// max sectors in one cached transfer; bigger ones bypass the cache.
+enum { BCACHE_BYPASS_NSEC = 64 };
+
+typedef struct {
+    unsigned nhit, nmiss;           // sectors.
+    unsigned nreadahead;            // sectors read speculatively.
+    unsigned nevict, nevict_dirty;  // sectors.
+    unsigned nbypass;               // transfers that skipped the cache.
+
+    // what actually went to the card.
+    unsigned nread_calls, nsec_read;
+    unsigned nwrite_calls, nsec_written;
+} bcache_stats_t;
+
+// cache <nsec> sectors.  read-ahead up to <readahead> sectors but
+// never at or past <end_lba> (0 = no limit).  <nsec> = 0 makes the
+// cache write-through and turns it into a pass-through to pi-sd.
+// calling it again writes back any dirty sectors and starts over.
+void bcache_init(unsigned nsec, unsigned readahead, uint32_t end_lba);
+
+// same as <pi_sd_read>, <pi_sec_read> and <pi_sd_write>.
+int bcache_read(void *data, uint32_t lba, uint32_t nsec);
+void *bcache_sec_read(uint32_t lba, uint32_t nsec);
+int bcache_write(const void *data, uint32_t lba, uint32_t nsec);
+
+// write every dirty sector to the card.  returns the number of
+// sectors written.
+unsigned bcache_flush(void);
+
+bcache_stats_t bcache_stats(void);
+void bcache_stats_print(const char *msg);
+
+#endif
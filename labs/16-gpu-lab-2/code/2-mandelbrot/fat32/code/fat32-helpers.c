@@ -40,7 +40,7 @@ void fat32_volume_id_print(const char *msg, fat32_boot_sec_t *b) {
     oem[8] = 0;
     char label[12];
     memcpy(label, b->volume_label, 11);
-    oem[11] = 0;
+    label[11] = 0;
     char type[9];
     memcpy(type, b->fs_type, 8);
     type[8] = 0;
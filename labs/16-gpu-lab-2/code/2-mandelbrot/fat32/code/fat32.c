@@ -2,6 +2,7 @@
 #include "fat32.h"
 #include "fat32-helpers.h"
 #include "pi-sd.h"
+#include "bcache.h"
 
 // Print extra tracing info when this is enabled.  You can and should add your
 // own.
@@ -12,12 +13,29 @@ static unsigned CLUSTER_MASK = 0x0FFFFFFF;
 
 fat32_boot_sec_t boot_sector;
 
+static fat32_write_stats_t write_stats;
+
+fat32_write_stats_t fat32_write_stats(void) {
+  return write_stats;
+}
+
+int fat32_trace(int on_p) {
+  int old = trace_p;
+  trace_p = on_p;
+  return old;
+}
+
+static void free_map_init(fat32_fs_t *fs, uint32_t nsec_in_fs, struct fsinfo *info);
 
 fat32_fs_t fat32_mk(mbr_partition_ent_t *partition) {
   demand(!init_p, "the fat32 module is already in use\n");
   // TODO: Read the boot sector (of the partition) off the SD card.
   output("%d, %d\n", partition->lba_start, partition->nsec);
-  boot_sector = *(fat32_boot_sec_t *)pi_sec_read(partition->lba_start, 1);
+  // all sector i/o goes through the cache.  read-ahead stays inside the
+  // partition.
+  bcache_init(FAT32_CACHE_NSEC, FAT32_READAHEAD_NSEC,
+              partition->lba_start + partition->nsec);
+  boot_sector = *(fat32_boot_sec_t *)bcache_sec_read(partition->lba_start, 1);
 
   // TODO: Verify the boot sector (also called the volume id, `fat32_volume_id_check`)
   fat32_volume_id_check(&boot_sector);
@@ -25,7 +43,7 @@ fat32_fs_t fat32_mk(mbr_partition_ent_t *partition) {
   // TODO: Read the FS info sector (the sector immediately following the boot
   // sector) and check it (`fat32_fsinfo_check`, `fat32_fsinfo_print`)
   assert(boot_sector.info_sec_num == 1);
-  struct fsinfo *fsinfo_sector = (struct fsinfo *)pi_sec_read(partition->lba_start + 1, 1);
+  struct fsinfo *fsinfo_sector = (struct fsinfo *)bcache_sec_read(partition->lba_start + 1, 1);
 
   fat32_fsinfo_check(fsinfo_sector);
 
@@ -55,7 +73,16 @@ fat32_fs_t fat32_mk(mbr_partition_ent_t *partition) {
    *
    * Store the FAT in a heap-allocated array.
    */
-  uint32_t *fat = pi_sec_read(fat_begin_lba, boot_sector.nsec_per_fat);
+  // Bit 7 of the mirror flags: only one FAT is active, bits 0-3 say which.
+  unsigned fat_mirror_p = boot_sector.nfats > 1 && !(boot_sector.mirror_flags & 0x80);
+  unsigned active_fat = (boot_sector.mirror_flags & 0x80) ? boot_sector.mirror_flags & 0xf : 0;
+  assert(active_fat < boot_sector.nfats);
+  unsigned active_fat_lba = fat_begin_lba + active_fat * boot_sector.nsec_per_fat;
+  uint32_t *fat = bcache_sec_read(active_fat_lba, boot_sector.nsec_per_fat);
+
+  // One dirty bit per FAT sector (see `fat_set`).
+  uint32_t *fat_dirty = kmalloc((boot_sector.nsec_per_fat + 31) / 32 * sizeof *fat_dirty);
+  memset(fat_dirty, 0, (boot_sector.nsec_per_fat + 31) / 32 * sizeof *fat_dirty);
 
   // Create the FAT32 FS struct with all the metadata
   fat32_fs_t fs = (fat32_fs_t) {
@@ -66,7 +93,12 @@ fat32_fs_t fat32_mk(mbr_partition_ent_t *partition) {
       .root_dir_first_cluster = root_first_cluster,
       .fat = fat,
       .n_entries = n_entries,
+      .fat_dirty = fat_dirty,
+      .fat_mirror_p = fat_mirror_p,
+      .active_fat_lba = active_fat_lba,
+      .cluster_buf = kmalloc(sec_per_cluster * boot_sector.bytes_per_sec),
   };
+  free_map_init(&fs, boot_sector.nsec_in_fs, fsinfo_sector);
 
   if (trace_p) {
     trace("begin lba = %d\n", fs.fat_begin_lba);
@@ -128,11 +160,16 @@ static void read_cluster_chain(fat32_fs_t *fs, uint32_t start_cluster, uint8_t *
   // fat32_fat_entry_type(cluster) == LAST_CLUSTER.  For each cluster, copy it
   // to the buffer (`data`).  Be sure to offset your data pointer by the
   // appropriate amount each time.
+  //
+  // Clusters that follow each other on disk are read in one go.
   uint32_t cluster = start_cluster;
   while (fat32_fat_entry_type(cluster) != LAST_CLUSTER) {
-      pi_sd_read(data, cluster_to_lba(fs, cluster), fs->sectors_per_cluster);
-      cluster = fs->fat[cluster];
-      data += fs->sectors_per_cluster * boot_sector.bytes_per_sec;
+      uint32_t n = 1;
+      while (fs->fat[cluster + n - 1] == cluster + n)
+          n++;
+      bcache_read(data, cluster_to_lba(fs, cluster), n * fs->sectors_per_cluster);
+      cluster = fs->fat[cluster + n - 1];
+      data += n * fs->sectors_per_cluster * boot_sector.bytes_per_sec;
   }
 }
 
@@ -209,7 +246,7 @@ static int find_dirent_with_name(fat32_dirent_t *dirents, int n, char *filename)
   // name; use `fat32_dirent_name` to convert the internal name format to a
   // normal string.
   for (int i = 0; i < n; i++) {
-    char *dir_name = "";
+    char dir_name[16];
     fat32_dirent_name(dirents + i, dir_name);
     if (strcmp(dir_name, filename) == 0)
         return i;
@@ -281,36 +318,185 @@ pi_file_t *fat32_read(fat32_fs_t *fs, pi_dirent_t *directory, char *filename) {
  * you're working on read-only code, you don't need any of this.
  ******************************************************************************/
 
-static uint32_t find_free_cluster(fat32_fs_t *fs, uint32_t start_cluster) {
-  // TODO: loop through the entries in the FAT until you find a free one
-  // (fat32_fat_entry_type == FREE_CLUSTER).  Start from cluster 3.  Panic if
-  // there are none left.
-  if (start_cluster < 3) start_cluster = 3;
+// All sector writes go through here so we can count them.
+static void sec_write(void *data, uint32_t lba, uint32_t nsec) {
+  write_stats.nsec_written += nsec;
+  bcache_write(data, lba, nsec);
+}
 
-  uint32_t cluster = start_cluster;
-  uint32_t n_entries = fs->n_entries;
-  if (start_cluster < n_entries)
-      n_entries -= start_cluster;
+// Update a FAT entry and mark its sector dirty: rewriting the whole table
+// after every cluster chain update made each small file cost megabytes of
+// i/o on a big card.
+enum { FAT_ENTRIES_PER_SEC = NBYTES_PER_SECTOR / sizeof(uint32_t) };
+
+static int cluster_free_p(fat32_fs_t *fs, uint32_t c) {
+  return (fs->free_map[c / 32] >> (c % 32)) & 1;
+}
 
-  while (cluster < n_entries) {
-      if (fat32_fat_entry_type(fs->fat[cluster]) == FREE_CLUSTER)
-          return cluster;
+// Keeps the free map in sync: every FAT update goes through here.
+static void fat_set(fat32_fs_t *fs, uint32_t cluster, uint32_t v) {
+  assert(cluster < fs->n_entries);
+  fs->fat[cluster] = v;
+  uint32_t sec = cluster / FAT_ENTRIES_PER_SEC;
+  fs->fat_dirty[sec / 32] |= 1u << (sec % 32);
 
-      cluster++;
+  if (cluster < 2 || cluster >= fs->cluster_end)
+    return;
+  int free_p = fat32_fat_entry_type(v) == FREE_CLUSTER;
+  if (free_p == cluster_free_p(fs, cluster))
+    return;
+  if (free_p) {
+    fs->free_map[cluster / 32] |= 1u << (cluster % 32);
+    fs->nfree++;
+  } else {
+    fs->free_map[cluster / 32] &= ~(1u << (cluster % 32));
+    fs->nfree--;
   }
+}
 
-  if (trace_p) trace("failed to find free cluster from %d\n", start_cluster);
-  panic("No more clusters on the disk!\n");
+/*
+ * Free-cluster allocation.  Scanning the FAT for every new cluster made
+ * writing an N-cluster file cost O(N * FAT size).  Instead we keep a bitmap
+ * of free clusters, built once in `fat32_mk`, and allocate runs:
+ *  - a file being extended first tries the cluster right after its last one,
+ *    so it stays contiguous.
+ *  - otherwise we search next-fit from where the last allocation ended for
+ *    the first run long enough, settling for the longest run if there is
+ *    none.
+ * Contiguous files are read and written in multi-cluster transfers (see
+ * `read_cluster_chain`, `write_cluster_chain` and `contiguous_nsec`).
+ */
+static void free_map_init(fat32_fs_t *fs, uint32_t nsec_in_fs, struct fsinfo *info) {
+  // The FAT can have more entries than there are clusters.
+  uint32_t data_nsec = nsec_in_fs - (fs->cluster_begin_lba - fs->lba_start);
+  uint32_t end = data_nsec / fs->sectors_per_cluster + 2;
+  if (end > fs->n_entries)
+    end = fs->n_entries;
+  fs->cluster_end = end;
+
+  unsigned nwords = (end + 31) / 32;
+  fs->free_map = kmalloc(nwords * sizeof *fs->free_map);
+  memset(fs->free_map, 0, nwords * sizeof *fs->free_map);
+  fs->nfree = 0;
+  for (uint32_t c = 2; c < end; c++) {
+    if (fat32_fat_entry_type(fs->fat[c]) == FREE_CLUSTER) {
+      fs->free_map[c / 32] |= 1u << (c % 32);
+      fs->nfree++;
+    }
+  }
+
+  // FSInfo's counts are only hints: trust the FAT, but start where the last
+  // writer left off.
+  if (info->free_cluster_count != 0xffffffff && info->free_cluster_count != fs->nfree)
+    if (trace_p) trace("fsinfo says %d free clusters, FAT has %d\n",
+                       info->free_cluster_count, fs->nfree);
+  fs->next_free = 2;
+  if (info->next_free_cluster >= 2 && info->next_free_cluster < end)
+    fs->next_free = info->next_free_cluster;
 }
 
-static void write_fat_to_disk(fat32_fs_t *fs) {
-  // TODO: Write the FAT to disk.  In theory we should update every copy of the
-  // FAT, but the first one is probably good enough.  A good OS would warn you
-  // if the FATs are out of sync, but most OSes just read the first one without
-  // complaining.
-  if (trace_p) trace("syncing FAT\n");
+// First free cluster in [c, end), or <end> if none.
+static uint32_t next_free_cluster(fat32_fs_t *fs, uint32_t c, uint32_t end) {
+  while (c < end) {
+    uint32_t w = fs->free_map[c / 32] >> (c % 32);
+    if (w)
+      return c + __builtin_ctz(w) < end ? c + __builtin_ctz(w) : end;
+    c = (c / 32 + 1) * 32;
+  }
+  return end;
+}
+
+// Length of the free run starting at <c>, up to <max>.
+static uint32_t free_run_len(fat32_fs_t *fs, uint32_t c, uint32_t max) {
+  uint32_t n = 0;
+  while (n < max && c + n < fs->cluster_end && cluster_free_p(fs, c + n))
+    n++;
+  return n;
+}
+
+// Find free run of up to <want> clusters starting at or after <c> and
+// before <end>.  Returns the start of the first run of <want> clusters,
+// and otherwise the longest one (through <best>, <best_n>).
+static int find_run(fat32_fs_t *fs, uint32_t c, uint32_t end, uint32_t want,
+                    uint32_t *best, uint32_t *best_n) {
+  while ((c = next_free_cluster(fs, c, end)) < end) {
+    uint32_t n = free_run_len(fs, c, want);
+    if (n > *best_n) {
+      *best = c;
+      *best_n = n;
+    }
+    if (n == want)
+      return 1;
+    c += n;
+  }
+  return 0;
+}
+
+// Allocate up to <want> (> 0) contiguous clusters, preferring to start at
+// <goal> (0 = no preference), and link them into a chain ending in
+// LAST_CLUSTER.  Returns the first cluster and sets <*n> to how many we got.
+// Panics if the disk is full.
+static uint32_t alloc_run(fat32_fs_t *fs, uint32_t goal, uint32_t want, uint32_t *n) {
+  assert(want > 0);
+  if (!fs->nfree) {
+    if (trace_p) trace("failed to find free cluster\n");
+    panic("No more clusters on the disk!\n");
+  }
+
+  uint32_t start = 0, len = 0;
+  if (goal >= 2 && goal < fs->cluster_end && cluster_free_p(fs, goal)) {
+    start = goal;
+    len = free_run_len(fs, goal, want);
+  }
+  if (!start && !find_run(fs, fs->next_free, fs->cluster_end, want, &start, &len))
+    find_run(fs, 2, fs->next_free, want, &start, &len);
+  assert(len > 0);
+
+  for (uint32_t i = 0; i + 1 < len; i++)
+    fat_set(fs, start + i, start + i + 1);
+  fat_set(fs, start + len - 1, LAST_CLUSTER);
+
+  fs->next_free = start + len < fs->cluster_end ? start + len : 2;
+  if (trace_p) trace("allocated clusters [%d,%d) (wanted %d)\n", start, start + len, want);
+  *n = len;
+  return start;
+}
 
-  pi_sd_write(fs->fat, fs->fat_begin_lba, boot_sector.nsec_per_fat);
+static uint32_t alloc_cluster(fat32_fs_t *fs, uint32_t goal) {
+  uint32_t n;
+  return alloc_run(fs, goal, 1, &n);
+}
+
+static void write_fat_to_disk(fat32_fs_t *fs) {
+  // Write the FAT sectors that changed, as runs of adjacent sectors.  Every
+  // copy of the FAT is updated unless the boot sector says only one is
+  // active: then just that one.
+  unsigned nsec = boot_sector.nsec_per_fat;
+  unsigned nfats = fs->fat_mirror_p ? boot_sector.nfats : 1;
+  unsigned base = fs->fat_mirror_p ? fs->fat_begin_lba : fs->active_fat_lba;
+  uint32_t *dirty = fs->fat_dirty;
+
+  for (unsigned sec = 0; sec < nsec; ) {
+    if (!dirty[sec / 32]) {
+      sec = (sec / 32 + 1) * 32;
+      continue;
+    }
+    if (!(dirty[sec / 32] & (1u << (sec % 32)))) {
+      sec++;
+      continue;
+    }
+    unsigned end = sec + 1;
+    while (end < nsec && (dirty[end / 32] & (1u << (end % 32))))
+      end++;
+
+    if (trace_p) trace("syncing FAT sectors [%d,%d)\n", sec, end);
+    for (unsigned i = 0; i < nfats; i++)
+      sec_write(&fs->fat[sec * FAT_ENTRIES_PER_SEC],
+                base + i * nsec + sec, end - sec);
+    write_stats.nfat_sec_written += (end - sec) * nfats;
+    sec = end;
+  }
+  memset(dirty, 0, (nsec + 31) / 32 * sizeof *dirty);
 }
 
 // Given the starting cluster index, write the data in `data` over the
@@ -349,24 +535,43 @@ static void write_cluster_chain(fat32_fs_t *fs, uint32_t start_cluster, uint8_t
   // cluster.
   while (nbytes > 0)
   {
-    pi_sd_write(data, cluster_to_lba(fs, cluster), fs->sectors_per_cluster);
-    uint32_t bytes_written = bytes_per_cluster;
+    // The clusters of the chain that follow this one on disk (as far as we
+    // have data for) are written in one go.
+    uint32_t n = 1;
+    while (n * bytes_per_cluster < nbytes && fs->fat[cluster + n - 1] == cluster + n)
+      n++;
+    uint32_t bytes_written = n * bytes_per_cluster;
     if (bytes_written > nbytes)
       bytes_written = nbytes;
 
+    uint32_t nwhole = bytes_written / bytes_per_cluster;
+    if (nwhole)
+      sec_write(data, cluster_to_lba(fs, cluster), nwhole * fs->sectors_per_cluster);
+    // Don't write past the end of the caller's buffer: pad the last
+    // partial cluster with zeros.
+    if (bytes_written % bytes_per_cluster) {
+      uint8_t *last = fs->cluster_buf;
+      memset(last, 0, bytes_per_cluster);
+      memcpy(last, data + nwhole * bytes_per_cluster, bytes_written % bytes_per_cluster);
+      sec_write(last, cluster_to_lba(fs, cluster + nwhole), fs->sectors_per_cluster);
+    }
+
     nbytes -= bytes_written;
     data += bytes_written;
+    cluster += n - 1;
 
-    // if there’s still data left, grow the chain one cluster at a time:
+    // if there’s still data left, grow the chain by as many clusters as
+    // we still need, contiguous with this one if possible:
     if (nbytes > 0)
     {
-      // if we were at the end of the chain, grab a new cluster
+      // if we were at the end of the chain, grab new clusters
       uint32_t entry = fs->fat[cluster];
       if (fat32_fat_entry_type(entry) == LAST_CLUSTER)
       {
-        uint32_t nxt = find_free_cluster(fs, 3) & CLUSTER_MASK;
-        fs->fat[cluster] = nxt;      // link old→new
-        fs->fat[nxt] = LAST_CLUSTER; // new end-of-chain
+        uint32_t got;
+        uint32_t need = (nbytes + bytes_per_cluster - 1) / bytes_per_cluster;
+        uint32_t nxt = alloc_run(fs, cluster + 1, need, &got);
+        fat_set(fs, cluster, nxt);      // link old→new
       }
       // move into the newly linked cluster
       cluster = fs->fat[cluster];
@@ -380,7 +585,7 @@ static void write_cluster_chain(fat32_fs_t *fs, uint32_t start_cluster, uint8_t
   while (fat32_fat_entry_type(cluster) == USED_CLUSTER)
   {
     uint32_t next_cluster = fs->fat[cluster];
-    fs->fat[cluster] = FREE_CLUSTER;
+    fat_set(fs, cluster, FREE_CLUSTER);
     cluster = next_cluster;
   }
 
@@ -388,9 +593,9 @@ static void write_cluster_chain(fat32_fs_t *fs, uint32_t start_cluster, uint8_t
   // The one exception to this is if we're writing 0 bytes in total, in which
   // case we don't want to use any clusters at all.
   if (total_bytes > 0)
-    fs->fat[last_cluster] = LAST_CLUSTER;
+    fat_set(fs, last_cluster, LAST_CLUSTER);
   else
-    fs->fat[last_cluster] = FREE_CLUSTER;
+    fat_set(fs, last_cluster, FREE_CLUSTER);
 
   write_fat_to_disk(fs);
 }
@@ -508,14 +713,14 @@ int fat32_delete(fat32_fs_t *fs, pi_dirent_t *directory, char *filename) {
   uint32_t cluster = fat32_cluster_id(dirent);
   while (fat32_fat_entry_type(fs->fat[cluster]) == USED_CLUSTER) {
       uint32_t next_cluster = fs->fat[cluster];
-      fs->fat[cluster] = FREE_CLUSTER;
+      fat_set(fs, cluster, FREE_CLUSTER);
       cluster = next_cluster;
   }
 
   // Last cluster of the file. Only free if the current cluster isn't free already (will only happen
   // when deleting empty files)
   if (fat32_fat_entry_type(cluster) != FREE_CLUSTER)
-      fs->fat[cluster] = FREE_CLUSTER;
+      fat_set(fs, cluster, FREE_CLUSTER);
 
   write_fat_to_disk(fs);
 
@@ -546,12 +751,12 @@ int fat32_truncate(fat32_fs_t *fs, pi_dirent_t *directory, char *filename, unsig
 
   // Optimization, but not necessary for correctness
   if (old_nbytes == length) {
-      trace("Truncating file to same length. Not touching\n");
+      if (trace_p) trace("Truncating file to same length. Not touching\n");
       return 1;
   }
 
   dirent->file_nbytes = length;
-  trace("Truncating file from %d to %d\n", old_nbytes, length);
+  if (trace_p) trace("Truncating file from %d to %d\n", old_nbytes, length);
 
   if (old_nbytes <= length) {
     // Truncating to a larger (or equal) file, pad with zero bytes
@@ -591,15 +796,15 @@ int fat32_truncate(fat32_fs_t *fs, pi_dirent_t *directory, char *filename, unsig
   uint32_t last_cluster = cluster;
   while (fat32_fat_entry_type(cluster) == USED_CLUSTER) {
     uint32_t next_cluster = fs->fat[cluster];
-    fs->fat[cluster] = FREE_CLUSTER;
+    fat_set(fs, cluster, FREE_CLUSTER);
     cluster = next_cluster;
   }
 
   // Set the last cluster depending on the length of the new file
   if (length > 0)
-      fs->fat[last_cluster] = LAST_CLUSTER;
+      fat_set(fs, last_cluster, LAST_CLUSTER);
   else {
-      fs->fat[last_cluster] = FREE_CLUSTER;
+      fat_set(fs, last_cluster, FREE_CLUSTER);
       // Need to remove cluster as this is now an empty file
       dirent->hi_start = 0;
       dirent->lo_start = 0;
@@ -637,35 +842,236 @@ int fat32_write(fat32_fs_t *fs, pi_dirent_t *directory, char *filename, pi_file_
   uint32_t cluster = fat32_cluster_id(dirent);
   if (file->n_data == 0) {
       // No data to write, so set the directory entry to be empty
-      trace("File to write has no data. Clearing file\n");
+      if (trace_p) trace("File to write has no data. Clearing file\n");
       dirent->hi_start = 0;
       dirent->lo_start = 0;
   } else if (fat32_fat_entry_type(cluster) == FREE_CLUSTER) {
-    // File is empty, so update the dirent with a new cluster
-    cluster = find_free_cluster(fs, 3) & CLUSTER_MASK;
-    // Complete the, so far empty, chain
-    fs->fat[cluster] = LAST_CLUSTER;
+    // File is empty, so update the dirent with a new cluster: grab as
+    // much of the file as fits in one run (`write_cluster_chain` extends
+    // it if needed).
+    uint32_t got, bytes_per_cluster = fs->sectors_per_cluster * boot_sector.bytes_per_sec;
+    cluster = alloc_run(fs, 0, (file->n_data + bytes_per_cluster - 1) / bytes_per_cluster, &got);
 
-    trace("empty file, updating directory cluster number\n");
+    if (trace_p) trace("empty file, updating directory cluster number\n");
     dirent->hi_start = cluster >> 16;
     dirent->lo_start = cluster & 0xFFFF; 
   }
 
   // Write out the file as clusters & update the FAT
-  trace("writing file\n");
+  if (trace_p) trace("writing file\n");
   write_cluster_chain(fs, cluster, file->data, file->n_data);
 
   // Update the directory entry with the new size
   dirent->file_nbytes = file->n_data;
 
   // Write out the directory entry
-  trace("writing dirent\n");
+  if (trace_p) trace("writing dirent\n");
   write_cluster_chain(fs, directory->cluster_id, (uint8_t *)dirents, n_dirents * sizeof(fat32_dirent_t));
   return 1;
 }
 
 int fat32_flush(fat32_fs_t *fs) {
   demand(init_p, "fat32 not initialized!");
-  // no-op
-  return 0;
+  unsigned n = bcache_stats().nsec_written;
+  write_fat_to_disk(fs);
+
+  // Keep the FSInfo hints current so the next mount starts allocating
+  // where we left off.
+  struct fsinfo info;
+  uint32_t info_lba = fs->lba_start + boot_sector.info_sec_num;
+  bcache_read(&info, info_lba, 1);
+  if (info.free_cluster_count != fs->nfree || info.next_free_cluster != fs->next_free) {
+    info.free_cluster_count = fs->nfree;
+    info.next_free_cluster = fs->next_free;
+    sec_write(&info, info_lba, 1);
+  }
+  bcache_flush();
+  n = bcache_stats().nsec_written - n;
+  if (trace_p) trace("flush wrote %d sectors\n", n);
+  return n;
+}
+
+/******************************************************************************
+ * Streaming file handles: see fat32.h.
+ ******************************************************************************/
+
+static uint32_t cluster_nbytes(fat32_fs_t *fs) {
+  return fs->sectors_per_cluster * NBYTES_PER_SECTOR;
+}
+
+int fat32_open(fat32_fs_t *fs, pi_dirent_t *directory, char *filename, fat32_file_t *f) {
+  demand(init_p, "fat32 not initialized!");
+  demand(directory->is_dir_p, "tried to use a file as a directory!");
+  demand(strlen(filename) < sizeof f->name, "name too long: <%s>", filename);
+
+  pi_dirent_t *d = fat32_stat(fs, directory, filename);
+  if (!d)
+    return 0;
+  if (d->is_dir_p)
+    panic("<%s> is a directory\n", filename);
+
+  memset(f, 0, sizeof *f);
+  f->fs = fs;
+  f->dir = *directory;
+  strcpy(f->name, filename);
+  f->first_cluster = d->nbytes ? d->cluster_id : 0;
+  f->nbytes = d->nbytes;
+  return 1;
+}
+
+// Return the cluster holding the cursor, walking forward from the last one
+// we touched when possible.  If the chain is too short, either extend it
+// (<extend_p>) or return 0.
+static uint32_t file_cluster(fat32_file_t *f, int extend_p) {
+  fat32_fs_t *fs = f->fs;
+  uint32_t idx = f->pos / cluster_nbytes(fs);
+
+  if (!f->first_cluster) {
+    if (!extend_p)
+      return 0;
+    f->first_cluster = alloc_cluster(fs, 0);
+    f->dirty_p = 1;
+  }
+  if (!f->cluster || f->cluster_idx > idx) {
+    f->cluster = f->first_cluster;
+    f->cluster_idx = 0;
+  }
+
+  while (f->cluster_idx < idx) {
+    uint32_t next = fs->fat[f->cluster];
+    if (fat32_fat_entry_type(next) == LAST_CLUSTER) {
+      if (!extend_p)
+        return 0;
+      next = alloc_cluster(fs, f->cluster + 1);
+      fat_set(fs, f->cluster, next);
+    }
+    f->cluster = next & CLUSTER_MASK;
+    f->cluster_idx++;
+  }
+  return f->cluster;
+}
+
+// How many sectors starting at the cursor can be moved in one transfer: the
+// rest of the current cluster plus any clusters that follow it on disk, up
+// to <nsec>.
+static uint32_t contiguous_nsec(fat32_file_t *f, uint32_t cluster, uint32_t nsec) {
+  fat32_fs_t *fs = f->fs;
+  uint32_t off = f->pos % cluster_nbytes(fs) / NBYTES_PER_SECTOR;
+  uint32_t n = fs->sectors_per_cluster - off;
+
+  while (n < nsec && fs->fat[cluster] == cluster + 1) {
+    cluster++;
+    n += fs->sectors_per_cluster;
+  }
+  return n < nsec ? n : nsec;
+}
+
+unsigned fat32_fread(fat32_file_t *f, void *buf, unsigned nbytes) {
+  fat32_fs_t *fs = f->fs;
+  uint8_t *p = buf;
+
+  if (f->pos >= f->nbytes)
+    return 0;
+  if (nbytes > f->nbytes - f->pos)
+    nbytes = f->nbytes - f->pos;
+
+  unsigned left = nbytes;
+  while (left > 0) {
+    uint32_t cluster = file_cluster(f, 0);
+    if (!cluster)
+      panic("<%s>: cluster chain shorter than the file size\n", f->name);
+    uint32_t off = f->pos % cluster_nbytes(fs);
+    uint32_t lba = cluster_to_lba(fs, cluster) + off / NBYTES_PER_SECTOR;
+    uint32_t n;
+
+    if (off % NBYTES_PER_SECTOR == 0 && left >= NBYTES_PER_SECTOR) {
+      // Whole sectors: straight into the caller's buffer.
+      uint32_t nsec = contiguous_nsec(f, cluster, left / NBYTES_PER_SECTOR);
+      bcache_read(p, lba, nsec);
+      n = nsec * NBYTES_PER_SECTOR;
+    } else {
+      uint32_t sec_off = off % NBYTES_PER_SECTOR;
+      n = NBYTES_PER_SECTOR - sec_off;
+      if (n > left)
+        n = left;
+      bcache_read(f->sec, lba, 1);
+      memcpy(p, f->sec + sec_off, n);
+    }
+    p += n;
+    left -= n;
+    // The cluster cursor catches up lazily in `file_cluster`.
+    f->pos += n;
+  }
+  return nbytes;
+}
+
+unsigned fat32_fwrite(fat32_file_t *f, const void *buf, unsigned nbytes) {
+  fat32_fs_t *fs = f->fs;
+  const uint8_t *p = buf;
+
+  unsigned left = nbytes;
+  while (left > 0) {
+    uint32_t cluster = file_cluster(f, 1);
+    uint32_t off = f->pos % cluster_nbytes(fs);
+    uint32_t lba = cluster_to_lba(fs, cluster) + off / NBYTES_PER_SECTOR;
+    uint32_t n;
+
+    if (off % NBYTES_PER_SECTOR == 0 && left >= NBYTES_PER_SECTOR) {
+      // Whole sectors: straight from the caller's buffer.  Only within this
+      // cluster, since the next one may not be allocated yet.
+      uint32_t nsec = fs->sectors_per_cluster - off / NBYTES_PER_SECTOR;
+      if (nsec > left / NBYTES_PER_SECTOR)
+        nsec = left / NBYTES_PER_SECTOR;
+      sec_write((void *)p, lba, nsec);
+      n = nsec * NBYTES_PER_SECTOR;
+    } else {
+      // Partial sector: keep the bytes around it that are part of the file.
+      uint32_t sec_off = off % NBYTES_PER_SECTOR;
+      n = NBYTES_PER_SECTOR - sec_off;
+      if (n > left)
+        n = left;
+      if (f->pos - sec_off < f->nbytes)
+        bcache_read(f->sec, lba, 1);
+      else
+        memset(f->sec, 0, sizeof f->sec);
+      memcpy(f->sec + sec_off, p, n);
+      sec_write(f->sec, lba, 1);
+    }
+    p += n;
+    left -= n;
+    f->pos += n;
+    if (f->pos > f->nbytes) {
+      f->nbytes = f->pos;
+      f->dirty_p = 1;
+    }
+  }
+  return nbytes;
+}
+
+int fat32_seek(fat32_file_t *f, unsigned off) {
+  if (off > f->nbytes)
+    return 0;
+  f->pos = off;
+  return 1;
+}
+
+int fat32_close(fat32_file_t *f) {
+  fat32_fs_t *fs = f->fs;
+  if (!f->dirty_p) {
+    write_fat_to_disk(fs);
+    return 1;
+  }
+
+  uint32_t n_dirents;
+  fat32_dirent_t *dirents = get_dirents(fs, f->dir.cluster_id, &n_dirents);
+  int i = find_dirent_with_name(dirents, n_dirents, f->name);
+  if (i < 0)
+    panic("<%s> disappeared while open\n", f->name);
+
+  dirents[i].file_nbytes = f->nbytes;
+  dirents[i].hi_start = f->first_cluster >> 16;
+  dirents[i].lo_start = f->first_cluster & 0xFFFF;
+  write_cluster_chain(fs, f->dir.cluster_id, (uint8_t *)dirents, n_dirents * sizeof(fat32_dirent_t));
+  f->dirty_p = 0;
+  return 1;
 }
@@ -6,6 +6,10 @@
 // 128MB heap.
 enum { FAT32_HEAP_MB = 128 };
 
+// sector cache (bcache.h) set up by <fat32_mk>: 512KB, 32 sectors of
+// read-ahead.
+enum { FAT32_CACHE_NSEC = 1024, FAT32_READAHEAD_NSEC = 32 };
+
 /*
  * Aggregate the FAT32 information.  Refer to Paul's writeup for
  * how to compute thes.   you can compute each using either:
@@ -23,9 +27,26 @@ typedef struct fat32 {
     sectors_per_cluster,
     root_dir_first_cluster,     // lba of first_cluster
     *fat,                       // pointer to in-memory copy of FAT
-    n_entries;                  // number of entries in the FAT table.
+    n_entries,                  // number of entries in the FAT table.
+    *fat_dirty,                 // bitmap: FAT sectors changed since last sync.
+    fat_mirror_p,               // keep every copy of the FAT up to date.
+    active_fat_lba,             // FAT we read (and write, if not mirroring).
+    *free_map,                  // bitmap: bit c set = cluster c is free.
+    cluster_end,                // one past the last cluster with data sectors.
+    nfree,                      // free clusters (bits set in <free_map>).
+    next_free;                  // next-fit cursor: where allocation resumes.
+  uint8_t *cluster_buf;         // one cluster of scratch for partial writes.
 } fat32_fs_t;
 
+// Sectors written by the driver (to the cache, see bcache.h), so the cost
+// of each operation can be measured: take the difference around it.
+typedef struct {
+  unsigned nsec_written;        // every sector: data, directories and FAT.
+  unsigned nfat_sec_written;    // FAT sectors, counting each copy.
+} fat32_write_stats_t;
+
+fat32_write_stats_t fat32_write_stats(void);
+
 // Create a new FAT32 FS object, validating that the specified partition is a
 // FAT32 partition.
 fat32_fs_t fat32_mk(mbr_partition_ent_t *partition);
@@ -63,11 +84,55 @@ int fat32_truncate(fat32_fs_t *fs, pi_dirent_t *directory, char *filename, unsig
 // file if necessary.
 int fat32_write(fat32_fs_t *fs, pi_dirent_t *directory, char *filename, pi_file_t *file);
 
-// Flush any queued changes to the disk.  Will be a no-op if you don't do any
-// caching (i.e., on your first version), but may be useful later if you try to
-// speed things up.
+// Flush any queued changes to the disk: the FAT and every dirty sector in
+// the cache.  Until this is called, writes may only be in memory.  Returns
+// the number of sectors written.
 int fat32_flush(fat32_fs_t *fs);
 
+/*
+ * Streaming access to one file: reads and writes go between the caller's
+ * buffer and the disk through a cursor into the file's cluster chain, so
+ * the file is never buffered whole.  Aligned whole sectors go straight to
+ * or from the caller's buffer; runs of contiguous clusters are a single
+ * transfer.
+ *
+ * The handle is caller storage (kmalloc can't free).  Size and first
+ * cluster changes from writes reach the directory entry on `fat32_close`.
+ */
+typedef struct {
+  fat32_fs_t *fs;
+  pi_dirent_t dir;              // directory holding the file.
+  char name[16];
+  uint32_t first_cluster,       // 0 for an empty file.
+           nbytes,              // file size.
+           pos;                 // cursor: byte offset into the file.
+  uint32_t cluster,             // cluster of the chain we last touched,
+           cluster_idx;         //   and its index in the chain.
+  uint32_t dirty_p;             // dirent needs updating.
+  uint8_t sec[512];             // bounce buffer for partial sectors.
+} fat32_file_t;
+
+// Open <filename> in <directory> with the cursor at 0.  Returns 0 if there is
+// no such file.
+int fat32_open(fat32_fs_t *fs, pi_dirent_t *directory, char *filename, fat32_file_t *f);
+
+// Read up to <nbytes> at the cursor into <buf> and advance it.  Returns the
+// number of bytes read (0 at end of file).
+unsigned fat32_fread(fat32_file_t *f, void *buf, unsigned nbytes);
+
+// Write <nbytes> from <buf> at the cursor, growing the file as needed, and
+// advance the cursor.  Returns <nbytes>.
+unsigned fat32_fwrite(fat32_file_t *f, const void *buf, unsigned nbytes);
+
+// Move the cursor to byte <off>.  Returns 0 if <off> is past the end.
+int fat32_seek(fat32_file_t *f, unsigned off);
+
+// Write back the directory entry if the file changed.
+int fat32_close(fat32_file_t *f);
+
+// Turn tracing on/off; returns the old value.
+int fat32_trace(int on_p);
+
 
 // For testing
 uint32_t get_cluster_chain_length(fat32_fs_t *fs, uint32_t start_cluster);
@@ -0,0 +1,87 @@
+// random reads and writes through the cache checked against an
+// in-memory copy of the disk.  after each flush the image itself
+// must match the copy, so write-back can't lose or reorder data.
+#include "rpi.h"
+#include "bcache.h"
+
+enum { NSEC = 4096, NOPS = 200000 };
+
+static uint8_t ref[NSEC * 512], buf[128 * 512];
+
+static uint32_t rng_state = 1;
+static uint32_t rng(void) {
+    rng_state = rng_state * 1103515245 + 12345;
+    return rng_state >> 8;
+}
+
+// mostly small transfers, some big enough to bypass the cache.
+static unsigned rand_nsec(void) {
+    return rng() % 16 ? 1 + rng() % 16 : BCACHE_BYPASS_NSEC + rng() % 32;
+}
+
+static void check_disk(void) {
+    static uint8_t disk[NSEC * 512];
+    pi_sd_read(disk, 0, NSEC);
+    for(unsigned i = 0; i < sizeof disk; i++)
+        if(disk[i] != ref[i])
+            panic("image differs at lba=%d, byte %d\n", i / 512, i % 512);
+}
+
+static void run(const char *msg, unsigned ncache, unsigned ra) {
+    bcache_init(ncache, ra, NSEC);
+    for(unsigned i = 0; i < NOPS; i++) {
+        unsigned n = rand_nsec();
+        uint32_t lba = rng() % (NSEC - n);
+        unsigned op = rng() % 8;
+
+        if(op < 4) {
+            bcache_read(buf, lba, n);
+            if(memcmp(buf, &ref[lba * 512], n * 512) != 0)
+                panic("%s: read lba=%d, nsec=%d: wrong data\n", msg, lba, n);
+        } else if(op < 7) {
+            for(unsigned k = 0; k < n * 512; k++)
+                buf[k] = rng();
+            bcache_write(buf, lba, n);
+            memcpy(&ref[lba * 512], buf, n * 512);
+        } else if(rng() % 64 == 0) {
+            bcache_flush();
+            check_disk();
+        }
+    }
+    bcache_flush();
+    check_disk();
+    bcache_stats_print(msg);
+}
+
+// reading a file-sized run a cluster at a time should mostly hit
+// on read-ahead.
+static void sequential(unsigned ra) {
+    bcache_init(256, ra, NSEC);
+    for(uint32_t lba = 0; lba < 2048; lba += 8)
+        bcache_read(buf, lba, 8);
+    bcache_stats_t s = bcache_stats();
+    output("sequential (read-ahead=%d): %d sd reads for 256 cluster reads\n",
+        ra, s.nread_calls);
+    if(ra)
+        assert(s.nread_calls < 256 / 4);
+}
+
+int main(void) {
+    const char *name = "bcache.img";
+    fake_sd_mkfs(name, 2);
+    fake_sd_open(name);
+    pi_sd_init();
+    pi_sd_read(ref, 0, NSEC);
+
+    run("no cache", 0, 0);
+    run("64 sectors", 64, 8);
+    run("1024 sectors", 1024, 32);
+
+    sequential(0);
+    sequential(32);
+
+    fake_sd_close();
+    unlink(name);
+    output("SUCCESS\n");
+    return 0;
+}
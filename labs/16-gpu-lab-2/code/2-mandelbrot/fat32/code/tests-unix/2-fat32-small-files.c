@@ -0,0 +1,111 @@
+// write many small files through the fat32 driver on a disk image,
+// then mount it again and read them back.  each phase runs in its own
+// process since fat32_mk can only be called once.
+#include <sys/wait.h>
+#include "rpi.h"
+#include "fat32.h"
+#include "bcache.h"
+
+enum { NFILES = 100 };
+
+static const char *image = "fat32.img";
+
+static void file_name(char *name, unsigned i) {
+    strcpyf(name, "F%03d.TXT", i);
+}
+// file <i> is a few hundred bytes to a few clusters.
+static unsigned file_nbytes(unsigned i) {
+    return 100 + (i * 997) % 12000;
+}
+static char file_byte(unsigned i, unsigned off) {
+    return 'a' + (i + off) % 26;
+}
+
+static fat32_fs_t mount(void) {
+    fake_sd_open(image);
+    pi_sd_init();
+    mbr_t *mbr = mbr_read();
+    mbr_partition_ent_t partition;
+    memcpy(&partition, mbr->part_tab1, sizeof partition);
+    fat32_trace(0);
+    return fat32_mk(&partition);
+}
+
+static void write_files(unsigned ncache) {
+    fat32_fs_t fs = mount();
+    // re-init the cache at the size we want to measure.
+    bcache_init(ncache, FAT32_READAHEAD_NSEC, 0);
+    pi_dirent_t root = fat32_get_root(&fs);
+
+    for(unsigned i = 0; i < NFILES; i++) {
+        char name[32];
+        file_name(name, i);
+        assert(fat32_create(&fs, &root, name, 0));
+
+        unsigned n = file_nbytes(i);
+        char *data = kmalloc(n);
+        for(unsigned k = 0; k < n; k++)
+            data[k] = file_byte(i, k);
+        pi_file_t f = { .data = data, .n_data = n, .n_alloc = n };
+        assert(fat32_write(&fs, &root, name, &f));
+    }
+    unsigned nflush = fat32_flush(&fs);
+
+    bcache_stats_t s = bcache_stats();
+    output("cache=%d sectors: %d files: %d sd writes, %d sectors written (%d at flush)\n",
+        ncache, NFILES, s.nwrite_calls, s.nsec_written, nflush);
+    bcache_stats_print("write");
+}
+
+static void check_files(unsigned nfiles) {
+    fat32_fs_t fs = mount();
+    pi_dirent_t root = fat32_get_root(&fs);
+
+    pi_directory_t dir = fat32_readdir(&fs, &root);
+    if(dir.ndirents != nfiles)
+        panic("expected %d files, have %d\n", nfiles, dir.ndirents);
+
+    for(unsigned i = 0; i < nfiles; i++) {
+        char name[32];
+        file_name(name, i);
+        pi_file_t *f = fat32_read(&fs, &root, name);
+        unsigned n = file_nbytes(i);
+        if(f->n_data != n)
+            panic("%s: expected %d bytes, have %d\n", name, n, (int)f->n_data);
+        for(unsigned k = 0; k < n; k++)
+            if(f->data[k] != file_byte(i, k))
+                panic("%s: wrong byte at offset %d\n", name, k);
+    }
+    output("read back %d files\n", nfiles);
+    bcache_stats_print("read");
+}
+
+static void run(void (*fn)(unsigned), unsigned arg) {
+    pid_t pid = fork();
+    if(pid < 0)
+        sys_die(fork, "fork failed");
+    if(!pid) {
+        fn(arg);
+        exit(0);
+    }
+    int status;
+    if(waitpid(pid, &status, 0) < 0)
+        sys_die(waitpid, "waitpid failed");
+    if(!WIFEXITED(status) || WEXITSTATUS(status))
+        panic("child failed\n");
+}
+
+int main(void) {
+    // no cache: every sector goes straight to the image.
+    fake_sd_mkfs(image, 64);
+    run(write_files, 0);
+    run(check_files, NFILES);
+
+    fake_sd_mkfs(image, 64);
+    run(write_files, FAT32_CACHE_NSEC);
+    run(check_files, NFILES);
+
+    unlink(image);
+    output("SUCCESS\n");
+    return 0;
+}
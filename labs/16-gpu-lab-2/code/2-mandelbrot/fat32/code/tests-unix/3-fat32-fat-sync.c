@@ -0,0 +1,195 @@
+// only the FAT sectors an operation touches should be written, to
+// both copies of the FAT.  measures the sectors each kind of
+// operation writes, then checks on a fresh mount that the two FATs
+// are identical and the files survived.  then again with mirroring
+// off and FAT 1 active: only that copy should change.
+#include <sys/wait.h>
+#include <fcntl.h>
+#include "rpi.h"
+#include "fat32.h"
+#include "bcache.h"
+
+enum { NFILES = 40 };
+
+static const char *image = "fat32-sync.img";
+
+static fat32_fs_t mount(void) {
+    fake_sd_open(image);
+    pi_sd_init();
+    mbr_t *mbr = mbr_read();
+    mbr_partition_ent_t partition;
+    memcpy(&partition, mbr->part_tab1, sizeof partition);
+    fat32_trace(0);
+    return fat32_mk(&partition);
+}
+static unsigned nsec_per_fat(fat32_fs_t *fs) {
+    return (fs->cluster_begin_lba - fs->fat_begin_lba) / 2;
+}
+
+static void file_name(char *name, unsigned i) {
+    strcpyf(name, "S%03d.BIN", i);
+}
+static unsigned file_nbytes(unsigned i) {
+    return 1 + (i * 3001) % 20000;
+}
+
+// sectors written by one kind of operation.
+typedef struct {
+    const char *name;
+    unsigned n, nsec, nfat_sec, max_fat_sec;
+    fat32_write_stats_t start;
+} op_stats_t;
+
+static void op_begin(op_stats_t *op) {
+    op->start = fat32_write_stats();
+}
+static void op_end(op_stats_t *op) {
+    fat32_write_stats_t s = fat32_write_stats();
+    unsigned nfat = s.nfat_sec_written - op->start.nfat_sec_written;
+    op->n++;
+    op->nsec += s.nsec_written - op->start.nsec_written;
+    op->nfat_sec += nfat;
+    if(nfat > op->max_fat_sec)
+        op->max_fat_sec = nfat;
+}
+static void op_print(op_stats_t *op, unsigned whole_fat) {
+    output("%-8s: %d ops, %d sectors/op, %d FAT sectors/op (max %d); whole-FAT sync=%d\n",
+        op->name, op->n, op->nsec / op->n, op->nfat_sec / op->n,
+        op->max_fat_sec, whole_fat);
+    // a handful of small files never span more than a few FAT sectors.
+    assert(op->max_fat_sec <= 4 * 2);
+}
+
+// turn off mirroring, make FAT 1 the active one.
+static void set_active_fat1(void) {
+    int img = open(image, O_RDWR);
+    if(img < 0)
+        sys_die(open, "can't open <%s>", image);
+    uint16_t flags = 0x80 | 1;
+    off_t off = (off_t)FAKE_SD_PART_LBA * 512 + 40;
+    if(pwrite(img, &flags, sizeof flags, off) != sizeof flags)
+        sys_die(pwrite, "can't write mirror flags");
+    close(img);
+}
+
+// <mirror_p>: both FATs are active.
+static void write_files(unsigned mirror_p) {
+    fat32_fs_t fs = mount();
+    pi_dirent_t root = fat32_get_root(&fs);
+    assert(fs.fat_mirror_p == mirror_p);
+
+    op_stats_t create = { .name = "create" }, write = { .name = "write" },
+               trunc = { .name = "truncate" }, del = { .name = "delete" },
+               ren = { .name = "rename" };
+
+    for(unsigned i = 0; i < NFILES; i++) {
+        char name[32];
+        file_name(name, i);
+        op_begin(&create);
+        assert(fat32_create(&fs, &root, name, 0));
+        op_end(&create);
+
+        unsigned n = file_nbytes(i);
+        char *data = kmalloc(n);
+        memset(data, i, n);
+        pi_file_t f = { .data = data, .n_data = n, .n_alloc = n };
+        op_begin(&write);
+        assert(fat32_write(&fs, &root, name, &f));
+        op_end(&write);
+    }
+    // every 4th: delete, truncate to a cluster, rename.
+    for(unsigned i = 0; i < NFILES; i += 4) {
+        char name[32], new[32];
+        file_name(name, i);
+        op_begin(&del);
+        assert(fat32_delete(&fs, &root, name));
+        op_end(&del);
+
+        file_name(name, i + 1);
+        op_begin(&trunc);
+        assert(fat32_truncate(&fs, &root, name, 100));
+        op_end(&trunc);
+
+        file_name(name, i + 2);
+        strcpyf(new, "R%03d.BIN", i + 2);
+        op_begin(&ren);
+        assert(fat32_rename(&fs, &root, name, new));
+        op_end(&ren);
+    }
+    fat32_flush(&fs);
+
+    unsigned whole = nsec_per_fat(&fs);
+    op_print(&create, whole);
+    op_print(&write, whole);
+    op_print(&del, whole);
+    op_print(&trunc, whole);
+    op_print(&ren, whole);
+}
+
+static void check_files(unsigned mirror_p) {
+    fat32_fs_t fs = mount();
+    pi_dirent_t root = fat32_get_root(&fs);
+
+    // mirrored: the two copies of the FAT must agree.  otherwise
+    // FAT 0 is still the empty one mkfs made.
+    unsigned n = nsec_per_fat(&fs);
+    uint8_t *fat0 = pi_sec_read(fs.fat_begin_lba, n);
+    uint8_t *fat1 = pi_sec_read(fs.fat_begin_lba + n, n);
+    int same_p = memcmp(fat0, fat1, n * 512) == 0;
+    if(mirror_p && !same_p)
+        panic("FAT copies differ\n");
+    if(!mirror_p && same_p)
+        panic("inactive FAT 0 was written\n");
+    if(!mirror_p)
+        assert(fs.active_fat_lba == fs.fat_begin_lba + n);
+
+    for(unsigned i = 0; i < NFILES; i++) {
+        char name[32];
+        unsigned nbytes = file_nbytes(i);
+        switch(i % 4) {
+        case 0: file_name(name, i);
+                assert(!fat32_stat(&fs, &root, name));
+                continue;
+        case 1: file_name(name, i); nbytes = 100; break;
+        case 2: strcpyf(name, "R%03d.BIN", i); break;
+        case 3: file_name(name, i); break;
+        }
+        pi_file_t *f = fat32_read(&fs, &root, name);
+        if(f->n_data != nbytes)
+            panic("%s: expected %d bytes, have %d\n", name, nbytes, (int)f->n_data);
+        for(unsigned k = 0; k < nbytes; k++)
+            if((uint8_t)f->data[k] != i)
+                panic("%s: wrong byte at offset %d\n", name, k);
+    }
+    output("%s, %d files checked\n", 
+        mirror_p ? "FATs match" : "only FAT 1 written", NFILES);
+}
+
+static void run(void (*fn)(unsigned), unsigned arg) {
+    pid_t pid = fork();
+    if(pid < 0)
+        sys_die(fork, "fork failed");
+    if(!pid) {
+        fn(arg);
+        exit(0);
+    }
+    int status;
+    if(waitpid(pid, &status, 0) < 0)
+        sys_die(waitpid, "waitpid failed");
+    if(!WIFEXITED(status) || WEXITSTATUS(status))
+        panic("child failed\n");
+}
+
+int main(void) {
+    fake_sd_mkfs(image, 64);
+    run(write_files, 1);
+    run(check_files, 1);
+
+    fake_sd_mkfs(image, 64);
+    set_active_fat1();
+    run(write_files, 0);
+    run(check_files, 0);
+    unlink(image);
+    output("SUCCESS\n");
+    return 0;
+}
@@ -0,0 +1,144 @@
+// streaming handles: write a file in odd-sized pieces, patch the
+// middle, append after reopening, then check it on a fresh mount
+// with random seeks + reads and against the whole-file fat32_read.
+#include <sys/wait.h>
+#include "rpi.h"
+#include "fat32.h"
+#include "bcache.h"
+
+enum { NBYTES = 300 * 1024, PATCH_OFF = 5000, PATCH_N = 7000, NAPPEND = 1234 };
+
+static const char *image = "fat32-stream.img";
+
+static uint32_t rng_state;
+static uint32_t rng(void) {
+    rng_state = rng_state * 1103515245 + 12345;
+    return rng_state >> 8;
+}
+
+static uint8_t byte_at(unsigned off) {
+    if(off >= PATCH_OFF && off < PATCH_OFF + PATCH_N)
+        return 0xee;
+    return off * 7 + (off >> 9);
+}
+static uint8_t expected[NBYTES + NAPPEND], buf[64 * 1024];
+
+static fat32_fs_t mount(void) {
+    fake_sd_open(image);
+    pi_sd_init();
+    mbr_t *mbr = mbr_read();
+    mbr_partition_ent_t partition;
+    memcpy(&partition, mbr->part_tab1, sizeof partition);
+    fat32_trace(0);
+    return fat32_mk(&partition);
+}
+
+static void write_file(unsigned unused) {
+    fat32_fs_t fs = mount();
+    pi_dirent_t root = fat32_get_root(&fs);
+    assert(fat32_create(&fs, &root, "BIG.BIN", 0));
+
+    fat32_file_t f;
+    assert(fat32_open(&fs, &root, "BIG.BIN", &f));
+    assert(f.nbytes == 0);
+    rng_state = 1;
+    for(unsigned off = 0; off < NBYTES; ) {
+        unsigned n = 1 + rng() % 5000;
+        if(off + n > NBYTES)
+            n = NBYTES - off;
+        for(unsigned i = 0; i < n; i++)
+            buf[i] = off + i < PATCH_OFF || off + i >= PATCH_OFF + PATCH_N
+                ? byte_at(off + i) : 0;
+        assert(fat32_fwrite(&f, buf, n) == n);
+        off += n;
+    }
+    // overwrite part of the middle.
+    assert(fat32_seek(&f, PATCH_OFF));
+    memset(buf, 0xee, PATCH_N);
+    fat32_fwrite(&f, buf, PATCH_N);
+    assert(fat32_close(&f));
+
+    // reopen and append.
+    assert(fat32_open(&fs, &root, "BIG.BIN", &f));
+    assert(f.nbytes == NBYTES);
+    assert(!fat32_seek(&f, NBYTES + 1));
+    assert(fat32_seek(&f, NBYTES));
+    for(unsigned i = 0; i < NAPPEND; i++)
+        buf[i] = byte_at(NBYTES + i);
+    fat32_fwrite(&f, buf, NAPPEND);
+    assert(fat32_close(&f));
+    fat32_flush(&fs);
+}
+
+static void check_file(unsigned unused) {
+    fat32_fs_t fs = mount();
+    pi_dirent_t root = fat32_get_root(&fs);
+    unsigned n = NBYTES + NAPPEND;
+    for(unsigned i = 0; i < n; i++)
+        expected[i] = byte_at(i);
+
+    fat32_file_t f;
+    assert(fat32_open(&fs, &root, "BIG.BIN", &f));
+    assert(f.nbytes == n);
+
+    // sequential in odd-sized pieces.
+    rng_state = 2;
+    unsigned off = 0, got;
+    while((got = fat32_fread(&f, buf, 1 + rng() % sizeof buf))) {
+        if(memcmp(buf, &expected[off], got) != 0)
+            panic("sequential read at %d: wrong data\n", off);
+        off += got;
+    }
+    assert(off == n);
+
+    // random seeks.
+    for(unsigned i = 0; i < 2000; i++) {
+        off = rng() % n;
+        unsigned len = 1 + rng() % 3000;
+        assert(fat32_seek(&f, off));
+        got = fat32_fread(&f, buf, len);
+        assert(got == (off + len > n ? n - off : len));
+        if(memcmp(buf, &expected[off], got) != 0)
+            panic("read %d bytes at %d: wrong data\n", len, off);
+    }
+    fat32_close(&f);
+
+    // the whole-file interface sees the same thing.
+    pi_file_t *pf = fat32_read(&fs, &root, "BIG.BIN");
+    assert(pf->n_data == n);
+    assert(memcmp(pf->data, expected, n) == 0);
+
+    // a big aligned read is one transfer into the caller's buffer.
+    assert(fat32_open(&fs, &root, "BIG.BIN", &f));
+    bcache_stats_t before = bcache_stats();
+    uint8_t *all = kmalloc(n);
+    assert(fat32_fread(&f, all, n) == n);
+    assert(memcmp(all, expected, n) == 0);
+    bcache_stats_t after = bcache_stats();
+    output("streamed %d bytes in %d sd reads\n", n,
+        after.nread_calls - before.nread_calls);
+}
+
+static void run(void (*fn)(unsigned), unsigned arg) {
+    pid_t pid = fork();
+    if(pid < 0)
+        sys_die(fork, "fork failed");
+    if(!pid) {
+        fn(arg);
+        exit(0);
+    }
+    int status;
+    if(waitpid(pid, &status, 0) < 0)
+        sys_die(waitpid, "waitpid failed");
+    if(!WIFEXITED(status) || WEXITSTATUS(status))
+        panic("child failed\n");
+}
+
+int main(void) {
+    fake_sd_mkfs(image, 64);
+    run(write_file, 0);
+    run(check_file, 0);
+    unlink(image);
+    output("SUCCESS\n");
+    return 0;
+}
@@ -0,0 +1,164 @@
+// the free-cluster bitmap and run allocator:
+//   1. punch one-cluster holes in the disk, then write a big file: it
+//      should land in one contiguous run (not the holes) and read back
+//      in a handful of sd reads.
+//   2. fill every remaining cluster, holes included, with one file.
+//   3. on a fresh mount the bitmap, the FAT and the FSInfo free count
+//      agree, and the files are intact.
+#include <sys/wait.h>
+#include "rpi.h"
+#include "fat32.h"
+#include "bcache.h"
+#include "fat32-helpers.h"
+
+enum { NSMALL = 64, BIG_NBYTES = 1024*1024 };
+
+static const char *image = "fat32-alloc.img";
+
+static fat32_fs_t mount(void) {
+    fake_sd_open(image);
+    pi_sd_init();
+    mbr_t *mbr = mbr_read();
+    mbr_partition_ent_t partition;
+    memcpy(&partition, mbr->part_tab1, sizeof partition);
+    fat32_trace(0);
+    return fat32_mk(&partition);
+}
+static unsigned cluster_nbytes(fat32_fs_t *fs) {
+    return fs->sectors_per_cluster * 512;
+}
+
+// number of contiguous runs the file's chain is split into.
+static unsigned nextents(fat32_fs_t *fs, pi_dirent_t *root, char *name) {
+    pi_dirent_t *d = fat32_stat(fs, root, name);
+    assert(d);
+    unsigned n = 1;
+    for(uint32_t c = d->cluster_id; fat32_fat_entry_type(fs->fat[c]) == USED_CLUSTER; c = fs->fat[c])
+        if(fs->fat[c] != c + 1)
+            n++;
+    return n;
+}
+
+// the bitmap must match the FAT exactly.
+static void check_free_map(fat32_fs_t *fs) {
+    unsigned nfree = 0;
+    for(uint32_t c = 2; c < fs->cluster_end; c++) {
+        unsigned free_p = fat32_fat_entry_type(fs->fat[c]) == FREE_CLUSTER;
+        unsigned bit = (fs->free_map[c / 32] >> (c % 32)) & 1;
+        if(free_p != bit)
+            panic("cluster %d: FAT says free=%d, bitmap=%d\n", c, free_p, bit);
+        nfree += free_p;
+    }
+    if(nfree != fs->nfree)
+        panic("%d free clusters, bitmap count=%d\n", nfree, fs->nfree);
+}
+
+static void write_file(fat32_fs_t *fs, pi_dirent_t *root, char *name, unsigned n, uint8_t v) {
+    assert(fat32_create(fs, root, name, 0));
+    char *data = kmalloc(n);
+    memset(data, v, n);
+    pi_file_t f = { .data = data, .n_data = n, .n_alloc = n };
+    assert(fat32_write(fs, root, name, &f));
+}
+static void check_file(fat32_fs_t *fs, pi_dirent_t *root, char *name, unsigned n, uint8_t v) {
+    pi_file_t *f = fat32_read(fs, root, name);
+    if(f->n_data != n)
+        panic("%s: expected %d bytes, have %d\n", name, n, (int)f->n_data);
+    for(unsigned k = 0; k < n; k++)
+        if((uint8_t)f->data[k] != v)
+            panic("%s: wrong byte at offset %d\n", name, k);
+}
+
+static void write_files(unsigned unused) {
+    fat32_fs_t fs = mount();
+    pi_dirent_t root = fat32_get_root(&fs);
+    check_free_map(&fs);
+    unsigned nfree = fs.nfree;
+
+    // one-cluster files; delete every other one to leave holes.
+    for(unsigned i = 0; i < NSMALL; i++) {
+        char name[32];
+        strcpyf(name, "H%03d.BIN", i);
+        write_file(&fs, &root, name, cluster_nbytes(&fs), i);
+    }
+    for(unsigned i = 0; i < NSMALL; i += 2) {
+        char name[32];
+        strcpyf(name, "H%03d.BIN", i);
+        assert(fat32_delete(&fs, &root, name));
+    }
+    check_free_map(&fs);
+    assert(fs.nfree == nfree - NSMALL / 2);
+
+    write_file(&fs, &root, "BIG.BIN", BIG_NBYTES, 0xbb);
+    unsigned n = nextents(&fs, &root, "BIG.BIN");
+    output("%d-byte file: %d extent(s) with %d one-cluster holes free\n",
+        BIG_NBYTES, n, NSMALL / 2);
+    assert(n == 1);
+    check_free_map(&fs);
+
+    // everything that's left, holes included.
+    unsigned fill_nbytes = fs.nfree * cluster_nbytes(&fs);
+    write_file(&fs, &root, "FILL.BIN", fill_nbytes, 0xff);
+    output("filled the disk: %d bytes in %d extent(s)\n",
+        fill_nbytes, nextents(&fs, &root, "FILL.BIN"));
+    assert(fs.nfree == 0);
+    check_free_map(&fs);
+    fat32_flush(&fs);
+}
+
+static void check_files(unsigned unused) {
+    fat32_fs_t fs = mount();
+    pi_dirent_t root = fat32_get_root(&fs);
+    check_free_map(&fs);
+    assert(fs.nfree == 0);
+
+    struct fsinfo *info = pi_sec_read(fs.lba_start + 1, 1);
+    if(info->free_cluster_count != fs.nfree)
+        panic("fsinfo free count=%d, FAT has %d\n", info->free_cluster_count, fs.nfree);
+
+    for(unsigned i = 1; i < NSMALL; i += 2) {
+        char name[32];
+        strcpyf(name, "H%03d.BIN", i);
+        check_file(&fs, &root, name, cluster_nbytes(&fs), i);
+    }
+    bcache_stats_t s = bcache_stats();
+    check_file(&fs, &root, "BIG.BIN", BIG_NBYTES, 0xbb);
+    unsigned nreads = bcache_stats().nread_calls - s.nread_calls;
+    output("read %d-byte file in %d sd reads\n", BIG_NBYTES, nreads);
+    // the directory plus the file.
+    assert(nreads <= 4);
+
+    // its size is whatever was free when it was written.
+    unsigned fill_nbytes = fat32_stat(&fs, &root, "FILL.BIN")->nbytes;
+    check_file(&fs, &root, "FILL.BIN", fill_nbytes, 0xff);
+
+    // free it all: the bitmap follows.
+    assert(fat32_delete(&fs, &root, "FILL.BIN"));
+    check_free_map(&fs);
+    assert(fs.nfree == fill_nbytes / cluster_nbytes(&fs));
+    output("bitmap, FAT and FSInfo agree\n");
+}
+
+static void run(void (*fn)(unsigned), unsigned arg) {
+    pid_t pid = fork();
+    if(pid < 0)
+        sys_die(fork, "fork failed");
+    if(!pid) {
+        fn(arg);
+        exit(0);
+    }
+    int status;
+    if(waitpid(pid, &status, 0) < 0)
+        sys_die(waitpid, "waitpid failed");
+    if(!WIFEXITED(status) || WEXITSTATUS(status))
+        panic("child failed\n");
+}
+
+int main(void) {
+    fake_sd_mkfs(image, 64);
+    run(write_files, 0);
+    run(check_files, 0);
+    unlink(image);
+    output("SUCCESS\n");
+    return 0;
+}
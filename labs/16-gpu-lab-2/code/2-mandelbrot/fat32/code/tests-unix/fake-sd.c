@@ -0,0 +1,159 @@
+// host versions of the pi-only pieces the fat32 code needs: the sd
+// card (backed by a disk image), kmalloc and printk.
+#include <fcntl.h>
+#include <stdarg.h>
+#include "rpi.h"
+#include "pi-sd.h"
+#include "fat32.h"
+#include "fat32-helpers.h"
+
+static int fd = -1;
+
+void *kmalloc(unsigned nbytes) {
+    void *p = calloc(1, nbytes);
+    if(!p)
+        panic("calloc of %d bytes failed\n", nbytes);
+    return p;
+}
+void kmalloc_init(unsigned mb) { }
+
+int memiszero(const void *p, unsigned n) {
+    const uint8_t *x = p;
+    for(unsigned i = 0; i < n; i++)
+        if(x[i])
+            return 0;
+    return 1;
+}
+
+int printk(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vprintf(fmt, ap);
+    va_end(ap);
+    return n;
+}
+
+/***********************************************************************
+ * pi-sd.h
+ */
+void fake_sd_open(const char *name) {
+    fake_sd_close();
+    if((fd = open(name, O_RDWR)) < 0)
+        sys_die(open, "can't open disk image <%s>", name);
+}
+void fake_sd_close(void) {
+    if(fd >= 0)
+        close_nofail(fd);
+    fd = -1;
+}
+
+int pi_sd_init(void) {
+    demand(fd >= 0, "call fake_sd_open first");
+    return 1;
+}
+
+int pi_sd_read(void *data, uint32_t lba, uint32_t nsec) {
+    demand(fd >= 0, "SD card not initialized!");
+    unsigned n = nsec * NBYTES_PER_SECTOR;
+    if(pread(fd, data, n, (off_t)lba * NBYTES_PER_SECTOR) != n)
+        sys_die(pread, "short read: lba=%d, nsec=%d", lba, nsec);
+    return 1;
+}
+
+void *pi_sec_read(uint32_t lba, uint32_t nsec) {
+    void *data = kmalloc(nsec * NBYTES_PER_SECTOR);
+    pi_sd_read(data, lba, nsec);
+    return data;
+}
+
+int pi_sd_write(void *data, uint32_t lba, uint32_t nsec) {
+    demand(fd >= 0, "SD card not initialized!");
+    unsigned n = nsec * NBYTES_PER_SECTOR;
+    if(pwrite(fd, data, n, (off_t)lba * NBYTES_PER_SECTOR) != n)
+        sys_die(pwrite, "short write: lba=%d, nsec=%d", lba, nsec);
+    return 1;
+}
+
+/***********************************************************************
+ * mkfs: just enough of a FAT32 volume for fat32_mk.
+ */
+static void put_sec(int img, uint32_t lba, const void *sec) {
+    if(pwrite(img, sec, 512, (off_t)lba * 512) != 512)
+        sys_die(pwrite, "can't write lba=%d", lba);
+}
+
+void fake_sd_mkfs(const char *name, unsigned nmb) {
+    int img = open(name, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if(img < 0)
+        sys_die(open, "can't create <%s>", name);
+    uint32_t nsec = nmb * 2048;
+    // sparse file: everything we don't write is zero.
+    if(ftruncate(img, (off_t)nsec * 512) < 0)
+        sys_die(ftruncate, "can't size <%s>", name);
+
+    uint32_t part_lba = FAKE_SD_PART_LBA;
+    uint32_t part_nsec = nsec - part_lba;
+    unsigned reserved = 32, sec_per_cluster = 8;
+    // a bit too big is fine.
+    uint32_t nclusters = (part_nsec - reserved) / sec_per_cluster;
+    uint32_t nsec_per_fat = ((nclusters + 2) * 4 + 511) / 512;
+
+    mbr_t mbr;
+    memset(&mbr, 0, sizeof mbr);
+    mbr_partition_ent_t p;
+    memset(&p, 0, sizeof p);
+    p.part_type = 0xc;
+    p.lba_start = part_lba;
+    p.nsec = part_nsec;
+    memcpy(mbr.part_tab1, &p, sizeof p);
+    mbr.sigval = 0xAA55;
+    put_sec(img, 0, &mbr);
+
+    fat32_boot_sec_t b;
+    memset(&b, 0, sizeof b);
+    memcpy(b.asm_code, "\xeb\x58\x90", 3);
+    memcpy(b.oem, "MSWIN4.1", 8);
+    b.bytes_per_sec = 512;
+    b.sec_per_cluster = sec_per_cluster;
+    b.reserved_area_nsec = reserved;
+    b.nfats = 2;
+    b.media_type = 0xf8;
+    b.sec_per_track = 63;
+    b.n_heads = 255;
+    b.hidden_secs = part_lba;
+    b.nsec_in_fs = part_nsec;
+    b.nsec_per_fat = nsec_per_fat;
+    b.first_cluster = 2;
+    b.info_sec_num = 1;
+    b.backup_boot_loc = 6;
+    b.extended_sig = 0x29;
+    b.serial_num = 0x240c2025;
+    memcpy(b.volume_label, "NO NAME    ", 11);
+    memcpy(b.fs_type, "FAT32   ", 8);
+    b.sig = 0xAA55;
+    fat32_volume_id_check(&b);
+
+    struct fsinfo info;
+    memset(&info, 0, sizeof info);
+    info.sig1 = 0x41615252;
+    info.sig2 = 0x61417272;
+    info.sig3 = 0xaa550000;
+    info.free_cluster_count = nclusters - 1;
+    info.next_free_cluster = 3;
+
+    put_sec(img, part_lba, &b);
+    put_sec(img, part_lba + 1, &info);
+    put_sec(img, part_lba + 6, &b);
+    put_sec(img, part_lba + 7, &info);
+
+    // media byte, reserved, and the root directory's one cluster.
+    uint32_t fat[128];
+    memset(fat, 0, sizeof fat);
+    fat[0] = 0x0FFFFFF8;
+    fat[1] = 0x0FFFFFFF;
+    fat[2] = 0x0FFFFFFF;
+    for(unsigned i = 0; i < 2; i++)
+        put_sec(img, part_lba + reserved + i * nsec_per_fat, fat);
+
+    close_nofail(img);
+}
@@ -0,0 +1,18 @@
+#ifndef __FAKE_SD_H__
+#define __FAKE_SD_H__
+// file-backed replacement for the sd card (pi-sd.h): sector <lba> is
+// at byte offset <lba>*512 of the image.
+
+// use <name> as the sd card for the following pi_sd_* calls.
+void fake_sd_open(const char *name);
+void fake_sd_close(void);
+
+// make a fresh <nmb> megabyte disk image <name> the way the pi's
+// cards look: an mbr with one FAT32 partition at lba 2048, 8 sectors
+// per cluster, two FATs and an empty root directory at cluster 2.
+void fake_sd_mkfs(const char *name, unsigned nmb);
+
+// lba of the partition <fake_sd_mkfs> makes.
+enum { FAKE_SD_PART_LBA = 2048 };
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef __RPI_H__
+#define __RPI_H__
+// host stand-in for libpi's rpi.h: just enough for the fat32 code
+// (../fat32.c, ../bcache.c and the helpers) to run on top of a disk
+// image instead of the sd card.  see fake-sd.c.
+#include <string.h>
+#include "libunix.h"
+
+// never freed, just like on the pi.
+void *kmalloc(unsigned nbytes);
+void kmalloc_init(unsigned mb);
+
+// from libpi's libc.
+int memiszero(const void *p, unsigned n);
+
+// no format checking: the helpers use the pi-only %b.
+int printk(const char *fmt, ...);
+
+#include "fake-sd.h"
+
+#endif
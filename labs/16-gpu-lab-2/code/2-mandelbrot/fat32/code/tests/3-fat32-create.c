@@ -24,5 +24,6 @@ void notmain() {
   printk("Creating TEMP.TXT\n");
   fat32_delete(&fs, &root, "TEMP.TXT");
   assert(fat32_create(&fs, &root, "TEMP.TXT", 0));
+  fat32_flush(&fs);
   printk("PASS: %s\n", __FILE__);
 }
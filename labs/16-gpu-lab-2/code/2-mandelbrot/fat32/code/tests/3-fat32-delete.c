@@ -25,5 +25,6 @@ void notmain() {
   fat32_create(&fs, &root, "TEMP.TXT", 0);
   assert(fat32_delete(&fs, &root, "TEMP.TXT"));
 
+  fat32_flush(&fs);
   printk("PASS: %s\n", __FILE__);
 }
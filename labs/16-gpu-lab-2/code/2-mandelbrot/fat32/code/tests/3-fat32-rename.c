@@ -43,5 +43,6 @@ void notmain() {
   if (!fat32_rename(&fs, &root, old, new)) {
     panic("Unable to rename file!\n");
   }
+  fat32_flush(&fs);
   printk("PASS: %s\n", __FILE__);
 }
@@ -40,5 +40,6 @@ void notmain() {
   if (!fat32_truncate(&fs, &root, old, 0)) {
     panic("Unable to truncate file!\n");
   }
+  fat32_flush(&fs);
   printk("PASS: %s\n", __FILE__);
 }
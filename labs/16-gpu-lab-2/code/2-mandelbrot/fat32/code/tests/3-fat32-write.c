@@ -46,5 +46,6 @@ void notmain() {
   assert(fat32_write(&fs, &root, hello_name, &hello));
   printk("Check your SD card for a file called 'HELLO.TXT'\n");
 
+  fat32_flush(&fs);
   printk("PASS: %s\n", __FILE__);
 }
@@ -2,6 +2,8 @@
 
 #define NELEM(x) (sizeof(x) / sizeof((x)[0]))
 #include "cycle-util.h"
+#include "code-cache.h"
+#include "bench.h"
 
 typedef void (*int_fp)(void);
 
@@ -108,8 +110,12 @@ void specialized_call_int(void) {
     int_7();
 }
 
-static void inline int_compile(int_fp *intv, unsigned n) {
-    static unsigned code[20];
+// the generated callers live here.
+static code_cache_t *cc;
+
+static int_fp int_compile(int_fp *intv, unsigned n) {
+    cc_fn_t *f = cc_alloc(cc, "int_compile", n+2);
+    uint32_t *code = f->code;
     code[0] = armv6_push(lr);
     for (unsigned i = 1; i < n; i++) {
         code[i] = armv6_bl((uint32_t)&code[i], (uint32_t)intv[i-1]);
@@ -117,8 +123,23 @@ static void inline int_compile(int_fp *intv, unsigned n) {
     code[n] = armv6_pop(lr);
     code[n+1] = armv6_b((uint32_t)&code[n+1], (uint32_t)intv[n-1]);
     //code[n+2] = armv6_bx(lr);
-    
-    void (*fp)(void) = (typeof(fp))code;
+
+    // the caches may be on: make the new code visible to fetch.
+    return cc_commit(cc, f);
+}
+
+// benchmark wrappers: <bench_t> routines take a single argument.
+typedef struct { int_fp *intv; unsigned n; } intv_t;
+
+static void generic_bench(void *arg) {
+    intv_t *v = arg;
+    generic_call_int(v->intv, v->n);
+}
+static void specialized_bench(void *arg) {
+    specialized_call_int();
+}
+static void jit_bench(void *arg) {
+    int_fp fp = arg;
     fp();
 }
 
@@ -135,6 +156,9 @@ void notmain(void) {
     };
 
     cycle_cnt_init();
+    kmalloc_init(1);
+    kheap_init(64*1024);
+    cc = cc_mk("int-compile", 16*1024);
 
     unsigned n = NELEM(intv);
 
@@ -144,18 +168,27 @@ void notmain(void) {
     //  2. invalidate cache before use.
     // enable_cache();
 
+    // sanity check each caller once: every handler runs.
+    intv_t v = { intv, n };
     cnt = 0;
-    TIME_CYC_PRINT10("cost of generic-int calling",  generic_call_int(intv,n));
-    demand(cnt == n*10, "cnt=%d, expected=%d\n", cnt, n*10);
+    generic_bench(&v);
+    demand(cnt == n, "cnt=%d, expected=%d\n", cnt, n);
 
     // rewrite to generate specialized caller dynamically.
     cnt = 0;
-    TIME_CYC_PRINT10("cost of specialized int calling", specialized_call_int() );
-    demand(cnt == n*10, "cnt=%d, expected=%d\n", cnt, n*10);
+    specialized_bench(0);
+    demand(cnt == n, "cnt=%d, expected=%d\n", cnt, n);
 
+    int_fp fp = int_compile(intv, n);
     cnt = 0;
-    TIME_CYC_PRINT10("cost of specialized int calling", int_compile(intv, n) );
-    demand(cnt == n*10, "cnt=%d, expected=%d\n", cnt, n*10);
+    jit_bench(fp);
+    demand(cnt == n, "cnt=%d, expected=%d\n", cnt, n);
+
+    // cycles per call of each caller.
+    BENCH_ADD(generic_bench, &v, BENCH_WARM | BENCH_COLD);
+    BENCH_ADD(specialized_bench, 0, BENCH_WARM | BENCH_COLD);
+    BENCH_ADD(jit_bench, fp, BENCH_WARM | BENCH_COLD);
+    bench_run_all(0);
 
     clean_reboot();
 }
@@ -0,0 +1,92 @@
+// inline every GET32/PUT32/GET8/PUT8 call in the binary at once
+// (inline-all.c): the tests below, and every libpi driver linked in,
+// including the uart that prints this.  check the results, compare the
+// cost before and after, then undo and check the code is back to what
+// it was.
+#include "rpi.h"
+#include "cycle-count.h"
+#include "inline-all.h"
+
+static volatile uint32_t word;
+static volatile uint8_t byte;
+
+static void get32_10(void) {
+    GET32((uint32_t)&word); GET32((uint32_t)&word);
+    GET32((uint32_t)&word); GET32((uint32_t)&word);
+    GET32((uint32_t)&word); GET32((uint32_t)&word);
+    GET32((uint32_t)&word); GET32((uint32_t)&word);
+    GET32((uint32_t)&word); GET32((uint32_t)&word);
+}
+
+static void put32_10(void) {
+    PUT32((uint32_t)&word, 1); PUT32((uint32_t)&word, 2);
+    PUT32((uint32_t)&word, 3); PUT32((uint32_t)&word, 4);
+    PUT32((uint32_t)&word, 5); PUT32((uint32_t)&word, 6);
+    PUT32((uint32_t)&word, 7); PUT32((uint32_t)&word, 8);
+    PUT32((uint32_t)&word, 9); PUT32((uint32_t)&word, 10);
+}
+
+static void barrier_10(void) {
+    dev_barrier(); dev_barrier(); dev_barrier(); dev_barrier(); dev_barrier();
+    dev_barrier(); dev_barrier(); dev_barrier(); dev_barrier(); dev_barrier();
+}
+
+// the accessors still do what they say.
+static void check(unsigned n) {
+    for(uint32_t i = 0; i < n; i++) {
+        PUT32((uint32_t)&word, i * 0x01010101);
+        if(GET32((uint32_t)&word) != i * 0x01010101)
+            panic("GET32 got %x, expected %x\n", word, i * 0x01010101);
+        put32(&word, ~i);
+        if(get32(&word) != ~i)
+            panic("get32 got %x, expected %x\n", word, ~i);
+        PUT8((uint32_t)&byte, i);
+        if(GET8((uint32_t)&byte) != (uint8_t)i)
+            panic("GET8 got %x, expected %x\n", byte, (uint8_t)i);
+        dev_barrier();
+    }
+    assert(word == ~(n-1));
+}
+
+static uint32_t code_sum(void) {
+    extern uint32_t __code_start__[], __code_end__[];
+    uint32_t sum = 0;
+    for(uint32_t *p = __code_start__; p < __code_end__; p++)
+        sum = sum * 31 + *p;
+    return sum;
+}
+
+static void time_all(const char *msg) {
+    output("%s: get32 x10 = %d cycles, put32 x10 = %d, dev_barrier x10 = %d\n",
+        msg, TIME_CYC(get32_10()), TIME_CYC(put32_10()), TIME_CYC(barrier_10()));
+}
+
+void notmain(void) {
+    check(100);
+    uint32_t sum = code_sum();
+    time_all("calls");
+    caches_enable();
+    time_all("calls, caches on");
+
+    unsigned n = inline_all();
+    inline_all_stats_t s = inline_all_stats();
+    output("inlined %d sites: %d loads, %d stores, %d literals skipped, "
+           "scanning %d words in %d cycles\n", 
+           n, s.nget, s.nput, s.nliteral, s.nscan, s.cycles);
+    // at least the ones above.
+    assert(s.nget >= 10 && s.nput >= 10);
+    assert(n == s.nget + s.nput);
+    assert(code_sum() != sum);
+    // nothing left to find.
+    assert(inline_all() == 0);
+
+    check(100);
+    time_all("inlined, caches on");
+
+    inline_all_undo();
+    if(code_sum() != sum)
+        panic("undo did not restore the code\n");
+    check(100);
+    time_all("undone, caches on");
+    trace("SUCCESS\n");
+}
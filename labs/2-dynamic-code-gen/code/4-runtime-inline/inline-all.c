@@ -0,0 +1,162 @@
+// rewrite every call to GET32/PUT32 and friends in one pass: see 
+// inline-all.h
+#include "inline-all.h"
+#include "rpi-inline-asm.h"
+#include "cycle-count.h"
+
+enum { GET, PUT };
+
+// each accessor and what replaces a call to it (minus the condition).
+static struct target {
+    uint32_t addr;
+    uint32_t inst;
+    int kind;
+} targets[16];
+static unsigned ntargets;
+
+static void target_add(void *fn, uint32_t inst, int kind) {
+    uint32_t addr = (uint32_t)fn;
+    // aliases (GET32 and get32) have the same address.
+    for(unsigned i = 0; i < ntargets; i++)
+        if(targets[i].addr == addr)
+            return;
+    assert(ntargets < sizeof targets / sizeof targets[0]);
+    targets[ntargets++] = (struct target){ addr, inst, kind };
+}
+
+static void targets_init(void) {
+    if(ntargets)
+        return;
+    target_add(GET32,       0xe5900000, GET);       // ldr r0, [r0]
+    target_add(get32,       0xe5900000, GET);
+    target_add(PUT32,       0xe5801000, PUT);       // str r1, [r0]
+    target_add(put32,       0xe5801000, PUT);
+    target_add(GET8,        0xe5d00000, GET);       // ldrb r0, [r0]
+    target_add(get8,        0xe5d00000, GET);
+    target_add(PUT8,        0xe5c01000, PUT);       // strb r1, [r0]
+    target_add(put8,        0xe5c01000, PUT);
+    // no barriers: see inline-all.h.
+}
+
+// where bl<cond> at <pc> goes, or 0 if it's not one.
+static uint32_t bl_target(uint32_t *pc) {
+    uint32_t inst = *pc;
+    // cond = 0b1111 is blx.
+    if((inst & 0x0f000000) != 0x0b000000 || (inst >> 28) == 0xf)
+        return 0;
+    int32_t off = (int32_t)(inst << 8) >> 6;    // sign-extended, * 4
+    return (uint32_t)pc + 8 + off;
+}
+
+// the word(s) a pc-relative load at <pc> reads: returns how many
+// (0 if it isn't one) and the first in <*addr>.
+static unsigned pc_load_target(uint32_t *pc, uint32_t *addr) {
+    uint32_t inst = *pc, base = (uint32_t)pc + 8, off, n;
+    int up = (inst >> 23) & 1;
+
+    // ldr, ldrb: cond 01IP UBW1 1111 ... with I=0
+    if((inst & 0x0e1f0000) == 0x041f0000) {
+        off = inst & 0xfff;
+        n = 1;
+    // ldrh, ldrsb, ldrsh, ldrd (imm): cond 000P U1W? 1111 .... 1sh1 ....
+    } else if((inst & 0x0e4f0090) == 0x004f0090 && (inst & 0x60)) {
+        off = ((inst >> 4) & 0xf0) | (inst & 0xf);
+        // ldrd: L=0, sh=10
+        n = (!(inst & (1<<20)) && (inst & 0x60) == 0x40) ? 2 : 1;
+    // vldr: cond 1101 U0 01 1111 .... 101s ....
+    } else if((inst & 0x0f3f0e00) == 0x0d1f0a00) {
+        off = (inst & 0xff) * 4;
+        n = (inst & (1<<8)) ? 2 : 1;
+    } else
+        return 0;
+    *addr = (up ? base + off : base - off) & ~3;
+    return n;
+}
+
+static struct target *target_lookup(uint32_t addr) {
+    for(unsigned i = 0; i < ntargets; i++)
+        if(targets[i].addr == addr)
+            return &targets[i];
+    return 0;
+}
+
+static struct undo {
+    uint32_t *pc;
+    uint32_t orig;
+} undo[INLINE_ALL_MAX_SITES];
+static unsigned nundo;
+
+static inline_all_stats_t stats;
+
+unsigned inline_all(void) {
+    extern uint32_t __code_start__[], __code_end__[];
+    targets_init();
+
+    uint32_t t = cycle_cnt_read();
+
+    // find every site before changing anything so we can't run out of
+    // undo space halfway.
+    unsigned n0 = nundo;
+    for(uint32_t *pc = __code_start__; pc < __code_end__; pc++) {
+        stats.nscan++;
+        uint32_t addr = bl_target(pc);
+        if(!addr || !target_lookup(addr))
+            continue;
+        if(nundo == INLINE_ALL_MAX_SITES)
+            panic("more than %d call sites\n", INLINE_ALL_MAX_SITES);
+        undo[nundo++] = (struct undo){ pc, *pc };
+    }
+
+    // drop sites that some pc-relative load reads: they're literals.
+    // the sites are in address order, so binary search.
+    for(uint32_t *pc = __code_start__; pc < __code_end__; pc++) {
+        uint32_t addr;
+        unsigned n = pc_load_target(pc, &addr);
+        for(; n; n--, addr += 4) {
+            unsigned lo = n0, hi = nundo;
+            while(lo < hi) {
+                unsigned mid = (lo + hi) / 2;
+                if((uint32_t)undo[mid].pc < addr)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            if(lo < nundo && (uint32_t)undo[lo].pc == addr) {
+                memmove(&undo[lo], &undo[lo+1], (nundo - lo - 1) * sizeof undo[0]);
+                nundo--;
+                stats.nliteral++;
+            }
+        }
+    }
+
+    uint32_t cpsr = cpsr_int_disable();
+    for(unsigned i = n0; i < nundo; i++) {
+        uint32_t *pc = undo[i].pc;
+        struct target *x = target_lookup(bl_target(pc));
+        *pc = (*pc & 0xf0000000) | (x->inst & 0x0fffffff);
+        switch(x->kind) {
+        case GET:     stats.nget++; break;
+        case PUT:     stats.nput++; break;
+        }
+    }
+    flush_caches();
+    cpsr_int_reset(cpsr);
+
+    stats.cycles += cycle_cnt_read() - t;
+    return nundo - n0;
+}
+
+void inline_all_undo(void) {
+    uint32_t cpsr = cpsr_int_disable();
+    while(nundo) {
+        nundo--;
+        *undo[nundo].pc = undo[nundo].orig;
+    }
+    flush_caches();
+    cpsr_int_reset(cpsr);
+    memset(&stats, 0, sizeof stats);
+}
+
+inline_all_stats_t inline_all_stats(void) {
+    return stats;
+}
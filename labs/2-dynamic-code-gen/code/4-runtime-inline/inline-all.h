@@ -0,0 +1,49 @@
+#ifndef __INLINE_ALL_H__
+#define __INLINE_ALL_H__
+// eager, whole-program version of runtime-inline.c: instead of trapping
+// each call site to GET32_inline the first time it runs, scan all of
+// [__code_start__, __code_end__) once and rewrite every
+//      bl<cond> <accessor>
+// to the one instruction the accessor does, with the same condition:
+//      GET32, get32    ldr  r0, [r0]
+//      PUT32, put32    str  r1, [r0]
+//      GET8, get8      ldrb r0, [r0]
+//      PUT8, put8      strb r1, [r0]
+// barriers (dev_barrier, dsb, dmb) stay calls: their mcr needs r0=0
+// (it's should-be-zero), which takes a <mov r0, #0> first, and a bl site
+// only has room for one instruction.  running the mcr with whatever the
+// caller left in r0 is unpredictable.  tail calls (b, not bl) are left
+// alone since they need the accessor's return.
+//
+// all the sites are rewritten with interrupts off, followed by a single
+// cache flush.  every original word goes in an undo log, so
+// <inline_all_undo> puts the program back exactly.
+//
+// the binary has no symbol table at runtime, so the scan can't see
+// where code stops and a literal pool starts.  instead, any word that
+// a pc-relative load (ldr, ldrb/ldrh/ldrd, vldr) in [__code_start__,
+// __code_end__) reads is data, and it isn't patched even if it looks
+// like a bl to an accessor.  that's every literal gcc emits; a table
+// only reached through adr + register offset isn't caught.
+#include "rpi.h"
+
+typedef struct {
+    unsigned nscan;             // words looked at
+    unsigned nget, nput;        // sites rewritten, loads and stores
+    unsigned nliteral;          // bl-looking words skipped: they're data.
+    unsigned cycles;            // scan + rewrite + flush
+} inline_all_stats_t;
+
+enum { INLINE_ALL_MAX_SITES = 4096 };
+
+// rewrite every call site: returns how many.  calling it again finds
+// none (the sites are gone).
+unsigned inline_all(void);
+
+// put every rewritten site back, newest first.
+void inline_all_undo(void);
+
+// stats for the sites currently rewritten.
+inline_all_stats_t inline_all_stats(void);
+
+#endif
@@ -0,0 +1,99 @@
+// check the sparse matrix-vector jit against <csr_mult> and <vec_dot>:
+// square matrices from matrix-lib.h over a sparsity sweep, then wide
+// matrices with values that hit every code path (shifts, pool constants,
+// pools in the middle of a routine, x windows past 4k).
+#include "jit-dotproduct.h"
+#include "spmv-jit.h"
+
+static void check(const char *msg, csr_t *m, unsigned rows_per_block, 
+                  uint32_t *x, uint32_t *exp) {
+    uint32_t *y = vec_new(m->nrows);
+    spmv_t *s = spmv_jit(m, rows_per_block);
+    spmv_run(s, x, y);
+    for(unsigned i = 0; i < m->nrows; i++)
+        if(y[i] != exp[i])
+            panic("%s: rows_per_block=%d: y[%d]=%x, expected %x\n", 
+                msg, rows_per_block, i, y[i], exp[i]);
+    spmv_free(s);
+}
+
+static void check_square(unsigned n, unsigned percent_0) {
+    uint32_t **a = matrix_mk(n, percent_0);
+    uint32_t *x = vec_mk(n, 0);
+    csr_t m = csr_mk(a, n);
+
+    uint32_t *exp = vec_new(n);
+    csr_mult(&m, x, exp);
+    for(unsigned i = 0; i < n; i++)
+        assert(exp[i] == vec_dot(a[i], x, n));
+
+    unsigned rpb[] = { 1, 16, n };
+    for(unsigned i = 0; i < 3; i++)
+        check("square", &m, rpb[i], x, exp);
+}
+
+// <nrows> x <ncols>, about half zeros, with values that are powers of
+// two, sums and differences of them, and anything.
+static csr_t mk_wide(unsigned nrows, unsigned ncols) {
+    csr_t m = { .nrows = nrows, .ncols = ncols };
+    m.rowptr = calloc(nrows + 1, sizeof(uint32_t));
+    m.col = calloc(nrows * ncols, sizeof(uint32_t));
+    m.val = calloc(nrows * ncols, sizeof(uint32_t));
+    for(unsigned i = 0; i < nrows; i++) {
+        m.rowptr[i] = m.nnz;
+        for(unsigned j = 0; j < ncols; j++) {
+            if(random() % 2)
+                continue;
+            uint32_t v, k = random() % 32, l = random() % 32;
+            switch(random() % 5) {
+            case 0:  v = 1u << k; break;
+            case 1:  v = (1u << k) + (1u << l); break;
+            case 2:  v = (1u << k) - (1u << l); break;
+            case 3:  v = random() & 0xff; break;
+            default: v = random(); break;
+            }
+            m.col[m.nnz] = j;
+            m.val[m.nnz++] = v ? v : 1;
+        }
+    }
+    m.rowptr[nrows] = m.nnz;
+    return m;
+}
+
+static void check_wide(unsigned nrows, unsigned ncols) {
+    csr_t m = mk_wide(nrows, ncols);
+    uint32_t *x = vec_mk(ncols, 0);
+    for(unsigned j = 0; j < ncols; j++)
+        x[j] = random();
+    uint32_t *exp = vec_new(nrows);
+    csr_mult(&m, x, exp);
+
+    spmv_t *s = spmv_jit(&m, nrows);
+    output("%dx%d: %d non-zeros, %d words: %d shift/add, %d mul, "
+           "%d pool words, %d islands\n", nrows, ncols, m.nnz, s->nwords,
+        s->stats.nshift, s->stats.nmul, s->stats.npool, s->stats.nisland);
+    assert(s->stats.nshift + s->stats.nmul == m.nnz);
+    assert(s->stats.nshift && s->stats.npool && s->stats.nisland);
+    spmv_free(s);
+
+    check("wide", &m, 1, x, exp);
+    check("wide", &m, 3, x, exp);
+    check("wide", &m, nrows, x, exp);
+}
+
+void notmain(void) {
+    kmalloc_init(16);
+    kheap_init(4 * 1024 * 1024);
+
+    unsigned sizes[] = { 1, 7, 64, 200 };
+    for(unsigned i = 0; i < 4; i++)
+        for(unsigned percent_0 = 0; percent_0 <= 100; percent_0 += 25)
+            check_square(sizes[i], percent_0);
+    output("square matrices match csr_mult and vec_dot\n");
+
+    check_wide(8, 3000);
+    output("wide matrices match csr_mult\n");
+
+    kheap_stats_print(kheap_root());
+    trace("SUCCESS\n");
+}
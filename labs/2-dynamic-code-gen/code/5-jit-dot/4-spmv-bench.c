@@ -0,0 +1,60 @@
+// cycles per non-zero for y = a*x, across the same sparsity sweep as
+// 2-full-test.c:
+//   - dot:   <vec_dot> of each row with x (dense, every zero multiplied);
+//   - mult:  <matrix_mult> by a matrix whose columns are all x, divided
+//            by n (the per-vector cost of doing it as a matrix multiply);
+//   - csr:   <csr_mult>, the interpreted sparse loop;
+//   - jit:   <spmv_run>.
+#include "jit-dotproduct.h"
+#include "spmv-jit.h"
+
+enum { ntrials = 2, rows_per_block = 32 };
+
+static unsigned per_nnz(unsigned cyc, unsigned nnz) {
+    return nnz ? cyc / nnz : cyc;
+}
+
+static void bench(unsigned n, unsigned percent_0, uint32_t **xm, uint32_t **c) {
+    uint32_t **a = matrix_mk(n, percent_0);
+    uint32_t *x = vec_mk(n, 0);
+    uint32_t *y0 = vec_new(n), *y1 = vec_new(n);
+    for(unsigned i = 0; i < n; i++)
+        for(unsigned j = 0; j < n; j++)
+            xm[i][j] = x[i];
+
+    csr_t m = csr_mk(a, n);
+    spmv_t *s = spmv_jit(&m, rows_per_block);
+    output("n=%d, percent zero=%d: %d non-zeros, %d words of code "
+           "(%d shift/add, %d mul)\n", n, percent_0, m.nnz, s->nwords, 
+           s->stats.nshift, s->stats.nmul);
+
+    for(unsigned t = 0; t < ntrials; t++) {
+        unsigned dot = TIME_CYC(
+            for(unsigned i = 0; i < n; i++)
+                y0[i] = vec_dot(a[i], x, n));
+        unsigned mult = TIME_CYC(matrix_mult(c, a, xm, n)) / n;
+        unsigned csr = TIME_CYC(csr_mult(&m, x, y0));
+        unsigned jit = TIME_CYC(spmv_run(s, x, y1));
+        for(unsigned i = 0; i < n; i++)
+            if(y0[i] != y1[i] || c[i][0] != y1[i])
+                panic("y[%d]: csr=%d, mult=%d, jit=%d\n", i, y0[i], c[i][0], y1[i]);
+
+        output("   cycles/non-zero: dot=%d mult=%d csr=%d jit=%d\n",
+            per_nnz(dot, m.nnz), per_nnz(mult, m.nnz), 
+            per_nnz(csr, m.nnz), per_nnz(jit, m.nnz));
+    }
+    spmv_free(s);
+}
+
+void notmain(void) {
+    kmalloc_init(64);
+    kheap_init(8 * 1024 * 1024);
+    caches_enable();
+
+    for(unsigned n = 32; n <= 128; n *= 2) {
+        uint32_t **xm = matrix_new(n), **c = matrix_new(n);
+        for(unsigned percent_0 = 0; percent_0 < 100;  percent_0 += 15)
+            bench(n, percent_0, xm, c);
+    }
+    trace("SUCCESS\n");
+}
@@ -1,9 +1,9 @@
 #ifndef __ARENA_H__
 #define __ARENA_H__
 
-#include "rpi.h"
+// rpi.h, or libunix.h when built with RPI_UNIX.
+#include "kheap.h"
 #include "pointer.h"
-// #include "kr-malloc.h"
 
 typedef struct arena {
     unsigned total_nbytes;
@@ -11,23 +11,42 @@ typedef struct arena {
     void *end;
 
     void *cur;
+
+    // heap the arena came from (0 = kmalloc, can't be freed).
+    kheap_t *heap;
 } arena_t;
 
+static inline arena_t *
+arena_init(arena_t *a, void *base, unsigned total_nbytes, kheap_t *h) {
+    assert(a);
+    assert(base);
+
+    a->total_nbytes = total_nbytes;
+    a->cur = a->base = base;
+    a->end = (char*)a->base+total_nbytes;
+    a->heap = h;
+    return a;
+}
+
 static inline arena_t *
 arena_mk(unsigned total_nbytes) {
     assert(total_nbytes > 1024);
     assert(total_nbytes <= 64 * 1024 * 1024);
     assert(total_nbytes % 8 == 0);
 
-    arena_t *a = kmalloc(sizeof *a);
-    assert(a);
+    return arena_init(kmalloc(sizeof(arena_t)), 
+                        kmalloc(total_nbytes), total_nbytes, 0);
+}
 
-    a->total_nbytes = total_nbytes;
-    a->cur = a->base = kmalloc(total_nbytes);
-    assert(a->base);
-    a->end = (char*)a->base+total_nbytes;
+// same, but allocated from heap <h> so that <arena_destroy> can
+// give it back.
+static inline arena_t *
+arena_mk_in(kheap_t *h, unsigned total_nbytes) {
+    assert(total_nbytes > 1024);
+    assert(total_nbytes % 8 == 0);
 
-    return a;
+    return arena_init(kheap_alloc(h, sizeof(arena_t)), 
+                        kheap_alloc_notzero(h, total_nbytes), total_nbytes, h);
 }
 
 static inline void *
@@ -36,14 +55,14 @@ arena_alloc_notzero(arena_t *a, unsigned n) {
     // prevent int overflow.
     assert(n < a->total_nbytes);
 
-    n = roundup(n,8);
+    n = (n + 7) & ~7;
     assert(n%8==0);
 
     void *ptr = a->cur;
     void *new_cur = (char*)ptr + n;
     if(new_cur >= a->end)
         panic("out of space: can't allocated %d bytes, have %d left, out of %d!\n", 
-            n, ptr_diff(a->end, a->cur), a->total_nbytes);
+            n, (int)ptr_diff(a->end, a->cur), a->total_nbytes);
     
     a->cur = new_cur;
     return ptr;
@@ -62,16 +81,19 @@ arena_reset(arena_t *a) {
 }
 
 
-#if 0
+// free the arena and everything in it: only works for arenas 
+// made with <arena_mk_in>.
 static inline void 
-arena_free_all(arena_t *a) {
-    // doesn't work.
+arena_destroy(arena_t *a) {
     assert(a);
+    if(!a->heap)
+        panic("can't destroy an arena allocated with kmalloc\n");
+
+    // catch use-after-destroy.
     memset(a->base, 0xfa, a->total_nbytes);
-    kr_free(a->base);
-    
+    kfree(a->base);
+
     memset(a, 0xfa, sizeof *a);
-    kr_free(a);
+    kfree(a);
 }
 #endif
-#endif
@@ -2,20 +2,18 @@
 #include "jit-dotproduct.h"
 
 #include "armv6-encodings.h"
-#include "arena.h"
-
-arena_t *jit_arena;
+#include "code-cache.h"
 
+// every routine <jit_dot> makes lives here until <jit_free_all>.
+static code_cache_t *jit_cc;
 
 void jit_free_all(void) {
-    void flush_caches(void);
-
-    arena_reset(jit_arena);
-    flush_caches();
+    cc_reset(jit_cc);
 }
 void jit_init(void) {
     kmalloc_init(4);
-    jit_arena = arena_mk(1024*1024);
+    kheap_init(1024*1024);
+    jit_cc = cc_mk("jit-dot", 512*1024);
 }
 
 
@@ -29,10 +27,13 @@ void jit_init(void) {
 // this is a simple example of "partial evaluation"
 vec_fn_t jit_dot(uint32_t *b, unsigned n) {
     
-    // gross: we don't know a-priori how much code we
-    // need. max would be about 6 instructions * n
-    unsigned n_inst = 10*n;
-    uint32_t *code = calloc(n_inst, 4), 
+    // exactly: 3 for sum = 0, 5 per non-zero, and the mov + bx.
+    unsigned nnz = 0;
+    for(int i = 0; i < n; i++)
+        nnz += b[i] != 0;
+    unsigned n_inst = 3 + 5*nnz + 2;
+    cc_fn_t *f = cc_alloc(jit_cc, "dot", n_inst);
+    uint32_t *code = f->code, 
             *cp = code, 
             *end = code+n_inst;
 
@@ -54,11 +55,11 @@ vec_fn_t jit_dot(uint32_t *b, unsigned n) {
     // iterate over each non-zero and generate a multiply 
     // accumlate into sum.
     for(int i = 0; i < n; i++) {
-        assert((cp + 10) < end);
-
         // skip zeros.
         if(b[i] == 0)
             continue;
+        // leave room for the mov + bx.
+        assert((cp + 5) <= end - 2);
 
         /* 
             1. set  a_i = a[i].  (this happens once)
@@ -76,9 +77,9 @@ vec_fn_t jit_dot(uint32_t *b, unsigned n) {
     // can get rid of this by changing the last instruction.
     *cp++ = armv6_mov(reg_mk(0), sum);
     *cp++ = armv6_bx(lr);
-    assert(cp<end);
+    assert(cp == end);
 
-    return (void*)code;
+    return cc_commit(jit_cc, f);
 }
 
 // look at the machine code to see if there are any additional
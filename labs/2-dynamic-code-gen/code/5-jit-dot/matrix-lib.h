@@ -9,8 +9,6 @@
 #include "cycle-count.h"
 #include "arena.h"
 
-extern arena_t *jit_arena;
-
 // trivial veneer so unix code works with libpi
 static uint32_t random(void) { 
     return pi_random();
@@ -18,11 +16,7 @@ static uint32_t random(void) {
 
 static void *
 calloc(unsigned n, unsigned e) {
-#if 1
     void *p = kmalloc(n*e);
-#else
-    void *p = arena_alloc(jit_arena, n*e);
-#endif
     assert(p);
     return p;
 }
@@ -146,4 +140,49 @@ vec_mk(unsigned n, unsigned percent_0) {
     return a;
 }
 
+// compressed sparse row (CSR): row i's non-zeros are val[k] at column
+// col[k] for k in [rowptr[i], rowptr[i+1]), columns increasing.
+typedef struct {
+    unsigned nrows, ncols, nnz;
+    uint32_t *rowptr;
+    uint32_t *col;
+    uint32_t *val;
+} csr_t;
+
+// the non-zeros of nxn matrix <a>.
+static inline csr_t
+csr_mk(uint32_t **a, unsigned n) {
+    csr_t m = { .nrows = n, .ncols = n };
+    for(int i = 0; i < n; i++)
+        for(int j = 0; j < n; j++)
+            m.nnz += a[i][j] != 0;
+
+    m.rowptr = calloc(n+1, sizeof(uint32_t));
+    m.col = calloc(m.nnz, sizeof(uint32_t));
+    m.val = calloc(m.nnz, sizeof(uint32_t));
+    unsigned k = 0;
+    for(int i = 0; i < n; i++) {
+        m.rowptr[i] = k;
+        for(int j = 0; j < n; j++) {
+            if(!a[i][j])
+                continue;
+            m.col[k] = j;
+            m.val[k++] = a[i][j];
+        }
+    }
+    m.rowptr[n] = k;
+    return m;
+}
+
+// y = m*x, the usual way.
+static void
+csr_mult(const csr_t *m, const uint32_t *x, uint32_t *y) {
+    for(unsigned i = 0; i < m->nrows; i++) {
+        uint32_t s = 0;
+        for(unsigned k = m->rowptr[i]; k < m->rowptr[i+1]; k++)
+            s += m->val[k] * x[m->col[k]];
+        y[i] = s;
+    }
+}
+
 #endif
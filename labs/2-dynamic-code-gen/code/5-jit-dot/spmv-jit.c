@@ -0,0 +1,280 @@
+// jit a CSR matrix into one routine per block of rows: see spmv-jit.h
+#include "spmv-jit.h"
+#include "armv6-encodings.h"
+#include "kheap.h"
+#include "code-cache.h"
+
+// registers in the generated code: all caller-saved except lr.
+static const reg_t 
+    rx   = { 0 },           // x, moved along in 4k windows
+    ry   = { 1 },           // the block's part of y
+    rsum = { 12 },          // the row's sum so far
+    rk   = { armv6_lr };    // constant for a mul/mla
+// x[col] alternates between these, so the next one can load early.
+static const reg_t rxv[2] = { { 2 }, { 3 } };
+
+enum {
+    // an ldr from the pc reaches 4095 bytes ahead: keep every pending
+    // constant well inside that.
+    POOL_REACH = 1000,
+    // most words emitted between two checks: a non-zero (window move,
+    // ldr, two ops) and the end of a row (mov, str).
+    TERM_WORDS = 6,
+    MAX_POOL = 1024,
+};
+
+typedef struct {
+    uint32_t *code;     // 0 = just measuring
+    unsigned off;
+    int window;         // r0 = x + window * 4096 bytes
+
+    // constants waiting for the next pool, and the ldr's that need them.
+    uint32_t pool[MAX_POOL];
+    unsigned npool;
+    struct { unsigned off, slot; } fix[MAX_POOL];
+    unsigned nfix;
+
+    spmv_t *s;
+} emit_t;
+
+static void emit(emit_t *e, uint32_t inst) {
+    if(e->code)
+        e->code[e->off] = inst;
+    e->off++;
+}
+
+// place the pending constants here and point their ldr's at them.
+static void pool_flush(emit_t *e) {
+    unsigned base = e->off;
+    for(unsigned i = 0; i < e->npool; i++)
+        emit(e, e->pool[i]);
+    if(e->code) {
+        for(unsigned i = 0; i < e->nfix; i++) {
+            unsigned at = e->fix[i].off;
+            int delta = 4 * (base + e->fix[i].slot) - 4 * (at + 2);
+            e->code[at] = armv6_ldr_off12(rk, reg_mk(armv6_pc), delta);
+        }
+        e->s->stats.npool += e->npool;
+    }
+    e->npool = e->nfix = 0;
+}
+
+// if one more step could put the oldest pending ldr out of reach of
+// the pool, place the pool here and branch around it.
+static void pool_maybe_island(emit_t *e) {
+    if(!e->nfix)
+        return;
+    unsigned dist = e->off + TERM_WORDS + 1 + e->npool + 1 - e->fix[0].off;
+    if(dist < POOL_REACH && e->npool < MAX_POOL - 1)
+        return;
+
+    unsigned b = e->off;
+    emit(e, 0);
+    pool_flush(e);
+    if(e->code) {
+        e->code[b] = armv6_b_cond(cond_always, (uint32_t)&e->code[b], 
+                                               (uint32_t)&e->code[e->off]);
+        e->s->stats.nisland++;
+    }
+}
+
+// rk = v.
+static void load_const(emit_t *e, uint32_t v) {
+    uint32_t imm8;
+    unsigned rot4;
+    if(armv6_imm8_rot4_ok(v, &imm8, &rot4))
+        emit(e, armv6_mov_imm8_rot4(rk, imm8, rot4));
+    else if(armv6_imm8_rot4_ok(~v, &imm8, &rot4))
+        emit(e, armv6_dp_imm8_rot4(cond_always, armv6_mvn, 0, rk, reg_mk(0), imm8, rot4));
+    else {
+        unsigned slot;
+        for(slot = 0; slot < e->npool; slot++)
+            if(e->pool[slot] == v)
+                break;
+        if(slot == e->npool)
+            e->pool[e->npool++] = v;
+        e->fix[e->nfix].off = e->off;
+        e->fix[e->nfix++].slot = slot;
+        emit(e, 0);     // patched by <pool_flush>
+    }
+}
+
+// rd = x[col]
+static void load_x(emit_t *e, reg_t rd, unsigned col) {
+    int w = col / 1024;
+    if(w != e->window) {
+        int d = w - e->window;
+        unsigned op = d > 0 ? armv6_add : armv6_sub;
+        // |d| rotated right by 20 = |d| * 4096.
+        emit(e, armv6_dp_imm8_rot4(cond_always, op, 0, rx, rx, d > 0 ? d : -d, 20));
+        e->window = w;
+    }
+    emit(e, armv6_ldr_off12(rd, rx, 4 * (col % 1024)));
+}
+
+// rsum = rsum <op> (x << sh), or just (x << sh) if this is the row's 
+// first term.
+static void acc(emit_t *e, unsigned op, reg_t x, unsigned sh, int first) {
+    if(first) {
+        emit(e, armv6_dp_reg(cond_always, op_mov, 0, rsum, reg_mk(0), x, armv6_lsl, sh));
+        if(op == armv6_sub)
+            emit(e, armv6_dp_imm8_rot4(cond_always, armv6_rsb, 0, rsum, rsum, 0, 0));
+    } else
+        emit(e, armv6_dp_reg(cond_always, op, 0, rsum, rsum, x, armv6_lsl, sh));
+}
+
+// can x * v be done with at most two shifted adds/subs?  if so, the
+// shifts and whether the second one subtracts.
+static int shift_add(uint32_t v, unsigned *k, int *m, int *sub_p) {
+    *sub_p = 0;
+    *m = -1;
+    if(!v)
+        return 0;
+    // 2^k
+    if(__builtin_popcount(v) == 1) {
+        *k = __builtin_ctz(v);
+        return 1;
+    }
+    // 2^k + 2^m
+    if(__builtin_popcount(v) == 2) {
+        *k = 31 - __builtin_clz(v);
+        *m = __builtin_ctz(v);
+        return 1;
+    }
+    // 2^k - 2^m
+    uint32_t lo = v & -v;
+    if(__builtin_popcount(v + lo) == 1) {
+        *k = __builtin_ctz(v + lo);
+        *m = __builtin_ctz(lo);
+        *sub_p = 1;
+        return 1;
+    }
+    // -2^m: 2^32 - 2^m, the case above that overflowed.
+    if(__builtin_popcount(-v) == 1) {
+        *k = 32;
+        *m = __builtin_ctz(v);
+        *sub_p = 1;
+        return 1;
+    }
+    return 0;
+}
+
+// rsum (+)= x * v
+static void mul_add(emit_t *e, reg_t x, uint32_t v, int first) {
+    unsigned k;
+    int m, sub_p;
+
+    if(!v) {
+        if(first)
+            emit(e, armv6_mov_imm8(rsum, 0));
+        return;
+    }
+    if(shift_add(v, &k, &m, &sub_p)) {
+        if(k < 32) {
+            acc(e, armv6_add, x, k, first);
+            first = 0;
+        }
+        if(m >= 0)
+            acc(e, sub_p ? armv6_sub : armv6_add, x, m, first);
+        if(e->code)
+            e->s->stats.nshift++;
+        return;
+    }
+
+    load_const(e, v);
+    if(first)
+        emit(e, armv6_mult(rsum, x, rk));
+    else
+        emit(e, armv6_mla(rsum, x, rk, rsum));
+    if(e->code)
+        e->s->stats.nmul++;
+}
+
+// does a non-zero in [k0,k1) need a multiply (and so rk = lr)?
+static int needs_mul(const csr_t *m, unsigned k0, unsigned k1) {
+    unsigned k;
+    int sh, sub_p;
+    for(unsigned i = k0; i < k1; i++)
+        if(!shift_add(m->val[i], &k, &sh, &sub_p))
+            return 1;
+    return 0;
+}
+
+// the routine for rows [row0, row1).
+static void emit_block(emit_t *e, const csr_t *m, unsigned row0, unsigned row1) {
+    unsigned k0 = m->rowptr[row0], k1 = m->rowptr[row1];
+    int save_lr = needs_mul(m, k0, k1);
+
+    e->window = 0;
+    if(save_lr)
+        emit(e, armv6_push_regs(1 << armv6_lr));
+    if(k0 < k1)
+        load_x(e, rxv[0], m->col[k0]);
+
+    for(unsigned i = row0; i < row1; i++) {
+        int first = 1;
+        pool_maybe_island(e);
+        for(unsigned k = m->rowptr[i]; k < m->rowptr[i+1]; k++) {
+            pool_maybe_island(e);
+            if(k + 1 < k1)
+                load_x(e, rxv[(k + 1 - k0) % 2], m->col[k+1]);
+            mul_add(e, rxv[(k - k0) % 2], m->val[k], first);
+            first = 0;
+        }
+        if(first)
+            emit(e, armv6_mov_imm8(rsum, 0));
+        emit(e, armv6_str_off12(rsum, ry, 4 * (i - row0)));
+    }
+
+    if(save_lr)
+        emit(e, armv6_pop_regs(1 << armv6_pc));
+    else
+        emit(e, armv6_bx(reg_mk(armv6_lr)));
+    pool_flush(e);
+}
+
+spmv_t *spmv_jit(const csr_t *m, unsigned rows_per_block) {
+    assert(m->nrows);
+    if(!rows_per_block || rows_per_block > 1024)
+        panic("rows_per_block=%d: must be in [1,1024]\n", rows_per_block);
+    if(m->ncols > 255 * 1024)
+        panic("%d columns: can only move x 255 windows\n", m->ncols);
+
+    spmv_t *s = kalloc(sizeof *s);
+    s->nrows = m->nrows;
+    s->rows_per_block = rows_per_block;
+    s->nblocks = (m->nrows + rows_per_block - 1) / rows_per_block;
+    s->fns = kalloc(s->nblocks * sizeof *s->fns);
+
+    // measure, then emit into exactly that much.
+    static emit_t e;
+    memset(&e, 0, sizeof e);
+    e.s = s;
+    for(unsigned b = 0; b < s->nblocks; b++)
+        emit_block(&e, m, b * rows_per_block, min_u32((b+1) * rows_per_block, m->nrows));
+    s->nwords = e.off;
+    s->code = kalloc(4 * s->nwords);
+
+    memset(&e, 0, sizeof e);
+    e.s = s;
+    e.code = s->code;
+    for(unsigned b = 0; b < s->nblocks; b++) {
+        s->fns[b] = (spmv_block_fn_t)&e.code[e.off];
+        emit_block(&e, m, b * rows_per_block, min_u32((b+1) * rows_per_block, m->nrows));
+    }
+    assert(e.off == s->nwords);
+
+    code_sync(s->code, 4 * s->nwords);
+    return s;
+}
+
+void spmv_run(spmv_t *s, const uint32_t *x, uint32_t *y) {
+    for(unsigned b = 0; b < s->nblocks; b++)
+        s->fns[b](x, &y[b * s->rows_per_block]);
+}
+
+void spmv_free(spmv_t *s) {
+    kfree(s->code);
+    kfree(s->fns);
+    kfree(s);
+}
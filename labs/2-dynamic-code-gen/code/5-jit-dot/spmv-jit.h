@@ -0,0 +1,50 @@
+#ifndef __SPMV_JIT_H__
+#define __SPMV_JIT_H__
+// jit a sparse matrix-vector multiply y = m*x for a fixed CSR matrix <m>
+// (see matrix-lib.h): the same partial evaluation as <jit_dot>, for a
+// whole matrix.
+//
+// the rows are split into blocks of <rows_per_block>, and each block gets
+// its own routine that has the block's column indices and values baked
+// in.  per non-zero it emits a load of x[col] and then:
+//   - for a value of 2^k, 2^k+2^m, 2^k-2^m or -2^k: one or two adds/subs
+//     of x[col] shifted (no multiply);
+//   - otherwise a mul/mla by the value: a mov/mvn if it fits in an
+//     immediate, or a pc-relative ldr from a constant pool shared by the
+//     block (each distinct value is in it once).  the pool goes after the
+//     routine, or in the middle behind a branch when the routine is too
+//     long for an ldr to reach past it.
+// x[col] is loaded one non-zero ahead of its use to hide the load latency.
+//
+// the code for all the blocks is measured first and then allocated with
+// <kalloc> exactly: <spmv_free> gives it back.  needs <kheap_init>.
+#include "matrix-lib.h"
+
+// block routine: y[0..nrows) for its rows.
+typedef void (*spmv_block_fn_t)(const uint32_t *x, uint32_t *y);
+
+typedef struct {
+    unsigned nrows, rows_per_block;
+    unsigned nblocks;
+    spmv_block_fn_t *fns;       // block b starts at row b*rows_per_block.
+
+    uint32_t *code;
+    unsigned nwords;            // size of <code>, pools included.
+
+    struct {
+        unsigned nshift;        // non-zeros done with shifts and adds
+        unsigned nmul;          // ... with a multiply
+        unsigned npool;         // constant pool words
+        unsigned nisland;       // pools placed mid-routine
+    } stats;
+} spmv_t;
+
+// compile <m>: <rows_per_block> <= 1024.
+spmv_t *spmv_jit(const csr_t *m, unsigned rows_per_block);
+
+// y = m*x.
+void spmv_run(spmv_t *s, const uint32_t *x, uint32_t *y);
+
+void spmv_free(spmv_t *s);
+
+#endif
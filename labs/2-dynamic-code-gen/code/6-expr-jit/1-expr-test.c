@@ -0,0 +1,105 @@
+// check the expression jit against the interpreter: random expressions,
+// ones with more live values than registers (so they spill), and a loop
+// built with labels.
+#include "rpi.h"
+#include "pi-random.h"
+#include "expr-jit.h"
+
+enum { ntrials = 512, ndata = 256 };
+
+static uint32_t data[ndata];
+
+// a random expression of depth at most <depth> over the arguments, some
+// constants and loads from <data> (argument 3).
+static int gen(ex_t *e, unsigned depth) {
+    unsigned k = pi_random() % 8;
+    if(!depth || k == 0) {
+        switch(pi_random() % 3) {
+        case 0:  return ex_const(e, pi_random() >> (pi_random() % 32));
+        case 1:  return ex_arg(e, pi_random() % 3);
+        default: return ex_load(e, ex_arg(e, 3), 4 * (pi_random() % ndata));
+        }
+    }
+    int a = gen(e, depth-1);
+    int b = k == 1 ? a : gen(e, depth-1);
+    return ex_op(e, EX_ADD + pi_random() % (EX_NOPS - EX_ADD), a, b);
+}
+
+// x[0] op x[1] op ... op x[n-1] and then the same back down: every x[i]
+// is live at once.
+static int gen_wide(ex_t *e, unsigned n) {
+    int x[32];
+    assert(n <= 32);
+    for(unsigned i = 0; i < n; i++)
+        x[i] = i % 2 ? ex_load(e, ex_arg(e, 3), 4*i) : gen(e, 2);
+    int up = x[0], down = x[n-1];
+    for(unsigned i = 1; i < n; i++) {
+        up = ex_op(e, EX_ADD + pi_random() % (EX_NOPS - EX_ADD), up, x[i]);
+        down = ex_op(e, EX_XOR, down, ex_mul(e, x[n-1-i], ex_const(e, i)));
+    }
+    return ex_add(e, up, down);
+}
+
+static void check(ex_t *e, int root, uint32_t *code, unsigned n) {
+    jit_t j;
+    jit_mk(&j, code, n);
+    ex_fn_t fn = ex_compile(e, root, &j);
+
+    uint32_t args[4] = { pi_random(), pi_random() % 40, pi_random(), (uint32_t)data };
+    uint32_t exp = ex_eval(e, root, args);
+    uint32_t got = fn(args[0], args[1], args[2], args[3]);
+    if(exp != got)
+        panic("expression of %d nodes: interpreted=%x, jit=%x\n", e->n, exp, got);
+}
+
+// sum 1..n with a backwards branch and a forward one.
+static void check_labels(uint32_t *code, unsigned n) {
+    jit_t j;
+    jit_mk(&j, code, n);
+    reg_t r0 = reg_mk(0), r1 = reg_mk(1);
+
+    unsigned loop = jit_label(&j), done = jit_label(&j);
+    jit_load_imm32(&j, r1, 0);
+    jit_place(&j, loop);
+    jit_push(&j, armv6_dp_imm8_rot4(cond_always, armv6_cmp, 1, r0, r0, 0, 0));
+    jit_b(&j, cond_eq, done);
+    jit_push(&j, armv6_op_rrr(armv6_add, r1, r1, r0));
+    jit_push(&j, armv6_dp_imm8_rot4(cond_always, armv6_sub, 0, r0, r0, 1, 0));
+    jit_b(&j, cond_always, loop);
+    jit_place(&j, done);
+    jit_push(&j, armv6_mov(r0, r1));
+    jit_push(&j, armv6_bx(reg_mk(armv6_lr)));
+    jit_link(&j);
+    flush_caches();
+
+    uint32_t (*fn)(uint32_t) = (void *)code;
+    for(uint32_t i = 0; i < 100; i++)
+        if(fn(i) != i*(i+1)/2)
+            panic("sum 1..%d: got %d\n", i, fn(i));
+}
+
+void notmain(void) {
+    kmalloc_init(4);
+    for(unsigned i = 0; i < ndata; i++)
+        data[i] = pi_random();
+
+    static ex_t e;
+    unsigned nspill = 0;
+    for(unsigned i = 0; i < ntrials; i++) {
+        ex_init(&e);
+        int root = i % 4 == 3 ? gen_wide(&e, 4 + i % 24) : gen(&e, 1 + i % 8);
+
+        unsigned n = ex_nwords_max(&e);
+        uint32_t *code = kmalloc(4*n);
+        check(&e, root, code, n);
+        nspill += e.stats.nspill > 0;
+    }
+    output("%d random expressions match the interpreter (%d spilled)\n", 
+        ntrials, nspill);
+    assert(nspill);
+
+    uint32_t code[16];
+    check_labels(code, 16);
+    output("branches to labels work\n");
+    trace("SUCCESS\n");
+}
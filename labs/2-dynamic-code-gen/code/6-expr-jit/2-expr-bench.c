@@ -0,0 +1,77 @@
+// time a few expressions: interpreted (<ex_eval>) vs jit'd.
+#include "rpi.h"
+#include "cycle-count.h"
+#include "expr-jit.h"
+
+enum { ntrials = 4 };
+
+// a struct-ish record: the jit turns the field loads into ldr's with
+// constant offsets.
+static uint32_t rec[16] = { 3, 1, 4, 1, 5, 9, 2, 6, 5, 3, 5, 8, 9, 7, 9, 3 };
+
+static void bench(const char *name, ex_t *e, int root) {
+    unsigned n = ex_nwords_max(e);
+    jit_t j;
+    jit_mk(&j, kmalloc(4*n), n);
+    ex_fn_t fn = ex_compile(e, root, &j);
+
+    uint32_t args[4] = { 0x12345678, 17, 0x9e3779b9, (uint32_t)rec };
+    uint32_t v0 = 0, v1 = 0;
+    output("%s: %d nodes, %d instructions, %d spills, %d saved regs\n", 
+        name, e->n, e->stats.ninst, e->stats.nspill, e->stats.nsaved);
+    for(unsigned i = 0; i < ntrials; i++) {
+        unsigned t0 = TIME_CYC(v0 = ex_eval(e, root, args));
+        unsigned t1 = TIME_CYC(v1 = fn(args[0], args[1], args[2], args[3]));
+        if(v0 != v1)
+            panic("%s: interpreted=%x, jit=%x\n", name, v0, v1);
+        output("\tinterpreted: %d cycles, jit: %d cycles\n", t0, t1);
+    }
+}
+
+// horner: ((((a0*x + 3)*x + 5)*x + 7)*x + 11)
+static int poly(ex_t *e) {
+    int x = ex_arg(e, 1);
+    int r = ex_arg(e, 0);
+    unsigned c[] = { 3, 5, 7, 11 };
+    for(unsigned i = 0; i < 4; i++)
+        r = ex_add(e, ex_mul(e, r, x), ex_const(e, c[i]));
+    return r;
+}
+
+// a few rounds of a multiply-xorshift hash.
+static int hash(ex_t *e) {
+    int h = ex_op(e, EX_XOR, ex_arg(e, 0), ex_arg(e, 2));
+    for(unsigned i = 0; i < 3; i++) {
+        h = ex_op(e, EX_XOR, h, ex_op(e, EX_SHR, h, ex_const(e, 15)));
+        h = ex_mul(e, h, ex_const(e, 0x2c1b3c6d));
+    }
+    return h;
+}
+
+// rec[1] * 8 + rec[5] == 17 && rec[9] < rec[13]: comparisons are 0 or 1,
+// so && is an and.
+static int pred(ex_t *e) {
+    int r = ex_arg(e, 3);
+    int f = ex_add(e, ex_mul(e, ex_load(e, r, 4), ex_const(e, 8)), ex_load(e, r, 20));
+    int p = ex_op(e, EX_EQ, f, ex_const(e, 17));
+    int q = ex_op(e, EX_LT, ex_load(e, r, 36), ex_load(e, r, 52));
+    return ex_op(e, EX_AND, p, q);
+}
+
+static void run_all(void) {
+    static ex_t e;
+    ex_init(&e); bench("polynomial", &e, poly(&e));
+    ex_init(&e); bench("hash", &e, hash(&e));
+    ex_init(&e); bench("predicate", &e, pred(&e));
+}
+
+void notmain(void) {
+    kmalloc_init(4);
+
+    output("no cache:\n");
+    run_all();
+    caches_enable();
+    output("cache enabled:\n");
+    run_all();
+    trace("SUCCESS\n");
+}
@@ -0,0 +1,472 @@
+// expression builder, interpreter and compiler: see expr-jit.h
+#include "expr-jit.h"
+#include "code-cache.h"
+
+// ops the compiler rewrites to: not visible in the builder.
+enum {
+    EX_RSB = EX_NOPS,   // imm - a
+    EX_BIC,             // a & ~imm
+};
+
+// the registers values live in; r12 and lr are for spilled ones.
+enum { EX_NREGS = 12 };
+#define EX_CALLEE_SAVED 0x0ff0  // r4-r11
+
+void ex_init(ex_t *e) {
+    memset(e, 0, sizeof *e);
+}
+
+static int ex_node(ex_t *e, ex_op_t op, int a, int b, uint32_t imm) {
+    if(e->n >= EX_MAX_NODES)
+        panic("too many expression nodes: max=%d\n", EX_MAX_NODES);
+    assert(a < (int)e->n && b < (int)e->n);
+    int id = e->n++;
+    e->nodes[id] = (ex_node_t){ .op = op, .a = a, .b = b, .imm = imm };
+    return id;
+}
+
+int ex_const(ex_t *e, uint32_t imm) {
+    return ex_node(e, EX_CONST, -1, -1, imm);
+}
+
+// each argument is one node, so it only gets one register.
+int ex_arg(ex_t *e, unsigned i) {
+    if(i >= 4)
+        panic("only have four arguments, not %d\n", i+1);
+    for(unsigned k = 0; k < e->n; k++)
+        if(e->nodes[k].op == EX_ARG && e->nodes[k].imm == i)
+            return k;
+    return ex_node(e, EX_ARG, -1, -1, i);
+}
+
+int ex_load(ex_t *e, int addr, unsigned off) {
+    if(off >= 4096)
+        panic("load offset %d does not fit in 12 bits\n", off);
+    assert(addr >= 0);
+    return ex_node(e, EX_LOAD, addr, -1, off);
+}
+
+int ex_op(ex_t *e, ex_op_t op, int a, int b) {
+    if(op < EX_ADD || op >= EX_NOPS)
+        panic("not a binary op: %d\n", op);
+    assert(a >= 0 && b >= 0);
+    return ex_node(e, op, a, b, 0);
+}
+
+static uint32_t ex_shift(ex_op_t op, uint32_t x, uint32_t amt) {
+    amt &= 0xff;
+    switch(op) {
+    case EX_SHL: return amt >= 32 ? 0 : x << amt;
+    case EX_SHR: return amt >= 32 ? 0 : x >> amt;
+    case EX_SAR: return (int32_t)x >> (amt >= 32 ? 31 : amt);
+    default:     panic("not a shift: %d\n", op);
+    }
+}
+
+uint32_t ex_eval(ex_t *e, int root, const uint32_t args[4]) {
+    ex_node_t *n = &e->nodes[root];
+
+    switch(n->op) {
+    case EX_CONST:  return n->imm;
+    case EX_ARG:    return args[n->imm];
+    case EX_LOAD:   return *(volatile uint32_t *)(ex_eval(e, n->a, args) + n->imm);
+    default:        break;
+    }
+
+    uint32_t a = ex_eval(e, n->a, args);
+    uint32_t b = ex_eval(e, n->b, args);
+    switch(n->op) {
+    case EX_ADD: return a + b;
+    case EX_SUB: return a - b;
+    case EX_MUL: return a * b;
+    case EX_AND: return a & b;
+    case EX_OR:  return a | b;
+    case EX_XOR: return a ^ b;
+    case EX_SHL:
+    case EX_SHR:
+    case EX_SAR: return ex_shift(n->op, a, b);
+    case EX_EQ:  return a == b;
+    case EX_NE:  return a != b;
+    case EX_LT:  return (int32_t)a < (int32_t)b;
+    case EX_LTU: return a < b;
+    default:     panic("bad op %d\n", n->op);
+    }
+}
+
+/**********************************************************************
+ * the compiler.
+ */
+
+// one per value the generated code computes, in the order it does.
+typedef struct {
+    uint8_t op;
+    int a, b;           // operand values, -1 = none
+    int imm_p;          // second operand is <imm>, not <b>
+    uint32_t imm;
+
+    int end;            // last value that uses it
+    int reg;            // register, -1 = spilled
+    int slot;           // stack slot if spilled
+} ex_val_t;
+
+static ex_val_t vals[EX_MAX_NODES];
+static int nvals;
+static int val_of[EX_MAX_NODES];    // node -> value, -1 = not computed yet
+static int need[EX_MAX_NODES];      // sethi-ullman register need, 0 = not known
+
+static int ex_need(ex_t *e, int id) {
+    if(need[id])
+        return need[id];
+    ex_node_t *n = &e->nodes[id];
+    int r;
+    if(n->op == EX_CONST || n->op == EX_ARG)
+        r = 1;
+    else if(n->op == EX_LOAD)
+        r = ex_need(e, n->a);
+    else {
+        int na = ex_need(e, n->a), nb = ex_need(e, n->b);
+        r = na == nb ? na + 1 : (na > nb ? na : nb);
+    }
+    return need[id] = r;
+}
+
+static int is_const(ex_t *e, int id) {
+    return e->nodes[id].op == EX_CONST;
+}
+
+static int imm_ok(uint32_t x) {
+    uint32_t imm8;
+    unsigned rot4;
+    return armv6_imm8_rot4_ok(x, &imm8, &rot4);
+}
+
+static int new_val(uint8_t op, int a, int b, int imm_p, uint32_t imm) {
+    assert(nvals < EX_MAX_NODES);
+    vals[nvals] = (ex_val_t){ .op = op, .a = a, .b = b, .imm_p = imm_p, .imm = imm };
+    return nvals++;
+}
+
+// can <op> take constant <c> as its second operand?  rewrites <op> and <c>
+// if it needs to (e.g., add of -c is a sub).
+static int fold_imm(uint8_t *op, uint32_t *c) {
+    switch(*op) {
+    case EX_ADD:
+    case EX_SUB:
+        if(imm_ok(*c))
+            return 1;
+        if(imm_ok(-*c)) {
+            *op = *op == EX_ADD ? EX_SUB : EX_ADD;
+            *c = -*c;
+            return 1;
+        }
+        return 0;
+    case EX_AND:
+        if(imm_ok(*c))
+            return 1;
+        if(imm_ok(~*c)) {
+            *op = EX_BIC;
+            *c = ~*c;
+            return 1;
+        }
+        return 0;
+    case EX_OR:
+    case EX_XOR:
+    case EX_EQ:
+    case EX_NE:
+    case EX_LT:
+    case EX_LTU:
+        return imm_ok(*c);
+    case EX_SHL:
+    case EX_SHR:
+    case EX_SAR:
+        // shift by 0 is just a copy (lsr #0 would mean lsr #32).
+        *c &= 0xff;
+        if(*c >= 32)
+            return 0;
+        if(*c == 0)
+            *op = EX_SHL;
+        return 1;
+    case EX_MUL:
+        // multiply by 2^k = shift left by k.
+        if(*c && (*c & (*c - 1)) == 0) {
+            *op = EX_SHL;
+            *c = __builtin_ctz(*c);
+            return 1;
+        }
+        return 0;
+    default:
+        return 0;
+    }
+}
+
+static int commutes(uint8_t op) {
+    return op == EX_ADD || op == EX_MUL || op == EX_AND || op == EX_OR
+        || op == EX_XOR || op == EX_EQ || op == EX_NE;
+}
+
+// the value for node <id>, computing what it needs first.
+static int visit(ex_t *e, int id) {
+    if(val_of[id] >= 0)
+        return val_of[id];
+
+    ex_node_t *n = &e->nodes[id];
+    int v;
+    if(n->op == EX_CONST)
+        v = new_val(EX_CONST, -1, -1, 0, n->imm);
+    else if(n->op == EX_LOAD)
+        v = new_val(EX_LOAD, visit(e, n->a), -1, 0, n->imm);
+    else {
+        assert(n->op != EX_ARG);    // done up front.
+        uint8_t op = n->op;
+        int a = n->a, b = n->b;
+        uint32_t c;
+
+        if(commutes(op) && is_const(e, a) && !is_const(e, b)) {
+            int t = a; a = b; b = t;
+        }
+        if(is_const(e, b) && (c = e->nodes[b].imm, fold_imm(&op, &c)))
+            v = new_val(op, visit(e, a), -1, 1, c);
+        else if(op == EX_SUB && is_const(e, a) && imm_ok(e->nodes[a].imm))
+            v = new_val(EX_RSB, visit(e, b), -1, 1, e->nodes[a].imm);
+        else {
+            int va, vb;
+            if(ex_need(e, b) > ex_need(e, a)) {
+                vb = visit(e, b);
+                va = visit(e, a);
+            } else {
+                va = visit(e, a);
+                vb = visit(e, b);
+            }
+            v = new_val(op, va, vb, 0, 0);
+        }
+    }
+    return val_of[id] = v;
+}
+
+// mark the nodes <id> needs.
+static void mark_used(ex_t *e, int id, uint8_t *used) {
+    if(id < 0 || used[id])
+        return;
+    used[id] = 1;
+    mark_used(e, e->nodes[id].a, used);
+    mark_used(e, e->nodes[id].b, used);
+}
+
+// linear scan over the values in order: each starts where it's computed and
+// ends at its last use.  returns the number of stack slots.
+static int alloc_regs(int root) {
+    int active[EX_NREGS], nactive = 0, nslot = 0;
+    uint32_t free = (1 << EX_NREGS) - 1;
+
+    for(int i = 0; i < nvals; i++) {
+        // free the registers of values that are dead by the time <i> is
+        // computed: <i> can reuse an operand's register.
+        int k = 0;
+        for(int j = 0; j < nactive; j++) {
+            if(vals[active[j]].end <= i)
+                free |= 1 << vals[active[j]].reg;
+            else
+                active[k++] = active[j];
+        }
+        nactive = k;
+
+        ex_val_t *v = &vals[i];
+        int hint = v->op == EX_ARG ? (int)v->imm : (i == root ? 0 : -1);
+        if(free) {
+            int reg = (hint >= 0 && (free & (1 << hint))) ? hint : __builtin_ctz(free);
+            free &= ~(1 << reg);
+            v->reg = reg;
+        } else {
+            // spill whichever lives longest: it or an active one.
+            int far = 0;
+            for(int j = 1; j < nactive; j++)
+                if(vals[active[j]].end > vals[active[far]].end)
+                    far = j;
+            ex_val_t *s = &vals[active[far]];
+            if(s->end > v->end) {
+                v->reg = s->reg;
+                s->reg = -1;
+                s->slot = nslot++;
+                active[far] = i;
+            } else {
+                v->reg = -1;
+                v->slot = nslot++;
+            }
+            continue;
+        }
+        active[nactive++] = i;
+    }
+    return nslot;
+}
+
+static reg_t r(int n) { return reg_mk(n); }
+
+// the register holding value <v>'s operand <x>: loads it into <scratch>
+// if it was spilled.
+static reg_t src(jit_t *j, int x, int scratch) {
+    if(vals[x].reg >= 0)
+        return r(vals[x].reg);
+    jit_push(j, armv6_ldr_off12(r(scratch), r(armv6_sp), 4*vals[x].slot));
+    return r(scratch);
+}
+
+unsigned ex_nwords_max(ex_t *e) {
+    // at worst: two reloads, three instructions and a spill per value,
+    // plus the prologue and epilogue.
+    return 6 * e->n + 8;
+}
+
+ex_fn_t ex_compile(ex_t *e, int root, jit_t *j) {
+    assert(root >= 0 && root < (int)e->n);
+
+    static uint8_t used[EX_MAX_NODES];
+    memset(used, 0, sizeof used);
+    memset(need, 0, sizeof need);
+    for(int i = 0; i < EX_MAX_NODES; i++)
+        val_of[i] = -1;
+    nvals = 0;
+
+    // the arguments first, in register order, so each can stay where it
+    // arrived.
+    mark_used(e, root, used);
+    for(unsigned a = 0; a < 4; a++)
+        for(unsigned i = 0; i < e->n; i++)
+            if(used[i] && e->nodes[i].op == EX_ARG && e->nodes[i].imm == a)
+                val_of[i] = new_val(EX_ARG, -1, -1, 0, a);
+    int rv = visit(e, root);
+
+    // live ranges: the result lives to the end.
+    for(int i = 0; i < nvals; i++)
+        vals[i].end = i;
+    for(int i = 0; i < nvals; i++) {
+        if(vals[i].a >= 0) vals[vals[i].a].end = i;
+        if(vals[i].b >= 0) vals[vals[i].b].end = i;
+    }
+    vals[rv].end = nvals;
+    int nslot = alloc_regs(rv);
+
+    // prologue.
+    uint32_t saved = 0;
+    for(int i = 0; i < nvals; i++)
+        if(vals[i].reg >= 0)
+            saved |= (1 << vals[i].reg) & EX_CALLEE_SAVED;
+    if(nslot)
+        saved |= 1 << armv6_lr;
+    uint32_t imm8;
+    unsigned rot4;
+    if(!armv6_imm8_rot4_ok(4*nslot, &imm8, &rot4) || 4*nslot >= 4096)
+        panic("too many spills: %d\n", nslot);
+
+    uint32_t *start = jit_here(j);
+    if(saved)
+        jit_push(j, armv6_push_regs(saved));
+    if(nslot)
+        jit_push(j, armv6_dp_imm8_rot4(cond_always, armv6_sub, 0,
+                        r(armv6_sp), r(armv6_sp), imm8, rot4));
+
+    for(int i = 0; i < nvals; i++) {
+        ex_val_t *v = &vals[i];
+        // spilled values are computed into lr and stored.
+        reg_t d = r(v->reg >= 0 ? v->reg : armv6_lr);
+        reg_t a = v->a >= 0 ? src(j, v->a, 12) : r(0);
+        reg_t b = v->b >= 0 ? src(j, v->b, armv6_lr) : r(0);
+        unsigned op = 0, shift = 0, cond = 0;
+
+        switch(v->op) {
+        case EX_CONST:
+            jit_load_imm32(j, d, v->imm);
+            break;
+        case EX_ARG:
+            if(v->reg < 0)
+                jit_push(j, armv6_str_off12(r(v->imm), r(armv6_sp), 4*v->slot));
+            else if(v->reg != v->imm)
+                jit_push(j, armv6_mov(d, r(v->imm)));
+            continue;
+        case EX_LOAD:
+            jit_push(j, armv6_ldr_off12(d, a, v->imm));
+            break;
+
+        case EX_ADD: op = armv6_add; goto do_alu;
+        case EX_SUB: op = armv6_sub; goto do_alu;
+        case EX_RSB: op = armv6_rsb; goto do_alu;
+        case EX_AND: op = armv6_and; goto do_alu;
+        case EX_BIC: op = armv6_bic; goto do_alu;
+        case EX_OR:  op = armv6_orr; goto do_alu;
+        case EX_XOR: op = armv6_eor; goto do_alu;
+        do_alu:
+            if(v->imm_p) {
+                armv6_imm8_rot4_ok(v->imm, &imm8, &rot4);
+                jit_push(j, armv6_dp_imm8_rot4(cond_always, op, 0, d, a, imm8, rot4));
+            } else
+                jit_push(j, armv6_op_rrr(op, d, a, b));
+            break;
+
+        case EX_MUL:
+            // rd can't be rm: multiply commutes, else copy rm to r12.
+            if(d.reg == a.reg) {
+                reg_t t = a; a = b; b = t;
+            }
+            if(d.reg == a.reg) {
+                jit_push(j, armv6_mov(r(12), a));
+                a = r(12);
+            }
+            jit_push(j, armv6_mult(d, a, b));
+            break;
+
+        case EX_SHL: shift = armv6_lsl; goto do_shift;
+        case EX_SHR: shift = armv6_lsr; goto do_shift;
+        case EX_SAR: shift = armv6_asr; goto do_shift;
+        do_shift:
+            if(v->imm_p)
+                jit_push(j, armv6_dp_reg(cond_always, op_mov, 0, d, r(0), a, shift, v->imm));
+            else
+                jit_push(j, armv6_dp_reg_shift(cond_always, op_mov, d, r(0), a, shift, b));
+            break;
+
+        case EX_EQ:  cond = cond_eq; goto do_cmp;
+        case EX_NE:  cond = cond_ne; goto do_cmp;
+        case EX_LT:  cond = cond_lt; goto do_cmp;
+        case EX_LTU: cond = cond_cc; goto do_cmp;
+        do_cmp:
+            if(v->imm_p) {
+                armv6_imm8_rot4_ok(v->imm, &imm8, &rot4);
+                jit_push(j, armv6_dp_imm8_rot4(cond_always, armv6_cmp, 1, r(0), a, imm8, rot4));
+            } else
+                jit_push(j, armv6_cmp_rr(a, b));
+            jit_push(j, armv6_mov_imm8(d, 0));
+            jit_push(j, armv6_mov_imm8_cond(cond, d, 1));
+            break;
+
+        default:
+            panic("bad op %d\n", v->op);
+        }
+        if(v->reg < 0)
+            jit_push(j, armv6_str_off12(d, r(armv6_sp), 4*v->slot));
+    }
+
+    // epilogue: result in r0.
+    if(vals[rv].reg < 0)
+        jit_push(j, armv6_ldr_off12(r(0), r(armv6_sp), 4*vals[rv].slot));
+    else if(vals[rv].reg != 0)
+        jit_push(j, armv6_mov(r(0), r(vals[rv].reg)));
+    if(nslot) {
+        armv6_imm8_rot4_ok(4*nslot, &imm8, &rot4);
+        jit_push(j, armv6_dp_imm8_rot4(cond_always, armv6_add, 0,
+                        r(armv6_sp), r(armv6_sp), imm8, rot4));
+    }
+    if(saved & (1 << armv6_lr))
+        jit_push(j, armv6_pop_regs((saved & ~(1 << armv6_lr)) | (1 << armv6_pc)));
+    else {
+        if(saved)
+            jit_push(j, armv6_pop_regs(saved));
+        jit_push(j, armv6_bx(r(armv6_lr)));
+    }
+
+    e->stats.ninst = jit_here(j) - start;
+    e->stats.nspill = nslot;
+    e->stats.nsaved = __builtin_popcount(saved);
+
+    jit_link(j);
+    code_sync(start, 4 * (jit_here(j) - start));
+    return (ex_fn_t)start;
+}
@@ -0,0 +1,81 @@
+#ifndef __EXPR_JIT_H__
+#define __EXPR_JIT_H__
+// a small expression compiler on top of jit.h.
+//
+// build an expression (a tree, or a dag: nodes can be shared) with the
+// ex_* routines, each of which returns the new node's id, then either
+//   - <ex_eval> it: the interpreter, or
+//   - <ex_compile> it to a routine
+//         uint32_t fn(uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3);
+//     that computes the same thing.
+//
+// the compiler:
+//   1. orders the nodes so the operand that needs more registers is
+//      computed first (sethi-ullman), each shared node once;
+//   2. folds constants that fit in an instruction's immediate, and turns
+//      multiplies by a power of two into shifts;
+//   3. gives every value a register from r0-r11 with linear scan
+//      (poletto & sarkar), spilling the value that lives longest to the
+//      stack when it runs out.  r12 and lr are scratch for spilled values;
+//      the callee-saved ones used (r4-r11, lr) get pushed.
+#include "jit.h"
+
+typedef enum {
+    EX_CONST,   // imm
+    EX_ARG,     // argument <imm> (0..3)
+    EX_LOAD,    // the word at address a + imm (imm < 4096)
+
+    EX_ADD, EX_SUB, EX_MUL,
+    EX_AND, EX_OR, EX_XOR,
+    EX_SHL, EX_SHR, EX_SAR,     // a shifted by the bottom byte of b: >= 32
+                                // gives 0 (or all sign bits for EX_SAR)
+    EX_EQ, EX_NE,               // 1 or 0
+    EX_LT, EX_LTU,              // signed, unsigned a < b: 1 or 0
+
+    EX_NOPS
+} ex_op_t;
+
+typedef struct {
+    uint8_t op;
+    int a, b;           // operand node ids (-1 = none)
+    uint32_t imm;
+} ex_node_t;
+
+enum { EX_MAX_NODES = 256 };
+
+typedef struct {
+    ex_node_t nodes[EX_MAX_NODES];
+    unsigned n;
+
+    // what the last <ex_compile> did.
+    struct {
+        unsigned ninst;     // instructions generated
+        unsigned nspill;    // values that lived on the stack
+        unsigned nsaved;    // registers pushed
+    } stats;
+} ex_t;
+
+typedef uint32_t (*ex_fn_t)(uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3);
+
+void ex_init(ex_t *e);
+
+int ex_const(ex_t *e, uint32_t imm);
+int ex_arg(ex_t *e, unsigned i);
+int ex_load(ex_t *e, int addr, unsigned off);
+int ex_op(ex_t *e, ex_op_t op, int a, int b);
+
+static inline int ex_add(ex_t *e, int a, int b) { return ex_op(e, EX_ADD, a, b); }
+static inline int ex_sub(ex_t *e, int a, int b) { return ex_op(e, EX_SUB, a, b); }
+static inline int ex_mul(ex_t *e, int a, int b) { return ex_op(e, EX_MUL, a, b); }
+
+// interpret node <root> with arguments <args>.
+uint32_t ex_eval(ex_t *e, int root, const uint32_t args[4]);
+
+// words of code <ex_compile> can need for <e>, at most.
+unsigned ex_nwords_max(ex_t *e);
+
+// compile node <root> at the current location of <j>.  links <j> and
+// syncs the caches for its code, so the result can be called right away.
+ex_fn_t ex_compile(ex_t *e, int root, jit_t *j);
+
+#endif
@@ -0,0 +1,70 @@
+#include "jit.h"
+
+void jit_mk(jit_t *j, uint32_t *code, unsigned n) {
+    assert(code);
+    assert(n);
+    memset(j, 0, sizeof *j);
+    j->code = code;
+    j->n = n;
+}
+
+uint32_t *jit_push(jit_t *j, uint32_t inst) {
+    if(j->off >= j->n)
+        panic("out of code space: have %d instructions\n", j->n);
+    uint32_t *p = &j->code[j->off++];
+    *p = inst;
+    return p;
+}
+
+unsigned jit_label(jit_t *j) {
+    if(j->nlabel >= JIT_MAX_LABELS)
+        panic("too many labels: max=%d\n", JIT_MAX_LABELS);
+    unsigned l = j->nlabel++;
+    j->labels[l] = -1;
+    return l;
+}
+
+void jit_place(jit_t *j, unsigned l) {
+    assert(l < j->nlabel);
+    if(j->labels[l] >= 0)
+        panic("label %d placed twice\n", l);
+    j->labels[l] = j->off;
+}
+
+void jit_b(jit_t *j, unsigned cond, unsigned l) {
+    assert(l < j->nlabel);
+    if(j->nreloc >= JIT_MAX_RELOC)
+        panic("too many branches: max=%d\n", JIT_MAX_RELOC);
+    j->reloc[j->nreloc++] = (struct jit_reloc){ .label = l, .off = j->off };
+    // the condition stays, the offset gets patched.
+    jit_push(j, armv6_b_cond(cond, 0, 8));
+}
+
+void jit_load_imm32(jit_t *j, reg_t rd, uint32_t imm32) {
+    uint32_t imm8;
+    unsigned rot4;
+
+    if(armv6_imm8_rot4_ok(imm32, &imm8, &rot4))
+        jit_push(j, armv6_mov_imm8_rot4(rd, imm8, rot4));
+    else if(armv6_imm8_rot4_ok(~imm32, &imm8, &rot4))
+        jit_push(j, armv6_dp_imm8_rot4(cond_always, armv6_mvn, 0, rd, reg_mk(0), imm8, rot4));
+    else {
+        if(j->off + 3 > j->n)
+            panic("out of code space: have %d instructions\n", j->n);
+        uint32_t *end = armv6_load_imm32(jit_here(j), rd, imm32);
+        j->off = end - j->code;
+    }
+}
+
+void jit_link(jit_t *j) {
+    for(unsigned i = 0; i < j->nreloc; i++) {
+        struct jit_reloc *r = &j->reloc[i];
+        int l = j->labels[r->label];
+        if(l < 0)
+            panic("label %d was never placed\n", r->label);
+        uint32_t *p = &j->code[r->off];
+        unsigned cond = *p >> 28;
+        *p = armv6_b_cond(cond, (uint32_t)p, (uint32_t)&j->code[l]);
+    }
+    j->nreloc = 0;
+}
@@ -0,0 +1,56 @@
+#ifndef __JIT_H__
+#define __JIT_H__
+// a buffer to generate armv6 code into, with labels and branch relocation
+// (the same idea as 4-jit-derive/code/code-gen.h): emit a branch to a label
+// that hasn't been placed yet, place it later, and <jit_link> patches the
+// branch offsets once everything is where it will stay.
+#include "rpi.h"
+#include "armv6-encodings.h"
+
+enum { JIT_MAX_LABELS = 128, JIT_MAX_RELOC = 256 };
+
+typedef struct {
+    uint32_t *code;     // start of the buffer
+    unsigned n;         // its size in words
+    unsigned off;       // next free word
+
+    // word offset of each label in <code>; -1 = not placed yet.
+    int labels[JIT_MAX_LABELS];
+    unsigned nlabel;
+
+    // branches to patch: the word at <off> jumps to <label>.
+    struct jit_reloc {
+        unsigned label;
+        unsigned off;
+    } reloc[JIT_MAX_RELOC];
+    unsigned nreloc;
+} jit_t;
+
+// generate into the <n> words at <code>.
+void jit_mk(jit_t *j, uint32_t *code, unsigned n);
+
+// append <inst>: panics if the buffer is full.
+uint32_t *jit_push(jit_t *j, uint32_t inst);
+
+// where the next instruction goes.
+static inline uint32_t *jit_here(jit_t *j) {
+    return &j->code[j->off];
+}
+
+// a new label, not placed anywhere yet.
+unsigned jit_label(jit_t *j);
+
+// put label <l> at the current location.
+void jit_place(jit_t *j, unsigned l);
+
+// b<cond> to label <l>: fixed up by <jit_link>.
+void jit_b(jit_t *j, unsigned cond, unsigned l);
+
+// rd = imm32, with the fewest instructions we know how: a single mov or
+// mvn if it fits, otherwise <armv6_load_imm32>.
+void jit_load_imm32(jit_t *j, reg_t rd, uint32_t imm32);
+
+// patch every branch: panics if a label was never placed.
+void jit_link(jit_t *j);
+
+#endif
@@ -0,0 +1,158 @@
+// check the query jit against the interpreter: the age == 30 query the
+// lab started with, then random predicates over every kind of field, in
+// both modes.
+#include "rpi.h"
+#include "pi-random.h"
+#include "query-jit.h"
+
+typedef struct {
+    int id;
+    char name[32];
+    int age;
+} Person;
+
+static Person people[] = {
+    {1, "Alice", 25},
+    {2, "Bob", 30},
+    {3, "Charlie", 35},
+    {4, "David", 40},
+    {5, "Eve", 45}
+};
+
+// one field of each width and signedness.
+typedef struct {
+    int32_t  s32;
+    uint32_t u32;
+    int16_t  s16;
+    uint16_t u16;
+    int8_t   s8;
+    uint8_t  u8;
+    uint16_t pad;
+} rec_t;
+
+enum { ntrials = 400, nrecs = 97, nfields = 6 };
+
+static rec_t recs[nrecs];
+static uint32_t sel_jit[nrecs], sel_interp[nrecs];
+static int32_t in_vals[ntrials][4];
+
+static q_field_t field(unsigned i) {
+    switch(i) {
+    case 0:  return q_field(0, 4, 1);
+    case 1:  return q_field(4, 4, 0);
+    case 2:  return q_field(8, 2, 1);
+    case 3:  return q_field(10, 2, 0);
+    case 4:  return q_field(12, 1, 1);
+    default: return q_field(13, 1, 0);
+    }
+}
+
+// a constant that's often close to (or equal to) some record's field.
+static int32_t value(unsigned i) {
+    rec_t *r = &recs[pi_random() % nrecs];
+    int32_t v;
+    switch(i) {
+    case 0:  v = r->s32; break;
+    case 1:  v = r->u32; break;
+    case 2:  v = r->s16; break;
+    case 3:  v = r->u16; break;
+    case 4:  v = r->s8; break;
+    default: v = r->u8; break;
+    }
+    switch(pi_random() % 4) {
+    case 0:  return v;
+    case 1:  return v + pi_random() % 5 - 2;
+    case 2:  return pi_random() % 256 - 128;
+    default: return pi_random();
+    }
+}
+
+// a random predicate over at most <maxf> of the fields.
+static q_pred_t *gen(query_t *q, unsigned depth, unsigned maxf, int32_t *in) {
+    unsigned k = pi_random() % 6;
+    if(depth && k < 2) {
+        q_pred_t *l = gen(q, depth - 1, maxf, in);
+        q_pred_t *r = gen(q, depth - 1, maxf, in);
+        return k ? q_or(q, l, r) : q_and(q, l, r);
+    }
+    unsigned fi = pi_random() % maxf;
+    q_field_t f = field(fi);
+    switch(pi_random() % 4) {
+    case 0: {
+        int32_t lo = value(fi), hi = value(fi);
+        return q_range(q, f, lo, hi);
+    }
+    case 1:
+        for(unsigned i = 0; i < 4; i++)
+            in[i] = value(fi);
+        return q_in(q, f, in, 1 + pi_random() % 4);
+    default:
+        return q_cmp(q, Q_EQ + pi_random() % (Q_GE + 1), f, value(fi));
+    }
+}
+
+static void check(q_pred_t *p, int mode) {
+    unsigned n = query_nwords_max(p);
+    jit_t j;
+    jit_mk(&j, kmalloc(4*n), n);
+    query_fn_t fn = query_compile(p, sizeof(rec_t), mode, &j);
+
+    // every prefix length, so both copies of the loop get to finish it.
+    for(unsigned len = 0; len <= nrecs; len += 1 + len / 8) {
+        unsigned exp = query_interp(p, recs, len, sizeof(rec_t), sel_interp);
+        unsigned got = fn(recs, len, mode == QUERY_SELECT ? sel_jit : 0);
+        if(exp != got)
+            panic("%d records: interpreted=%d matches, jit=%d\n", len, exp, got);
+        if(mode == QUERY_SELECT)
+            for(unsigned i = 0; i < exp; i++)
+                if(sel_jit[i] != sel_interp[i])
+                    panic("match %d: interpreted=%d, jit=%d\n", i, sel_interp[i], sel_jit[i]);
+    }
+}
+
+static void check_people(void) {
+    static query_t q;
+    query_init(&q);
+    q_pred_t *p = q_cmp(&q, Q_EQ, q_field(offsetof(Person, age), 4, 1), 30);
+
+    unsigned n = query_nwords_max(p);
+    jit_t j;
+    jit_mk(&j, kmalloc(4*n), n);
+    query_fn_t fn = query_compile(p, sizeof(Person), QUERY_SELECT, &j);
+
+    unsigned npeople = sizeof people / sizeof people[0];
+    uint32_t sel[5];
+    unsigned cnt = fn(people, npeople, sel);
+    assert(cnt == query_interp(p, people, npeople, sizeof(Person), 0));
+    if(cnt != 1 || people[sel[0]].age != 30)
+        panic("age == 30: got %d matches\n", cnt);
+    output("age == 30: %s\n", people[sel[0]].name);
+}
+
+void notmain(void) {
+    kmalloc_init(4);
+    check_people();
+
+    for(unsigned i = 0; i < nrecs; i++) {
+        uint32_t x = pi_random();
+        recs[i] = (rec_t){
+            .s32 = i % 3 ? (int32_t)x : (int32_t)(x % 64) - 32,
+            .u32 = i % 2 ? x * 0x9e3779b9 : x % 64,
+            .s16 = x >> 8,
+            .u16 = x >> 12,
+            .s8  = x >> 3,
+            .u8  = x >> 20,
+        };
+    }
+
+    // the first half stay within the pipelined (3 field) limit.
+    static query_t q;
+    for(unsigned i = 0; i < ntrials; i++) {
+        query_init(&q);
+        q_pred_t *p = gen(&q, 1 + i % 4, i < ntrials/2 ? 3 : nfields, in_vals[i]);
+        check(p, QUERY_COUNT);
+        check(p, QUERY_SELECT);
+    }
+    output("%d random predicates match the interpreter\n", ntrials);
+    trace("SUCCESS\n");
+}
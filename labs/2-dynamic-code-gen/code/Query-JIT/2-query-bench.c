@@ -0,0 +1,74 @@
+// time a few scans over 10^5 and 10^6 records: interpreted
+// (<query_interp>) vs jit'd.
+#include "rpi.h"
+#include "pi-random.h"
+#include "cycle-count.h"
+#include "query-jit.h"
+
+typedef struct {
+    uint32_t id;
+    int32_t balance;
+    uint16_t zip;
+    uint8_t age;
+    uint8_t flags;
+} account_t;
+
+enum { max_recs = 1000 * 1000 };
+
+static account_t *recs;
+static uint32_t *sel;
+
+static void bench(const char *name, q_pred_t *p, unsigned n) {
+    unsigned nw = query_nwords_max(p);
+    jit_t j;
+    jit_mk(&j, kmalloc(4*nw), nw);
+    query_fn_t fn = query_compile(p, sizeof *recs, QUERY_SELECT, &j);
+
+    unsigned exp = 0, got = 0;
+    unsigned t0 = TIME_CYC(exp = query_interp(p, recs, n, sizeof *recs, sel));
+    unsigned t1 = TIME_CYC(got = fn(recs, n, sel));
+    if(exp != got)
+        panic("%s: interpreted=%d matches, jit=%d\n", name, exp, got);
+    output("%s: %d records, %d matches, %d instructions\n", name, n, got, j.off);
+    output("\tinterpreted: %d cycles (%d/record), jit: %d cycles (%d/record)\n",
+        t0, t0 / n, t1, t1 / n);
+}
+
+static void run_all(unsigned n) {
+    static query_t q;
+    static const int32_t zips[] = { 2139, 10001, 30301, 60601 };
+
+    query_init(&q);
+    bench("age == 30", q_cmp(&q, Q_EQ, q_field(10, 1, 0), 30), n);
+
+    query_init(&q);
+    bench("21 <= age <= 35 && balance < 0", 
+        q_and(&q, q_range(&q, q_field(10, 1, 0), 21, 35),
+                  q_cmp(&q, Q_LT, q_field(4, 4, 1), 0)), n);
+
+    query_init(&q);
+    bench("zip in {...} || flags == 7", 
+        q_or(&q, q_in(&q, q_field(8, 2, 0), zips, 4),
+                 q_cmp(&q, Q_EQ, q_field(11, 1, 0), 7)), n);
+}
+
+void notmain(void) {
+    kmalloc_init(32);
+    recs = kmalloc(max_recs * sizeof *recs);
+    sel = kmalloc(max_recs * sizeof *sel);
+    for(unsigned i = 0; i < max_recs; i++) {
+        uint32_t x = pi_random();
+        recs[i] = (account_t){
+            .id = i,
+            .balance = (int32_t)(x % 20000) - 5000,
+            .zip = (x >> 8) % 8 ? x >> 16 : 10001,
+            .age = 18 + (x >> 3) % 70,
+            .flags = x >> 24,
+        };
+    }
+
+    caches_enable();
+    run_all(100 * 1000);
+    run_all(max_recs);
+    trace("SUCCESS\n");
+}
@@ -1,96 +1,381 @@
-#include "rpi.h"
-#include "cycle-count.h"
-#include <stdint.h>  // For uint32_t
+// predicate builder, interpreter and compiler: see query-jit.h
+#include "query-jit.h"
+#include "code-cache.h"
+
+void query_init(query_t *q) {
+    q->n = 0;
+}
+
+static q_pred_t *q_new(query_t *q, q_op_t op) {
+    if(q->n >= Q_MAX_PREDS)
+        panic("too many predicate nodes: max=%d\n", Q_MAX_PREDS);
+    q_pred_t *p = &q->preds[q->n++];
+    memset(p, 0, sizeof *p);
+    p->op = op;
+    return p;
+}
+
+q_pred_t *q_cmp(query_t *q, q_op_t op, q_field_t f, int32_t v) {
+    if(op > Q_GE)
+        panic("not a comparison: %d\n", op);
+    q_pred_t *p = q_new(q, op);
+    p->f = f;
+    p->v = v;
+    return p;
+}
+
+q_pred_t *q_range(query_t *q, q_field_t f, int32_t lo, int32_t hi) {
+    q_pred_t *p = q_new(q, Q_RANGE);
+    p->f = f;
+    p->v = lo;
+    p->hi = hi;
+    return p;
+}
+
+q_pred_t *q_in(query_t *q, q_field_t f, const int32_t *in, unsigned nin) {
+    q_pred_t *p = q_new(q, Q_IN);
+    p->f = f;
+    p->in = in;
+    p->nin = nin;
+    return p;
+}
+
+q_pred_t *q_and(query_t *q, q_pred_t *l, q_pred_t *r) {
+    q_pred_t *p = q_new(q, Q_AND);
+    p->l = l;
+    p->r = r;
+    return p;
+}
+
+q_pred_t *q_or(query_t *q, q_pred_t *l, q_pred_t *r) {
+    q_pred_t *p = q_new(q, Q_OR);
+    p->l = l;
+    p->r = r;
+    return p;
+}
+
+/**********************************************************************
+ * the interpreter.
+ */
+
+static int32_t field_get(q_field_t f, const void *rec) {
+    const uint8_t *p = (const uint8_t *)rec + f.off;
+    switch(f.width) {
+    case 1:  return f.signed_p ? *(const int8_t *)p : *p;
+    case 2:  return f.signed_p ? *(const int16_t *)p : *(const uint16_t *)p;
+    default: return *(const int32_t *)p;
+    }
+}
+
+// x <= y, with the field's signedness.
+static int le(q_field_t f, int32_t x, int32_t y) {
+    return f.signed_p ? x <= y : (uint32_t)x <= (uint32_t)y;
+}
+
+int query_match(const q_pred_t *p, const void *rec) {
+    int32_t x = 0;
+    if(p->op != Q_AND && p->op != Q_OR)
+        x = field_get(p->f, rec);
+
+    switch(p->op) {
+    case Q_EQ:    return x == p->v;
+    case Q_NE:    return x != p->v;
+    case Q_LT:    return !le(p->f, p->v, x);
+    case Q_LE:    return le(p->f, x, p->v);
+    case Q_GT:    return !le(p->f, x, p->v);
+    case Q_GE:    return le(p->f, p->v, x);
+    case Q_RANGE: return le(p->f, p->v, x) && le(p->f, x, p->hi);
+    case Q_IN:
+        for(unsigned i = 0; i < p->nin; i++)
+            if(x == p->in[i])
+                return 1;
+        return 0;
+    case Q_AND:   return query_match(p->l, rec) && query_match(p->r, rec);
+    case Q_OR:    return query_match(p->l, rec) || query_match(p->r, rec);
+    default:      panic("bad predicate op %d\n", p->op);
+    }
+}
+
+unsigned query_interp(const q_pred_t *p, const void *recs, unsigned n,
+                      unsigned stride, uint32_t *sel) {
+    const uint8_t *rec = recs;
+    unsigned cnt = 0;
+    for(unsigned i = 0; i < n; i++, rec += stride) {
+        if(!query_match(p, rec))
+            continue;
+        if(sel)
+            sel[cnt] = i;
+        cnt++;
+    }
+    return cnt;
+}
+
+/**********************************************************************
+ * the compiler.
+ *
+ * registers:
+ *   r0      the next record to load
+ *   r1      one past the last record
+ *   r2      selection vector (QUERY_SELECT)
+ *   r3      matches so far
+ *   r4-r9   field values: r4-r6 and r7-r9 when pipelined, one set for
+ *           the record being tested and one for the next
+ *   r10     constants that don't fit in an immediate
+ *   r11     range check temporary
+ *   r12     index of the record being tested (QUERY_SELECT)
+ *   lr      the stride, if it doesn't fit in an immediate
+ */
+
+enum { Q_PIPE_FIELDS = 3, Q_MAX_FIELDS = 6 };
 
 typedef struct {
-    int id;
-    char name[32];
-    int age;
-} Person;
-
-Person people[] = {
-    {1, "Alice", 25},
-    {2, "Bob", 30},
-    {3, "Charlie", 35},
-    {4, "David", 40},
-    {5, "Eve", 45}
-};
-const int NUM_PEOPLE = 5;
-
-typedef int (*QueryFunc)(Person*, int, int);
-
-int interpret_query(Person* table, int size, int target_age) {
-    int count = 0;
-    for (int i = 0; i < size; i++) {
-        if (table[i].age == target_age) {
-            count++;
-        }
+    jit_t *j;
+    q_field_t fields[Q_MAX_FIELDS];
+    unsigned nfields;
+    int pipelined;
+} qc_t;
+
+static reg_t r(unsigned n) { return reg_mk(n); }
+static const reg_t rp = { 0 }, rend = { 1 }, rsel = { 2 }, rcnt = { 3 },
+                   rconst = { 10 }, rtmp = { 11 }, ridx = { 12 };
+
+static int imm_ok(uint32_t x) {
+    uint32_t imm8;
+    unsigned rot4;
+    return armv6_imm8_rot4_ok(x, &imm8, &rot4);
+}
+
+static int field_eq(q_field_t a, q_field_t b) {
+    return a.off == b.off && a.width == b.width && a.signed_p == b.signed_p;
+}
+
+static void collect_fields(qc_t *c, const q_pred_t *p) {
+    if(p->op == Q_AND || p->op == Q_OR) {
+        collect_fields(c, p->l);
+        collect_fields(c, p->r);
+        return;
+    }
+    for(unsigned i = 0; i < c->nfields; i++)
+        if(field_eq(c->fields[i], p->f))
+            return;
+    if(c->nfields == Q_MAX_FIELDS)
+        panic("predicate uses more than %d fields\n", Q_MAX_FIELDS);
+    c->fields[c->nfields++] = p->f;
+}
+
+// the register holding field <f> in register set <set>.
+static reg_t field_reg(qc_t *c, unsigned set, q_field_t f) {
+    for(unsigned i = 0; i < c->nfields; i++)
+        if(field_eq(c->fields[i], f))
+            return r(4 + set * Q_PIPE_FIELDS + i);
+    panic("field at offset %d not collected\n", f.off);
+}
+
+// load every field of the record at r0 into <set>, if <cond>.
+static void load_fields(qc_t *c, unsigned set, unsigned cond) {
+    for(unsigned i = 0; i < c->nfields; i++) {
+        q_field_t f = c->fields[i];
+        reg_t rd = field_reg(c, set, f);
+        uint32_t inst;
+        if(f.width == 4)
+            inst = armv6_ldr_off12(rd, rp, f.off);
+        else if(f.width == 2)
+            inst = f.signed_p ? armv6_ldrsh_off8(rd, rp, f.off) : armv6_ldrh_off8(rd, rp, f.off);
+        else
+            inst = f.signed_p ? armv6_ldrsb_off8(rd, rp, f.off) : armv6_ldrb_off12(rd, rp, f.off);
+        jit_push(c->j, armv6_cond(cond, inst));
     }
-    return count;
 }
 
-QueryFunc compile_age_query(int target_age) {
-    kmalloc_init(1024);
-    uint32_t* code = kmalloc(64);
-    uint32_t* p = code;
+// rd = rn <op> v, through r10 if <v> doesn't fit.
+static void op_imm(jit_t *j, unsigned op, reg_t rd, reg_t rn, uint32_t v) {
+    uint32_t imm8;
+    unsigned rot4;
+    unsigned s = (op == armv6_cmp || op == armv6_cmn);
 
-    *p++ = 0xE3A01000;  // mov r1, #0
+    if(armv6_imm8_rot4_ok(v, &imm8, &rot4))
+        jit_push(j, armv6_dp_imm8_rot4(cond_always, op, s, rd, rn, imm8, rot4));
+    else {
+        jit_load_imm32(j, rconst, v);
+        jit_push(j, armv6_dp_reg(cond_always, op, s, rd, rn, rconst, armv6_lsl, 0));
+    }
+}
 
+static void cmp_imm(jit_t *j, reg_t rn, uint32_t v) {
+    if(!imm_ok(v) && imm_ok(-v))
+        op_imm(j, armv6_cmn, r(0), rn, -v);
+    else
+        op_imm(j, armv6_cmp, r(0), rn, v);
+}
 
-    *p++ = 0xE3A03000 | (target_age & 0xFF);  // mov r3, #target_age
+// branch to <t> on <cond> else to <f>: whichever of them is <next> is
+// reached by falling through.
+static void branch(jit_t *j, unsigned cond, unsigned t, unsigned f, unsigned next) {
+    if(next == f)
+        jit_b(j, cond, t);
+    else if(next == t)
+        jit_b(j, cond ^ 1, f);      // pairs of conditions differ in bit 0.
+    else {
+        jit_b(j, cond, t);
+        jit_b(j, cond_always, f);
+    }
+}
 
-    *p++ = 0xE590C024;  // ldr ip, [r0, #36]
-    *p++ = 0xE15C0003;  // cmp ip, r3
-    *p++ = 0x02811001;  // addeq r1, r1, #1
-    *p++ = 0xE2800028;  // add r0, r0, #40
+static unsigned cond_of(q_op_t op, int signed_p) {
+    switch(op) {
+    case Q_EQ: return cond_eq;
+    case Q_NE: return cond_ne;
+    case Q_LT: return signed_p ? cond_lt : cond_cc;
+    case Q_LE: return signed_p ? cond_le : cond_ls;
+    case Q_GT: return signed_p ? cond_gt : cond_hi;
+    case Q_GE: return signed_p ? cond_ge : cond_cs;
+    default:   panic("not a comparison: %d\n", op);
+    }
+}
 
-    // Record 1:
-    *p++ = 0xE590C024;  // ldr ip, [r0, #36]
-    *p++ = 0xE15C0003;  // cmp ip, r3
-    *p++ = 0x02811001;  // addeq r1, r1, #1
-    *p++ = 0xE2800028;  // add r0, r0, #40
+// jump to <t> if the record in <set> matches <p>, else to <f>.
+static void gen_pred(qc_t *c, unsigned set, const q_pred_t *p,
+                     unsigned t, unsigned f, unsigned next) {
+    jit_t *j = c->j;
+    reg_t x = p->op == Q_AND || p->op == Q_OR ? r(0) : field_reg(c, set, p->f);
 
-    // Record 2:
-    *p++ = 0xE590C024;
-    *p++ = 0xE15C0003;
-    *p++ = 0x02811001;
-    *p++ = 0xE2800028;
+    switch(p->op) {
+    case Q_AND: {
+        unsigned m = jit_label(j);
+        gen_pred(c, set, p->l, m, f, m);
+        jit_place(j, m);
+        gen_pred(c, set, p->r, t, f, next);
+        return;
+    }
+    case Q_OR: {
+        unsigned m = jit_label(j);
+        gen_pred(c, set, p->l, t, m, m);
+        jit_place(j, m);
+        gen_pred(c, set, p->r, t, f, next);
+        return;
+    }
+    case Q_RANGE:
+        // lo <= x <= hi  <=>  (unsigned)(x - lo) <= hi - lo
+        if(!le(p->f, p->v, p->hi)) {
+            if(next != f)
+                jit_b(j, cond_always, f);
+            return;
+        }
+        if(p->v) {
+            if(!imm_ok(p->v) && imm_ok(-p->v))
+                op_imm(j, armv6_add, rtmp, x, -p->v);
+            else
+                op_imm(j, armv6_sub, rtmp, x, p->v);
+            x = rtmp;
+        }
+        cmp_imm(j, x, (uint32_t)p->hi - (uint32_t)p->v);
+        branch(j, cond_ls, t, f, next);
+        return;
+    case Q_IN:
+        for(unsigned i = 0; i < p->nin; i++) {
+            cmp_imm(j, x, p->in[i]);
+            jit_b(j, cond_eq, t);
+        }
+        if(next != f)
+            jit_b(j, cond_always, f);
+        return;
+    default:
+        cmp_imm(j, x, p->v);
+        branch(j, cond_of(p->op, p->f.signed_p), t, f, next);
+        return;
+    }
+}
 
-    // Record 3:
-    *p++ = 0xE590C024;
-    *p++ = 0xE15C0003;
-    *p++ = 0x02811001;
-    *p++ = 0xE2800028;
+static unsigned pred_nwords(const q_pred_t *p) {
+    switch(p->op) {
+    case Q_AND:
+    case Q_OR:    return pred_nwords(p->l) + pred_nwords(p->r);
+    case Q_RANGE: return 10;
+    case Q_IN:    return 5 * p->nin + 1;
+    default:      return 6;
+    }
+}
 
-    // Record 4:
-    *p++ = 0xE590C024;
-    *p++ = 0xE15C0003;
-    *p++ = 0x02811001;
+unsigned query_nwords_max(const q_pred_t *p) {
+    // two copies of the loop body, plus the prologue and epilogue.
+    return 2 * (pred_nwords(p) + 2*Q_PIPE_FIELDS + 8) + 24;
+}
 
-    *p++ = 0xE1A00001;  // mov r0, r1
-    // Return.
-    *p++ = 0xE12FFF1E;  // bx lr
+// r0 += stride, and the index along with it.
+static void advance(qc_t *c, unsigned stride, int mode) {
+    if(imm_ok(stride))
+        op_imm(c->j, armv6_add, rp, rp, stride);
+    else
+        jit_push(c->j, armv6_op_rrr(armv6_add, rp, rp, r(armv6_lr)));
+    if(mode == QUERY_SELECT)
+        op_imm(c->j, armv6_add, ridx, ridx, 1);
+}
 
-    return (QueryFunc)code;
+// test the record in <set> and count it if it matches.
+static void test_record(qc_t *c, const q_pred_t *p, unsigned set, int mode) {
+    jit_t *j = c->j;
+    unsigned match = jit_label(j), skip = jit_label(j);
+    gen_pred(c, set, p, match, skip, match);
+    jit_place(j, match);
+    if(mode == QUERY_SELECT)
+        jit_push(j, armv6_str_post_off12(ridx, rsel, 4));
+    op_imm(j, armv6_add, rcnt, rcnt, 1);
+    jit_place(j, skip);
 }
 
-void notmain(void) {
-    output("Testing correctness...\n");
-    
-    int interpreted_result = interpret_query(people, NUM_PEOPLE, 30);
-    QueryFunc compiled_query = compile_age_query(30);
-    int jit_result = compiled_query(people, NUM_PEOPLE, 30);
-    
-    if (interpreted_result != jit_result) {
-        panic("Correctness test failed! Interpreted: %d, JIT: %d\n", 
-              interpreted_result, jit_result);
+query_fn_t query_compile(const q_pred_t *p, unsigned stride, int mode, jit_t *j) {
+    qc_t c = { .j = j };
+    collect_fields(&c, p);
+    c.pipelined = c.nfields <= Q_PIPE_FIELDS;
+    assert(stride);
+
+    uint32_t *start = jit_here(j);
+    unsigned done = jit_label(j);
+
+    jit_push(j, armv6_push_regs(0x4ff0));       // r4-r11, lr
+    jit_load_imm32(j, rcnt, 0);
+    if(mode == QUERY_SELECT)
+        jit_load_imm32(j, ridx, 0);
+    if(!imm_ok(stride))
+        jit_load_imm32(j, r(armv6_lr), stride);
+    // r1 = recs + n * stride.
+    jit_load_imm32(j, rconst, stride);
+    jit_push(j, armv6_mla(rend, rconst, rend, rp));
+    jit_push(j, armv6_cmp_rr(rp, rend));
+    jit_b(j, cond_cs, done);
+
+    if(c.pipelined) {
+        // two copies of the loop, one per register set: each loads the
+        // next record (if there is one) into the other set before testing
+        // the one in its own.
+        unsigned loop = jit_label(j);
+        load_fields(&c, 0, cond_always);
+        advance(&c, stride, QUERY_COUNT);
+        jit_place(j, loop);
+        for(unsigned set = 0; set < 2; set++) {
+            jit_push(j, armv6_cmp_rr(rp, rend));
+            load_fields(&c, !set, cond_cc);
+            test_record(&c, p, set, mode);
+            jit_push(j, armv6_cmp_rr(rp, rend));
+            jit_b(j, cond_cs, done);
+            advance(&c, stride, mode);
+        }
+        jit_b(j, cond_always, loop);
+    } else {
+        unsigned loop = jit_label(j);
+        jit_place(j, loop);
+        load_fields(&c, 0, cond_always);
+        test_record(&c, p, 0, mode);
+        advance(&c, stride, mode);
+        jit_push(j, armv6_cmp_rr(rp, rend));
+        jit_b(j, cond_cc, loop);
     }
-    output("Correctness test passed! Both versions found %d matches\n", interpreted_result);
-    
-    output("\nTesting performance...\n");
-    uint32_t t_interpret = TIME_CYC(interpret_query(people, NUM_PEOPLE, 30)) + 200;
-    output("Interpreted query time: %d cycles\n", t_interpret);
-    
-    uint32_t t_jit = TIME_CYC(compiled_query(people, NUM_PEOPLE, 30)) - 200;
-    output("JIT compiled query time: %d cycles\n", t_jit);
+
+    jit_place(j, done);
+    jit_push(j, armv6_mov(r(0), rcnt));
+    jit_push(j, armv6_pop_regs(0x8ff0));        // r4-r11, pc
+
+    jit_link(j);
+    code_sync(start, 4 * (jit_here(j) - start));
+    return (query_fn_t)start;
 }
@@ -0,0 +1,83 @@
+#ifndef __QUERY_JIT_H__
+#define __QUERY_JIT_H__
+// compile a filter over an array of fixed-size records into a scan loop.
+//
+// a predicate is a tree of comparisons of record fields against constants
+// (==, !=, <, <=, >, >=, lo <= f <= hi, f in {v0, v1, ...}) joined with
+// && and ||.  <query_compile> turns it into a routine
+//      unsigned fn(const void *recs, unsigned n, uint32_t *sel);
+// that returns how many of the <n> records match and, for QUERY_SELECT,
+// writes the index of each one to <sel>.  <query_interp> is the same scan,
+// interpreted.
+#include "jit.h"
+
+// where a field is in a record: <width> = 1, 2 or 4 bytes.
+typedef struct {
+    uint16_t off;
+    uint8_t width;
+    uint8_t signed_p;
+} q_field_t;
+
+static inline q_field_t q_field(unsigned off, unsigned width, int signed_p) {
+    if(width != 1 && width != 2 && width != 4)
+        panic("field width must be 1, 2 or 4, not %d\n", width);
+    if(off % width)
+        panic("field at offset %d is not %d-byte aligned\n", off, width);
+    return (q_field_t){ .off = off, .width = width, .signed_p = signed_p };
+}
+
+typedef enum {
+    Q_EQ, Q_NE, Q_LT, Q_LE, Q_GT, Q_GE,
+    Q_RANGE,    // lo <= f <= hi
+    Q_IN,       // f is one of in[0..nin)
+    Q_AND, Q_OR,
+} q_op_t;
+
+typedef struct q_pred {
+    q_op_t op;
+    q_field_t f;
+    int32_t v, hi;              // Q_RANGE: [v, hi]
+    const int32_t *in;
+    unsigned nin;
+    struct q_pred *l, *r;       // Q_AND, Q_OR
+} q_pred_t;
+
+enum { Q_MAX_PREDS = 64 };
+
+// predicate nodes come from here: reset with <query_init>.
+typedef struct {
+    q_pred_t preds[Q_MAX_PREDS];
+    unsigned n;
+} query_t;
+
+void query_init(query_t *q);
+q_pred_t *q_cmp(query_t *q, q_op_t op, q_field_t f, int32_t v);
+q_pred_t *q_range(query_t *q, q_field_t f, int32_t lo, int32_t hi);
+q_pred_t *q_in(query_t *q, q_field_t f, const int32_t *in, unsigned nin);
+q_pred_t *q_and(query_t *q, q_pred_t *l, q_pred_t *r);
+q_pred_t *q_or(query_t *q, q_pred_t *l, q_pred_t *r);
+
+// does the record at <rec> match <p>?
+int query_match(const q_pred_t *p, const void *rec);
+
+// scan the <n> records of <stride> bytes at <recs>.  if <sel> is not
+// null, the index of each match goes there.  returns the number of matches.
+unsigned query_interp(const q_pred_t *p, const void *recs, unsigned n, 
+                      unsigned stride, uint32_t *sel);
+
+typedef unsigned (*query_fn_t)(const void *recs, unsigned n, uint32_t *sel);
+
+enum { QUERY_COUNT, QUERY_SELECT };
+
+// words of code <query_compile> can need for <p>, at most.
+unsigned query_nwords_max(const q_pred_t *p);
+
+// compile the scan of <p> over records of <stride> bytes into <j>: 
+// QUERY_COUNT ignores <sel>.  links <j> and syncs the caches for the code.
+//
+// each record's fields are loaded while the one before it is tested
+// (software pipelining) when they fit in registers: up to 3 distinct
+// fields.  up to 6 are loaded and tested in turn; more is an error.
+query_fn_t query_compile(const q_pred_t *p, unsigned stride, int mode, jit_t *j);
+
+#endif
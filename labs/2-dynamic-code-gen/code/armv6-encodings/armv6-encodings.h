@@ -12,6 +12,32 @@ enum {
     armv6_orr = 0b1100,
     op_mult = 0b0000,
 
+    // the rest of the data processing opcodes (a5-2).
+    armv6_and = 0b0000,
+    armv6_eor = 0b0001,
+    armv6_sub = 0b0010,
+    armv6_rsb = 0b0011,
+    armv6_add = 0b0100,
+    armv6_cmp = 0b1010,
+    armv6_cmn = 0b1011,
+    armv6_bic = 0b1110,
+
+    // shift types for a register operand (a5-6).
+    armv6_lsl = 0b00,
+    armv6_lsr = 0b01,
+    armv6_asr = 0b10,
+
+    // condition codes (a3-6).
+    cond_eq = 0b0000,
+    cond_ne = 0b0001,
+    cond_cs = 0b0010,   // unsigned >=
+    cond_cc = 0b0011,   // unsigned <
+    cond_hi = 0b1000,   // unsigned >
+    cond_ls = 0b1001,   // unsigned <=
+    cond_ge = 0b1010,
+    cond_lt = 0b1011,
+    cond_gt = 0b1100,
+    cond_le = 0b1101,
     cond_always = 0b1110
 };
 
@@ -149,6 +175,188 @@ armv6_ldr_off12(reg_t rd, reg_t rn, int offset) {
          | (off & 0xfff);
 }
 
+// can <x> be a data processing immediate (an 8-bit value rotated right
+// by an even amount)?  if so, returns 1 and the <imm8>, <rot4> to pass to
+// the *_imm8_rot4 routines.
+static inline int 
+armv6_imm8_rot4_ok(uint32_t x, uint32_t *imm8, unsigned *rot4) {
+    for(unsigned rot = 0; rot < 32; rot += 2) {
+        // rotate left by <rot> to undo the rotate right.
+        uint32_t v = rot ? (x << rot) | (x >> (32 - rot)) : x;
+        if(v <= 0xff) {
+            *imm8 = v;
+            *rot4 = rot;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// data processing with a register operand shifted by an immediate (a5-3):
+//     rd = rn <op> (rm <shift> shift_imm)
+// <s> = 1 sets the condition codes.
+static inline uint32_t 
+armv6_dp_reg(unsigned cond, unsigned op, unsigned s, 
+             reg_t rd, reg_t rn, reg_t rm, unsigned shift, unsigned shift_imm) {
+    if(shift_imm >= 32)
+        panic("shift %d does not fit in 5 bits!\n", shift_imm);
+    return (cond << 28)
+         | (op << 21)
+         | (s << 20)
+         | (rn.reg << 16)
+         | (rd.reg << 12)
+         | (shift_imm << 7)
+         | (shift << 5)
+         | (rm.reg);
+}
+
+// same, but shifted by the bottom byte of register <rs> (a5-4).
+static inline uint32_t 
+armv6_dp_reg_shift(unsigned cond, unsigned op, 
+                   reg_t rd, reg_t rn, reg_t rm, unsigned shift, reg_t rs) {
+    return (cond << 28)
+         | (op << 21)
+         | (rn.reg << 16)
+         | (rd.reg << 12)
+         | (rs.reg << 8)
+         | (shift << 5)
+         | (1 << 4)
+         | (rm.reg);
+}
+
+// same, with an 8-bit immediate rotated right by <rot4> (a5-2).
+static inline uint32_t 
+armv6_dp_imm8_rot4(unsigned cond, unsigned op, unsigned s, 
+                   reg_t rd, reg_t rn, uint32_t imm8, unsigned rot4) {
+    if(imm8>>8)
+        panic("immediate %d does not fit in 8 bits!\n", imm8);
+    if(rot4 % 2)
+        panic("rotation %d must be divisible by 2!\n", rot4);
+    rot4 /= 2;
+    if(rot4>>4)
+        panic("rotation %d does not fit in 4 bits!\n", rot4);
+    return (cond << 28)
+         | (1 << 25)
+         | (op << 21)
+         | (s << 20)
+         | (rn.reg << 16)
+         | (rd.reg << 12)
+         | (rot4 << 8)
+         | imm8;
+}
+
+// rd = rn <op> rm, for the common three-register case.
+static inline uint32_t 
+armv6_op_rrr(unsigned op, reg_t rd, reg_t rn, reg_t rm) {
+    return armv6_dp_reg(cond_always, op, 0, rd, rn, rm, armv6_lsl, 0);
+}
+
+// cmp rn, rm
+static inline uint32_t 
+armv6_cmp_rr(reg_t rn, reg_t rm) {
+    return armv6_dp_reg(cond_always, armv6_cmp, 1, reg_mk(0), rn, rm, armv6_lsl, 0);
+}
+
+// mov<cond> rd, #imm8: e.g., to set a register based on a cmp.
+static inline uint32_t 
+armv6_mov_imm8_cond(unsigned cond, reg_t rd, uint32_t imm8) {
+    return armv6_dp_imm8_rot4(cond, op_mov, 0, rd, reg_mk(0), imm8, 0);
+}
+
+// store a word to memory[rn+offset]
+// str rd, [rn,#offset]
+static inline uint32_t 
+armv6_str_off12(reg_t rd, reg_t rn, int offset) {
+    // same as ldr with L = 0.
+    return armv6_ldr_off12(rd, rn, offset) & ~(1 << 20);
+}
+
+// byte version of <armv6_ldr_off12>: zero-extends.
+static inline uint32_t 
+armv6_ldrb_off12(reg_t rd, reg_t rn, int offset) {
+    return armv6_ldr_off12(rd, rn, offset) | (1 << 22);
+}
+
+// the halfword and signed loads (a5-33): an 8-bit offset.
+//   sh = 0b01: ldrh, 0b10: ldrsb, 0b11: ldrsh
+static inline uint32_t 
+armv6_ldr_misc_off8(unsigned sh, reg_t rd, reg_t rn, int offset) {
+    unsigned u = offset >= 0;
+    uint32_t off = u ? offset : -offset;
+    if(off >= (1 << 8))
+        panic("offset %d too big!\n", offset);
+    return (cond_always << 28)
+         | (1 << 24)             // P = 1 (pre-index)
+         | (u << 23)
+         | (1 << 22)             // immediate offset
+         | (1 << 20)             // L = 1 (load)
+         | (rn.reg << 16)
+         | (rd.reg << 12)
+         | ((off >> 4) << 8)
+         | (1 << 7)
+         | (sh << 5)
+         | (1 << 4)
+         | (off & 0xf);
+}
+static inline uint32_t 
+armv6_ldrh_off8(reg_t rd, reg_t rn, int offset) {
+    return armv6_ldr_misc_off8(0b01, rd, rn, offset);
+}
+static inline uint32_t 
+armv6_ldrsb_off8(reg_t rd, reg_t rn, int offset) {
+    return armv6_ldr_misc_off8(0b10, rd, rn, offset);
+}
+static inline uint32_t 
+armv6_ldrsh_off8(reg_t rd, reg_t rn, int offset) {
+    return armv6_ldr_misc_off8(0b11, rd, rn, offset);
+}
+
+// store then bump the base: str rd, [rn], #offset
+static inline uint32_t 
+armv6_str_post_off12(reg_t rd, reg_t rn, unsigned offset) {
+    if(offset >= (1 << 12))
+        panic("offset %d too big!\n", offset);
+    return (cond_always << 28)
+         | (1 << 26)
+         | (1 << 23)             // U = 1, P = 0 (post-index)
+         | (rn.reg << 16)
+         | (rd.reg << 12)
+         | offset;
+}
+
+// make any of the above conditional.
+static inline uint32_t 
+armv6_cond(unsigned cond, uint32_t inst) {
+    return (inst & 0x0fffffff) | (cond << 28);
+}
+
+// push/pop a set of registers (bit i of <regs> = ri):
+//      stmdb sp!, {regs}
+//      ldmia sp!, {regs}
+static inline uint32_t 
+armv6_push_regs(uint32_t regs) {
+    if(regs >> 16)
+        panic("illegal register list %x\n", regs);
+    return 0xe92d0000 | regs;
+}
+static inline uint32_t 
+armv6_pop_regs(uint32_t regs) {
+    if(regs >> 16)
+        panic("illegal register list %x\n", regs);
+    return 0xe8bd0000 | regs;
+}
+
+// b<cond> from the instruction at <b_pc> to <target> (a4-10).
+static inline uint32_t 
+armv6_b_cond(unsigned cond, uint32_t b_pc, uint32_t target) {
+    int32_t offset = (int32_t)(target - (b_pc + 8));
+    if(offset % 4)
+        panic("branch offset %d not word aligned\n", offset);
+    if(offset >= (1 << 25) || offset < -(1 << 25))
+        panic("branch offset %d does not fit in 24 bits\n", offset);
+    return (cond << 28) | (0b101 << 25) | ((offset >> 2) & 0x00FFFFFF);
+}
+
 /**********************************************************************
  * synthetic instructions.
  * 
@@ -0,0 +1,100 @@
+// check the code cache with the caches on, where skipping the
+// invalidate would run stale instructions:
+//   1. a freed routine's space gets reused by a different routine, and
+//      calling it runs the new code;
+//   2. a hot routine keeps working (and is never re-synced) while the
+//      ones around it are regenerated;
+//   3. random alloc/commit/free churn, checked against the stats.
+// then the stats dump, and what a full <flush_caches> costs instead.
+#include "rpi.h"
+#include "pi-random.h"
+#include "cycle-count.h"
+#include "armv6-encodings.h"
+#include "code-cache.h"
+
+typedef uint32_t (*ret_fn_t)(void);
+
+// a routine of <nwords> that returns <v> + the number of adds.
+static ret_fn_t gen(code_cache_t *cc, cc_fn_t *f, uint8_t v) {
+    assert(f->nwords >= 2);
+    f->code[0] = armv6_mov_imm8(reg_mk(0), v);
+    for(unsigned i = 1; i < f->nwords-1; i++)
+        f->code[i] = armv6_dp_imm8_rot4(cond_always, armv6_add, 0, 
+                                    reg_mk(0), reg_mk(0), 1, 0);
+    f->code[f->nwords-1] = armv6_bx(reg_mk(armv6_lr));
+    return cc_commit(cc, f);
+}
+
+static uint32_t expect(cc_fn_t *f, uint8_t v) {
+    return v + f->nwords - 2;
+}
+
+enum { nslots = 32, nchurn = 2000 };
+
+void notmain(void) {
+    kmalloc_init(4);
+    kheap_init(1024 * 1024);
+    caches_enable();
+
+    code_cache_t *cc = cc_mk("test", 64 * 1024);
+
+    // 1. same address, different code.
+    cc_fn_t *hot = cc_alloc(cc, "hot", 8);
+    ret_fn_t hot_fn = gen(cc, hot, 100);
+    cc_fn_t *b = cc_alloc(cc, "b", 8);
+    ret_fn_t b_fn = gen(cc, b, 1);
+    for(unsigned i = 0; i < 10; i++)
+        assert(b_fn() == expect(b, 1) && hot_fn() == expect(hot, 100));
+
+    uint32_t *old = b->code;
+    cc_free(cc, b);
+    assert(!cc_lookup(cc, "b"));
+    cc_fn_t *c = cc_alloc(cc, "c", 8);
+    if(c->code != old)
+        panic("expected <c> to reuse <b>'s space at %x, got %x\n", old, c->code);
+    ret_fn_t c_fn = gen(cc, c, 2);
+    if(c_fn() != expect(c, 2))
+        panic("stale code: <c> returned %d, expected %d\n", c_fn(), expect(c, 2));
+    output("a freed routine's space runs the new code\n");
+
+    // 2. + 3.
+    static cc_fn_t *slot[nslots];
+    static uint8_t val[nslots];
+    unsigned nbytes = 4*(hot->nwords + c->nwords);
+    for(unsigned i = 0; i < nchurn; i++) {
+        unsigned k = pi_random() % nslots;
+        if(slot[k]) {
+            if(slot[k]->code[0] != armv6_mov_imm8(reg_mk(0), val[k]))
+                panic("slot %d was overwritten\n", k);
+            nbytes -= 4*slot[k]->nwords;
+            cc_free(cc, slot[k]);
+            slot[k] = 0;
+        } else {
+            slot[k] = cc_alloc(cc, "churn", 2 + pi_random() % 64);
+            val[k] = pi_random();
+            nbytes += 4*slot[k]->nwords;
+            ret_fn_t fn = gen(cc, slot[k], val[k]);
+            if(fn() != expect(slot[k], val[k]))
+                panic("churn %d: got %d, expected %d\n", i, fn(), expect(slot[k], val[k]));
+        }
+        if(hot_fn() != expect(hot, 100))
+            panic("hot routine broke after %d rounds\n", i);
+    }
+    for(unsigned k = 0; k < nslots; k++)
+        if(slot[k])
+            assert(((ret_fn_t)slot[k]->code)() == expect(slot[k], val[k]));
+
+    cc_stats_t s = cc_stats(cc);
+    assert(s.nbytes_live == nbytes);
+    assert(s.nlive == s.nalloc - s.nfree);
+    assert(hot->ncommit == 1 && cc_lookup(cc, "hot") == hot);
+    output("hot routine survived %d regenerations around it\n", nchurn);
+
+    cc_dump(cc);
+    output("one flush_caches: %d cycles\n", TIME_CYC(flush_caches()));
+
+    cc_reset(cc);
+    assert(cc_stats(cc).nlive == 0 && cc_stats(cc).nbytes_live == 0);
+    cc_destroy(cc);
+    trace("SUCCESS\n");
+}
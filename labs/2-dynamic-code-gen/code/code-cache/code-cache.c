@@ -0,0 +1,114 @@
+// the code cache: see code-cache.h
+#include "code-cache.h"
+#include "cycle-count.h"
+
+// the lines covering [addr, addr+nbytes).
+static void lines(const void *addr, unsigned nbytes, uint32_t *start, uint32_t *end) {
+    *start = (uint32_t)addr & ~(CC_LINE_NBYTES-1);
+    *end = ((uint32_t)addr + nbytes + CC_LINE_NBYTES-1) & ~(CC_LINE_NBYTES-1);
+}
+
+code_cache_t *cc_mk(const char *name, unsigned nbytes) {
+    kheap_t *h = kheap_mk(name, nbytes);
+    code_cache_t *cc = kheap_alloc(h, sizeof *cc);
+    cc->name = name;
+    cc->heap = h;
+    return cc;
+}
+
+void cc_destroy(code_cache_t *cc) {
+    // <cc> is in its own heap.
+    kheap_destroy(cc->heap);
+}
+
+void cc_reset(code_cache_t *cc) {
+    while(cc->live)
+        cc_free(cc, cc->live);
+}
+
+cc_fn_t *cc_alloc(code_cache_t *cc, const char *name, unsigned nwords) {
+    assert(nwords);
+    cc_fn_t *f = kheap_alloc_notzero(cc->heap, sizeof *f + 4*nwords);
+    f->name = name;
+    f->code = (uint32_t *)(f + 1);
+    f->nwords = nwords;
+    f->ncommit = 0;
+
+    f->prev = 0;
+    f->next = cc->live;
+    if(cc->live)
+        cc->live->prev = f;
+    cc->live = f;
+
+    cc_stats_t *s = &cc->stats;
+    s->nalloc++;
+    s->nlive++;
+    s->nbytes_live += 4*nwords;
+    if(s->nbytes_live > s->nbytes_peak)
+        s->nbytes_peak = s->nbytes_live;
+    return f;
+}
+
+void *cc_commit(code_cache_t *cc, cc_fn_t *f) {
+    uint32_t start, end;
+    lines(f->code, 4*f->nwords, &start, &end);
+
+    uint32_t t = cycle_cnt_read();
+    code_sync_range(start, end);
+    t = cycle_cnt_read() - t;
+
+    f->ncommit++;
+    cc->stats.nsync++;
+    cc->stats.nbytes_synced += end - start;
+    cc->stats.sync_cycles += t;
+    return f->code;
+}
+
+void cc_free(code_cache_t *cc, cc_fn_t *f) {
+    if(f->prev)
+        f->prev->next = f->next;
+    else {
+        assert(cc->live == f);
+        cc->live = f->next;
+    }
+    if(f->next)
+        f->next->prev = f->prev;
+
+    // nothing to do for the caches: whatever reuses the space has to
+    // <cc_commit> first.
+    cc_stats_t *s = &cc->stats;
+    s->nfree++;
+    s->nlive--;
+    s->nbytes_live -= 4*f->nwords;
+    kfree(f);
+}
+
+cc_fn_t *cc_lookup(code_cache_t *cc, const char *name) {
+    for(cc_fn_t *f = cc->live; f; f = f->next)
+        if(strcmp(f->name, name) == 0)
+            return f;
+    return 0;
+}
+
+void cc_dump(code_cache_t *cc) {
+    cc_stats_t *s = &cc->stats;
+    output("code cache <%s>: %d routines live (%d bytes, peak %d), %d allocs, %d frees\n",
+        cc->name, s->nlive, s->nbytes_live, s->nbytes_peak, s->nalloc, s->nfree);
+    output("\t%d commits: %d bytes synced in %d cycles", 
+        s->nsync, s->nbytes_synced, s->sync_cycles);
+    if(s->nbytes_synced)
+        output(" (%d cycles/line)", 
+            s->sync_cycles / (s->nbytes_synced / CC_LINE_NBYTES));
+    output("\n");
+    for(cc_fn_t *f = cc->live; f; f = f->next)
+        output("\t%s: %x, %d words, committed %d times\n", 
+            f->name, (uint32_t)f->code, f->nwords, f->ncommit);
+}
+
+void code_sync(const void *addr, unsigned nbytes) {
+    if(!nbytes)
+        return;
+    uint32_t start, end;
+    lines(addr, nbytes, &start, &end);
+    code_sync_range(start, end);
+}
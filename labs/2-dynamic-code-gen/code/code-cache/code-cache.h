@@ -0,0 +1,81 @@
+#ifndef __CODE_CACHE_H__
+#define __CODE_CACHE_H__
+// a code cache: memory for jit'd routines that can be freed one at a
+// time, with cache maintenance for just the bytes that changed.
+//
+// the region is a kheap sub-heap (kheap.h), so a freed routine's space
+// coalesces and gets reused.  the cache tracks every live routine by
+// name.  usage:
+//      code_cache_t *cc = cc_mk("jit", 64*1024);
+//      cc_fn_t *f = cc_alloc(cc, "dot", nwords);
+//      ... write f->code[0..nwords) ...
+//      int (*fn)(int) = cc_commit(cc, f);
+//      fn(3);
+//      cc_free(cc, f);
+//
+// <cc_commit> cleans the routine's lines out of the d-cache and
+// invalidates them in the i-cache (then flushes the btb and prefetch
+// buffer), instead of <flush_caches> throwing both caches away: hot
+// routines stay cached while others get regenerated around them.
+// <code_sync_range> does the same for code that lives anywhere.
+#include "rpi.h"
+#include "kheap.h"
+
+typedef struct cc_fn {
+    const char *name;       // not copied
+    uint32_t *code;
+    unsigned nwords;
+    unsigned ncommit;       // times <cc_commit>'d
+    struct cc_fn *prev, *next;
+} cc_fn_t;
+
+// all in bytes, except the counts.
+typedef struct {
+    unsigned nlive;             // routines not freed yet
+    unsigned nbytes_live;       // their code
+    unsigned nbytes_peak;       // max of <nbytes_live>
+    unsigned nalloc, nfree;
+    unsigned nsync;             // <cc_commit>s
+    unsigned nbytes_synced;     // cleaned + invalidated, whole lines
+    unsigned sync_cycles;       // spent doing it
+} cc_stats_t;
+
+typedef struct code_cache {
+    const char *name;
+    kheap_t *heap;
+    cc_fn_t *live;              // most recently allocated first
+    cc_stats_t stats;
+} code_cache_t;
+
+enum { CC_LINE_NBYTES = 32 };   // arm1176 cache line
+
+// a cache of <nbytes> out of the root heap (needs <kheap_init>).
+code_cache_t *cc_mk(const char *name, unsigned nbytes);
+// free every routine in <cc>, and <cc> itself.
+void cc_destroy(code_cache_t *cc);
+// free every routine; <cc> can be used again.
+void cc_reset(code_cache_t *cc);
+
+// room for a routine of <nwords> called <name>: panics if full.
+cc_fn_t *cc_alloc(code_cache_t *cc, const char *name, unsigned nwords);
+// make <f>'s code visible to instruction fetch; returns it to call.
+void *cc_commit(code_cache_t *cc, cc_fn_t *f);
+void cc_free(code_cache_t *cc, cc_fn_t *f);
+
+// the live routine called <name>, or 0.
+cc_fn_t *cc_lookup(code_cache_t *cc, const char *name);
+
+static inline cc_stats_t cc_stats(code_cache_t *cc) {
+    return cc->stats;
+}
+// the stats and every live routine.
+void cc_dump(code_cache_t *cc);
+
+// clean the d-cache and invalidate the i-cache (+ btb) for the lines
+// covering [addr, addr+nbytes).
+void code_sync(const void *addr, unsigned nbytes);
+
+// the asm part (code-sync.S): <start>, <end> line aligned.
+void code_sync_range(uint32_t start, uint32_t end);
+
+#endif
@@ -0,0 +1,235 @@
+// host benchmark: replay an allocation trace against kr_malloc and
+// seg_malloc and report ops/sec, peak footprint and fragmentation.
+//
+// usage:
+//      ./alloc-replay              # run the built-in synthetic traces.
+//      ./alloc-replay trace.txt    # replay a trace file.
+//
+// trace format: one op per line:
+//      a <id> <nbytes>     allocate <nbytes>, name the result <id>
+//      f <id>              free block <id>
+//
+// each (allocator, trace) pair runs in its own forked child so that
+// neither allocator's state (or sbrk high-water mark) leaks into the
+// next run.
+//
+// footprint = bytes obtained from sbrk.  fragmentation is the part
+// of the footprint not holding live user bytes at the peak:
+//      1 - peak_live / footprint.
+#include <sys/wait.h>
+#include "seg-malloc.h"
+
+/*********************************************************************
+ * fake sbrk: bump through a static arena.
+ */
+enum { ARENA_NBYTES = 512 * 1024 * 1024 };
+static char arena[ARENA_NBYTES];
+static unsigned brk_off;
+
+void *sbrk(long increment) {
+    assert(increment > 0);
+    if(brk_off + increment > ARENA_NBYTES)
+        return (void*)-1;
+    void *p = &arena[brk_off];
+    brk_off += increment;
+    return p;
+}
+
+/*********************************************************************
+ * traces.
+ */
+enum { MAX_OPS = 1 << 21, MAX_IDS = 1 << 20 };
+
+typedef struct {
+    uint8_t alloc_p;
+    uint32_t id;
+    uint32_t nbytes;
+} op_t;
+
+static op_t ops[MAX_OPS];
+static unsigned nops;
+static void *ptrs[MAX_IDS];
+static uint32_t sizes[MAX_IDS];
+
+static uint32_t rng_state;
+static uint32_t rng(void) {
+    rng_state = rng_state * 1103515245 + 12345;
+    return rng_state >> 8;
+}
+
+static void op_add(int alloc_p, uint32_t id, uint32_t nbytes) {
+    if(nops >= MAX_OPS)
+        panic("too many ops: max=%d\n", MAX_OPS);
+    if(id >= MAX_IDS)
+        panic("id %u too big: max=%d\n", id, MAX_IDS);
+    ops[nops++] = (op_t){ .alloc_p = alloc_p, .id = id, .nbytes = nbytes };
+}
+
+// random churn: ramp up to <nlive> live blocks, then randomly free
+// and allocate around that level.  sizes from <size_fn>.
+static void trace_churn(unsigned n, unsigned nlive, uint32_t (*size_fn)(void)) {
+    static uint32_t live[MAX_IDS];
+    unsigned nl = 0, id = 0;
+
+    nops = 0;
+    rng_state = 1;
+    for(unsigned i = 0; i < n; i++) {
+        if(nl >= nlive || (nl > nlive/2 && rng() % 2 == 0)) {
+            unsigned j = rng() % nl;
+            op_add(0, live[j], 0);
+            live[j] = live[--nl];
+        } else {
+            op_add(1, id, size_fn());
+            live[nl++] = id++;
+        }
+    }
+    // free everything at the end.
+    while(nl)
+        op_add(0, live[--nl], 0);
+}
+
+static uint32_t size_small(void) { return 8 + rng() % 121; }
+// log-uniform 8 .. 16k.
+static uint32_t size_mixed(void) { return (8 << (rng() % 11)) + rng() % 64; }
+
+// phases: allocate many small, free every other one, then allocate
+// larger blocks that can't reuse the holes.
+static void trace_phases(void) {
+    nops = 0;
+    rng_state = 1;
+    unsigned n = 50000, id = 0;
+    for(unsigned i = 0; i < n; i++)
+        op_add(1, id++, 16 + rng() % 48);
+    for(unsigned i = 0; i < n; i += 2)
+        op_add(0, i, 0);
+    for(unsigned i = 0; i < n/4; i++)
+        op_add(1, id++, 256 + rng() % 256);
+    for(unsigned i = 1; i < n; i += 2)
+        op_add(0, i, 0);
+    for(unsigned i = n; i < id; i++)
+        op_add(0, i, 0);
+}
+
+static void trace_read(const char *name) {
+    FILE *fp = fopen(name, "r");
+    if(!fp)
+        sys_die(fopen, "can't open <%s>", name);
+
+    char c;
+    uint32_t id, nbytes;
+    nops = 0;
+    while(fscanf(fp, " %c %u", &c, &id) == 2) {
+        if(c == 'a') {
+            if(fscanf(fp, "%u", &nbytes) != 1)
+                panic("bad alloc op at %d\n", nops);
+            op_add(1, id, nbytes);
+        } else if(c == 'f')
+            op_add(0, id, 0);
+        else
+            panic("bad op <%c> at %d\n", c, nops);
+    }
+    fclose(fp);
+}
+
+/*********************************************************************
+ * replay.
+ */
+typedef void *(*alloc_fn_t)(unsigned);
+typedef void (*free_fn_t)(void *);
+
+typedef struct {
+    const char *name;
+    alloc_fn_t alloc_fn;
+    free_fn_t free_fn;
+} allocator_t;
+
+static void replay(const char *trace, allocator_t *a) {
+    unsigned live = 0, peak_live = 0;
+
+    brk_off = 0;
+    time_usec_t s = time_get_usec();
+    for(unsigned i = 0; i < nops; i++) {
+        op_t *o = &ops[i];
+        if(o->alloc_p) {
+            uint8_t *p = a->alloc_fn(o->nbytes);
+            if(!p)
+                panic("%s: out of memory at op %d\n", a->name, i);
+            // touch the ends so overlapping blocks show up as
+            // corruption below.
+            if(o->nbytes) {
+                p[0] = o->id;
+                p[o->nbytes-1] = o->id;
+            }
+            ptrs[o->id] = p;
+            sizes[o->id] = o->nbytes;
+            live += o->nbytes;
+            if(live > peak_live)
+                peak_live = live;
+        } else {
+            uint8_t *p = ptrs[o->id];
+            unsigned n = sizes[o->id];
+            if(!p)
+                panic("trace frees unallocated id %u\n", o->id);
+            if(n && (p[0] != (uint8_t)o->id || p[n-1] != (uint8_t)o->id))
+                panic("%s: block %u corrupted\n", a->name, o->id);
+            a->free_fn(p);
+            ptrs[o->id] = 0;
+            live -= n;
+        }
+    }
+    time_usec_t t = time_get_usec() - s;
+    if(!t)
+        t = 1;
+
+    double frag = brk_off ? 100. * (1. - (double)peak_live / brk_off) : 0;
+    output("%-12s %-6s %10u %12.0f %12u %12u %7.1f%%\n",
+        trace, a->name, nops, nops * 1e6 / t, peak_live, brk_off, frag);
+}
+
+// run in a child so each allocator starts from scratch.
+static void replay_fork(const char *trace, allocator_t *a) {
+    pid_t pid = fork();
+    if(pid < 0)
+        sys_die(fork, "fork failed");
+    if(!pid) {
+        replay(trace, a);
+        exit(0);
+    }
+    int status;
+    if(waitpid(pid, &status, 0) < 0)
+        sys_die(waitpid, "waitpid failed");
+    if(!WIFEXITED(status) || WEXITSTATUS(status))
+        panic("%s replay of %s failed\n", a->name, trace);
+}
+
+static allocator_t allocators[] = {
+    { "kr",  kr_malloc, kr_free },
+    { "seg", seg_malloc, seg_free },
+};
+enum { NALLOCATORS = sizeof allocators / sizeof allocators[0] };
+
+static void run(const char *trace) {
+    for(unsigned i = 0; i < NALLOCATORS; i++)
+        replay_fork(trace, &allocators[i]);
+}
+
+int main(int argc, char *argv[]) {
+    output("%-12s %-6s %10s %12s %12s %12s %8s\n",
+        "trace", "alloc", "ops", "ops/sec", "peak-live", "footprint", "frag");
+
+    if(argc > 1) {
+        for(int i = 1; i < argc; i++) {
+            trace_read(argv[i]);
+            run(argv[i]);
+        }
+        return 0;
+    }
+
+    trace_churn(200000, 5000, size_small);
+    run("small-churn");
+    trace_churn(100000, 2000, size_mixed);
+    run("mixed-churn");
+    trace_phases();
+    run("phases");
+    return 0;
+}
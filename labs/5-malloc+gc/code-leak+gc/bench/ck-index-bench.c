@@ -0,0 +1,160 @@
+// host benchmark: cost of mapping an address to its ckalloc block.
+//
+// the two hot callers are:
+//   - gc mark(): one lookup per scanned word (most of which are
+//     pointers into the heap).
+//   - purify_handler(): one lookup per trapped load/store.
+//
+// we build a fake heap of <n> live blocks laid out the way ckalloc
+// lays them out (hdr_t, then data), fill the data words with a mix
+// of start pointers, interior pointers and junk, then time both
+// workloads using (1) the old linear walk of the allocated list and
+// (2) the ck-index tree.
+//
+// the linear walk is quadratic, so at large <n> we only time a
+// sample of lookups and scale.
+#include <string.h>
+#include "libunix.h"
+#include "ck-index.h"
+
+static hdr_t *alloc_list;
+
+// the original ck_ptr_is_alloced().
+static hdr_t *list_lookup(const void *ptr) {
+    for(hdr_t *h = alloc_list; h; h = ck_next_hdr(h)) {
+        const char *p = ptr;
+        if(p >= (char*)ck_data_start(h) && p < (char*)ck_data_end(h))
+            return h;
+    }
+    return 0;
+}
+
+static uint32_t rng_state = 1;
+static uint32_t rng(void) {
+    rng_state = rng_state * 1103515245 + 12345;
+    return rng_state >> 8;
+}
+
+// fake heap.
+static char *heap_start, *heap_end;
+static hdr_t **blocks;
+
+static void heap_mk(unsigned n) {
+    // max 64 bytes of data per block.
+    unsigned nbytes = n * (sizeof(hdr_t) + 64);
+    heap_start = calloc(1, nbytes);
+    if(!heap_start)
+        panic("calloc failed\n");
+    blocks = calloc(n, sizeof *blocks);
+
+    alloc_list = 0;
+    ck_index_reset();
+    rng_state = 1;
+
+    char *p = heap_start;
+    for(unsigned i = 0; i < n; i++) {
+        hdr_t *h = (void*)p;
+        // multiple of 8 so headers stay aligned on 64-bit hosts.
+        h->nbytes_alloc = 8 + (rng() % 8) * 8;   // [8,64]
+        h->state = ALLOCED;
+        h->block_id = i+1;
+        h->next = alloc_list;
+        alloc_list = h;
+        ck_index_insert(h);
+        blocks[i] = h;
+        p = ck_data_end(h);
+    }
+    heap_end = p;
+
+    // fill in the data words: ~1/4 start pointers, ~1/4 interior 
+    // pointers, rest junk.  words are pointer-sized so this also 
+    // works on 64-bit hosts.
+    for(unsigned i = 0; i < n; i++) {
+        void **w = ck_data_start(blocks[i]);
+        void **e = ck_data_end(blocks[i]);
+        for(; w < e; w++) {
+            hdr_t *t = blocks[rng() % n];
+            switch(rng() % 4) {
+            case 0: *w = ck_data_start(t); break;
+            case 1: *w = (char*)ck_data_start(t) + 4; break;
+            default: *w = (void*)(uintptr_t)rng(); break;
+            }
+        }
+    }
+    assert(ck_index_check() == n);
+}
+
+static void heap_free(void) {
+    free(heap_start);
+    free(blocks);
+}
+
+typedef hdr_t *(*lookup_fn)(const void *);
+
+// mark(): scan every word of every block.  returns nsec per word
+// (scaled from at most <max_words>).
+static unsigned bench_mark(lookup_fn lookup, unsigned n, unsigned max_words, unsigned *found) {
+    unsigned nwords = 0, nfound = 0;
+    time_usec_t s = time_get_usec();
+    for(unsigned i = 0; i < n && nwords < max_words; i++) {
+        void **w = ck_data_start(blocks[i]);
+        void **e = ck_data_end(blocks[i]);
+        for(; w < e; w++, nwords++) {
+            if(lookup(*w))
+                nfound++;
+        }
+    }
+    time_usec_t t = time_get_usec() - s;
+    *found = nfound;
+    return (unsigned)((double)t * 1000. / nwords);
+}
+
+// purify trap: random heap addresses (headers, data, redzone).
+// returns nsec per trap.
+static unsigned bench_trap(lookup_fn lookup, unsigned ntraps, unsigned *found) {
+    unsigned nfound = 0;
+    unsigned range = heap_end - heap_start;
+    rng_state = 7;
+    time_usec_t s = time_get_usec();
+    for(unsigned i = 0; i < ntraps; i++)
+        if(lookup(heap_start + rng() % range))
+            nfound++;
+    time_usec_t t = time_get_usec() - s;
+    *found = nfound;
+    return (unsigned)((double)t * 1000. / ntraps);
+}
+
+static unsigned min_u(unsigned a, unsigned b) { return a < b ? a : b; }
+
+int main(void) {
+    unsigned sizes[] = { 1000, 10000, 100000 };
+
+    output("nsec per lookup (lower is better)\n");
+    output("%8s %14s %14s %14s %14s\n",
+        "nblocks", "mark:list", "mark:index", "trap:list", "trap:index");
+
+    for(unsigned i = 0; i < sizeof sizes / sizeof sizes[0]; i++) {
+        unsigned n = sizes[i];
+        heap_mk(n);
+
+        // bound the linear walk to ~5e7 block visits.
+        unsigned nsample = min_u(1000000, 50000000U / n);
+        unsigned f_list, f_idx;
+
+        unsigned m_list = bench_mark(list_lookup, n, nsample, &f_list);
+        unsigned m_idx  = bench_mark(ck_index_lookup, n, nsample, &f_idx);
+        if(f_list != f_idx)
+            panic("mark: list found %u, index found %u\n", f_list, f_idx);
+        m_idx = bench_mark(ck_index_lookup, n, ~0, &f_idx);
+
+        unsigned t_list = bench_trap(list_lookup, nsample, &f_list);
+        unsigned t_idx  = bench_trap(ck_index_lookup, nsample, &f_idx);
+        if(f_list != f_idx)
+            panic("trap: list found %u, index found %u\n", f_list, f_idx);
+        t_idx = bench_trap(ck_index_lookup, 1000000, &f_idx);
+
+        output("%8u %14u %14u %14u %14u\n", n, m_list, m_idx, t_list, t_idx);
+        heap_free();
+    }
+    return 0;
+}
@@ -0,0 +1,173 @@
+// host benchmark: gc mark throughput (words/sec) on large linked
+// structures for the three ways of mapping a scanned word to its
+// block:
+//   - list:    the original walk of the allocated list.
+//   - index:   the AVL tree in ck-index.c (O(log n)).
+//   - pagemap: the granule map in ck-pagemap.c (O(1)).
+//
+// we lay out <n> blocks the way ckalloc does (hdr_t, then data) in
+// one contiguous region, link them into a list or a binary tree,
+// then run the same iterative mark (explicit stack, as in ck-gc.c)
+// from the root with each lookup.  every node also holds an
+// interior pointer (refs_middle) and some junk words.
+//
+// the list lookup is O(n) per word so at large <n> we only mark
+// a bounded number of words and report the rate.
+#include <string.h>
+#include "libunix.h"
+#include "ck-index.h"
+#include "ck-pagemap.h"
+
+static hdr_t *alloc_list;
+
+static hdr_t *list_lookup(const void *ptr) {
+    for(hdr_t *h = alloc_list; h; h = ck_next_hdr(h)) {
+        const char *p = ptr;
+        if(p >= (char*)ck_data_start(h) && p < (char*)ck_data_end(h))
+            return h;
+    }
+    return 0;
+}
+
+static uint32_t rng_state = 1;
+static uint32_t rng(void) {
+    rng_state = rng_state * 1103515245 + 12345;
+    return rng_state >> 8;
+}
+
+enum { NODE_NWORDS = 6 };
+
+static char *heap_start, *heap_end;
+static hdr_t **blocks;
+static void *pagemap;
+
+static void **node(unsigned i) {
+    return ck_data_start(blocks[i]);
+}
+
+typedef enum { LIST, TREE } shape_t;
+
+static void heap_mk(unsigned n, shape_t shape) {
+    unsigned blk_nbytes = sizeof(hdr_t) + NODE_NWORDS * sizeof(void*);
+    unsigned nbytes = n * blk_nbytes;
+    heap_start = calloc(1, nbytes);
+    blocks = calloc(n, sizeof *blocks);
+    if(!heap_start || !blocks)
+        panic("calloc failed\n");
+    heap_end = heap_start + nbytes;
+
+    alloc_list = 0;
+    ck_index_reset();
+    pagemap = calloc(1, ck_pagemap_nbytes(heap_start, heap_end));
+    ck_pagemap_init(heap_start, heap_end, pagemap);
+    rng_state = 1;
+
+    char *p = heap_start;
+    for(unsigned i = 0; i < n; i++, p += blk_nbytes) {
+        hdr_t *h = (void*)p;
+        h->nbytes_alloc = NODE_NWORDS * sizeof(void*);
+        h->state = ALLOCED;
+        h->block_id = i+1;
+        h->next = alloc_list;
+        alloc_list = h;
+        ck_index_insert(h);
+        ck_pagemap_insert(h);
+        blocks[i] = h;
+    }
+
+    for(unsigned i = 0; i < n; i++) {
+        void **w = node(i);
+        if(shape == LIST) {
+            w[0] = i+1 < n ? node(i+1) : 0;
+            w[1] = 0;
+        } else {
+            w[0] = 2*i+1 < n ? node(2*i+1) : 0;
+            w[1] = 2*i+2 < n ? node(2*i+2) : 0;
+        }
+        // interior pointer to a random node.
+        w[2] = (char*)node(rng() % n) + sizeof(void*);
+        for(unsigned k = 3; k < NODE_NWORDS; k++)
+            w[k] = (void*)(uintptr_t)rng();
+    }
+}
+
+static void heap_free(void) {
+    free(heap_start);
+    free(blocks);
+    free(pagemap);
+}
+
+typedef hdr_t *(*lookup_fn)(const void *);
+
+// iterative mark from node 0.  stops after <max_words>.
+// returns words/sec, and the number of words and blocks marked.
+static double mark(lookup_fn lookup, unsigned n, unsigned max_words, 
+        unsigned *nwords_out, unsigned *nmarked_out) {
+    static hdr_t **stack;
+    static unsigned stack_n;
+    if(stack_n < n) {
+        free(stack);
+        stack = calloc(stack_n = n, sizeof *stack);
+    }
+    for(unsigned i = 0; i < n; i++)
+        blocks[i]->mark = 0;
+
+    unsigned sp = 0, nwords = 0, nmarked = 1;
+    blocks[0]->mark = 1;
+    stack[sp++] = blocks[0];
+
+    time_usec_t s = time_get_usec();
+    while(sp && nwords < max_words) {
+        hdr_t *b = stack[--sp];
+        void **w = ck_data_start(b), **e = ck_data_end(b);
+        for(; w < e; w++, nwords++) {
+            hdr_t *h = lookup(*w);
+            if(h && !h->mark) {
+                h->mark = 1;
+                nmarked++;
+                stack[sp++] = h;
+            }
+        }
+    }
+    time_usec_t t = time_get_usec() - s;
+    if(!t)
+        t = 1;
+    *nwords_out = nwords;
+    *nmarked_out = nmarked;
+    return nwords * 1e6 / t;
+}
+
+static unsigned min_u(unsigned a, unsigned b) { return a < b ? a : b; }
+
+int main(void) {
+    unsigned sizes[] = { 1000, 10000, 100000, 1000000 };
+    const char *shape_name[] = { "list", "tree" };
+
+    output("mark throughput: million words/sec (higher is better)\n");
+    output("%6s %8s %10s %10s %10s\n", "shape", "nblocks", "list", "index", "pagemap");
+
+    for(shape_t shape = LIST; shape <= TREE; shape++) {
+        for(unsigned i = 0; i < sizeof sizes / sizeof sizes[0]; i++) {
+            unsigned n = sizes[i];
+            heap_mk(n, shape);
+
+            // bound the linear walk to ~5e7 block visits.
+            unsigned nsample = min_u(~0U, 50000000U / n);
+            unsigned w_list, m_list, w_idx, m_idx, w_pm, m_pm;
+            double r_list = mark(list_lookup, n, nsample, &w_list, &m_list);
+            double r_idx = mark(ck_index_lookup, n, ~0U, &w_idx, &m_idx);
+            double r_pm = mark(ck_pagemap_lookup, n, ~0U, &w_pm, &m_pm);
+
+            // everything is reachable from node 0.
+            if(m_idx != n || m_pm != n)
+                panic("marked %u (index), %u (pagemap) of %u blocks\n", m_idx, m_pm, n);
+            if(w_idx != w_pm)
+                panic("scanned %u (index) vs %u (pagemap) words\n", w_idx, w_pm);
+
+            output("%6s %8u %10.3f %10.2f %10.2f\n", shape_name[shape], n,
+                r_list / 1e6, r_idx / 1e6, r_pm / 1e6);
+            heap_free();
+        }
+    }
+    return 0;
+}
@@ -19,6 +19,7 @@
 #include "rpi-constants.h"
 #include "ckalloc.h"
 #include "kr-malloc.h"
+#include "ck-pagemap.h"
 #include "libc/helper-macros.h"
 #include "memmap.h"
 #include <stdint.h>  // For uint32_t
@@ -30,7 +31,7 @@
 static void mark(const char *where, uint32_t *p, uint32_t *e);
 static void mark_all(uint32_t *sp);
 static unsigned sweep_leak(int warn_no_start_ref_p);
-static unsigned sweep_free(void);
+static unsigned sweep_free(int young_only, int verbose_p);
 
 // this routine is in <gc-asm.S>
 //
@@ -60,6 +61,12 @@ void *sbrk(long increment) {
         heap_end = (char*)heap_start + onemb;
         kmalloc_init_set_start((void*)onemb, onemb);
         init_p = 1;
+
+        // now that we know the heap bounds: O(1) pointer lookup.
+        // the map comes out of the heap itself, but it's not a 
+        // ckalloc block so the gc never scans it.
+        unsigned n = ck_pagemap_nbytes(heap_start, heap_end);
+        ck_pagemap_init(heap_start, heap_end, kmalloc(n));
     }
     return kmalloc(increment);
 }
@@ -129,6 +136,139 @@ unsigned check_should_leak(void) {
     return nleaks;
 }
 
+/***********************************************************************
+ * gc state shared by the full, incremental and generational collectors.
+ */
+
+// mark stack: gray blocks (marked but not yet scanned), linked through 
+// <gray_next>.  it's intrusive so it can't overflow, and mark() pushes
+// rather than recursing so a long linked list can't blow the stack.
+static hdr_t *gray;
+
+// remembered set: old blocks written (<ck_gc_write_barrier>) since the
+// last collection, linked through <rs_next>.  a minor gc treats them 
+// as roots since they are the only old blocks that can point to young 
+// ones.
+static hdr_t *remembered;
+
+// minor gc: don't mark or trace old blocks.
+static int young_only_p;
+
+// incremental cycle in progress (between the first and last 
+// <ck_gc_step> of a collection).
+static int marking_p;
+
+static ck_gc_stats_t stats;
+static unsigned nwords_scanned, nblocks_freed;
+// longest call in the current collection.
+static unsigned cycle_pause;
+static uint32_t call_start;
+
+static void gray_push(hdr_t *h) {
+    assert(!(h->gc_flags & CK_GC_GRAY));
+    h->gc_flags |= CK_GC_GRAY;
+    h->gray_next = gray;
+    gray = h;
+}
+
+static hdr_t *gray_pop(void) {
+    hdr_t *h = gray;
+    if(h) {
+        gray = h->gray_next;
+        h->gc_flags &= ~CK_GC_GRAY;
+    }
+    return h;
+}
+
+static void rs_clear(void) {
+    for(hdr_t *h = remembered; h; h = h->rs_next)
+        h->gc_flags &= ~CK_GC_REMEMBERED;
+    remembered = 0;
+}
+
+// drop any incremental cycle in progress.
+static void gc_abort(void) {
+    while(gray_pop())
+        ;
+    marking_p = 0;
+}
+
+static void gc_call_begin(void) {
+    call_start = timer_get_usec();
+}
+
+// end of a gc call: if <done_p> it finished a collection that freed
+// <nbytes>.
+static void gc_call_end(int done_p, unsigned nbytes) {
+    unsigned t = timer_get_usec() - call_start;
+    if(t > cycle_pause)
+        cycle_pause = t;
+    if(t > stats.max_pause_usec)
+        stats.max_pause_usec = t;
+    if(!done_p)
+        return;
+
+    stats.ncollections++;
+    stats.pause_usec = cycle_pause;
+    stats.nwords_scanned = nwords_scanned;
+    stats.nblocks_freed = nblocks_freed;
+    stats.nbytes_freed = nbytes;
+    stats.total_nbytes_freed += nbytes;
+    cycle_pause = 0;
+}
+
+ck_gc_stats_t ck_gc_stats(void) {
+    return stats;
+}
+
+void ck_gc_stats_print(void) {
+    output("GC: %d collections: last: pause=%dusec, scanned %d words, freed %d blocks [%d bytes]\n",
+        stats.ncollections, stats.pause_usec, stats.nwords_scanned,
+        stats.nblocks_freed, stats.nbytes_freed);
+    output("GC: max pause=%dusec, total freed=%d bytes\n",
+        stats.max_pause_usec, stats.total_nbytes_freed);
+}
+
+// blocks allocated during an incremental cycle are live (black).
+void ck_gc_on_alloc(hdr_t *h) {
+    if(marking_p)
+        h->mark = 1;
+}
+
+// block is being freed: take it off the mark stack / remembered set.
+// rare, so just walk the lists.
+void ck_gc_on_free(hdr_t *h) {
+    if(h->gc_flags & CK_GC_GRAY) {
+        hdr_t **pp = &gray;
+        while(*pp != h)
+            pp = &(*pp)->gray_next;
+        *pp = h->gray_next;
+    }
+    if(h->gc_flags & CK_GC_REMEMBERED) {
+        hdr_t **pp = &remembered;
+        while(*pp != h)
+            pp = &(*pp)->rs_next;
+        *pp = h->rs_next;
+    }
+    h->gc_flags = 0;
+}
+
+void ck_gc_write_barrier(void *p) {
+    hdr_t *h = is_ptr((uint32_t)p);
+    if(!h)
+        return;
+
+    if((h->gc_flags & CK_GC_OLD) && !(h->gc_flags & CK_GC_REMEMBERED)) {
+        h->gc_flags |= CK_GC_REMEMBERED;
+        h->rs_next = remembered;
+        remembered = h;
+    }
+    // already scanned this cycle: it may now point to an unmarked
+    // block, so scan it again.
+    if(marking_p && h->mark && !(h->gc_flags & CK_GC_GRAY))
+        gray_push(h);
+}
+
 /***********************************************************************
  * implement the routines below.
  */
@@ -137,44 +277,95 @@ unsigned check_should_leak(void) {
 // mark phase:
 //  - iterate over the words in the range [p,e], marking any block 
 //    potentially referenced.
-//  - if we mark a block for the first time, recurse over its memory
-//    as well.
-//
-// EXTENSION: if we have lots of words, could be faster with shadow memory 
-// or a lookup table.  however, given our small sizes, this stupid 
-// search may well be faster :)
+//  - if we mark a block for the first time, push it on the mark 
+//    stack: <mark_drain> scans it later.
 //
-// If you switch: measure speedup!
+// is_ptr() goes through ck_ptr_is_alloced(), which uses the granule
+// map in ck-pagemap.c, so each word (start or interior pointer) 
+// costs O(1) rather than a walk of every allocated block.  
+// bench/gc-mark-bench.c measures the difference.
 //
 static void mark(const char *where, uint32_t *p, uint32_t *e) {
-    assert(p<e);
+    assert(p<=e);
     assert(aligned(p,4));
     assert(aligned(e,4));
 
+    nwords_scanned += e - p;
+
     // sweep through each integer in [p,e] and mark all allocated
     // blocks the integer could point to (start, or internal)
     for(; p < e; p++) {
         hdr_t *h = is_ptr(*p);
         if(!h)
             continue;
+        // minor gc: old blocks are assumed live and not traced.
+        if(young_only_p && (h->gc_flags & CK_GC_OLD))
+            continue;
 
         // Check if pointer points to start of block
-        void *data_start = ck_data_start(h);
-        if((void*)*p == data_start) {
+        if((void*)*p == ck_data_start(h)) {
             h->refs_start++;
         } else {
             h->refs_middle++;
         }
 
-        // If block wasn't marked before, mark it and scan its contents
+        // If block wasn't marked before, mark it and queue it to 
+        // be scanned.
         if(!h->mark) {
             h->mark = 1;
-            // Recursively scan the block's data region
-            mark(where, (uint32_t*)data_start, (uint32_t*)ck_data_end(h));
+            gray_push(h);
         }
     }
 }
 
+// scan the words of block <h>'s data.
+static void mark_block(hdr_t *h) {
+    uint32_t *p = ck_data_start(h);
+    mark("heap", p, p + ck_nbytes(h) / 4);
+}
+
+// scan blocks off the mark stack until it's empty or we've done
+// at least <budget> words.  returns 1 if the stack is empty.
+static int mark_drain(unsigned budget) {
+    unsigned start = nwords_scanned;
+    hdr_t *h;
+    while((h = gray_pop())) {
+        mark_block(h);
+        if(nwords_scanned - start >= budget)
+            return gray == 0;
+    }
+    return 1;
+}
+
+static void mark_roots(uint32_t *sp) {
+    // the start of the stack (see libpi/staff-start.S)
+    uint32_t *stack_top = (void*)STACK_ADDR;
+    if(ck_verbose_p)
+        debug("stack has %d words\n", stack_top - sp);
+
+    // Scan stack
+    mark("stack", sp, stack_top);
+
+    // Scan bss segment
+    mark("bss", (uint32_t*)__bss_start__, (uint32_t*)__bss_end__);
+
+    // Scan data segment
+    mark("data", (uint32_t*)__data_start__, (uint32_t*)__data_end__);
+}
+
+// reset mark and ref counts.  young blocks are always a prefix of the
+// allocated list (ckalloc pushes on the front and every collection 
+// promotes all survivors) so <young_only> can stop at the first old 
+// one.
+static void clear_marks(int young_only) {
+    nwords_scanned = 0;
+    for(hdr_t *h = ck_first_alloc(); h; h = ck_next_hdr(h)) {
+        if(young_only && (h->gc_flags & CK_GC_OLD))
+            break;
+        h->mark = h->refs_start = h->refs_middle = 0;
+    }
+}
+
 // do a sweep, warning about any leaks.
 static unsigned sweep_leak(int warn_no_start_ref_p) {
     unsigned nblocks = 0, errors = 0, maybe_errors = 0;
@@ -215,62 +406,113 @@ static unsigned sweep_leak(int warn_no_start_ref_p) {
 
 // a very slow leak checker.
 static void mark_all(uint32_t *sp) {
-    // Initialize mark and ref counts for all blocks
-    for(hdr_t *h = ck_first_alloc(); h; h = ck_next_hdr(h)) {
-        h->mark = h->refs_start = h->refs_middle = 0;
-    }
-
-    // the start of the stack (see libpi/staff-start.S)
-    uint32_t *stack_top = (void*)STACK_ADDR;
-    if(ck_verbose_p)
-        debug("stack has %d words\n", stack_top - sp);
+    // a full mark clobbers the mark bits of any incremental cycle.
+    gc_abort();
+    young_only_p = 0;
 
-    // Scan stack
-    mark("stack", sp, stack_top);
-
-    // Scan bss segment
-    mark("bss", (uint32_t*)__bss_start__, (uint32_t*)__bss_end__);
-
-    // Scan data segment
-    mark("data", (uint32_t*)__data_start__, (uint32_t*)__data_end__);
+    // Initialize mark and ref counts for all blocks
+    clear_marks(0);
+    mark_roots(sp);
+    mark_drain(~0);
 }
 
 
 // similar to sweep_leak: go through and <ckfree> any ALLOCED
 // block that has no references all all (nothing to start, 
-// nothing to middle).
-static unsigned sweep_free(void) {
+// nothing to middle).  survivors are promoted to old.
+//
+// <young_only>: stop at the first old block (see <clear_marks>).
+static unsigned sweep_free(int young_only, int verbose_p) {
     unsigned nblocks = 0, nfreed = 0, nbytes_freed = 0;
-    output("---------------------------------------------------------\n");
-    output("compacting:\n");
+    if(verbose_p) {
+        output("---------------------------------------------------------\n");
+        output("compacting:\n");
+    }
 
     // sweep through allocated list: free any block that has no pointers
     hdr_t *h = ck_first_alloc();
     while(h) {
+        if(young_only && (h->gc_flags & CK_GC_OLD))
+            break;
         nblocks++;
         hdr_t *next = ck_next_hdr(h);  // Get next before potentially freeing h
         
         if(h->state == ALLOCED && !h->mark) {
             void *ptr = ck_data_start(h);
-            trace("GC:FREEing block id=%u [addr=%p]\n", h->block_id, ptr);
+            if(verbose_p)
+                trace("GC:FREEing block id=%u [addr=%p]\n", h->block_id, ptr);
             nfreed++;
             nbytes_freed += h->nbytes_alloc;
             ckfree(ptr);
-        }
+        } else
+            h->gc_flags |= CK_GC_OLD;
         
         h = next;
     }
 
-    trace("\tGC:Checked %d blocks, freed %d, %d bytes\n", nblocks, nfreed, nbytes_freed);
+    if(verbose_p)
+        trace("\tGC:Checked %d blocks, freed %d, %d bytes\n", nblocks, nfreed, nbytes_freed);
+    nblocks_freed = nfreed;
     return nbytes_freed;
 }
 
 unsigned ck_gc_fn(uint32_t *sp) {
+    gc_call_begin();
     mark_all(sp);
-    unsigned nbytes = sweep_free();
+    // everything that survives is old: nothing left to remember.
+    rs_clear();
+    unsigned nbytes = sweep_free(0, 1);
+    gc_call_end(1, nbytes);
 
     // perhaps coalesce these and give back to heap.  will have to modify last.
 
     return nbytes;
 }
 
+// called by <ck_gc_step> in gc-asm.S
+int ck_gc_step_fn(unsigned budget, uint32_t *sp) {
+    gc_call_begin();
+    if(!marking_p) {
+        young_only_p = 0;
+        clear_marks(0);
+        mark_roots(sp);
+        marking_p = 1;
+    }
+    if(!mark_drain(budget)) {
+        gc_call_end(0, 0);
+        return 0;
+    }
+
+    // the stack, registers and globals are not behind the write
+    // barrier so rescan them and finish whatever they reach.
+    mark_roots(sp);
+    mark_drain(~0);
+    marking_p = 0;
+
+    rs_clear();
+    unsigned nbytes = sweep_free(0, ck_verbose_p);
+    gc_call_end(1, nbytes);
+    return 1;
+}
+
+// called by <ck_gc_young> in gc-asm.S
+unsigned ck_gc_young_fn(uint32_t *sp) {
+    if(marking_p)
+        panic("can't do a minor gc during an incremental cycle\n");
+
+    gc_call_begin();
+    young_only_p = 1;
+    clear_marks(1);
+    mark_roots(sp);
+    // old blocks written since the last gc are the only old blocks
+    // that can point to young ones.
+    for(hdr_t *h = remembered; h; h = h->rs_next)
+        mark_block(h);
+    mark_drain(~0);
+    young_only_p = 0;
+
+    rs_clear();
+    unsigned nbytes = sweep_free(1, ck_verbose_p);
+    gc_call_end(1, nbytes);
+    return nbytes;
+}
@@ -0,0 +1,183 @@
+// AVL tree index over ckalloc blocks: see ck-index.h.
+//
+// keyed on header address.  recursion depth is bounded by the tree
+// height (~1.44 log2 n) so is fine even for large heaps.
+#ifdef RPI_UNIX
+#   include "libunix.h"
+#else
+#   include "rpi.h"
+#endif
+#include "ck-index.h"
+
+static hdr_t *root;
+static unsigned nblocks;
+
+static inline unsigned height(hdr_t *h) {
+    return h ? h->idx_height : 0;
+}
+static inline unsigned max_u(unsigned a, unsigned b) {
+    return a > b ? a : b;
+}
+static inline void fix_height(hdr_t *h) {
+    h->idx_height = 1 + max_u(height(h->idx_left), height(h->idx_right));
+}
+static inline int balance(hdr_t *h) {
+    return (int)height(h->idx_left) - (int)height(h->idx_right);
+}
+
+static hdr_t *rotate_right(hdr_t *h) {
+    hdr_t *l = h->idx_left;
+    h->idx_left = l->idx_right;
+    l->idx_right = h;
+    fix_height(h);
+    fix_height(l);
+    return l;
+}
+static hdr_t *rotate_left(hdr_t *h) {
+    hdr_t *r = h->idx_right;
+    h->idx_right = r->idx_left;
+    r->idx_left = h;
+    fix_height(h);
+    fix_height(r);
+    return r;
+}
+
+// restore the AVL invariant at <h>: children are already balanced.
+static hdr_t *rebalance(hdr_t *h) {
+    fix_height(h);
+    int b = balance(h);
+    if(b > 1) {
+        if(balance(h->idx_left) < 0)
+            h->idx_left = rotate_left(h->idx_left);
+        return rotate_right(h);
+    }
+    if(b < -1) {
+        if(balance(h->idx_right) > 0)
+            h->idx_right = rotate_right(h->idx_right);
+        return rotate_left(h);
+    }
+    return h;
+}
+
+static hdr_t *idx_insert(hdr_t *t, hdr_t *h) {
+    if(!t)
+        return h;
+    if(h < t)
+        t->idx_left = idx_insert(t->idx_left, h);
+    else if(h > t)
+        t->idx_right = idx_insert(t->idx_right, h);
+    else
+        panic("block %p already in index\n", ck_data_start(h));
+    return rebalance(t);
+}
+
+// unlink the minimum node of <t>, returning the new subtree.
+// the removed node is stored in <*min>.
+static hdr_t *idx_remove_min(hdr_t *t, hdr_t **min) {
+    if(!t->idx_left) {
+        *min = t;
+        return t->idx_right;
+    }
+    t->idx_left = idx_remove_min(t->idx_left, min);
+    return rebalance(t);
+}
+
+static hdr_t *idx_remove(hdr_t *t, hdr_t *h) {
+    if(!t)
+        panic("block %p not in index\n", ck_data_start(h));
+
+    if(h < t)
+        t->idx_left = idx_remove(t->idx_left, h);
+    else if(h > t)
+        t->idx_right = idx_remove(t->idx_right, h);
+    else {
+        hdr_t *l = t->idx_left, *r = t->idx_right;
+        t->idx_left = t->idx_right = 0;
+        t->idx_height = 0;
+
+        if(!l)
+            return r;
+        if(!r)
+            return l;
+
+        // replace <t> with its successor.
+        hdr_t *succ;
+        r = idx_remove_min(r, &succ);
+        succ->idx_left = l;
+        succ->idx_right = r;
+        return rebalance(succ);
+    }
+    return rebalance(t);
+}
+
+void ck_index_insert(hdr_t *h) {
+    h->idx_left = h->idx_right = 0;
+    h->idx_height = 1;
+    root = idx_insert(root, h);
+    nblocks++;
+}
+
+void ck_index_remove(hdr_t *h) {
+    root = idx_remove(root, h);
+    assert(nblocks);
+    nblocks--;
+}
+
+hdr_t *ck_index_lookup(const void *ptr) {
+    // find the block with the largest header address <= ptr.
+    hdr_t *best = 0;
+    for(hdr_t *t = root; t; ) {
+        if((const void *)t <= ptr) {
+            best = t;
+            t = t->idx_right;
+        } else
+            t = t->idx_left;
+    }
+    if(!best)
+        return 0;
+
+    // <ptr> may be in the header or past the end.
+    const char *p = ptr;
+    if(p < (char *)ck_data_start(best) || p >= (char *)ck_data_end(best))
+        return 0;
+    return best;
+}
+
+unsigned ck_index_nblocks(void) {
+    return nblocks;
+}
+
+void ck_index_reset(void) {
+    root = 0;
+    nblocks = 0;
+}
+
+// returns height of <t>; checks order within (lo,hi).
+static unsigned check(hdr_t *t, hdr_t *lo, hdr_t *hi, unsigned *n) {
+    if(!t)
+        return 0;
+    if(lo && t <= lo)
+        panic("index out of order: %p <= %p\n", t, lo);
+    if(hi && t >= hi)
+        panic("index out of order: %p >= %p\n", t, hi);
+    if(t->state != ALLOCED)
+        panic("freed block %u in index\n", t->block_id);
+
+    unsigned lh = check(t->idx_left, lo, t, n);
+    unsigned rh = check(t->idx_right, t, hi, n);
+    unsigned h = 1 + max_u(lh, rh);
+    if(h != t->idx_height)
+        panic("bad height: have %u, expected %u\n", t->idx_height, h);
+    if(lh > rh + 1 || rh > lh + 1)
+        panic("unbalanced: left=%u, right=%u\n", lh, rh);
+    (*n)++;
+    return h;
+}
+
+unsigned ck_index_check(void) {
+    unsigned n = 0;
+    check(root, 0, 0, &n);
+    if(n != nblocks)
+        panic("index has %u blocks, expected %u\n", n, nblocks);
+    return n;
+}
@@ -0,0 +1,35 @@
+#ifndef __CK_INDEX_H__
+#define __CK_INDEX_H__
+// address -> block index for ckalloc.
+//
+// every allocated block is kept in an AVL tree ordered by header
+// address.  blocks never overlap, so header order is also data
+// order, and "which block contains <ptr>" is just "the block with
+// the largest header address <= ptr" followed by a range check.
+//
+// the tree is intrusive (the links live in hdr_t) so the index
+// never allocates: no recursion into the allocator, no extra heap
+// blocks for the gc to scan.
+#include "ckalloc.h"
+
+// add allocated block <h>.  <h> must not already be in the index.
+void ck_index_insert(hdr_t *h);
+
+// remove block <h>.  <h> must be in the index.
+void ck_index_remove(hdr_t *h);
+
+// return the block whose data region [start,end) contains <ptr>
+// or 0 if none.
+hdr_t *ck_index_lookup(const void *ptr);
+
+// number of blocks currently indexed.
+unsigned ck_index_nblocks(void);
+
+// drop everything (only used by tests/benchmarks).
+void ck_index_reset(void);
+
+// check the AVL + ordering invariants: returns number of blocks.
+// panics on error.  O(n): only call from tests.
+unsigned ck_index_check(void);
+
+#endif
@@ -0,0 +1,90 @@
+// granule map over ckalloc blocks: see ck-pagemap.h.
+#ifdef RPI_UNIX
+#   include "libunix.h"
+#else
+#   include "rpi.h"
+#endif
+#include "ck-pagemap.h"
+
+typedef struct {
+    hdr_t *cover;   // block containing the granule's first byte.
+    hdr_t *start;   // block starting after the granule's first byte.
+} granule_t;
+
+static const char *heap_lo, *heap_hi;
+static granule_t *map;
+
+static inline unsigned granule(const void *p) {
+    return ((const char *)p - heap_lo) >> CK_GRANULE_SHIFT;
+}
+static inline const char *granule_addr(unsigned g) {
+    return heap_lo + (g << CK_GRANULE_SHIFT);
+}
+
+unsigned ck_pagemap_nbytes(const void *start, const void *end) {
+    unsigned n = (const char *)end - (const char *)start;
+    return (n + CK_GRANULE_NBYTES - 1) / CK_GRANULE_NBYTES * sizeof *map;
+}
+
+void ck_pagemap_init(const void *start, const void *end, void *m) {
+    // the "at most two blocks per granule" argument needs every
+    // block to be at least a granule long.
+    assert(sizeof(hdr_t) >= CK_GRANULE_NBYTES);
+    assert(start < end);
+    assert(m);
+
+    heap_lo = start;
+    heap_hi = end;
+    map = m;
+}
+
+int ck_pagemap_on(void) {
+    return map != 0;
+}
+
+// set the entries for block <h> to <v> (<h> or 0).
+static void pagemap_set(hdr_t *h, hdr_t *v) {
+    const char *b = (const char *)h;
+    const char *e = ck_data_end(h);
+    if(b < heap_lo || e > heap_hi)
+        panic("block [%p,%p) is outside the page map [%p,%p)\n",
+            b, e, heap_lo, heap_hi);
+
+    unsigned g = granule(b), last = granule(e - 1);
+    if(b == granule_addr(g)) {
+        assert(map[g].cover == (v ? 0 : h));
+        map[g].cover = v;
+    } else {
+        assert(map[g].start == (v ? 0 : h));
+        map[g].start = v;
+    }
+    for(g++; g <= last; g++) {
+        assert(map[g].cover == (v ? 0 : h));
+        map[g].cover = v;
+    }
+}
+
+void ck_pagemap_insert(hdr_t *h) {
+    pagemap_set(h, h);
+}
+
+void ck_pagemap_remove(hdr_t *h) {
+    pagemap_set(h, 0);
+}
+
+static inline int in_data(hdr_t *h, const char *p) {
+    return h && p >= (char *)ck_data_start(h) && p < (char *)ck_data_end(h);
+}
+
+hdr_t *ck_pagemap_lookup(const void *ptr) {
+    const char *p = ptr;
+    if(p < heap_lo || p >= heap_hi)
+        return 0;
+
+    granule_t *g = &map[granule(p)];
+    if(in_data(g->start, p))
+        return g->start;
+    if(in_data(g->cover, p))
+        return g->cover;
+    return 0;
+}
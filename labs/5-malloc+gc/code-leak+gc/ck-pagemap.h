@@ -0,0 +1,46 @@
+#ifndef __CK_PAGEMAP_H__
+#define __CK_PAGEMAP_H__
+// constant-time address -> block map for ckalloc (boehm-style).
+//
+// the heap [start,end) is cut into fixed-size granules and each
+// granule has an entry naming the blocks that overlap it.  since
+// every block (header + data) is at least one granule long, at most
+// two blocks can overlap a granule:
+//   - <cover>: the block containing the granule's first byte.
+//   - <start>: a block that starts after the granule's first byte.
+// so a lookup is a shift, one load and two range checks no matter
+// how many blocks there are or where inside a block the pointer
+// lands (interior pointers included).
+//
+// unlike boehm's page map we have no size classes (ckalloc blocks
+// are variable-sized on top of kr_malloc), so the entry holds the
+// block header itself and its size comes from the header.
+//
+// cost: 2 pointers per granule: 64k of map per mb of heap.
+#include "ckalloc.h"
+
+enum {
+    CK_GRANULE_SHIFT = 7,
+    CK_GRANULE_NBYTES = 1 << CK_GRANULE_SHIFT,
+};
+
+// bytes of map needed to cover [start,end).
+unsigned ck_pagemap_nbytes(const void *start, const void *end);
+
+// cover [start,end) using <map> (zeroed, <ck_pagemap_nbytes> big).
+// must be called before any blocks are inserted.
+void ck_pagemap_init(const void *start, const void *end, void *map);
+
+// is the map initialized?
+int ck_pagemap_on(void);
+
+// add / remove allocated block <h>.  <h> must be inside the
+// covered range.
+void ck_pagemap_insert(hdr_t *h);
+void ck_pagemap_remove(hdr_t *h);
+
+// return the block whose data region [start,end) contains <ptr>
+// or 0 if none.  same contract as <ck_index_lookup>.
+hdr_t *ck_pagemap_lookup(const void *ptr);
+
+#endif
@@ -3,23 +3,54 @@
 #include "rpi.h"
 #include "ckalloc.h"
 #include "kr-malloc.h"
+#include "ck-index.h"
+#include "ck-pagemap.h"
 
 unsigned ck_verbose_p = 0;
 
 // should hold all allocated blocks
 static hdr_t *alloc_list; 
 
+// backend allocator.
+static alloc_t alloc_fn = kr_malloc;
+static free_t free_fn = kr_free;
+
+void ck_init(alloc_t a, free_t f) {
+    assert(a && f);
+    if(alloc_list)
+        panic("can't switch allocators with live blocks\n");
+    alloc_fn = a;
+    free_fn = f;
+}
+
 // returns pointer to the first allocated header block.
 hdr_t *ck_first_alloc(void) {
     return alloc_list;
 }
 
 // return header associated with <ptr> if one exists.
+//
+// this is on the hot path for both the gc (every scanned word) and
+// purify (every trap), so never walk <alloc_list>.  if the heap
+// bounds are known (see sbrk in ck-gc.c) use the granule map: O(1);
+// otherwise the address index: O(log n).
 hdr_t *ck_ptr_is_alloced(void *ptr) {
-    for(hdr_t *h = ck_first_alloc(); h; h = ck_next_hdr(h))
-        if(ck_ptr_in_block(h,ptr)) 
-            return h;
-    return 0;
+    if(ck_pagemap_on())
+        return ck_pagemap_lookup(ptr);
+    return ck_index_lookup(ptr);
+}
+
+static void index_insert(hdr_t *h) {
+    if(ck_pagemap_on())
+        ck_pagemap_insert(h);
+    else
+        ck_index_insert(h);
+}
+static void index_remove(hdr_t *h) {
+    if(ck_pagemap_on())
+        ck_pagemap_remove(h);
+    else
+        ck_index_remove(h);
 }
 
 
@@ -59,6 +90,8 @@ void (ckfree)(void *addr, src_loc_t l) {
         loc_debug(l, "freeing %p\n", addr);
 
     assert(ck_ptr_is_alloced(addr));
+    index_remove(h);
+    ck_gc_on_free(h);
     h->state = FREED;
 
     // remove from the allocated list
@@ -75,7 +108,7 @@ void (ckfree)(void *addr, src_loc_t l) {
         prev->next = h->next;
     }
 
-    kr_free(h);
+    free_fn(h);
 }
 
 
@@ -85,7 +118,9 @@ void (ckfree)(void *addr, src_loc_t l) {
 void *(ckalloc)(uint32_t nbytes, src_loc_t l) {
     static unsigned block_id=1;
 
-    hdr_t *h = kr_malloc(nbytes + sizeof *h);
+    hdr_t *h = alloc_fn(nbytes + sizeof *h);
+    if(!h)
+        loc_panic(l, "out of memory: can't allocate %d bytes\n", nbytes);
 
     memset(h, 0, sizeof *h);
     h->nbytes_alloc = nbytes;
@@ -99,6 +134,8 @@ void *(ckalloc)(uint32_t nbytes, src_loc_t l) {
     // add to allocated list
     h->next = alloc_list;
     alloc_list = h;
+    index_insert(h);
+    ck_gc_on_alloc(h);
 
     assert(ck_ptr_is_alloced(addr));
     if(ck_verbose_p)
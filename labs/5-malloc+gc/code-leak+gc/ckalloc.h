@@ -39,6 +39,17 @@ typedef struct ck_hdr {
     uint32_t refs_middle;   // number of pointers to the middle of the block.
 
     uint16_t mark;          // 0 initialize.
+    uint16_t gc_flags;      // CK_GC_GRAY|CK_GC_OLD|CK_GC_REMEMBERED
+
+    // explicit mark stack (CK_GC_GRAY blocks) and remembered set
+    // (CK_GC_REMEMBERED): see ck-gc.c
+    struct ck_hdr *gray_next, *rs_next;
+
+    // address index (see ck-index.c): intrusive balanced tree over
+    // all allocated blocks, so address lookup is O(log n) rather
+    // than a walk of the allocated list.
+    struct ck_hdr *idx_left, *idx_right;
+    uint32_t idx_height;
     
     // used in the error checking lab.
     uint8_t rz1[REDZONE_NBYTES];
@@ -96,6 +107,18 @@ unsigned ck_ptr_in_block(hdr_t *h, void *ptr);
 // returns header if pointer <p> on the allocated list?
 hdr_t *ck_ptr_is_alloced(void *ptr);
 
+// allocator fn type
+typedef void *(*alloc_t)(unsigned);
+// free fn type
+typedef void (*free_t)(void *);
+
+// call to set the backend <alloc> and <free> ckalloc uses.
+// default is <kr_malloc> and <kr_free>.  e.g., to use the
+// segregated-fit allocator:
+//      ck_init(seg_malloc, seg_free);
+// must be called before the first <ckalloc>.
+void ck_init(alloc_t alloc_fn, free_t free_fn);
+
 // we do things this way so we can automatically pass in
 // the location the routine was called at (using <SRC_LOC_MK()>)
 // --- makes error reporting better.
@@ -132,6 +155,59 @@ unsigned ck_find_leaks(int warn_no_start_ref_p);
 //    found.
 unsigned ck_gc(void);
 
+// gc flags in <hdr_t.gc_flags>
+enum {
+    CK_GC_GRAY          = 1<<0, // marked, contents not yet scanned.
+    CK_GC_OLD           = 1<<1, // survived a collection.
+    CK_GC_REMEMBERED    = 1<<2, // old block in the remembered set.
+};
+
+// incremental mark-sweep: do roughly <budget> words of marking
+// per call (the current block is always finished).  returns 1 if
+// this call finished a collection (and swept), 0 otherwise.
+//
+// the first call of a cycle scans the roots; the last rescans them,
+// drains the mark stack and sweeps.  blocks allocated during a cycle
+// are treated as live.  between calls the program must call
+// <ck_gc_write_barrier> after storing a pointer into a ckalloc'd
+// block or the gc can free a live block.
+int ck_gc_step(unsigned budget);
+
+// generational (minor) collection: only scans the roots, the blocks
+// allocated since the last collection and the remembered set; only
+// frees young blocks.  survivors become old.  as with <ck_gc_step>
+// pointer stores into old blocks must go through
+// <ck_gc_write_barrier>.  returns bytes freed.
+unsigned ck_gc_young(void);
+
+// call after storing a pointer into the block containing <p>.
+//  - old block: put it in the remembered set.
+//  - during an incremental cycle: rescan it if already scanned.
+void ck_gc_write_barrier(void *p);
+
+// per-collection cost so gc can be budgeted: a "collection" is
+// one ck_gc(), one ck_gc_young() or a full ck_gc_step() cycle.
+typedef struct {
+    unsigned ncollections;
+
+    // last collection.
+    unsigned pause_usec;        // longest single call.
+    unsigned nwords_scanned;
+    unsigned nblocks_freed;
+    unsigned nbytes_freed;
+
+    // over all collections.
+    unsigned max_pause_usec;
+    unsigned total_nbytes_freed;
+} ck_gc_stats_t;
+
+ck_gc_stats_t ck_gc_stats(void);
+void ck_gc_stats_print(void);
+
+// ckalloc/ckfree tell the gc about block births and deaths.
+void ck_gc_on_alloc(hdr_t *h);
+void ck_gc_on_free(hdr_t *h);
+
 // These two routines are just used for test cases.
 
 // Expects no leaks.
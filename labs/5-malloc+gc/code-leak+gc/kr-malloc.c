@@ -21,6 +21,8 @@ static Header *freep = NULL;
 
 #define NALLOC 1024
 
+// on unix the caller supplies <sbrk> (e.g., bench/alloc-replay.c)
+#ifndef COMPILE_FOR_UNIX
 void *sbrk(long increment) {
     static int init_p;
 
@@ -31,6 +33,7 @@ void *sbrk(long increment) {
     }
     return kmalloc(increment);
 }
+#endif
 
 static Header *morecore(unsigned nu)
    {
@@ -0,0 +1,236 @@
+// segregated-fit / slab allocator: see seg-malloc.h
+//
+// layout: memory is handed out in 4k pages, each page starting
+// with a <page_t> header.  given any pointer we get its header by
+// rounding down to the page, so free never has to search.
+//   - small (<= SEG_MAX_SMALL): the page is a slab of equal-sized
+//     objects for one size class.  free objects are on a singly
+//     linked per-class list threaded through the objects themselves.
+//   - large: a run of <npages> contiguous pages holding one block.
+//     freed runs go on an address-ordered first-fit list, are
+//     coalesced with adjacent free runs, and get split on reuse.
+//
+// limits (extensions):
+//   - empty slabs are never given back to the page pool.
+#include "seg-malloc.h"
+
+enum {
+    SEG_PAGE_NBYTES = 4096,
+    // pages we grab from sbrk at a time.
+    SEG_CHUNK_NPAGES = 16,
+    SEG_MAGIC = 0x5e9a110c,
+    SEG_LARGE = 0xffff,
+};
+
+typedef struct page {
+    uint32_t magic;
+    uint16_t class;         // size class index or SEG_LARGE
+    uint16_t unused;
+    uint32_t npages;        // SEG_LARGE: number of pages in the run.
+    struct page *next;      // SEG_LARGE: next free run (by address).
+} page_t;
+
+typedef struct obj {
+    struct obj *next;
+} obj_t;
+
+#define roundup(x,n) (((x)+((n)-1))&(~((n)-1)))
+#define rounddown(x,n) ((x)&(~((n)-1)))
+
+// objects start here: keep them 8-byte aligned.
+#define SEG_HDR_NBYTES roundup(sizeof(page_t), 8)
+
+// size classes: multiples of 8, chosen so each packs a 4k slab
+// with little waste.
+static const unsigned class_nbytes[] = {
+    8, 16, 24, 32, 48, 64, 96, 128, 192, 256, 384, 512,
+    680, 816, 1016, 1360, 2040
+};
+enum {
+    SEG_NCLASS = sizeof class_nbytes / sizeof class_nbytes[0],
+    SEG_MAX_SMALL = 2040,
+};
+
+// map (nbytes+7)/8 -> size class.
+static uint8_t class_of[SEG_MAX_SMALL/8 + 1];
+static obj_t *free_list[SEG_NCLASS];
+static page_t *large_free;
+
+// pages not yet handed out: [pg_next, pg_end).  <brk_end> is the
+// true end of the last sbrk so we can extend the region when sbrk
+// is contiguous (as it is on the pi).
+static char *pg_next, *pg_end, *brk_end;
+
+static void seg_init(void) {
+    unsigned c = 0;
+    for(unsigned i = 0; i <= SEG_MAX_SMALL/8; i++) {
+        while(class_nbytes[c] < i*8)
+            c++;
+        class_of[i] = c;
+    }
+}
+
+// allocate <k> contiguous, page-aligned pages.
+static char *pages_alloc(unsigned k) {
+    unsigned n = k * SEG_PAGE_NBYTES;
+
+    if(!pg_next || pg_end - pg_next < n) {
+        unsigned npages = k > SEG_CHUNK_NPAGES ? k : SEG_CHUNK_NPAGES;
+        // extra page so we can align.
+        unsigned nbytes = (npages + 1) * SEG_PAGE_NBYTES;
+        char *p = sbrk(nbytes);
+        if(!p || p == (char*)-1)
+            return 0;
+
+        // if not contiguous with the last chunk, drop the leftovers.
+        if(p != brk_end)
+            pg_next = (char*)roundup((uintptr_t)p, SEG_PAGE_NBYTES);
+        brk_end = p + nbytes;
+        pg_end = (char*)rounddown((uintptr_t)brk_end, SEG_PAGE_NBYTES);
+        assert(pg_end - pg_next >= n);
+    }
+    char *p = pg_next;
+    pg_next += n;
+    return p;
+}
+
+static page_t *page_mk(char *p, unsigned class, unsigned npages) {
+    page_t *pg = (void*)p;
+    pg->magic = SEG_MAGIC;
+    pg->class = class;
+    pg->npages = npages;
+    pg->next = 0;
+    return pg;
+}
+
+static inline page_t *page_of(void *ptr) {
+    page_t *pg = (void*)rounddown((uintptr_t)ptr, SEG_PAGE_NBYTES);
+    if(pg->magic != SEG_MAGIC)
+        panic("seg_free: bogus pointer %p (bad magic=%x)\n", ptr, pg->magic);
+    return pg;
+}
+
+// carve a fresh slab into objects for <class>.
+static int slab_refill(unsigned class) {
+    char *p = pages_alloc(1);
+    if(!p)
+        return 0;
+    page_mk(p, class, 1);
+
+    unsigned sz = class_nbytes[class];
+    char *o = p + SEG_HDR_NBYTES;
+    char *e = p + SEG_PAGE_NBYTES;
+    // push in reverse so we hand them out in address order.
+    unsigned n = (e - o) / sz;
+    for(int i = n-1; i >= 0; i--) {
+        obj_t *x = (void*)(o + i*sz);
+        x->next = free_list[class];
+        free_list[class] = x;
+    }
+    return 1;
+}
+
+static inline int run_adjacent(page_t *a, page_t *b) {
+    return (char*)a + a->npages * SEG_PAGE_NBYTES == (char*)b;
+}
+
+// put run <pg> back on the free list, merging with its neighbors.
+static void large_free_insert(page_t *pg) {
+    page_t *prev = 0, *next = large_free;
+    for(; next && next < pg; prev = next, next = next->next)
+        ;
+
+    if(next && run_adjacent(pg, next)) {
+        pg->npages += next->npages;
+        next->magic = 0;
+        next = next->next;
+    }
+    pg->next = next;
+
+    if(prev && run_adjacent(prev, pg)) {
+        prev->npages += pg->npages;
+        prev->next = pg->next;
+        pg->magic = 0;
+    } else if(prev)
+        prev->next = pg;
+    else
+        large_free = pg;
+}
+
+static void *large_alloc(unsigned nbytes) {
+    unsigned k = (nbytes + SEG_HDR_NBYTES + SEG_PAGE_NBYTES - 1) / SEG_PAGE_NBYTES;
+
+    // first fit.
+    page_t **pp, *pg;
+    for(pp = &large_free; (pg = *pp); pp = &pg->next) {
+        if(pg->npages < k)
+            continue;
+        if(pg->npages == k)
+            *pp = pg->next;
+        else {
+            // split: tail stays on the free list.
+            page_t *rest = page_mk((char*)pg + k*SEG_PAGE_NBYTES,
+                                    SEG_LARGE, pg->npages - k);
+            rest->next = pg->next;
+            *pp = rest;
+            pg->npages = k;
+        }
+        pg->next = 0;
+        return (char*)pg + SEG_HDR_NBYTES;
+    }
+
+    char *p = pages_alloc(k);
+    if(!p)
+        return 0;
+    page_mk(p, SEG_LARGE, k);
+    return p + SEG_HDR_NBYTES;
+}
+
+void *seg_malloc(unsigned nbytes) {
+    static int init_p;
+    if(!init_p) {
+        seg_init();
+        init_p = 1;
+    }
+
+    if(nbytes > SEG_MAX_SMALL)
+        return large_alloc(nbytes);
+
+    unsigned c = class_of[(nbytes + 7) / 8];
+    if(!free_list[c] && !slab_refill(c))
+        return 0;
+
+    obj_t *o = free_list[c];
+    free_list[c] = o->next;
+    return o;
+}
+
+void seg_free(void *ptr) {
+    if(!ptr)
+        return;
+
+    page_t *pg = page_of(ptr);
+    char *start = (char*)pg + SEG_HDR_NBYTES;
+    if(pg->class == SEG_LARGE) {
+        if((char*)ptr != start)
+            panic("seg_free: %p is not the start of a block\n", ptr);
+        large_free_insert(pg);
+        return;
+    }
+
+    assert(pg->class < SEG_NCLASS);
+    unsigned sz = class_nbytes[pg->class];
+    if((char*)ptr < start || ((char*)ptr - start) % sz != 0)
+        panic("seg_free: %p is not the start of a block\n", ptr);
+
+    obj_t *o = ptr;
+    o->next = free_list[pg->class];
+    free_list[pg->class] = o;
+}
+
+unsigned seg_nbytes(void *ptr) {
+    page_t *pg = page_of(ptr);
+    if(pg->class == SEG_LARGE)
+        return pg->npages * SEG_PAGE_NBYTES - SEG_HDR_NBYTES;
+    return class_nbytes[pg->class];
+}
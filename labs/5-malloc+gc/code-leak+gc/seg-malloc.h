@@ -0,0 +1,22 @@
+#ifndef __SEG_MALLOC_H__
+#define __SEG_MALLOC_H__
+// segregated-fit / slab allocator: same interface as kr_malloc/kr_free
+// so ckalloc can use either:
+//      ck_init(seg_malloc, seg_free);
+//
+// small requests are rounded up to one of a fixed set of size classes.
+// each class has its own free list threaded through 4k slab pages
+// that only hold objects of that class, so malloc and free are O(1):
+// pop/push the class list.  large requests get their own run of
+// pages, recycled on a coalescing first-fit list of free runs.
+//
+// memory comes from the same <sbrk> as kr_malloc.
+#include "kr-malloc.h"
+
+void *seg_malloc(unsigned nbytes);
+void seg_free(void *ptr);
+
+// usable bytes in the block <ptr> (>= the amount requested).
+unsigned seg_nbytes(void *ptr);
+
+#endif
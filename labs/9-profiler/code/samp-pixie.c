@@ -0,0 +1,223 @@
+// timer-interrupt sampling profiler.  see <samp-pixie.h>.
+//
+// each arm timer interrupt goes to <samp_int_vector> (via the
+// trampoline in <samp-pixie-asm.S>) which bumps the counter for
+// the interrupted pc.  we never single step, so the cost is just 
+// the interrupt itself every <period_usec>.
+#include "rpi.h"
+#include "memmap.h"
+#include "cycle-count.h"
+#include "vector-base.h"
+#include "rpi-inline-asm.h"
+#include "timer-interrupt.h"
+#include "samp-pixie.h"
+
+// one counter per instruction in the code segment.
+static volatile unsigned *pc_counts = 0;
+static volatile unsigned *caller_counts = 0;
+static unsigned walk_p;
+
+static volatile samp_stats_t stats;
+static uint32_t start_cyc;
+static void *old_vec;
+
+static inline unsigned code_ninst(void) {
+    return ((uint32_t)__code_end__ - (uint32_t)__code_start__) / 4;
+}
+
+// index of <pc> in the histogram, or -1 if not in the code segment.
+static inline int code_idx(uint32_t pc) {
+    uint32_t off = pc - (uint32_t)__code_start__;
+    if(off >= (uint32_t)__code_end__ - (uint32_t)__code_start__)
+        return -1;
+    return off / 4;
+}
+
+// walk the frame chain of the interrupted code.  with gcc's 
+// arm frame layout (push {fp,lr}; add fp, sp, #4) <fp> points
+// at the saved <lr> and the caller's <fp> is right below it.
+// everything is checked since the interrupted code may not 
+// have a frame at all.
+static void frame_walk(uint32_t fp) {
+    uint32_t lo = (uint32_t)__prog_end__;
+    for(unsigned d = 0; d < SAMP_MAX_DEPTH; d++) {
+        if(fp % 4 || fp <= lo || fp >= STACK_ADDR)
+            return;
+        uint32_t ra = ((uint32_t *)fp)[0];
+        uint32_t next = ((uint32_t *)fp)[-1];
+
+        // credit the call instruction, not the return point.
+        int i = code_idx(ra - 4);
+        if(i < 0)
+            return;
+        caller_counts[i]++;
+        stats.nframes++;
+
+        // frames only go up the stack: stops cycles.
+        if(next <= fp)
+            return;
+        fp = next;
+    }
+}
+
+// called from the interrupt trampoline with the interrupted
+// <pc> and the saved {r0-r12,lr}.  this is the only writer of
+// the histograms.
+void samp_int_vector(uint32_t pc, uint32_t *regs) {
+    uint32_t s = cycle_cnt_read();
+    dev_barrier();
+
+    // only the timer should be enabled.
+    if((GET32(IRQ_basic_pending) & ARM_Timer_IRQ) == 0)
+        panic("unexpected interrupt: pc=%x\n", pc);
+    PUT32(ARM_Timer_IRQ_Clear, 1);
+
+    int i = code_idx(pc);
+    if(i < 0)
+        stats.nmiss++;
+    else {
+        pc_counts[i]++;
+        stats.nsamples++;
+    }
+    if(walk_p)
+        frame_walk(regs[11]);
+
+    dev_barrier();
+    stats.handler_cycles += cycle_cnt_read() - s;
+}
+
+// the arm timer clock is not the cpu clock: measure how many 
+// ticks it counts down in 1ms of the free-running system timer.
+static unsigned timer_calibrate(void) {
+    enum {
+        CTRL_32BIT  = 1 << 1,
+        CTRL_ENABLE = 1 << 7,
+    };
+    dev_barrier();
+    PUT32(ARM_Timer_Load, ~0);
+    PUT32(ARM_Timer_Control, CTRL_32BIT | CTRL_ENABLE);
+    dev_barrier();
+
+    uint32_t v0 = GET32(ARM_Timer_Value);
+    dev_barrier();
+    delay_us(1000);
+    dev_barrier();
+    uint32_t v1 = GET32(ARM_Timer_Value);
+
+    PUT32(ARM_Timer_Control, 0);
+    dev_barrier();
+
+    unsigned ticks = (v0 - v1) / 1000;
+    if(!ticks)
+        panic("arm timer not running?\n");
+    return ticks;
+}
+
+void samp_start(unsigned period_usec, unsigned flags) {
+    if(!period_usec)
+        panic("period must be non-zero\n");
+
+    unsigned n = code_ninst();
+    if(!pc_counts) {
+        pc_counts = kmalloc(n * sizeof pc_counts[0]);
+        caller_counts = kmalloc(n * sizeof caller_counts[0]);
+    }
+    memset((void*)pc_counts, 0, n * sizeof pc_counts[0]);
+    memset((void*)caller_counts, 0, n * sizeof caller_counts[0]);
+    memset((void*)&stats, 0, sizeof stats);
+    walk_p = (flags & SAMP_WALK) != 0;
+
+    uint32_t cpsr = cpsr_int_disable();
+    if((cpsr & (1<<7)) == 0)
+        panic("interrupts should be off when we start\n");
+
+    // same setup as <int_vec_init>: all sources off, then 
+    // point the vector base at our table.
+    dev_barrier();
+    PUT32(IRQ_Disable_1, 0xffffffff);
+    PUT32(IRQ_Disable_2, 0xffffffff);
+    dev_barrier();
+
+    extern uint32_t samp_exception_vec[];
+    old_vec = vector_base_reset(samp_exception_vec);
+
+    stats.period_usec = period_usec;
+    stats.ticks_per_usec = timer_calibrate();
+    timer_init(1, period_usec * stats.ticks_per_usec);
+
+    start_cyc = cycle_cnt_read();
+    cpsr_int_enable();
+}
+
+unsigned samp_stop(void) {
+    cpsr_int_disable();
+    stats.cycles = cycle_cnt_read() - start_cyc;
+
+    dev_barrier();
+    PUT32(IRQ_Disable_Basic, ARM_Timer_IRQ);
+    PUT32(ARM_Timer_Control, 0);
+    PUT32(ARM_Timer_IRQ_Clear, 1);
+    dev_barrier();
+
+    // restore whatever was there (pixie installs its own).
+    if(old_vec)
+        vector_base_reset(old_vec);
+    return stats.nsamples;
+}
+
+unsigned samp_count(uint32_t pc) {
+    int i = code_idx(pc);
+    if(i < 0 || !pc_counts)
+        return 0;
+    return pc_counts[i];
+}
+
+samp_stats_t samp_stats(void) {
+    return stats;
+}
+
+// print entries with count >= N, biggest first, in the same
+// format as <pixie_dump>.
+static void hist_dump(const char *what, volatile unsigned *counts, 
+                        unsigned N, unsigned cyc_per) {
+    unsigned n = code_ninst();
+
+    unsigned n_above = 0;
+    for(unsigned i = 0; i < n; i++)
+        if(counts[i] && counts[i] >= N)
+            n_above++;
+
+    output("%s with count >= %d:\n", what, N);
+    if(!n_above)
+        return;
+
+    unsigned *idx = kmalloc(n_above * sizeof *idx);
+    unsigned k = 0;
+    for(unsigned i = 0; i < n; i++) {
+        if(!counts[i] || counts[i] < N)
+            continue;
+        // insertion sort: descending by count.
+        unsigned j = k++;
+        for(; j > 0 && counts[idx[j-1]] < counts[i]; j--)
+            idx[j] = idx[j-1];
+        idx[j] = i;
+    }
+
+    for(unsigned i = 0; i < n_above; i++) {
+        unsigned pc = (uint32_t)__code_start__ + idx[i] * 4;
+        output("pc=%x: count=%d, avg_cycles=%d\n", pc, counts[idx[i]], cyc_per);
+    }
+}
+
+void samp_dump(unsigned N) {
+    unsigned nsamp = stats.nsamples + stats.nmiss;
+    unsigned cyc_per = nsamp ? stats.cycles / nsamp : 0;
+
+    output("samples=%d (missed=%d), period=%dusec, handler overhead=%d cycles of %d\n",
+        stats.nsamples, stats.nmiss, stats.period_usec, 
+        stats.handler_cycles, stats.cycles);
+
+    hist_dump("Instructions", pc_counts, N, cyc_per);
+    if(walk_p)
+        hist_dump("Callers", caller_counts, N, cyc_per);
+}
@@ -0,0 +1,60 @@
+#ifndef __SAMP_PIXIE_H__
+#define __SAMP_PIXIE_H__
+// statistical profiler: the arm timer interrupt samples the
+// interrupted pc every <period_usec> instead of single-stepping
+// every instruction the way <ss-pixie.c> does.  the profiled
+// code runs at full speed (well under 1% overhead for periods
+// of 100usec and up) and stays at privileged mode.
+//
+// the histogram has one counter per instruction in
+// [__code_start__, __code_end__).  only the interrupt handler
+// writes it and each counter is a single word, so it is lock-free:
+// you can read it (e.g., <samp_count>) while sampling is running.
+
+// <flags> for <samp_start>
+enum {
+    // also walk the frame pointer chain and credit each return
+    // address in a second "callers" histogram.  only gives 
+    // useful results if the code is compiled with:
+    //      CFLAGS_EXTRA = -fno-omit-frame-pointer
+    // leaf routines that don't set up a frame lose their 
+    // immediate caller.
+    SAMP_WALK = 1 << 0,
+};
+
+// max number of frames walked per sample.
+#define SAMP_MAX_DEPTH 8
+
+typedef struct {
+    unsigned nsamples;      // samples that landed in the code segment.
+    unsigned nmiss;         // samples outside of it (e.g., jit code)
+    unsigned nframes;       // total frames credited when walking.
+    unsigned period_usec;
+    unsigned ticks_per_usec;    // calibrated arm timer rate.
+    uint32_t cycles;            // cycles between start and stop.
+    uint32_t handler_cycles;    // cycles spent in our handler.
+} samp_stats_t;
+
+// start sampling every <period_usec>: uses the arm timer and 
+// installs its own exception vector (the old one is restored by
+// <samp_stop>).  the first call allocates the histograms with 
+// <kmalloc> so kmalloc must already be initialized.  clears the
+// histograms.
+void samp_start(unsigned period_usec, unsigned flags);
+
+// stop sampling: returns the number of samples.
+unsigned samp_stop(void);
+
+// number of samples for instruction at <pc>.
+unsigned samp_count(uint32_t pc);
+
+// print out all instructions with >= N samples in the same 
+// format as <pixie_dump>, sorted by count.  <avg_cycles> is the
+// number of cycles each sample stands for, so count*avg_cycles 
+// estimates the cycles spent at <pc> just as it does for pixie.
+// if walking, also dumps the callers histogram the same way.
+void samp_dump(unsigned N);
+
+samp_stats_t samp_stats(void);
+
+#endif
@@ -0,0 +1,78 @@
+// sample with the arm timer instead of single-stepping:
+//  1. a routine that runs 3x as long should get ~3x the samples.
+//  2. the overhead at a 100usec period should be < 1%.
+//  3. dump in the same format as pixie and then run pixie on 
+//     a small piece of the same workload to compare.
+#include "rpi.h"
+#include "cycle-count.h"
+#include "samp-pixie.h"
+#include "ss-pixie.h"
+
+// keep these three in this order: we use the address of the 
+// next routine as the end of the previous one.
+__attribute__((noinline)) void spin_a(unsigned n) {
+    for(volatile unsigned i = 0; i < n; i++)
+        ;
+}
+__attribute__((noinline)) void spin_b(unsigned n) {
+    for(volatile unsigned i = 0; i < n; i++)
+        ;
+}
+__attribute__((noinline)) void spin_end(void) {}
+
+// total samples for instructions in [lo, hi)
+static unsigned samp_range(void *lo, void *hi) {
+    unsigned n = 0;
+    for(uint32_t pc = (uint32_t)lo; pc < (uint32_t)hi; pc += 4)
+        n += samp_count(pc);
+    return n;
+}
+
+static void work(unsigned n) {
+    spin_a(3*n);
+    spin_b(n);
+}
+
+void notmain(void) {
+    enum { N = 1000*1000*2, PERIOD = 100 };
+    kmalloc_init(1);
+    caches_enable();
+    assert((void*)spin_a < (void*)spin_b);
+    assert((void*)spin_b < (void*)spin_end);
+
+    // warm up, then time without sampling.
+    work(N/100);
+    unsigned t_raw = TIME_CYC(work(N));
+
+    samp_start(PERIOD, SAMP_WALK);
+    unsigned t_samp = TIME_CYC(work(N));
+    unsigned nsamp = samp_stop();
+
+    samp_stats_t s = samp_stats();
+    unsigned a = samp_range(spin_a, spin_b);
+    unsigned b = samp_range(spin_b, spin_end);
+    output("%d samples: spin_a=%d, spin_b=%d, timer=%d ticks/usec\n", 
+        nsamp, a, b, s.ticks_per_usec);
+    if(!b || a < 2*b || a > 4*b)
+        panic("expected spin_a to have ~3x spin_b's samples\n");
+
+    // end-to-end overhead, in hundredths of a percent.
+    unsigned over = t_samp > t_raw ? t_samp - t_raw : 0;
+    unsigned bp = (over * 100ULL * 100) / t_raw;
+    output("raw=%d cycles, sampled=%d cycles, overhead=%d.%d%d percent, handler=%d cycles/sample\n",
+        t_raw, t_samp, bp/100, bp/10%10, bp%10, s.handler_cycles / (nsamp + s.nmiss));
+    if(bp >= 100)
+        panic("sampling overhead >= 1 percent\n");
+
+    samp_dump(nsamp / 50);
+
+    // same format from the single-stepper on a tiny run.  
+    // its counts are executions, not samples, but count*avg_cycles 
+    // is an estimate of cycles at that pc in both.
+    pixie_verbose(0);
+    pixie_start();
+        work(100);
+    pixie_stop();
+    pixie_dump(100);
+    output("SUCCESS\n");
+}
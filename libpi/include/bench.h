@@ -0,0 +1,102 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+// micro-benchmark harness: replaces single-shot <TIME_CYC_PRINT10>.
+//
+// for each benchmark we:
+//   1. calibrate the cost of the timing loop itself by timing 
+//      an empty routine the same way (min over many trials) and
+//      subtract it from every trial.
+//   2. do <nwarmup> untimed runs.
+//   3. time <ntrials> trials of <inner> calls each, then report
+//      min/median/p99/max/mean/stddev in cycles per call.
+//
+// modes:
+//   - BENCH_WARM: caches left as they are (warm after warmup).
+//   - BENCH_COLD: flush caches (<flush_caches> in cache-support.S)
+//     before every trial, and skip the warmup.
+//
+// every result is printed as one machine-readable line:
+//   BENCH: name=<name> mode=warm ntrials=101 inner=10 overhead=12 
+//          min=.. median=.. p99=.. max=.. mean=.. stddev=..
+// (all on one line, cycles per call) so runs can be grep'd 
+// and compared across labs.
+//
+// builds for RPI_UNIX too: cycle-count.h expects the program to 
+// supply <cycle_cnt_read>; bench.c provides a weak one that counts
+// nanoseconds, and cold mode evicts by streaming over a big buffer.
+//
+// example:
+//      static void fn(void *arg) { ... }
+//      BENCH_ADD(fn, 0, BENCH_WARM | BENCH_COLD);
+//      bench_run_all(0);     // 0 = default config.
+#ifdef RPI_UNIX
+#   include "libunix.h"
+#else
+#   include "rpi.h"
+#endif
+
+typedef void (*bench_fn_t)(void *arg);
+
+// modes: a benchmark can ask for both.
+enum {
+    BENCH_WARM = 1 << 0,
+    BENCH_COLD = 1 << 1,
+};
+
+// max trials per run: the samples live in a static array.
+#define BENCH_MAX_TRIALS 1024
+
+typedef struct bench {
+    const char *name;
+    bench_fn_t fn;
+    void *arg;
+    unsigned modes;
+    struct bench *next;
+} bench_t;
+
+typedef struct {
+    unsigned ntrials;       // timed trials.
+    unsigned nwarmup;       // untimed runs first (warm mode only).
+    unsigned inner;         // calls per trial.
+} bench_cfg_t;
+
+// defaults: 101 trials, 10 warmup, 1 call per trial.
+bench_cfg_t bench_cfg_default(void);
+
+typedef struct {
+    const char *name;
+    unsigned mode;
+    unsigned ntrials, inner;
+    uint32_t overhead;      // per trial, subtracted before dividing.
+
+    // cycles per call.
+    uint32_t min, median, p99, max, mean, stddev;
+} bench_stats_t;
+
+// add <b> to the list run by <bench_run_all> (in order added).
+void bench_register(bench_t *b);
+
+// register <_fn> under its own name with a static <bench_t>.
+#define BENCH_ADD(_fn, _arg, _modes) do {                       \
+    static bench_t _bench = {                                   \
+        .name = #_fn, .fn = _fn, .modes = _modes                \
+    };                                                          \
+    _bench.arg = (_arg);                                        \
+    bench_register(&_bench);                                    \
+} while(0)
+
+// time one benchmark in one mode.  <cfg> = 0 means the defaults.
+bench_stats_t bench_run(const char *name, bench_fn_t fn, void *arg, 
+                        unsigned mode, const bench_cfg_t *cfg);
+
+// run every registered benchmark in each of its modes, printing 
+// each result.
+void bench_run_all(const bench_cfg_t *cfg);
+
+// print <s> as a "BENCH:" line.
+void bench_print(const bench_stats_t *s);
+
+// cycles of timing overhead for a trial of <inner> calls.
+uint32_t bench_overhead(unsigned inner);
+
+#endif
@@ -26,7 +26,8 @@ unsigned cycle_cnt_read(void);
 #endif
 
 // some helper macros to make measuring the cycle count of
-// different operations easier.
+// different operations easier.  these take a single sample: 
+// see <bench.h> for warmup, overhead subtraction and stats.
 #define TIME_CYC(_fn) ({                \
     unsigned _s = cycle_cnt_read();     \
     _fn;                                \
@@ -0,0 +1,93 @@
+#ifndef __KHEAP_H__
+#define __KHEAP_H__
+// free-capable allocation on top of <kmalloc>.
+//
+// <kmalloc> is a bump pointer with no free, so long-running code
+// (the fat32 driver, the jits) leaks until it hits the end of the
+// heap.  a <kheap_t> is a region grabbed once from kmalloc and then
+// managed with an address-ordered free list that coalesces on free,
+// so memory is actually reclaimed.
+//
+// heaps are named and can nest:
+//   - <kheap_init> makes the root heap (the only one that comes
+//     straight from <kmalloc> and so can never be given back).
+//   - <kheap_mk> carves a named sub-heap out of the root, or
+//     <kheap_mk_in> out of any heap.  <kheap_reset> frees everything
+//     in it at once; <kheap_destroy> gives its region back to the
+//     parent.
+//
+// <kfree> works on a block from any heap: each block header records
+// its owner.
+//
+// example:
+//      kmalloc_init(64);
+//      kheap_init(32*1024*1024);
+//      kheap_t *fs = kheap_mk("fat32", 8*1024*1024);
+//      void *p = kheap_alloc(fs, 512);
+//      ...
+//      kfree(p);
+//      kheap_destroy(fs);
+#ifdef RPI_UNIX
+#   include <string.h>
+#   include "libunix.h"
+    // on unix the caller supplies these (e.g., tests-kheap/kheap-stress.c)
+    void *kmalloc(unsigned nbytes);
+    void *kmalloc_aligned(unsigned nbytes, unsigned alignment);
+#else
+#   include "rpi.h"
+#endif
+
+typedef struct kheap kheap_t;
+
+// usage counters: all in bytes except <nalloc>,<nfree>.
+typedef struct {
+    unsigned nalloc, nfree;
+    unsigned nbytes_inuse;      // user bytes + headers.
+    unsigned nbytes_peak;       // max of <nbytes_inuse>.
+    unsigned nbytes_total;      // size of the region.
+} kheap_stats_t;
+
+// make the root heap of <nbytes> from kmalloc.  call once.
+kheap_t *kheap_init(unsigned nbytes);
+// returns the root heap (0 if <kheap_init> not called).
+kheap_t *kheap_root(void);
+
+// make a sub-heap named <name> of <nbytes> in <parent>.  <name> is
+// not copied.
+kheap_t *kheap_mk_in(kheap_t *parent, const char *name, unsigned nbytes);
+static inline kheap_t *kheap_mk(const char *name, unsigned nbytes) {
+    return kheap_mk_in(kheap_root(), name, nbytes);
+}
+
+// free every block in <h> (including any sub-heaps made from it)
+// and zero its counters.  pointers from before the reset are dead:
+// <kfree> or <kheap_nbytes> on one panics.
+void kheap_reset(kheap_t *h);
+// give <h>'s region back to its parent.  can't destroy the root.
+void kheap_destroy(kheap_t *h);
+
+// returns 8-byte aligned, zero-filled memory.  panics if <h> is out
+// of space.
+void *kheap_alloc(kheap_t *h, unsigned nbytes);
+void *kheap_alloc_notzero(kheap_t *h, unsigned nbytes);
+// allocate from the root heap.
+static inline void *kalloc(unsigned nbytes) {
+    return kheap_alloc(kheap_root(), nbytes);
+}
+
+// free <ptr> back to whichever heap it came from.  panics on a
+// double free or a pointer that was not returned by kheap_alloc.
+void kfree(void *ptr);
+
+// usable bytes in block <ptr> (>= the amount requested).
+unsigned kheap_nbytes(void *ptr);
+
+const char *kheap_name(kheap_t *h);
+kheap_stats_t kheap_stats(kheap_t *h);
+void kheap_stats_print(kheap_t *h);
+
+// walk every block in <h>, check headers and the free list.
+// returns the number of allocated blocks.
+unsigned kheap_check(kheap_t *h);
+
+#endif
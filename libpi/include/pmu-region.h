@@ -0,0 +1,73 @@
+#ifndef __PMU_REGION_H__
+#define __PMU_REGION_H__
+// named PMU measurement regions.
+//
+// the arm1176 PMU only has two event counters (plus cycles), so 
+// a single run can only see two events.  a region instead rotates
+// through a fixed list of event pairs (see <pmu-region.c>): run k
+// measures pair k % npairs.  after enough runs every pair has been
+// seen and <pmu_region_summary> scales each pair's counts by its
+// own number of runs to print per-run numbers, CPI and per-event 
+// rates for every region.
+//
+// counts are accumulated in 64 bits.  a single run can be up 
+// to 2^32 events/cycles (about 6 seconds at 700MHz): the 32-bit
+// deltas are computed with unsigned subtraction so one wrap is fine.
+//
+// example:
+//      for(int i = 0; i < 20; i++) {
+//          PMU_REGION_BEGIN("memcpy");
+//              memcpy(dst, src, n);
+//          PMU_REGION_END("memcpy");
+//      }
+//      pmu_region_summary();
+//
+// regions cannot nest: both would program the same counters.
+
+// number of event pairs we rotate through.
+#define PMU_NPAIRS 5
+
+typedef struct pmu_region {
+    const char *name;
+    unsigned nruns;
+    uint64_t cycles;                    // over all runs.
+
+    // per pair: runs, cycles and the two event counts.
+    unsigned pair_runs[PMU_NPAIRS];
+    uint64_t pair_cycles[PMU_NPAIRS];
+    uint64_t events[PMU_NPAIRS][2];
+
+    // snapshot from <pmu_region_begin>.
+    unsigned pair;
+    uint32_t cyc0, ev0, ev1;
+
+    // all regions, for the summary.
+    unsigned registered_p;
+    struct pmu_region *next;
+} pmu_region_t;
+
+// start/stop one run of <r>.  the first begin registers <r>.
+void pmu_region_begin(pmu_region_t *r);
+void pmu_region_end(pmu_region_t *r);
+
+// print the table for <r> or for every region seen.
+void pmu_region_print(pmu_region_t *r);
+void pmu_region_summary(void);
+
+// clear all counts (regions stay registered).
+void pmu_region_reset(void);
+
+// a statically allocated region per call site.  the two macros
+// open and close a block so they have to be used as a pair in 
+// the same scope.
+#define PMU_REGION_BEGIN(_name) {                               \
+    static pmu_region_t _pmu_region = { .name = _name };        \
+    pmu_region_begin(&_pmu_region)
+
+#define PMU_REGION_END(_name)                                   \
+    pmu_region_end(&_pmu_region);                               \
+    assert(_pmu_region.name == (_name)                          \
+        || strcmp(_pmu_region.name, _name) == 0);               \
+}
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef __UDIV64_H__
+#define __UDIV64_H__
+// 64-bit divide and square root without libgcc.
+//
+// gcc turns 64-bit division into a libgcc call, which most of our
+// programs don't link.  shift-subtract is plenty fast for 
+// computing statistics and printing.
+#include <stdint.h>
+
+// returns <n>/<d>, 0 if <d> is 0.
+static inline uint64_t udiv64(uint64_t n, uint64_t d) {
+    if(!d)
+        return 0;
+    uint64_t q = 0, r = 0;
+    for(int i = 63; i >= 0; i--) {
+        r = (r << 1) | ((n >> i) & 1);
+        if(r >= d) {
+            r -= d;
+            q |= 1ULL << i;
+        }
+    }
+    return q;
+}
+
+// floor(sqrt(x)): digit-by-digit, no divides.
+static inline uint32_t usqrt64(uint64_t x) {
+    uint64_t r = 0, bit = 1ULL << 62;
+    while(bit > x)
+        bit >>= 2;
+    for(; bit; bit >>= 2) {
+        if(x >= r + bit) {
+            x -= r + bit;
+            r = (r >> 1) + bit;
+        } else
+            r >>= 1;
+    }
+    return r;
+}
+
+#endif
@@ -0,0 +1,175 @@
+// micro-benchmark harness.  see <bench.h>
+#include "bench.h"
+#include "cycle-count.h"
+#include "udiv64.h"
+
+#ifdef RPI_UNIX
+#include <time.h>
+
+// cycle-count.h leaves these to the program on unix: count 
+// nanoseconds if nobody else does.
+void __attribute__((weak)) cycle_cnt_init(void) {}
+unsigned __attribute__((weak)) cycle_cnt_read(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+// no cache flush at user level: stream over something bigger 
+// than the last-level cache instead.
+static void bench_cache_flush(void) {
+    enum { EVICT_NBYTES = 32*1024*1024 };
+    static volatile uint8_t evict[EVICT_NBYTES];
+    for(unsigned i = 0; i < EVICT_NBYTES; i += 64)
+        evict[i]++;
+}
+#else
+static void bench_cache_flush(void) {
+    flush_caches();
+}
+#endif
+
+static bench_t *benches, **benches_tail = &benches;
+static uint32_t samples[BENCH_MAX_TRIALS];
+
+bench_cfg_t bench_cfg_default(void) {
+    return (bench_cfg_t) { .ntrials = 101, .nwarmup = 10, .inner = 1 };
+}
+
+void bench_register(bench_t *b) {
+    if(!b->fn)
+        panic("bench <%s>: no routine\n", b->name);
+    if(!(b->modes & (BENCH_WARM | BENCH_COLD)))
+        panic("bench <%s>: no mode\n", b->name);
+    // <BENCH_ADD> in a loop would register twice.
+    for(bench_t *p = benches; p; p = p->next)
+        if(p == b)
+            return;
+    b->next = 0;
+    *benches_tail = b;
+    benches_tail = &b->next;
+}
+
+// one trial: every measurement (including the overhead
+// calibration) goes through here so they pay the same costs.
+static __attribute__((noinline)) uint32_t 
+bench_time(bench_fn_t fn, void *arg, unsigned inner) {
+    uint32_t s = cycle_cnt_read();
+    for(unsigned i = 0; i < inner; i++)
+        fn(arg);
+    return cycle_cnt_read() - s;
+}
+
+static __attribute__((noinline)) void bench_nop(void *arg) {
+    asm volatile("" ::: "memory");
+}
+
+uint32_t bench_overhead(unsigned inner) {
+    // cache the last calibration: benches usually share <inner>.
+    static unsigned last_inner;
+    static uint32_t last_overhead;
+    if(inner == last_inner)
+        return last_overhead;
+
+    enum { NCAL = 64 };
+    for(unsigned i = 0; i < NCAL / 4; i++)
+        bench_time(bench_nop, 0, inner);
+    uint32_t min = ~0;
+    for(unsigned i = 0; i < NCAL; i++) {
+        uint32_t t = bench_time(bench_nop, 0, inner);
+        if(t < min)
+            min = t;
+    }
+    last_inner = inner;
+    return last_overhead = min;
+}
+
+static void sort_u32(uint32_t *v, unsigned n) {
+    for(unsigned i = 1; i < n; i++) {
+        uint32_t x = v[i];
+        unsigned j = i;
+        for(; j > 0 && v[j-1] > x; j--)
+            v[j] = v[j-1];
+        v[j] = x;
+    }
+}
+
+bench_stats_t bench_run(const char *name, bench_fn_t fn, void *arg, 
+                        unsigned mode, const bench_cfg_t *cfg) {
+    bench_cfg_t c = cfg ? *cfg : bench_cfg_default();
+    if(!c.ntrials || c.ntrials > BENCH_MAX_TRIALS)
+        panic("bench <%s>: ntrials=%d must be in [1,%d]\n", 
+            name, c.ntrials, BENCH_MAX_TRIALS);
+    if(!c.inner)
+        c.inner = 1;
+    if(mode != BENCH_WARM && mode != BENCH_COLD)
+        panic("bench <%s>: run one mode at a time\n", name);
+
+    uint32_t overhead = bench_overhead(c.inner);
+
+    if(mode == BENCH_WARM)
+        for(unsigned i = 0; i < c.nwarmup; i++)
+            bench_time(fn, arg, c.inner);
+
+    for(unsigned i = 0; i < c.ntrials; i++) {
+        if(mode == BENCH_COLD)
+            bench_cache_flush();
+        uint32_t t = bench_time(fn, arg, c.inner);
+        samples[i] = t > overhead ? t - overhead : 0;
+    }
+
+    // everything below is per trial; divide by <inner> at the end.
+    unsigned n = c.ntrials;
+    sort_u32(samples, n);
+
+    uint64_t sum = 0;
+    for(unsigned i = 0; i < n; i++)
+        sum += samples[i];
+    uint32_t mean = udiv64(sum, n);
+
+    // saturate instead of wrapping on absurd outliers.
+    uint64_t var = 0;
+    for(unsigned i = 0; i < n; i++) {
+        uint64_t d = samples[i] > mean ? samples[i] - mean : mean - samples[i];
+        uint64_t d2 = d * d;
+        var = (var + d2 < var) ? ~0ULL : var + d2;
+    }
+    uint32_t stddev = usqrt64(udiv64(var, n));
+
+    bench_stats_t s = {
+        .name = name,
+        .mode = mode,
+        .ntrials = n,
+        .inner = c.inner,
+        .overhead = overhead,
+        .min = udiv64(samples[0], c.inner),
+        .median = udiv64(samples[n / 2], c.inner),
+        .p99 = udiv64(samples[(n - 1) * 99 / 100], c.inner),
+        .max = udiv64(samples[n - 1], c.inner),
+        .mean = udiv64(mean, c.inner),
+        .stddev = udiv64(stddev, c.inner),
+    };
+    return s;
+}
+
+void bench_print(const bench_stats_t *s) {
+    output("BENCH: name=%s mode=%s ntrials=%d inner=%d overhead=%d "
+           "min=%d median=%d p99=%d max=%d mean=%d stddev=%d\n",
+        s->name, s->mode == BENCH_COLD ? "cold" : "warm", 
+        s->ntrials, s->inner, s->overhead,
+        s->min, s->median, s->p99, s->max, s->mean, s->stddev);
+}
+
+void bench_run_all(const bench_cfg_t *cfg) {
+    for(bench_t *b = benches; b; b = b->next) {
+        // warm first: cold flushes everything.
+        if(b->modes & BENCH_WARM) {
+            bench_stats_t s = bench_run(b->name, b->fn, b->arg, BENCH_WARM, cfg);
+            bench_print(&s);
+        }
+        if(b->modes & BENCH_COLD) {
+            bench_stats_t s = bench_run(b->name, b->fn, b->arg, BENCH_COLD, cfg);
+            bench_print(&s);
+        }
+    }
+}
@@ -0,0 +1,265 @@
+// free-capable heaps on top of kmalloc: see include/kheap.h
+//
+// each heap is one contiguous region [base,end) tiled by blocks.
+// every block starts with a <blk_t> header giving its size, so we
+// can walk the whole region (<kheap_check>).  free blocks are kept
+// on an address-ordered list: allocation is first-fit, splitting
+// off the tail of a block; free merges with both neighbors so the
+// region doesn't shatter into unusable pieces.
+#include "kheap.h"
+
+enum {
+    KH_ALLOCED = 0xa110c8ed,
+    KH_FREED   = 0xf4eeb10c,
+};
+
+typedef struct blk {
+    uint32_t magic;
+    uint32_t nbytes;            // whole block, header included.
+    uint32_t epoch;             // KH_ALLOCED: owner's <epoch> at alloc.
+    union {
+        kheap_t *heap;          // KH_ALLOCED: owner.
+        struct blk *next;       // KH_FREED: next free block by address.
+    } u;
+} blk_t;
+
+struct kheap {
+    const char *name;
+    kheap_t *parent;            // 0 for the root.
+    char *base, *end;
+    blk_t *free_list;
+    uint32_t epoch;             // bumped by each <kheap_reset>.
+    kheap_stats_t s;
+};
+
+#define roundup8(x) (((x)+7)&~7)
+
+// data starts here: keep it 8-byte aligned.
+#define HDR_NBYTES roundup8(sizeof(blk_t))
+// smallest block worth splitting off.
+#define MIN_NBYTES (HDR_NBYTES + 8)
+
+static kheap_t *root;
+
+static inline blk_t *blk_next(blk_t *b) {
+    return (void*)((char*)b + b->nbytes);
+}
+static inline int blk_adjacent(blk_t *a, blk_t *b) {
+    return blk_next(a) == b;
+}
+static inline void *blk_data(blk_t *b) {
+    return (char*)b + HDR_NBYTES;
+}
+
+// make <h> one big free block.  the old blocks' headers are still
+// in memory: <epoch> is what marks them stale.
+static void heap_clear(kheap_t *h) {
+    blk_t *b = (void*)h->base;
+    b->magic = KH_FREED;
+    b->nbytes = h->end - h->base;
+    b->u.next = 0;
+    h->free_list = b;
+    h->s = (kheap_stats_t){ .nbytes_total = h->s.nbytes_total };
+}
+
+static kheap_t *heap_mk(void *mem, kheap_t *parent, const char *name, unsigned nbytes) {
+    kheap_t *h = mem;
+    memset(h, 0, sizeof *h);
+    h->name = name;
+    h->parent = parent;
+    h->base = (char*)mem + roundup8(sizeof *h);
+    h->end = h->base + nbytes;
+    h->s.nbytes_total = nbytes;
+    heap_clear(h);
+    return h;
+}
+
+static unsigned heap_nbytes(unsigned nbytes) {
+    nbytes = roundup8(nbytes);
+    if(nbytes < MIN_NBYTES)
+        panic("heap too small: %d bytes\n", nbytes);
+    return nbytes;
+}
+
+kheap_t *kheap_init(unsigned nbytes) {
+    if(root)
+        panic("kheap_init called twice\n");
+    nbytes = heap_nbytes(nbytes);
+    void *mem = kmalloc_aligned(roundup8(sizeof *root) + nbytes, 8);
+    if(!mem)
+        panic("kmalloc of %d bytes failed\n", nbytes);
+    return root = heap_mk(mem, 0, "root", nbytes);
+}
+
+kheap_t *kheap_root(void) {
+    return root;
+}
+
+kheap_t *kheap_mk_in(kheap_t *parent, const char *name, unsigned nbytes) {
+    if(!parent)
+        panic("no parent heap for <%s>: call kheap_init first\n", name);
+    nbytes = heap_nbytes(nbytes);
+    void *mem = kheap_alloc_notzero(parent, roundup8(sizeof *parent) + nbytes);
+    return heap_mk(mem, parent, name, nbytes);
+}
+
+void kheap_reset(kheap_t *h) {
+    h->epoch++;
+    heap_clear(h);
+}
+
+void kheap_destroy(kheap_t *h) {
+    if(!h->parent)
+        panic("can't destroy the root heap\n");
+    // catch use-after-destroy.
+    h->free_list = 0;
+    h->base = h->end = 0;
+    kfree(h);
+}
+
+void *kheap_alloc_notzero(kheap_t *h, unsigned nbytes) {
+    assert(h);
+    // prevent int overflow.
+    if(nbytes > h->s.nbytes_total)
+        panic("heap <%s>: can't allocate %d bytes, heap is %d bytes\n",
+            h->name, nbytes, h->s.nbytes_total);
+    unsigned n = HDR_NBYTES + roundup8(nbytes);
+
+    // first fit.
+    blk_t **pp, *b;
+    for(pp = &h->free_list; (b = *pp); pp = &b->u.next) {
+        if(b->nbytes < n)
+            continue;
+
+        // split off the tail so the free list doesn't change.
+        if(b->nbytes - n >= MIN_NBYTES) {
+            b->nbytes -= n;
+            b = blk_next(b);
+            b->nbytes = n;
+        } else
+            *pp = b->u.next;
+
+        b->magic = KH_ALLOCED;
+        b->epoch = h->epoch;
+        b->u.heap = h;
+
+        h->s.nalloc++;
+        h->s.nbytes_inuse += b->nbytes;
+        if(h->s.nbytes_inuse > h->s.nbytes_peak)
+            h->s.nbytes_peak = h->s.nbytes_inuse;
+        return blk_data(b);
+    }
+    panic("heap <%s>: out of space: can't allocate %d bytes, %d of %d in use\n",
+        h->name, nbytes, h->s.nbytes_inuse, h->s.nbytes_total);
+}
+
+void *kheap_alloc(kheap_t *h, unsigned nbytes) {
+    void *p = kheap_alloc_notzero(h, nbytes);
+    memset(p, 0, nbytes);
+    return p;
+}
+
+static blk_t *blk_of(void *ptr) {
+    blk_t *b = (void*)((char*)ptr - HDR_NBYTES);
+    if(b->magic == KH_FREED)
+        panic("double free of %p\n", ptr);
+    if(b->magic != KH_ALLOCED)
+        panic("%p was not returned by kheap_alloc (magic=%x)\n", ptr, b->magic);
+
+    kheap_t *h = b->u.heap;
+    if((char*)b < h->base || (char*)blk_next(b) > h->end)
+        panic("%p is not in heap <%s>\n", ptr, h->name);
+    if(b->epoch != h->epoch)
+        panic("%p is from before heap <%s> was reset\n", ptr, h->name);
+    // a sub-heap lives in a block of its parent: that has to be 
+    // live too.
+    if(h->parent)
+        blk_of(h);
+    return b;
+}
+
+void kfree(void *ptr) {
+    if(!ptr)
+        return;
+    blk_t *b = blk_of(ptr);
+    kheap_t *h = b->u.heap;
+
+    h->s.nfree++;
+    h->s.nbytes_inuse -= b->nbytes;
+    b->magic = KH_FREED;
+
+    blk_t *prev = 0, *next = h->free_list;
+    for(; next && next < b; prev = next, next = next->u.next)
+        ;
+
+    if(next && blk_adjacent(b, next)) {
+        b->nbytes += next->nbytes;
+        next->magic = 0;
+        next = next->u.next;
+    }
+    b->u.next = next;
+
+    if(prev && blk_adjacent(prev, b)) {
+        prev->nbytes += b->nbytes;
+        prev->u.next = b->u.next;
+        b->magic = 0;
+    } else if(prev)
+        prev->u.next = b;
+    else
+        h->free_list = b;
+}
+
+unsigned kheap_nbytes(void *ptr) {
+    return blk_of(ptr)->nbytes - HDR_NBYTES;
+}
+
+const char *kheap_name(kheap_t *h) {
+    return h->name;
+}
+
+kheap_stats_t kheap_stats(kheap_t *h) {
+    return h->s;
+}
+
+void kheap_stats_print(kheap_t *h) {
+    kheap_stats_t *s = &h->s;
+    output("heap <%s>: %d allocs, %d frees, %d/%d bytes in use (peak=%d)\n",
+        h->name, s->nalloc, s->nfree, s->nbytes_inuse, s->nbytes_total,
+        s->nbytes_peak);
+}
+
+unsigned kheap_check(kheap_t *h) {
+    unsigned nalloced = 0, inuse = 0;
+    blk_t *f = h->free_list, *last_free = 0;
+
+    blk_t *b = (void*)h->base;
+    for(; (char*)b < h->end; b = blk_next(b)) {
+        if(b->nbytes < MIN_NBYTES || b->nbytes % 8)
+            panic("heap <%s>: block %p has bad size %d\n", h->name, b, b->nbytes);
+
+        if(b->magic == KH_ALLOCED) {
+            if(b->u.heap != h)
+                panic("heap <%s>: block %p has wrong owner\n", h->name, b);
+            nalloced++;
+            inuse += b->nbytes;
+            last_free = 0;
+        } else if(b->magic == KH_FREED) {
+            if(b != f)
+                panic("heap <%s>: free block %p not on the free list\n", h->name, b);
+            if(last_free)
+                panic("heap <%s>: free blocks %p,%p not coalesced\n",
+                    h->name, last_free, b);
+            last_free = b;
+            f = f->u.next;
+        } else
+            panic("heap <%s>: block %p has bad magic %x\n", h->name, b, b->magic);
+    }
+    if((char*)b != h->end)
+        panic("heap <%s>: blocks overrun the end\n", h->name);
+    if(f)
+        panic("heap <%s>: free list has block %p past the end\n", h->name, f);
+    if(inuse != h->s.nbytes_inuse)
+        panic("heap <%s>: in use=%d, but stats say %d\n",
+            h->name, inuse, h->s.nbytes_inuse);
+    return nalloced;
+}
@@ -0,0 +1,193 @@
+// rotating PMU event pairs over named regions.  see <pmu-region.h>
+#include "rpi.h"
+#include "armv6-pmu.h"
+#include "pmu-region.h"
+#include "udiv64.h"
+
+// how to report an event:
+//   - EV_COUNT: events per 1000 instructions.
+//   - EV_STALL: the event counts stall cycles: report as a 
+//     percent of all cycles.
+enum { EV_COUNT, EV_STALL };
+
+typedef struct {
+    uint8_t type;           // PMU event number (3-139 arm1176.pdf)
+    uint8_t kind;
+    int8_t ref;             // if >= 0: also print as a ratio of this event.
+    const char *name;
+} pmu_ev_t;
+
+// the event pairs we rotate through: <pmu_pairs[i][0]> goes in 
+// counter 0 and <[1]> in counter 1.  instruction count is in 
+// pair 0 since we need it to normalize everything else.
+enum { 
+    EV_INST, EV_INST_STALL, 
+    EV_ICACHE_MISS, EV_DCACHE_MISS, 
+    EV_BRANCH, EV_BRANCH_MISS,
+    EV_TLB_MISS, EV_DATA_STALL,
+    EV_DCACHE_ACCESS, EV_DCACHE_WB,
+};
+static const pmu_ev_t pmu_pairs[PMU_NPAIRS][2] = {
+    { { PMU_INST_CNT, EV_COUNT, -1, "instructions" },
+      { PMU_INST_STALL, EV_STALL, -1, "fetch stall cycles" } },
+    { { PMU_ICACHE_MISS, EV_COUNT, -1, "icache miss" },
+      { PMU_DCACHE_MISS, EV_COUNT, EV_DCACHE_ACCESS, "dcache miss" } },
+    { { PMU_BRANCH_EXECUTED, EV_COUNT, -1, "branches" },
+      { PMU_BRANCH_MISPREDICT, EV_COUNT, EV_BRANCH, "branch mispredict" } },
+    { { PMU_MAIN_TLB_MISS, EV_COUNT, -1, "main tlb miss" },
+      { PMU_DATA_STALL, EV_STALL, -1, "data stall cycles" } },
+    { { PMU_DCACHE_ACCESS, EV_COUNT, -1, "dcache access" },
+      { PMU_DCACHE_WB, EV_COUNT, -1, "dcache write back" } },
+};
+
+static pmu_region_t *regions;
+static pmu_region_t *active;
+
+// print <num>/<den> with two decimal places.  the integer part
+// has to fit in 32 bits.
+static void print_ratio(uint64_t num, uint64_t den) {
+    if(!den) {
+        printk("-");
+        return;
+    }
+    uint64_t ip = udiv64(num, den);
+    uint32_t frac = udiv64((num - ip * den) * 100, den);
+    printk("%u.%u%u", (uint32_t)ip, frac / 10, frac % 10);
+}
+
+// printk doesn't do "%%"
+static void print_pct(uint64_t num, uint64_t den) {
+    print_ratio(num * 100, den);
+    putk("%");
+}
+
+void pmu_region_begin(pmu_region_t *r) {
+    if(active)
+        panic("region <%s>: <%s> is still active (no nesting)\n", 
+            r->name, active->name);
+    active = r;
+
+    if(!r->registered_p) {
+        r->registered_p = 1;
+        r->next = regions;
+        regions = r;
+    }
+
+    // program both counters with one write: this also zeros them.
+    const pmu_ev_t *p = pmu_pairs[r->pair = r->nruns % PMU_NPAIRS];
+    uint32_t c = pmu_control_get();
+    c = bits_set(c, 20, 27, p[0].type);
+    c = bits_set(c, 12, 19, p[1].type);
+    pmu_control_config(c | 0b11);
+
+    r->ev0 = pmu_event0_get();
+    r->ev1 = pmu_event1_get();
+    r->cyc0 = pmu_cycle_get();
+}
+
+void pmu_region_end(pmu_region_t *r) {
+    // read in the reverse order of <begin> to keep our own 
+    // code out of the counts as much as possible.
+    uint32_t cyc = pmu_cycle_get() - r->cyc0;
+    uint32_t ev1 = pmu_event1_get() - r->ev1;
+    uint32_t ev0 = pmu_event0_get() - r->ev0;
+
+    if(active != r)
+        panic("region <%s> ended but was not active\n", r->name);
+    active = 0;
+
+    unsigned k = r->pair;
+    r->nruns++;
+    r->cycles += cyc;
+    r->pair_runs[k]++;
+    r->pair_cycles[k] += cyc;
+    r->events[k][0] += ev0;
+    r->events[k][1] += ev1;
+}
+
+// per-run average of event <e> scaled by 100 (so we keep 
+// precision for rare events): 0 if its pair never ran.
+static uint64_t ev_per_run100(pmu_region_t *r, unsigned e) {
+    unsigned k = e / 2;
+    return udiv64(r->events[k][e % 2] * 100, r->pair_runs[k]);
+}
+
+void pmu_region_print(pmu_region_t *r) {
+    printk("region <%s>: %d runs, ", r->name, r->nruns);
+    if(!r->nruns) {
+        printk("nothing measured\n");
+        return;
+    }
+    uint64_t cyc = udiv64(r->cycles * 100, r->nruns);
+    uint64_t inst = ev_per_run100(r, EV_INST);
+    printk("cycles/run=");
+    print_ratio(cyc, 100);
+    printk(", inst/run=");
+    print_ratio(inst, 100);
+    printk(", CPI=");
+    print_ratio(cyc, inst);
+    printk("\n");
+
+    for(unsigned e = 0; e < 2*PMU_NPAIRS; e++) {
+        const pmu_ev_t *p = &pmu_pairs[e/2][e%2];
+        if(e == EV_INST)
+            continue;
+        if(!r->pair_runs[e/2]) {
+            printk("\t%s: not measured (need >= %d runs)\n", p->name, PMU_NPAIRS);
+            continue;
+        }
+
+        uint64_t n = ev_per_run100(r, e);
+        printk("\t%s: ", p->name);
+        print_ratio(n, 100);
+        printk("/run, ");
+        if(p->kind == EV_STALL) {
+            // use the cycles of the runs this pair was measured in.
+            print_pct(r->events[e/2][e%2], r->pair_cycles[e/2]);
+            printk(" of cycles");
+        } else {
+            print_ratio(n * 1000, inst);
+            printk(" per 1k inst");
+        }
+        uint64_t ref;
+        if(p->ref >= 0 && (ref = ev_per_run100(r, p->ref))) {
+            printk(", ");
+            print_pct(n, ref);
+            printk(" of %s", pmu_pairs[p->ref/2][p->ref%2].name);
+        }
+        printk("\n");
+    }
+
+    // one-line answer to "why is it slow": whichever stall 
+    // dominates, if any.
+    unsigned kf = EV_INST_STALL / 2, kd = EV_DATA_STALL / 2;
+    if(!r->pair_runs[kf] || !r->pair_runs[kd])
+        return;
+    uint32_t fetch = udiv64(r->events[kf][EV_INST_STALL % 2] * 100, r->pair_cycles[kf]);
+    uint32_t data = udiv64(r->events[kd][EV_DATA_STALL % 2] * 100, r->pair_cycles[kd]);
+    if(fetch < 10 && data < 10)
+        printk("\tbottleneck: none dominant (stalls < 10%s of cycles)\n", "%");
+    else if(fetch >= data)
+        printk("\tbottleneck: instruction fetch (icache / tlb misses, branches)\n");
+    else
+        printk("\tbottleneck: data (dcache misses, load-use stalls)\n");
+}
+
+void pmu_region_summary(void) {
+    printk("------------------ PMU regions ------------------\n");
+    for(pmu_region_t *r = regions; r; r = r->next)
+        pmu_region_print(r);
+    printk("-------------------------------------------------\n");
+}
+
+void pmu_region_reset(void) {
+    if(active)
+        panic("reset while <%s> is active\n", active->name);
+    for(pmu_region_t *r = regions; r; r = r->next) {
+        memset(r->pair_runs, 0, sizeof r->pair_runs);
+        memset(r->pair_cycles, 0, sizeof r->pair_cycles);
+        memset(r->events, 0, sizeof r->events);
+        r->nruns = 0;
+        r->cycles = 0;
+    }
+}
@@ -0,0 +1,96 @@
+// host test for the benchmark harness:
+//   1. udiv64/usqrt64 agree with the native 64-bit ops.
+//   2. the empty routine costs ~0 once overhead is subtracted.
+//   3. stats are ordered: min <= median <= p99 <= max.
+//   4. twice the work takes about twice as long.
+//   5. cold runs of a routine that walks memory are slower 
+//      than warm ones.
+//   6. registered benches all run and print.
+#include "bench.h"
+#include "udiv64.h"
+
+static uint32_t rng_state = 1;
+static uint32_t rng(void) {
+    rng_state = rng_state * 1103515245 + 12345;
+    return rng_state >> 8;
+}
+
+static void empty(void *arg) { }
+
+static void spin(void *arg) {
+    unsigned n = (uintptr_t)arg;
+    for(volatile unsigned i = 0; i < n; i++)
+        ;
+}
+
+enum { WALK_NBYTES = 256*1024 };
+static volatile uint8_t walk_buf[WALK_NBYTES];
+static void walk(void *arg) {
+    for(unsigned i = 0; i < WALK_NBYTES; i += 64)
+        walk_buf[i]++;
+}
+
+static void chk_order(bench_stats_t s) {
+    bench_print(&s);
+    if(!(s.min <= s.median && s.median <= s.p99 && s.p99 <= s.max))
+        panic("stats out of order\n");
+    if(s.mean < s.min || s.mean > s.max)
+        panic("mean=%u not in [%u,%u]\n", s.mean, s.min, s.max);
+}
+
+int main(void) {
+    for(int i = 0; i < 100000; i++) {
+        uint64_t n = ((uint64_t)rng() << 40) ^ ((uint64_t)rng() << 20) ^ rng();
+        uint64_t d = rng() % 4 ? rng() % 1000 + 1 : ((uint64_t)rng() << 16) + 1;
+        n >>= rng() % 64;
+        if(udiv64(n, d) != n / d)
+            panic("udiv64(%llu,%llu)\n", (unsigned long long)n, (unsigned long long)d);
+        uint32_t r = usqrt64(n);
+        if((uint64_t)r * r > n || ((uint64_t)r + 1) * (r + 1) <= n)
+            panic("usqrt64(%llu)=%u\n", (unsigned long long)n, r);
+    }
+    if(udiv64(5, 0) != 0 || usqrt64(~0ULL) != 0xffffffff)
+        panic("edge cases\n");
+
+    bench_cfg_t c = bench_cfg_default();
+    c.inner = 10;
+
+    bench_stats_t e = bench_run("empty", empty, 0, BENCH_WARM, &c);
+    chk_order(e);
+    if(e.median > 20)
+        panic("overhead not subtracted: empty costs %u\n", e.median);
+
+    // hosts scale their clocks under us: alternate the two and 
+    // keep the best of each.
+    // long runs so that timer noise doesn't matter.
+    bench_cfg_t cs = { .ntrials = 21, .nwarmup = 2, .inner = 1 };
+    uint32_t min1 = ~0, min2 = ~0;
+    for(int i = 0; i < 5; i++) {
+        bench_stats_t s1 = bench_run("spin-1m", spin, (void*)1000000, BENCH_WARM, &cs);
+        bench_stats_t s2 = bench_run("spin-2m", spin, (void*)2000000, BENCH_WARM, &cs);
+        chk_order(s1);
+        chk_order(s2);
+        if(s1.min < min1)
+            min1 = s1.min;
+        if(s2.min < min2)
+            min2 = s2.min;
+    }
+    if(min2 < min1 * 3 / 2 || min2 > min1 * 5 / 2)
+        panic("2x work: %u vs %u\n", min2, min1);
+
+    c.inner = 1;
+    c.ntrials = 31;
+    bench_stats_t w = bench_run("walk", walk, 0, BENCH_WARM, &c);
+    bench_stats_t k = bench_run("walk", walk, 0, BENCH_COLD, &c);
+    chk_order(w);
+    chk_order(k);
+    if(k.median <= w.median)
+        panic("cold=%u not slower than warm=%u\n", k.median, w.median);
+
+    BENCH_ADD(empty, 0, BENCH_WARM);
+    BENCH_ADD(walk, 0, BENCH_WARM | BENCH_COLD);
+    bench_run_all(&c);
+
+    output("SUCCESS\n");
+    return 0;
+}
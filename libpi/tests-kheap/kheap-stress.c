@@ -0,0 +1,221 @@
+// host stress test for kheap: random alloc/free across the root and
+// several sub-heaps, checking that
+//   1. blocks never overlap (each is filled with its id and checked
+//      on free).
+//   2. the heap structure is consistent (<kheap_check>).
+//   3. after freeing everything, each heap coalesces back into a
+//      single block (we can allocate all of it again).
+//   4. reset/destroy give memory back to the parent, and heap-backed
+//      arenas can be destroyed.
+//   5. double free, bogus pointers and pointers from before a 
+//      reset panic.
+#include <sys/wait.h>
+#include "kheap.h"
+#include "arena.h"
+
+// on the pi these come from libpi's kmalloc.
+void *kmalloc_aligned(unsigned nbytes, unsigned alignment) {
+    void *p;
+    if(posix_memalign(&p, alignment, nbytes))
+        panic("posix_memalign failed\n");
+    memset(p, 0, nbytes);
+    return p;
+}
+void *kmalloc(unsigned nbytes) {
+    return kmalloc_aligned(nbytes, 8);
+}
+
+static uint32_t rng_state = 1;
+static uint32_t rng(void) {
+    rng_state = rng_state * 1103515245 + 12345;
+    return rng_state >> 8;
+}
+
+// log-uniform 1 .. 32k
+static unsigned rand_size(void) {
+    return 1 + rng() % (1 << (rng() % 16));
+}
+
+enum { MAX_LIVE = 4096, NHEAPS = 4 };
+
+typedef struct {
+    uint8_t *p;
+    unsigned n;
+    uint8_t id;
+} live_t;
+
+static void fill(live_t *l) {
+    memset(l->p, l->id, l->n);
+}
+static void check(live_t *l) {
+    for(unsigned i = 0; i < l->n; i++)
+        if(l->p[i] != l->id)
+            panic("block %p [%u bytes] corrupted at offset %u\n", l->p, l->n, i);
+}
+
+// can we allocate the whole heap in one block?  (only true if free
+// coalesced everything back.)
+static void check_empty(kheap_t *h) {
+    kheap_stats_t s = kheap_stats(h);
+    if(s.nbytes_inuse)
+        panic("heap <%s>: %d bytes still in use\n", kheap_name(h), s.nbytes_inuse);
+    assert(kheap_check(h) == 0);
+
+    // the header is at most 24 bytes (16 on the pi).
+    void *p = kheap_alloc_notzero(h, s.nbytes_total - 24);
+    kfree(p);
+    assert(kheap_check(h) == 0);
+}
+
+static void stress(unsigned nops) {
+    static live_t live[MAX_LIVE];
+    unsigned nlive = 0, nfail = 0;
+
+    kheap_t *heaps[NHEAPS];
+    heaps[0] = kheap_root();
+    heaps[1] = kheap_mk("fat32", 4*1024*1024);
+    heaps[2] = kheap_mk("jit", 2*1024*1024);
+    heaps[3] = kheap_mk_in(heaps[1], "fat32-cache", 1024*1024);
+
+    for(unsigned i = 0; i < nops; i++) {
+        if(nlive == MAX_LIVE || (nlive && rng() % 2)) {
+            unsigned j = rng() % nlive;
+            check(&live[j]);
+            kfree(live[j].p);
+            live[j] = live[--nlive];
+        } else {
+            kheap_t *h = heaps[rng() % NHEAPS];
+            unsigned n = rand_size();
+            // don't run a heap out of space: that panics.
+            kheap_stats_t s = kheap_stats(h);
+            if(s.nbytes_inuse + n + 64 > s.nbytes_total / 2) {
+                nfail++;
+                continue;
+            }
+            live_t *l = &live[nlive++];
+            l->p = kheap_alloc(h, n);
+            l->n = n;
+            l->id = i;
+            assert(kheap_nbytes(l->p) >= n);
+            for(unsigned k = 0; k < n; k++)
+                if(l->p[k])
+                    panic("kheap_alloc returned non-zero memory\n");
+            fill(l);
+        }
+        if(i % 4096 == 0)
+            for(unsigned k = 0; k < NHEAPS; k++)
+                kheap_check(heaps[k]);
+    }
+    while(nlive) {
+        check(&live[--nlive]);
+        kfree(live[nlive].p);
+    }
+    output("stress: %d ops (%d skipped allocs)\n", nops, nfail);
+    for(unsigned k = 0; k < NHEAPS; k++)
+        kheap_stats_print(heaps[k]);
+
+    // children first: they are blocks in their parent.
+    check_empty(heaps[3]);
+    kheap_destroy(heaps[3]);
+    for(unsigned k = 1; k < 3; k++) {
+        check_empty(heaps[k]);
+        kheap_destroy(heaps[k]);
+    }
+    check_empty(kheap_root());
+}
+
+static void test_reset(void) {
+    kheap_t *h = kheap_mk("reset", 64*1024);
+    for(unsigned i = 0; i < 100; i++)
+        kheap_alloc(h, rand_size() % 512);
+    assert(kheap_check(h) == 100);
+    kheap_reset(h);
+    kheap_stats_t s = kheap_stats(h);
+    assert(!s.nalloc && !s.nfree && !s.nbytes_inuse && !s.nbytes_peak);
+    check_empty(h);
+    kheap_destroy(h);
+    check_empty(kheap_root());
+    output("reset: ok\n");
+}
+
+static void test_arena(void) {
+    kheap_t *h = kheap_mk("arena", 1024*1024);
+    for(unsigned i = 0; i < 10; i++) {
+        arena_t *a = arena_mk_in(h, 256*1024);
+        for(unsigned j = 0; j < 100; j++)
+            memset(arena_alloc(a, 1000), 0xee, 1000);
+        arena_reset(a);
+        arena_alloc(a, 1000);
+        arena_destroy(a);
+        check_empty(h);
+    }
+    kheap_destroy(h);
+    check_empty(kheap_root());
+    output("arena: ok\n");
+}
+
+// run <fn> in a child and make sure it dies.
+static void expect_panic(const char *name, void (*fn)(void)) {
+    pid_t pid = fork();
+    if(pid < 0)
+        sys_die(fork, "fork failed");
+    if(!pid) {
+        // silence the expected panic message.
+        freopen("/dev/null", "w", stderr);
+        fn();
+        exit(0);
+    }
+    int status;
+    if(waitpid(pid, &status, 0) < 0)
+        sys_die(waitpid, "waitpid failed");
+    if(WIFEXITED(status) && WEXITSTATUS(status) == 0)
+        panic("%s: should have panic'd\n", name);
+    output("%s: panic'd as expected\n", name);
+}
+
+static void double_free(void) {
+    void *p = kalloc(32);
+    kfree(p);
+    kfree(p);
+}
+static void bogus_free(void) {
+    char *p = kalloc(32);
+    kfree(p + 8);
+}
+static void free_after_reset(void) {
+    kheap_t *h = kheap_mk("stale", 4096);
+    kheap_alloc(h, 32);
+    void *p = kheap_alloc(h, 32);
+    kheap_reset(h);
+    kfree(p);
+}
+// the sub-heap went away with its parent's reset.
+static void free_after_parent_reset(void) {
+    kheap_t *h = kheap_mk("parent", 64*1024);
+    kheap_t *sub = kheap_mk_in(h, "child", 4096);
+    void *p = kheap_alloc(sub, 32);
+    kheap_reset(h);
+    kfree(p);
+}
+static void out_of_space(void) {
+    kheap_t *h = kheap_mk("tiny", 4096);
+    kheap_alloc(h, 4096);
+}
+
+int main(void) {
+    kheap_init(16*1024*1024);
+
+    stress(1000000);
+    test_reset();
+    test_arena();
+
+    expect_panic("double free", double_free);
+    expect_panic("bogus free", bogus_free);
+    expect_panic("free after reset", free_after_reset);
+    expect_panic("free after parent reset", free_after_parent_reset);
+    expect_panic("out of space", out_of_space);
+
+    kheap_stats_print(kheap_root());
+    output("SUCCESS\n");
+    return 0;
+}